@@ -1,5 +1,43 @@
 -- premake5.lua
 sources = { "./src/**.h", "./src/**.cpp" }
+-- command line tools (one main() per file)
+tool_sources = { "./src/tools/**.cpp" }
+-- shader evaluation without the viewer
+shader_sources = { "./src/shader.h", "./src/shader.cpp",
+                   "./src/sampling.h", "./src/sampling.cpp",
+                   "./src/measured.h", "./src/measured.cpp",
+                   "./src/tabulated.h", "./src/tabulated.cpp",
+                   "./src/tiled.h", "./src/tiled.cpp",
+                   "./src/io/mapped_file.h", "./src/io/mapped_file.cpp",
+                   "./src/io/block_file.h", "./src/io/block_file.cpp",
+                   "./src/simd/**.h", "./src/simd/**.cpp" }
+
+-- the brdf library (shaders, lobe meshes and the C interface)
+library_sources = { shader_sources, "./src/mesh.h", "./src/mesh.cpp",
+                    "./src/vertex_cache.h", "./src/vertex_cache.cpp",
+                    "./src/bench/profiler.h", "./src/bench/profiler.cpp",
+                    "./src/bench/alloc_tracker.h",
+                    "./src/bench/alloc_tracker.cpp",
+                    "./src/bench/perf_counters.h",
+                    "./src/bench/perf_counters.cpp",
+                    "./src/api/brdf.h", "./src/api/brdf.cpp" }
+
+newoption {
+  trigger = "brdf-shared",
+  description = "Build the brdf library as a shared library"
+}
+
+-- SIMD kernels of the wider instruction sets, selected at run time
+-- (src/simd/cpu_dispatch.h)
+function simd_kernel_options()
+  filter { "action:gmake*", "files:src/simd/kernels_sse42.cpp" }
+    buildoptions { "-msse4.2" }
+  filter { "action:gmake*", "files:src/simd/kernels_avx2.cpp" }
+    buildoptions { "-mavx2", "-mfma" }
+  filter { "action:gmake*", "files:src/simd/kernels_avx512.cpp" }
+    buildoptions { "-mavx512f" }
+  filter {}
+end
 
 workspace "BRDFViewWorkspace"
   configurations { "debug", "release" }
@@ -9,25 +47,18 @@ workspace "BRDFViewWorkspace"
   includedirs { "/usr/local/include" }
   libdirs { "/usr/local/lib" }
 
+  -- GL is linked by the viewer only
   configuration { "macosx", "gmake" }
     buildoptions { '-std=c++11' }
-    links { "GLEW", "glfw3" }
-    linkoptions { '-framework OpenGL' }  -- gl
     links { "pthread" }
 
   configuration { "linux", "gmake" }
     buildoptions { '-std=c++11' }
-    links { "GLEW", "glfw", "GLU", "GL" }  -- gl
-
-    -- for CentOS
-    --links { "GLEW", "glfw3", "GLU", "GL" }  -- gl
-    --links { "X11", "Xrandr", "Xi", "Xxf86vm", "Xcursor", "Xinerama" }
-    links { "pthread" }
+    links { "pthread", "rt" }  -- rt: shm_open
 
   configuration { "windows", "gmake" }
     -- Assume MinGW
     buildoptions { '-std=c++11' }
-    links { "GLEW", "glfw3" }
 
 
   -- Configuration
@@ -43,3 +74,98 @@ workspace "BRDFViewWorkspace"
 project "viewer"
   kind "ConsoleApp"
   files { sources }
+  removefiles { tool_sources }
+  simd_kernel_options()
+
+  configuration { "macosx", "gmake" }
+    links { "GLEW", "glfw3" }
+    linkoptions { '-framework OpenGL' }  -- gl
+
+  configuration { "linux", "gmake" }
+    links { "GLEW", "glfw", "GLU", "GL" }  -- gl
+
+    -- for CentOS
+    --links { "GLEW", "glfw3", "GLU", "GL" }  -- gl
+    --links { "X11", "Xrandr", "Xi", "Xxf86vm", "Xcursor", "Xinerama" }
+
+  configuration { "windows", "gmake" }
+    links { "GLEW", "glfw3" }
+
+  configuration {}
+
+-- Headless shaders, lobe meshes and their C interface (src/api/brdf.h)
+-- for other renderers, without GL or the allocation hooks
+project "brdf"
+  files { library_sources }
+  simd_kernel_options()
+  if _OPTIONS["brdf-shared"] then
+    kind "SharedLib"
+    defines { "BRDF_SHARED", "BRDF_BUILDING" }
+    pic "On"
+    filter "action:gmake*"
+      buildoptions { "-fvisibility=hidden" }
+    filter {}
+  else
+    kind "StaticLib"
+  end
+
+-- Chi-square test of the shader importance sampling
+project "brdfcheck"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/tools/brdfcheck.cpp" }
+  simd_kernel_options()
+
+-- Directional albedo and white furnace test
+project "brdfalbedo"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/albedo.h", "./src/albedo.cpp",
+          "./src/tools/brdfalbedo.cpp" }
+  simd_kernel_options()
+
+-- MERL to compact tabulated BRDF conversion
+project "brdfconvert"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/tools/brdfconvert.cpp" }
+  simd_kernel_options()
+
+-- Out-of-core 4D tabulated BRDF baking
+project "brdftile"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/tools/brdftile.cpp" }
+  simd_kernel_options()
+
+-- Headless parameter sweep baking
+project "brdfbake"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/sweep.h", "./src/sweep.cpp",
+          "./src/result_store.h", "./src/result_store.cpp",
+          "./src/sweep_coordinator.h", "./src/sweep_coordinator.cpp",
+          "./src/io/message_channel.h", "./src/io/message_channel.cpp",
+          "./src/tools/brdfbake.cpp" }
+  simd_kernel_options()
+
+-- Shared memory shader evaluation server
+project "brdfserve"
+  kind "ConsoleApp"
+  files { shader_sources, "./src/eval_client.h", "./src/eval_client.cpp",
+          "./src/io/message_channel.h", "./src/io/message_channel.cpp",
+          "./src/io/shared_memory.h", "./src/io/shared_memory.cpp",
+          "./src/tools/brdfserve.cpp" }
+  simd_kernel_options()
+
+-- Latency and throughput of a brdfserve process
+project "brdfservebench"
+  kind "ConsoleApp"
+  files { "./src/eval_client.h", "./src/eval_client.cpp",
+          "./src/io/message_channel.h", "./src/io/message_channel.cpp",
+          "./src/io/shared_memory.h", "./src/io/shared_memory.cpp",
+          "./src/tools/brdfservebench.cpp" }
+
+-- Sweep lobes to PLY / OBJ meshes
+project "brdfexport"
+  kind "ConsoleApp"
+  files { library_sources, "./src/result_store.h", "./src/result_store.cpp",
+          "./src/mesh_export.h", "./src/mesh_export.cpp",
+          "./src/tools/brdfexport.cpp" }
+  removefiles { "./src/api/**" }
+  simd_kernel_options()
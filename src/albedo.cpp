@@ -0,0 +1,340 @@
+#include "albedo.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <typeinfo>
+
+#include "measured.h"
+#include "tiled.h"
+
+namespace {
+
+const int ALBEDO_BLOCK = 4096;  // directions per sampleBatch()
+
+// Tangent of the fiber shaders
+bool fiberTangent(const BaseShader& shader, glm::vec3& tangent) {
+    if (const KajiyaKayShader* kk =
+            dynamic_cast<const KajiyaKayShader*>(&shader)) {
+        tangent = kk->tangent;
+        return true;
+    }
+    if (const AFMarschnerShader* af =
+            dynamic_cast<const AFMarschnerShader*>(&shader)) {
+        tangent = af->tangent;
+        return true;
+    }
+    if (const TiledShader* tiled = dynamic_cast<const TiledShader*>(&shader)) {
+        tangent = tiled->tangent;
+        return tiled->sphere();
+    }
+    return false;
+}
+
+// === Sobol ===
+// Points of the first two Sobol dimensions as 32 bit fractions, in Gray
+// code order (the first 2^k points are the same set)
+struct Sobol2D {
+    Sobol2D() {
+        for (int k = 0; k < 32; k++) vx[k] = 1u << (31 - k);
+        vy[0] = 1u << 31;
+        for (int k = 1; k < 32; k++) vy[k] = vy[k - 1] ^ (vy[k - 1] >> 1);
+    }
+    // point of Gray code index i
+    void point(uint32_t i, uint32_t& x, uint32_t& y) const {
+        i ^= i >> 1;
+        x = 0;
+        y = 0;
+        for (int k = 0; i; k++, i >>= 1) {
+            if (i & 1) {
+                x ^= vx[k];
+                y ^= vy[k];
+            }
+        }
+    }
+    // from the point of i - 1 to the point of i (i > 0)
+    void next(uint32_t i, uint32_t& x, uint32_t& y) const {
+        int k = 0;
+        while (!((i >> k) & 1)) k++;
+        x ^= vx[k];
+        y ^= vy[k];
+    }
+    uint32_t vx[32], vy[32];
+};
+
+// === FNV-1a ===
+inline void hashBytes(uint64_t& h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+}
+
+template <class T>
+inline void hashValue(uint64_t& h, const T& v) {
+    hashBytes(h, &v, sizeof(T));
+}
+
+struct AlbedoWork {
+    const BaseShader* shader;
+    const AlbedoSettings* settings;
+    bool fiber;
+    glm::vec3 normal, tangent;
+    std::vector<double> estimates;  // [angle * n_replicas + replica]
+    std::atomic<long long> n_nan;
+    std::atomic<int> next;
+};
+
+void albedoWorker(AlbedoWork& work) {
+    const AlbedoSettings& settings = *work.settings;
+    const int n_replicas = settings.n_replicas;
+    const int n_items = settings.n_angles * n_replicas;
+    const int n_points = std::max(settings.n_directions / n_replicas, 1);
+    const float pi = glm::pi<float>();
+    const Sobol2D sobol;
+
+    BaseShader* shader = work.shader->clone();
+    std::vector<glm::vec3> dirs(ALBEDO_BLOCK);
+    std::vector<float> weights(ALBEDO_BLOCK), values(ALBEDO_BLOCK);
+    // frame: y normal, z tangent (fiber) or the light plane (surface)
+    const glm::vec3 n = work.normal;
+    const glm::vec3 t = work.tangent;
+    const glm::vec3 b = glm::cross(n, t);
+
+    for (int item = work.next++; item < n_items; item = work.next++) {
+        const int a = item / n_replicas;
+        const int r = item % n_replicas;
+        const float theta = (settings.n_angles > 1)
+            ? 0.5f * pi * a / (settings.n_angles - 1) : 0.f;
+        // light in the normal / tangent (or x) plane
+        const glm::vec3 light_dir = work.fiber
+            ? std::cos(theta) * n + std::sin(theta) * t
+            : std::cos(theta) * n + std::sin(theta) * b;
+        // rotation of the replica (same for every angle)
+        std::mt19937 rng(settings.seed * 7919u + r);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const uint32_t shift_x = (uint32_t)(uniform(rng) * 4294967296.0);
+        const uint32_t shift_y = (uint32_t)(uniform(rng) * 4294967296.0);
+
+        double sum = 0.0;
+        long long n_nan = 0;
+        for (int i0 = 0; i0 < n_points; i0 += ALBEDO_BLOCK) {
+            const int m = std::min(ALBEDO_BLOCK, n_points - i0);
+            uint32_t x, y;
+            sobol.point(i0, x, y);
+            for (int k = 0; k < m; k++) {
+                if (k > 0) sobol.next(i0 + k, x, y);
+                const float u1 = (x + shift_x) * 2.3283064e-10f;
+                const float u2 = (y + shift_y) * 2.3283064e-10f;
+                const float phi = 2.f * pi * u2;
+                if (work.fiber) {
+                    // uniform sphere, cos of the inclination
+                    const float z = 1.f - 2.f * u1;
+                    const float s = std::sqrt(std::max(1.f - z * z, 0.f));
+                    dirs[k] = s * std::cos(phi) * n + s * std::sin(phi) * b +
+                              z * t;
+                    weights[k] = s;
+                } else {
+                    // uniform hemisphere, cos to the normal
+                    const float z = u1;
+                    const float s = std::sqrt(std::max(1.f - z * z, 0.f));
+                    dirs[k] = s * std::cos(phi) * b + z * n +
+                              s * std::sin(phi) * t;
+                    weights[k] = z;
+                }
+            }
+            shader->sampleBatch(light_dir, &dirs[0], n, &values[0], m);
+            for (int k = 0; k < m; k++) {
+                if (values[k] != values[k]) {
+                    n_nan++;
+                    continue;
+                }
+                sum += (double)values[k] * weights[k];
+            }
+        }
+        // 1 / pdf of the directions
+        const double inv_pdf = work.fiber ? 4.0 * pi : 2.0 * pi;
+        work.estimates[item] = sum * inv_pdf / n_points;
+        work.n_nan += n_nan;
+    }
+    delete shader;
+}
+
+} // namespace
+
+uint64_t shaderHash(BaseShader& shader) {
+    uint64_t h = 14695981039346656037ull;
+    const char* type = typeid(shader).name();
+    hashBytes(h, type, strlen(type));
+    // retained, the viewer hashes the shader every frame
+    static thread_local std::vector<ShaderParam> params;
+    params.clear();
+    shader.getParams(params);
+    for (int i = 0; i < params.size(); i++) {
+        hashBytes(h, params[i].name, strlen(params[i].name));
+        hashValue(h, *params[i].value);
+    }
+    glm::vec3 tangent;
+    if (fiberTangent(shader, tangent)) hashValue(h, tangent);
+    if (const MeasuredShader* measured =
+            dynamic_cast<const MeasuredShader*>(&shader)) {
+        const std::string& path = measured->getPath();
+        hashBytes(h, path.data(), path.size());
+    }
+    if (const TiledShader* tiled = dynamic_cast<const TiledShader*>(&shader)) {
+        const std::string& path = tiled->getPath();
+        hashBytes(h, path.data(), path.size());
+        hashValue(h, tiled->tangent);
+    }
+    hashValue(h, shader.fast_math);
+    return h;
+}
+
+uint64_t albedoHash(BaseShader& shader, const AlbedoSettings& settings) {
+    uint64_t h = shaderHash(shader);
+    hashValue(h, settings.n_angles);
+    hashValue(h, settings.n_directions);
+    hashValue(h, settings.n_replicas);
+    hashValue(h, settings.seed);
+    return h;
+}
+
+void computeAlbedo(const BaseShader& shader, const AlbedoSettings& settings,
+                   AlbedoResult& result) {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    const int n_angles = std::max(settings.n_angles, 1);
+    const int n_replicas = std::max(settings.n_replicas, 2);
+    AlbedoSettings s = settings;
+    s.n_angles = n_angles;
+    s.n_replicas = n_replicas;
+
+    AlbedoWork work;
+    work.shader = &shader;
+    work.settings = &s;
+    work.normal = glm::vec3(0.f, 1.f, 0.f);
+    work.fiber = fiberTangent(shader, work.tangent);
+    if (work.fiber) {
+        // tangent in the normal plane
+        work.tangent -= glm::dot(work.tangent, work.normal) * work.normal;
+        work.tangent = glm::normalize(work.tangent);
+    } else {
+        work.tangent = glm::vec3(0.f, 0.f, 1.f);
+    }
+    work.estimates.assign(n_angles * n_replicas, 0.0);
+    work.n_nan = 0;
+    work.next = 0;
+
+    // angles and replicas on the workers
+    int n_threads = s.n_threads > 0
+        ? s.n_threads : (int)std::thread::hardware_concurrency();
+    n_threads = std::max(std::min(n_threads, n_angles * n_replicas), 1);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_threads; i++) {
+        threads.push_back(std::thread(albedoWorker, std::ref(work)));
+    }
+    albedoWorker(work);
+    for (int i = 0; i < threads.size(); i++) threads[i].join();
+
+    // statistics
+    result.fiber = work.fiber;
+    result.n_nan = work.n_nan;
+    result.angle_deg.resize(n_angles);
+    result.albedo.resize(n_angles);
+    result.error.resize(n_angles);
+    result.max_albedo = -HUGE_VALF;
+    result.conserving = true;
+    double w_sum = 0.0, furnace = 0.0, furnace_var = 0.0;
+    for (int a = 0; a < n_angles; a++) {
+        const double* e = &work.estimates[a * n_replicas];
+        double mean = 0.0, var = 0.0;
+        for (int r = 0; r < n_replicas; r++) mean += e[r];
+        mean /= n_replicas;
+        for (int r = 0; r < n_replicas; r++) {
+            var += (e[r] - mean) * (e[r] - mean);
+        }
+        const double error = std::sqrt(var / (n_replicas * (n_replicas - 1)));
+        const float deg = (n_angles > 1) ? 90.f * a / (n_angles - 1) : 0.f;
+        result.angle_deg[a] = deg;
+        result.albedo[a] = (float)mean;
+        result.error[a] = (float)error;
+        if (mean > result.max_albedo) {
+            result.max_albedo = (float)mean;
+            result.max_angle_deg = deg;
+        }
+        if (mean - 3.0 * error > 1.0) result.conserving = false;
+
+        // trapezoid rule over the incident directions
+        const double theta = glm::radians((double)deg);
+        double w = work.fiber ? std::cos(theta)
+                              : std::cos(theta) * std::sin(theta);
+        if (n_angles > 1 && (a == 0 || a == n_angles - 1)) w *= 0.5;
+        w_sum += w;
+        furnace += w * mean;
+        furnace_var += w * w * error * error;
+    }
+    result.furnace = (w_sum > 0.0) ? (float)(furnace / w_sum)
+                                   : result.albedo[0];
+    result.furnace_error = (w_sum > 0.0)
+        ? (float)(std::sqrt(furnace_var) / w_sum) : result.error[0];
+    result.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+// === AlbedoCache ===
+const AlbedoResult* AlbedoCache::find(BaseShader& shader,
+                                      const AlbedoSettings& settings) const {
+    std::map<uint64_t, AlbedoResult>::const_iterator it =
+        this->results.find(albedoHash(shader, settings));
+    return (it != this->results.end()) ? &it->second : NULL;
+}
+
+const AlbedoResult& AlbedoCache::get(BaseShader& shader,
+                                     const AlbedoSettings& settings) {
+    const uint64_t h = albedoHash(shader, settings);
+    std::map<uint64_t, AlbedoResult>::iterator it = this->results.find(h);
+    if (it == this->results.end()) {
+        it = this->results.insert(std::make_pair(h, AlbedoResult())).first;
+        computeAlbedo(shader, settings, it->second);
+    }
+    return it->second;
+}
+
+void AlbedoCache::insert(uint64_t hash, const AlbedoResult& result) {
+    this->results[hash] = result;
+}
+
+
+// === AlbedoJob ===
+AlbedoJob::~AlbedoJob() {
+    if (this->thread.joinable()) this->thread.join();
+}
+
+bool AlbedoJob::start(BaseShader& shader, const AlbedoSettings& settings) {
+    if (this->running) return false;
+    if (this->thread.joinable()) this->thread.join();
+    this->shader.reset(shader.clone());
+    this->settings = settings;
+    this->hash = albedoHash(shader, settings);
+    this->running = true;
+    this->thread = std::thread(&AlbedoJob::run, this);
+    return true;
+}
+
+bool AlbedoJob::finished(AlbedoCache& cache) {
+    if (this->running || !this->thread.joinable()) return false;
+    this->thread.join();
+    cache.insert(this->hash, this->result);
+    this->shader.reset();
+    this->result = AlbedoResult();
+    return true;
+}
+
+void AlbedoJob::run() {
+    computeAlbedo(*this->shader, this->settings, this->result);
+    this->running = false;
+}
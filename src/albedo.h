@@ -0,0 +1,103 @@
+#ifndef ALBEDO_H_261018
+#define ALBEDO_H_261018
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "shader.h"
+
+// Directional albedo of a shader versus the incident angle, by randomized
+// quasi-Monte Carlo: every angle integrates `n_replicas` random rotations
+// (Cranley-Patterson) of a 2D Sobol set of directions, evaluated with
+// sampleBatch() on worker threads. The spread of the replicas gives the
+// error estimate.
+//
+// Surface shaders (Specular) integrate f cos(theta_o) over the hemisphere
+// of the normal with the light in the normal / x plane. Fiber shaders
+// (with a tangent) integrate f cos(theta_o) over the sphere, theta being
+// the inclination from the normal plane of the fiber, with the light in
+// the normal / tangent plane.
+struct AlbedoSettings {
+    AlbedoSettings() : n_angles(19), n_directions(1 << 20), n_replicas(8),
+                       n_threads(0), seed(1) {}
+    int n_angles;      // incident angles over [0, 90] degrees
+    int n_directions;  // per angle (over all the replicas)
+    int n_replicas;
+    int n_threads;     // 0: hardware concurrency
+    unsigned seed;
+};
+
+struct AlbedoResult {
+    AlbedoResult() : fiber(false), n_nan(0), furnace(0.f),
+                     furnace_error(0.f), max_albedo(0.f), max_angle_deg(0.f),
+                     conserving(false), seconds(0.0) {}
+    bool fiber;
+    std::vector<float> angle_deg;
+    std::vector<float> albedo;  // mean of the replicas
+    std::vector<float> error;   // standard error of the mean
+    long long n_nan;            // NaN samples (counted as zero)
+    // white furnace: albedo averaged over the incident directions
+    // (uniform illumination), assuming azimuthal symmetry
+    float furnace;
+    float furnace_error;
+    float max_albedo;
+    float max_angle_deg;
+    bool conserving;  // max albedo <= 1 within 3 standard errors
+    double seconds;
+};
+
+// Hash of the shader type, parameters, tangent, table file and math tier
+// (no allocation once a thread has hashed a shader of as many parameters)
+uint64_t shaderHash(BaseShader& shader);
+// shaderHash() and the settings
+uint64_t albedoHash(BaseShader& shader, const AlbedoSettings& settings);
+void computeAlbedo(const BaseShader& shader, const AlbedoSettings& settings,
+                   AlbedoResult& result);
+
+// Results by albedoHash()
+class AlbedoCache {
+public:
+    // NULL when not computed yet
+    const AlbedoResult* find(BaseShader& shader,
+                             const AlbedoSettings& settings) const;
+    const AlbedoResult& get(BaseShader& shader,
+                            const AlbedoSettings& settings);
+    // Result computed elsewhere (AlbedoJob), by albedoHash()
+    void insert(uint64_t hash, const AlbedoResult& result);
+    void clear() { this->results.clear(); }
+
+private:
+    std::map<uint64_t, AlbedoResult> results;
+};
+
+// Integrates a copy of a shader on a background thread, so the UI keeps
+// drawing frames meanwhile
+class AlbedoJob {
+public:
+    AlbedoJob() : hash(0), running(false) {}
+    ~AlbedoJob();
+    // false while the previous integration runs
+    bool start(BaseShader& shader, const AlbedoSettings& settings);
+    bool busy() const { return running; }
+    // Hands the result to the cache once finished (false while busy)
+    bool finished(AlbedoCache& cache);
+
+private:
+    AlbedoJob(const AlbedoJob&);
+    AlbedoJob& operator=(const AlbedoJob&);
+
+    void run();
+
+    std::unique_ptr<BaseShader> shader;
+    AlbedoSettings settings;
+    uint64_t hash;  // albedoHash() at start()
+    AlbedoResult result;
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+#endif
@@ -0,0 +1,345 @@
+#include "brdf.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../measured.h"
+#include "../mesh.h"
+#include "../shader.h"
+#include "../tiled.h"
+
+struct brdf_shader {
+    BaseShader* shader;
+    std::vector<ShaderParam> params;  // into shader
+    Mesh mesh;  // scratch of brdf_lobe_mesh()
+};
+
+namespace {
+
+brdf_shader* wrapShader(BaseShader* shader) {
+    brdf_shader* handle = new brdf_shader();
+    handle->shader = shader;
+    shader->getParams(handle->params);
+    return handle;
+}
+
+inline glm::vec3 toVec3(const float v[3]) {
+    return glm::vec3(v[0], v[1], v[2]);
+}
+
+// glm::vec3 is three packed floats
+inline const glm::vec3* asVec3(const float* v) {
+    return reinterpret_cast<const glm::vec3*>(v);
+}
+
+void copyError(const std::string& message, char* error, size_t error_size) {
+    if (!error || error_size == 0) return;
+    const size_t len = std::min(message.size(), error_size - 1);
+    memcpy(error, message.data(), len);
+    error[len] = '\0';
+}
+
+} // namespace
+
+
+extern "C" {
+
+uint32_t brdf_api_version(void) {
+    return BRDF_API_VERSION;
+}
+
+const char* brdf_status_string(brdf_status status) {
+    switch (status) {
+        case BRDF_OK: return "ok";
+        case BRDF_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case BRDF_ERROR_UNKNOWN_SHADER: return "unknown shader";
+        case BRDF_ERROR_UNKNOWN_PARAM: return "unknown parameter";
+        case BRDF_ERROR_LOAD: return "failed to load";
+        case BRDF_ERROR_UNSUPPORTED: return "not supported by the shader";
+        case BRDF_ERROR_OUT_OF_MEMORY: return "out of memory";
+    }
+    return "unknown status";
+}
+
+// === Shaders ===
+
+brdf_status brdf_shader_create(const char* name, brdf_shader** shader) {
+    if (!name || !shader) return BRDF_ERROR_INVALID_ARGUMENT;
+    // no exception may leave the C interface
+    try {
+        const std::string s = name;
+        if (s == "specular") {
+            *shader = wrapShader(new SpecularShader());
+        } else if (s == "kajiyakay") {
+            *shader = wrapShader(new KajiyaKayShader());
+        } else if (s == "marschner") {
+            *shader = wrapShader(new AFMarschnerShader());
+        } else {
+            return BRDF_ERROR_UNKNOWN_SHADER;
+        }
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+brdf_status brdf_shader_load(const char* kind, const char* path,
+                             size_t cache_bytes, brdf_shader** shader,
+                             char* error, size_t error_size) {
+    if (!kind || !path || !shader) return BRDF_ERROR_INVALID_ARGUMENT;
+    try {
+        const std::string s = kind;
+        if (s == "measured") {
+            MeasuredShader* measured = new MeasuredShader();
+            if (!measured->load(path)) {
+                copyError(measured->getError(), error, error_size);
+                delete measured;
+                return BRDF_ERROR_LOAD;
+            }
+            *shader = wrapShader(measured);
+        } else if (s == "tiled") {
+            TiledShader* tiled = new TiledShader();
+            if (!tiled->load(path, cache_bytes)) {
+                copyError(tiled->getError(), error, error_size);
+                delete tiled;
+                return BRDF_ERROR_LOAD;
+            }
+            *shader = wrapShader(tiled);
+        } else {
+            return BRDF_ERROR_UNKNOWN_SHADER;
+        }
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+brdf_status brdf_shader_clone(const brdf_shader* shader,
+                              brdf_shader** clone) {
+    if (!shader || !clone) return BRDF_ERROR_INVALID_ARGUMENT;
+    try {
+        *clone = wrapShader(shader->shader->clone());
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+void brdf_shader_destroy(brdf_shader* shader) {
+    if (!shader) return;
+    delete shader->shader;
+    delete shader;
+}
+
+int brdf_shader_num_params(const brdf_shader* shader) {
+    return shader ? (int)shader->params.size() : 0;
+}
+
+const char* brdf_shader_param_name(const brdf_shader* shader, int index) {
+    if (!shader || index < 0 || index >= (int)shader->params.size()) {
+        return NULL;
+    }
+    return shader->params[index].name;
+}
+
+brdf_status brdf_shader_set_param(brdf_shader* shader, const char* name,
+                                  float value) {
+    if (!shader || !name) return BRDF_ERROR_INVALID_ARGUMENT;
+    for (int i = 0; i < shader->params.size(); i++) {
+        if (strcmp(shader->params[i].name, name) == 0) {
+            *shader->params[i].value = value;
+            return BRDF_OK;
+        }
+    }
+    return BRDF_ERROR_UNKNOWN_PARAM;
+}
+
+brdf_status brdf_shader_get_param(const brdf_shader* shader,
+                                  const char* name, float* value) {
+    if (!shader || !name || !value) return BRDF_ERROR_INVALID_ARGUMENT;
+    for (int i = 0; i < shader->params.size(); i++) {
+        if (strcmp(shader->params[i].name, name) == 0) {
+            *value = *shader->params[i].value;
+            return BRDF_OK;
+        }
+    }
+    return BRDF_ERROR_UNKNOWN_PARAM;
+}
+
+brdf_status brdf_shader_set_tangent(brdf_shader* shader,
+                                    const float tangent[3]) {
+    if (!shader || !tangent) return BRDF_ERROR_INVALID_ARGUMENT;
+    // a zero (or NaN) vector would normalize to NaN
+    const float length = glm::length(toVec3(tangent));
+    if (!(length > 0.f) || std::isinf(length)) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    const glm::vec3 t = toVec3(tangent) / length;
+    if (AFMarschnerShader* marschner =
+            dynamic_cast<AFMarschnerShader*>(shader->shader)) {
+        marschner->tangent = t;
+    } else if (TiledShader* tiled =
+                   dynamic_cast<TiledShader*>(shader->shader)) {
+        tiled->tangent = t;
+    } else {
+        return BRDF_ERROR_UNSUPPORTED;
+    }
+    return BRDF_OK;
+}
+
+void brdf_shader_set_fast_math(brdf_shader* shader, int enabled) {
+    if (shader) shader->shader->fast_math = enabled != 0;
+}
+
+// === Batch evaluation ===
+
+brdf_status brdf_eval_batch(brdf_shader* shader, const float light[3],
+                            const float normal[3], const float* dirs,
+                            size_t n, float* out) {
+    if (!shader || !light || !normal || (n > 0 && (!dirs || !out)) ||
+        n > (size_t)INT_MAX) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    if (n == 0) return BRDF_OK;
+    // the shaders grow their scratch buffers
+    try {
+        shader->shader->sampleBatch(toVec3(light), asVec3(dirs),
+                                    toVec3(normal), out, (int)n);
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+brdf_status brdf_eval_color_batch(brdf_shader* shader, const float light[3],
+                                  const float normal[3], const float* dirs,
+                                  size_t n, const float* lambdas,
+                                  int n_channels, float* out) {
+    if (!shader || !light || !normal || (n > 0 && (!dirs || !out)) ||
+        n > (size_t)INT_MAX) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    ColorChannels channels;
+    if (lambdas) {
+        if (n_channels < 1 || n_channels > MAX_COLOR_CHANNELS) {
+            return BRDF_ERROR_INVALID_ARGUMENT;
+        }
+        channels.mode = COLOR_SPECTRAL;
+        channels.n = n_channels;
+        for (int c = 0; c < n_channels; c++) channels.lambda[c] = lambdas[c];
+    } else if (n_channels != 3) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    if (n == 0) return BRDF_OK;
+    try {
+        shader->shader->sampleColorBatch(toVec3(light), asVec3(dirs),
+                                         toVec3(normal), channels, out,
+                                         (int)n);
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+brdf_status brdf_sample_batch(brdf_shader* shader, const float light[3],
+                              const float normal[3], const float* u,
+                              size_t n, float* dirs, float* pdfs) {
+    if (!shader || !light || !normal || (n > 0 && (!u || !dirs || !pdfs))) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    const glm::vec3 l = toVec3(light), nrm = toVec3(normal);
+    try {
+        for (size_t i = 0; i < n; i++) {
+            glm::vec3 dir(0.f);
+            float pdf = 0.f;
+            if (!shader->shader->sampleDirection(l, nrm, u[2 * i],
+                                                 u[2 * i + 1], dir, pdf)) {
+                dir = glm::vec3(0.f);
+                pdf = 0.f;
+            }
+            dirs[3 * i + 0] = dir.x;
+            dirs[3 * i + 1] = dir.y;
+            dirs[3 * i + 2] = dir.z;
+            pdfs[i] = pdf;
+        }
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+brdf_status brdf_pdf_batch(brdf_shader* shader, const float light[3],
+                           const float normal[3], const float* dirs,
+                           size_t n, float* pdfs) {
+    if (!shader || !light || !normal || (n > 0 && (!dirs || !pdfs))) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    const glm::vec3 l = toVec3(light), nrm = toVec3(normal);
+    const glm::vec3* d = asVec3(dirs);
+    try {
+        for (size_t i = 0; i < n; i++) {
+            pdfs[i] = shader->shader->pdf(l, d[i], nrm);
+        }
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    return BRDF_OK;
+}
+
+// === Lobe meshes ===
+
+brdf_status brdf_lobe_mesh_size(int n_phi, size_t* n_vertices,
+                                size_t* n_triangles) {
+    if (n_phi < 3 || !n_vertices || !n_triangles) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    // as createBRDFMesh()
+    const size_t n_theta = std::max(n_phi / 2, 1);
+    *n_vertices = n_phi * n_theta + 2;
+    *n_triangles = 2 * n_phi * n_theta;
+    return BRDF_OK;
+}
+
+brdf_status brdf_lobe_mesh(brdf_shader* shader, const float light[3],
+                           const float up[3], float scale, int n_phi,
+                           float* positions, float* normals, float* values,
+                           float* colors, uint32_t* indices) {
+    if (!shader || !light || !up || !positions || n_phi < 3) {
+        return BRDF_ERROR_INVALID_ARGUMENT;
+    }
+    Mesh& mesh = shader->mesh;
+    try {
+        if (colors) {
+            createBRDFColorMesh(mesh, *shader->shader, toVec3(light), scale,
+                                n_phi, ColorChannels(), toVec3(up));
+        } else {
+            createBRDFMesh(mesh, *shader->shader, toVec3(light), scale,
+                           n_phi, toVec3(up));
+        }
+    } catch (const std::bad_alloc&) {
+        return BRDF_ERROR_OUT_OF_MEMORY;
+    }
+    const size_t n_vertices = mesh.vertices.size();
+    memcpy(positions, &mesh.vertices[0], n_vertices * 3 * sizeof(float));
+    if (normals) {
+        memcpy(normals, &mesh.normals[0], n_vertices * 3 * sizeof(float));
+    }
+    if (values) {
+        memcpy(values, &mesh.intensities[0], n_vertices * sizeof(float));
+    }
+    if (colors) {
+        memcpy(colors, &mesh.colors[0], n_vertices * 3 * sizeof(float));
+    }
+    if (indices) {
+        memcpy(indices, &mesh.indices[0],
+               mesh.indices.size() * 3 * sizeof(uint32_t));
+    }
+    return BRDF_OK;
+}
+
+} // extern "C"
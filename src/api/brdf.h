@@ -0,0 +1,138 @@
+#ifndef BRDF_API_H_261018
+#define BRDF_API_H_261018
+
+/*
+ * C interface of the brdf library: the shaders, their batch evaluation and
+ * importance sampling, and the lobe meshes of the viewer, without any GL.
+ *
+ * All outputs go to buffers of the caller and nothing allocated by the
+ * library is handed out, except the opaque shader handles. A handle is
+ * used by one thread at a time; other threads take a brdf_shader_clone()
+ * (clones of measured and tiled shaders share the mapped data). Handles
+ * keep their scratch buffers, so repeated calls of the same size do not
+ * allocate.
+ *
+ * Directions are unit float[3] (x, y, z) as in the viewer, y up.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(BRDF_SHARED) && defined(_WIN32)
+#  ifdef BRDF_BUILDING
+#    define BRDF_API __declspec(dllexport)
+#  else
+#    define BRDF_API __declspec(dllimport)
+#  endif
+#elif defined(BRDF_SHARED)
+#  define BRDF_API __attribute__((visibility("default")))
+#else
+#  define BRDF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Incremented when a function changes; new functions keep the version */
+#define BRDF_API_VERSION 1
+
+typedef enum brdf_status {
+    BRDF_OK = 0,
+    BRDF_ERROR_INVALID_ARGUMENT,
+    BRDF_ERROR_UNKNOWN_SHADER,
+    BRDF_ERROR_UNKNOWN_PARAM,
+    BRDF_ERROR_LOAD,
+    BRDF_ERROR_UNSUPPORTED,
+    BRDF_ERROR_OUT_OF_MEMORY
+} brdf_status;
+
+typedef struct brdf_shader brdf_shader;
+
+BRDF_API uint32_t brdf_api_version(void);
+BRDF_API const char* brdf_status_string(brdf_status status);
+
+/* === Shaders === */
+
+/* "specular", "kajiyakay" or "marschner" */
+BRDF_API brdf_status brdf_shader_create(const char* name,
+                                        brdf_shader** shader);
+/* "measured" (MERL or compact tabulated file) or "tiled" (4D table with a
+ * tile cache of cache_bytes). The message of BRDF_ERROR_LOAD goes to
+ * error (error_size bytes, may be NULL). */
+BRDF_API brdf_status brdf_shader_load(const char* kind, const char* path,
+                                      size_t cache_bytes,
+                                      brdf_shader** shader, char* error,
+                                      size_t error_size);
+BRDF_API brdf_status brdf_shader_clone(const brdf_shader* shader,
+                                       brdf_shader** clone);
+BRDF_API void brdf_shader_destroy(brdf_shader* shader);
+
+/* Named scalar parameters. Names stay valid as long as the shader. */
+BRDF_API int brdf_shader_num_params(const brdf_shader* shader);
+BRDF_API const char* brdf_shader_param_name(const brdf_shader* shader,
+                                            int index);
+BRDF_API brdf_status brdf_shader_set_param(brdf_shader* shader,
+                                           const char* name, float value);
+BRDF_API brdf_status brdf_shader_get_param(const brdf_shader* shader,
+                                           const char* name, float* value);
+/* Fiber direction of the hair shaders (marschner, tiled), normalized;
+   BRDF_ERROR_INVALID_ARGUMENT for a zero or non-finite vector */
+BRDF_API brdf_status brdf_shader_set_tangent(brdf_shader* shader,
+                                             const float tangent[3]);
+/* Fast tier of the SIMD math (approximate exp/log/trig) */
+BRDF_API void brdf_shader_set_fast_math(brdf_shader* shader, int enabled);
+
+/* === Batch evaluation === */
+
+/* out[i] for the n directions dirs[3 i .. 3 i + 2] */
+BRDF_API brdf_status brdf_eval_batch(brdf_shader* shader,
+                                     const float light[3],
+                                     const float normal[3],
+                                     const float* dirs, size_t n,
+                                     float* out);
+/* out[i * n_channels + c]: RGB when lambdas is NULL (n_channels 3), else
+ * spectral samples at the lambdas in nm (at most 16 channels) */
+BRDF_API brdf_status brdf_eval_color_batch(brdf_shader* shader,
+                                           const float light[3],
+                                           const float normal[3],
+                                           const float* dirs, size_t n,
+                                           const float* lambdas,
+                                           int n_channels, float* out);
+/* Importance sampling of n directions from u (n x 2 in [0, 1)): dirs
+ * (n x 3) and their solid angle densities (pdfs, 0 when none could be
+ * sampled) */
+BRDF_API brdf_status brdf_sample_batch(brdf_shader* shader,
+                                       const float light[3],
+                                       const float normal[3],
+                                       const float* u, size_t n,
+                                       float* dirs, float* pdfs);
+/* Densities of the importance sampling of n directions */
+BRDF_API brdf_status brdf_pdf_batch(brdf_shader* shader,
+                                    const float light[3],
+                                    const float normal[3],
+                                    const float* dirs, size_t n,
+                                    float* pdfs);
+
+/* === Lobe meshes === */
+
+/* Sizes of the lobe sphere of n_phi azimuth steps (n_phi >= 3) */
+BRDF_API brdf_status brdf_lobe_mesh_size(int n_phi, size_t* n_vertices,
+                                         size_t* n_triangles);
+/* The lobe sphere of the viewer: every grid direction around up scaled by
+ * its value. positions and normals are n_vertices x 3, values n_vertices
+ * and indices n_triangles x 3 (counter-clockwise); all but positions may
+ * be NULL. With colors (n_vertices x 3, may be NULL) the radius is the
+ * mean of the RGB evaluation and the colors its hue. */
+BRDF_API brdf_status brdf_lobe_mesh(brdf_shader* shader,
+                                    const float light[3],
+                                    const float up[3], float scale,
+                                    int n_phi, float* positions,
+                                    float* normals, float* values,
+                                    float* colors, uint32_t* indices);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+// Replaces the global operator new/delete to count heap allocations.
+// Link this file into executables which report allocations.
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracker.h"
+
+namespace {
+
+struct AllocHooksInit {
+    AllocHooksInit() { setAllocTrackingEnabled(true); }
+} g_alloc_hooks_init;
+
+inline void* countedAlloc(std::size_t size) {
+    recordAlloc(size);
+    void* ptr = malloc(size ? size : 1);
+    return ptr;
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    void* ptr = countedAlloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    void* ptr = countedAlloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw() {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw() {
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) throw() { free(ptr); }
+void operator delete[](void* ptr) throw() { free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) throw() { free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) throw() { free(ptr); }
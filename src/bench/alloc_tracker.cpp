@@ -0,0 +1,38 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+
+namespace {
+
+// plain thread locals: no constructors run inside operator new
+thread_local bool g_thread_tracked = false;
+thread_local long g_alloc_count = 0;
+thread_local long g_alloc_bytes = 0;
+std::atomic<bool> g_alloc_enabled(false);
+
+} // namespace
+
+AllocStats getAllocStats() {
+    AllocStats stats;
+    stats.count = g_alloc_count;
+    stats.bytes = g_alloc_bytes;
+    return stats;
+}
+
+bool allocTrackingEnabled() {
+    return g_alloc_enabled.load(std::memory_order_relaxed);
+}
+
+void setThreadAllocTracking(bool enabled) {
+    g_thread_tracked = enabled;
+}
+
+void recordAlloc(unsigned long size) {
+    if (!g_thread_tracked) return;
+    g_alloc_count++;
+    g_alloc_bytes += (long)size;
+}
+
+void setAllocTrackingEnabled(bool enabled) {
+    g_alloc_enabled.store(enabled, std::memory_order_relaxed);
+}
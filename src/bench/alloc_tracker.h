@@ -0,0 +1,24 @@
+#ifndef ALLOC_TRACKER_H_261018
+#define ALLOC_TRACKER_H_261018
+
+// Heap allocation counters of the profiled thread.
+// The counters are only fed when the operator new hooks in alloc_hooks.cpp
+// are linked into the executable; otherwise they stay zero. Only threads
+// which called setThreadAllocTracking(true) are counted, so background
+// workers are not charged to the stages of the render thread.
+struct AllocStats {
+    AllocStats() : count(0), bytes(0) {}
+    long count;  // number of allocations
+    long bytes;  // requested bytes
+};
+
+// Counters of the calling thread
+AllocStats getAllocStats();
+bool allocTrackingEnabled();
+void setThreadAllocTracking(bool enabled);
+
+// Called by the hooks
+void recordAlloc(unsigned long size);
+void setAllocTrackingEnabled(bool enabled);
+
+#endif
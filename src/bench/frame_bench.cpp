@@ -0,0 +1,227 @@
+#include "frame_bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// name=value or a +flag of a script line
+bool parseBenchToken(const std::string& token, BenchState& state) {
+    if (token == "+grid") {
+        state.grid_view = true;
+        return true;
+    }
+    if (token == "+light-cache") {
+        state.light_cache = true;
+        return true;
+    }
+    size_t eq = token.find('=');
+    if (eq == std::string::npos) return false;
+    float value = (float)atof(token.substr(eq + 1).c_str());
+    state.params.push_back(std::make_pair(token.substr(0, eq), value));
+    return true;
+}
+
+} // namespace
+
+bool loadBenchScript(const std::string& filename,
+                     std::vector<BenchState>& states) {
+    std::ifstream ifs(filename.c_str());
+    if (!ifs.is_open()) {
+        std::cerr << "Failed to open bench script: " << filename << std::endl;
+        return false;
+    }
+    states.clear();
+    std::string line;
+    int line_no = 0;
+    while (std::getline(ifs, line)) {
+        line_no++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        BenchState state;
+        if (!(iss >> state.label)) continue;  // empty line
+        if (!(iss >> state.shader_idx >> state.light_deg[0]
+                  >> state.light_deg[1])) {
+            std::cerr << filename << ":" << line_no << ": invalid state"
+                      << std::endl;
+            return false;
+        }
+        std::string token;
+        while (iss >> token) {
+            if (!parseBenchToken(token, state)) {
+                std::cerr << filename << ":" << line_no
+                          << ": expected name=value or a +flag, got "
+                          << token << std::endl;
+                return false;
+            }
+        }
+        states.push_back(state);
+    }
+    return !states.empty();
+}
+
+void defaultBenchScript(std::vector<BenchState>& states) {
+    const char* script[] = {
+        "specular       0  45   0  spec_factor=5",
+        "specular_sharp 0  30  90  spec_factor=80",
+        "kajiyakay      1  45   0  spec_factor=25 kd=0.3 ks=0.3",
+        "kajiyakay_back 1 135  45  spec_factor=50 kd=0.1 ks=0.8",
+        "marschner      2  45   0  intensityR=5 intensityTT=0.5 "
+                                  "intensityTRT=0.5",
+        "marschner_eta  2  80 -60  eta=1.3 sigma_a=0.5",
+        "marschner_grid 2  45   0  +grid",
+        "marschner_drag 2  50  10  +light-cache",
+    };
+    states.clear();
+    for (int i = 0; i < sizeof(script) / sizeof(script[0]); i++) {
+        std::istringstream iss(script[i]);
+        BenchState state;
+        iss >> state.label >> state.shader_idx >> state.light_deg[0]
+            >> state.light_deg[1];
+        std::string token;
+        while (iss >> token) parseBenchToken(token, state);
+        states.push_back(state);
+    }
+}
+
+
+// === Frame benchmark ===
+FrameBench::FrameBench(const std::vector<BenchState>& states, int n_frames,
+                       int n_warmup)
+    : states(states), results(states.size()), n_frames(n_frames),
+      n_warmup(n_warmup), state_idx(0), frame_idx(0) {
+    // no reallocation while measuring
+    for (int i = 0; i < this->results.size(); i++) {
+        this->results[i].frame_sec.reserve(n_frames);
+        this->results[i].frame_allocs.reserve(n_frames);
+        this->results[i].frame_alloc_bytes.reserve(n_frames);
+    }
+}
+
+void FrameBench::beginFrame() {
+    // warmup frames register the stages without recording them
+    Profiler::setActive(&this->profiler);
+    setThreadAllocTracking(true);
+    this->profiler.setRecording(this->measuring());
+    this->profiler.beginFrame();
+    this->frame_start = Profiler::Clock::now();
+}
+
+void FrameBench::endFrame() {
+    std::chrono::duration<double> d = Profiler::Clock::now() -
+                                      this->frame_start;
+    this->profiler.endFrame();
+    if (this->measuring()) {
+        StateResult& result = this->results[this->state_idx];
+        const AllocStats& allocs = this->profiler.getLastFrameAllocs();
+        result.frame_sec.push_back(d.count());
+        result.frame_allocs.push_back(allocs.count);
+        result.frame_alloc_bytes.push_back(allocs.bytes);
+    }
+    Profiler::setActive(NULL);
+    setThreadAllocTracking(false);
+
+    // next frame
+    this->frame_idx++;
+    if (this->frame_idx >= this->n_warmup + this->n_frames) {
+        this->frame_idx = 0;
+        this->state_idx++;
+    }
+}
+
+namespace {
+
+// Nearest-rank percentile of sorted samples
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    int idx = (int)std::ceil(p / 100.0 * sorted.size()) - 1;
+    idx = std::min(std::max(idx, 0), (int)sorted.size() - 1);
+    return sorted[idx];
+}
+
+void printRow(std::ostream& os, const std::string& label,
+              std::vector<double> frame_sec) {
+    std::sort(frame_sec.begin(), frame_sec.end());
+    double sum = 0.0;
+    for (int i = 0; i < frame_sec.size(); i++) sum += frame_sec[i];
+    const double mean = frame_sec.empty() ? 0.0 : sum / frame_sec.size();
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "  %-16s %6d %9.3f %9.3f %9.3f %9.3f %9.3f %9.1f\n",
+             label.c_str(), (int)frame_sec.size(), mean * 1e3,
+             percentile(frame_sec, 50) * 1e3, percentile(frame_sec, 90) * 1e3,
+             percentile(frame_sec, 99) * 1e3,
+             (frame_sec.empty() ? 0.0 : frame_sec.back()) * 1e3,
+             mean > 0.0 ? 1.0 / mean : 0.0);
+    os << buf;
+}
+
+} // namespace
+
+void FrameBench::report(std::ostream& os) {
+    char buf[256];
+    os << "* Frame times [ms]" << std::endl;
+    snprintf(buf, sizeof(buf), "  %-16s %6s %9s %9s %9s %9s %9s %9s\n",
+             "state", "frames", "mean", "p50", "p90", "p99", "max", "fps");
+    os << buf;
+    std::vector<double> all_sec;
+    for (int i = 0; i < this->states.size(); i++) {
+        const std::vector<double>& frame_sec = this->results[i].frame_sec;
+        printRow(os, this->states[i].label, frame_sec);
+        all_sec.insert(all_sec.end(), frame_sec.begin(), frame_sec.end());
+    }
+    printRow(os, "(all)", all_sec);
+
+    os << "* Stage breakdown (all states)" << std::endl;
+    this->profiler.report(os);
+
+    os << "* Peak RSS: " << getPeakRSSKB() << " KB" << std::endl;
+}
+
+bool FrameBench::checkZeroAlloc(std::ostream& os) {
+    if (!allocTrackingEnabled()) {
+        os << "* Allocation check skipped: allocation hooks not linked"
+           << std::endl;
+        return true;
+    }
+    bool ok = true;
+    for (int i = 0; i < this->states.size(); i++) {
+        const StateResult& result = this->results[i];
+        long max_allocs = 0, max_bytes = 0;
+        for (int j = 0; j < result.frame_allocs.size(); j++) {
+            max_allocs = std::max(max_allocs, result.frame_allocs[j]);
+            max_bytes = std::max(max_bytes, result.frame_alloc_bytes[j]);
+        }
+        if (max_allocs > 0) {
+            os << "* Steady-state frames of '" << this->states[i].label
+               << "' allocate (max " << max_allocs << " allocations, "
+               << max_bytes << " bytes per frame)" << std::endl;
+            ok = false;
+        }
+    }
+    if (ok) os << "* Allocation check passed: 0 allocations per steady-state "
+                  "frame" << std::endl;
+    return ok;
+}
+
+long getPeakRSSKB() {
+#if defined(__linux__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;  // bytes
+#else
+    return usage.ru_maxrss;  // kilobytes
+#endif
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,70 @@
+#ifndef FRAME_BENCH_H_261018
+#define FRAME_BENCH_H_261018
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "profiler.h"
+
+// One scripted viewer state of the frame benchmark.
+struct BenchState {
+    BenchState() : shader_idx(0), grid_view(false), light_cache(false) {
+        light_deg[0] = 45.f;
+        light_deg[1] = 0.f;
+    }
+    std::string label;
+    int shader_idx;
+    float light_deg[2];
+    std::vector<std::pair<std::string, float> > params;  // name, value
+    bool grid_view;  // +grid: small multiples
+    bool light_cache;  // +light-cache: lobe interpolated, light dragged
+};
+
+// Script format (one state per line, '#' starts a comment):
+//   <label> <shader_idx> <light_theta_deg> <light_phi_deg> [name=value ...]
+//   [+grid] [+light-cache]
+bool loadBenchScript(const std::string& filename,
+                     std::vector<BenchState>& states);
+void defaultBenchScript(std::vector<BenchState>& states);
+
+// Whole-frame benchmark driver.
+// Runs every state for `n_warmup + n_frames` frames and records the frame
+// times and per-stage breakdown of the measured frames.
+class FrameBench {
+public:
+    FrameBench(const std::vector<BenchState>& states, int n_frames,
+               int n_warmup=5);
+
+    bool finished() const { return state_idx >= states.size(); }
+    const BenchState& currentState() const { return states[state_idx]; }
+    bool stateChanged() const { return frame_idx == 0; }
+    bool measuring() const { return frame_idx >= n_warmup; }
+
+    void beginFrame();
+    void endFrame();
+    void report(std::ostream& os);
+    // Steady-state check: no measured frame may allocate from the heap.
+    // Requires the allocation hooks (alloc_hooks.cpp).
+    bool checkZeroAlloc(std::ostream& os);
+
+    Profiler& getProfiler() { return profiler; }
+
+private:
+    struct StateResult {
+        std::vector<double> frame_sec;
+        std::vector<long> frame_allocs;
+        std::vector<long> frame_alloc_bytes;
+    };
+    std::vector<BenchState> states;
+    std::vector<StateResult> results;
+    int n_frames, n_warmup;
+    int state_idx, frame_idx;
+    Profiler profiler;
+    Profiler::Clock::time_point frame_start;
+};
+
+long getPeakRSSKB();
+
+#endif
@@ -0,0 +1,142 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* perfEventName(int event) {
+    static const char* names[PERF_NUM_EVENTS] = {
+        "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses",
+    };
+    return (0 <= event && event < PERF_NUM_EVENTS) ? names[event] : "?";
+}
+
+PerfCounters::PerfCounters() : n_opened(0), leader_fd(-1) {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) fds[i] = -1;
+}
+
+PerfCounters::~PerfCounters() { close(); }
+
+#ifdef __linux__
+
+namespace {
+
+int perfEventOpen(struct perf_event_attr* attr, int group_fd) {
+    // this process, any cpu
+    return (int)syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+void eventConfig(int event, struct perf_event_attr& attr) {
+    switch (event) {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;  // last level
+            break;
+    }
+}
+
+} // namespace
+
+bool PerfCounters::open() {
+    close();
+    std::string first_error;
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        eventConfig(i, attr);
+        attr.disabled = (this->leader_fd < 0) ? 1 : 0;
+        attr.exclude_kernel = 1;  // permitted with perf_event_paranoid <= 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = perfEventOpen(&attr, this->leader_fd);
+        if (fd < 0) {
+            if (first_error.empty()) {
+                first_error = std::string(perfEventName(i)) + ": " +
+                              strerror(errno);
+            }
+            continue;
+        }
+        if (this->leader_fd < 0) this->leader_fd = fd;
+        this->fds[i] = fd;
+        this->n_opened++;
+    }
+    if (this->n_opened == 0) {
+        this->error = first_error + " (check kernel.perf_event_paranoid or "
+                      "the container seccomp profile)";
+        return false;
+    }
+    if (!first_error.empty()) this->error = "partially unavailable: " +
+                                            first_error;
+    ioctl(this->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(this->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void PerfCounters::close() {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (this->fds[i] >= 0) ::close(this->fds[i]);
+        this->fds[i] = -1;
+    }
+    this->n_opened = 0;
+    this->leader_fd = -1;
+}
+
+bool PerfCounters::read(PerfCounterValues& values) {
+    values.clear();
+    if (this->n_opened == 0) return false;
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (this->fds[i] < 0) continue;
+        uint64_t buf[3];  // value, time_enabled, time_running
+        if (::read(this->fds[i], buf, sizeof(buf)) != sizeof(buf)) {
+            return false;
+        }
+        if (buf[2] > 0 && buf[2] < buf[1]) {
+            // multiplexed: extrapolate to the enabled time
+            buf[0] = (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+        }
+        values.value[i] = buf[0];
+    }
+    return true;
+}
+
+#else
+
+bool PerfCounters::open() {
+    this->error = "perf_event_open is only available on Linux";
+    return false;
+}
+
+void PerfCounters::close() {}
+
+bool PerfCounters::read(PerfCounterValues& values) {
+    values.clear();
+    return false;
+}
+
+#endif
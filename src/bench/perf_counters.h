@@ -0,0 +1,50 @@
+#ifndef PERF_COUNTERS_H_261018
+#define PERF_COUNTERS_H_261018
+
+#include <stdint.h>
+#include <string>
+
+// Hardware counters read around profiled regions.
+enum PerfEvent {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_NUM_EVENTS
+};
+
+const char* perfEventName(int event);
+
+struct PerfCounterValues {
+    PerfCounterValues() { clear(); }
+    void clear() { for (int i = 0; i < PERF_NUM_EVENTS; i++) value[i] = 0; }
+    uint64_t value[PERF_NUM_EVENTS];
+};
+
+// Linux perf_event_open() counter group (user space only).
+// Events the kernel or the container does not permit are left out, so
+// open() fails only when no counter at all could be opened; callers then
+// fall back to wall time. On other platforms open() always fails.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    bool open();
+    void close();
+    bool available() const { return n_opened > 0; }
+    bool hasEvent(int event) const { return fds[event] >= 0; }
+    const std::string& getError() const { return error; }
+
+    // Current counts since open() (scaled when the PMU is multiplexed)
+    bool read(PerfCounterValues& values);
+
+private:
+    int fds[PERF_NUM_EVENTS];
+    int n_opened;
+    int leader_fd;
+    std::string error;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+thread_local Profiler* Profiler::active_profiler = NULL;
+
+void Profiler::beginFrame() {
+    this->frame_start = Clock::now();
+    this->frame_begin_allocs = getAllocStats();
+    this->depth = 0;
+}
+
+void Profiler::endFrame() {
+    std::chrono::duration<double> d = Clock::now() - this->frame_start;
+    AllocStats allocs = getAllocStats();
+    this->last_frame_allocs.count = allocs.count -
+                                    this->frame_begin_allocs.count;
+    this->last_frame_allocs.bytes = allocs.bytes -
+                                    this->frame_begin_allocs.bytes;
+    if (!this->recording) return;
+    this->total_frame_sec += d.count();
+    this->total_allocs.count += this->last_frame_allocs.count;
+    this->total_allocs.bytes += this->last_frame_allocs.bytes;
+    this->n_frames++;
+}
+
+int Profiler::stageIndex(const char* name) {
+    for (int i = 0; i < this->stages.size(); i++) {
+        if (strcmp(this->stages[i].name.c_str(), name) == 0) return i;
+    }
+    // register a new stage (first call only)
+    Stage stage;
+    stage.name = name;
+    stage.depth = this->depth;
+    stage.calls = 0;
+    stage.items = 0;
+    stage.total_sec = 0.0;
+    this->stages.push_back(stage);
+    return (int)this->stages.size() - 1;
+}
+
+void Profiler::beginStage(int stage_idx) {
+    this->depth++;
+}
+
+void Profiler::endStage(int stage_idx, double sec, long n_items,
+                        const AllocStats& begin_allocs,
+                        const PerfCounterValues* begin_values) {
+    this->depth--;
+    if (!this->recording) return;
+    Stage& stage = this->stages[stage_idx];
+    stage.calls++;
+    stage.items += n_items;
+    stage.total_sec += sec;
+    AllocStats allocs = getAllocStats();
+    stage.allocs.count += allocs.count - begin_allocs.count;
+    stage.allocs.bytes += allocs.bytes - begin_allocs.bytes;
+    if (begin_values && this->perf) {
+        PerfCounterValues end_values;
+        if (this->perf->read(end_values)) {
+            for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+                stage.counters.value[i] += end_values.value[i] -
+                                           begin_values->value[i];
+            }
+        }
+    }
+}
+
+void Profiler::reset() {
+    for (int i = 0; i < this->stages.size(); i++) {
+        this->stages[i].calls = 0;
+        this->stages[i].items = 0;
+        this->stages[i].total_sec = 0.0;
+        this->stages[i].counters.clear();
+        this->stages[i].allocs = AllocStats();
+    }
+    this->n_frames = 0;
+    this->total_frame_sec = 0.0;
+    this->total_allocs = AllocStats();
+}
+
+void Profiler::report(std::ostream& os) const {
+    if (this->n_frames == 0) return;
+    const double frame_ms = this->total_frame_sec * 1e3 / this->n_frames;
+    const bool allocs = allocTrackingEnabled();
+    char buf[256];
+    snprintf(buf, sizeof(buf), "  %-28s %10s %8s %8s", "stage", "ms/frame",
+             "%frame", "calls");
+    os << buf;
+    if (allocs) {
+        snprintf(buf, sizeof(buf), " %12s %12s", "allocs/frame", "KB/frame");
+        os << buf;
+    }
+    os << std::endl;
+    for (int i = 0; i < this->stages.size(); i++) {
+        const Stage& stage = this->stages[i];
+        const double ms = stage.total_sec * 1e3 / this->n_frames;
+        std::string name = std::string(stage.depth * 2, ' ') + stage.name;
+        snprintf(buf, sizeof(buf), "  %-28s %10.3f %7.1f%% %8ld",
+                 name.c_str(), ms, 100.0 * ms / std::max(frame_ms, 1e-12),
+                 stage.calls);
+        os << buf;
+        if (allocs) {
+            snprintf(buf, sizeof(buf), " %12.2f %12.3f",
+                     (double)stage.allocs.count / this->n_frames,
+                     stage.allocs.bytes / 1024.0 / this->n_frames);
+            os << buf;
+        }
+        os << std::endl;
+    }
+    snprintf(buf, sizeof(buf), "  %-28s %10.3f %8s %8s", "(frame)", frame_ms,
+             "", "");
+    os << buf;
+    if (allocs) {
+        snprintf(buf, sizeof(buf), " %12.2f %12.3f",
+                 (double)this->total_allocs.count / this->n_frames,
+                 this->total_allocs.bytes / 1024.0 / this->n_frames);
+        os << buf;
+    }
+    os << std::endl;
+
+    if (this->perf && this->perf->available()) this->reportCounters(os);
+}
+
+void Profiler::reportCounters(std::ostream& os) const {
+    char buf[256];
+    os << "* Hardware counters";
+    if (!this->perf->getError().empty()) {
+        os << " (" << this->perf->getError() << ")";
+    }
+    os << std::endl;
+    snprintf(buf, sizeof(buf), "  %-28s %6s %12s %12s %12s %12s\n", "stage",
+             "IPC", "cycles/item", "brmiss/item", "L1dmiss/item",
+             "LLCmiss/item");
+    os << buf;
+    for (int i = 0; i < this->stages.size(); i++) {
+        const Stage& stage = this->stages[i];
+        const uint64_t* v = stage.counters.value;
+        std::string name = std::string(stage.depth * 2, ' ') + stage.name;
+        const double ipc = v[PERF_CYCLES] > 0 ?
+            (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.0;
+        snprintf(buf, sizeof(buf), "  %-28s %6.2f", name.c_str(), ipc);
+        os << buf;
+        const int per_item[] = { PERF_CYCLES, PERF_BRANCH_MISSES,
+                                 PERF_L1D_MISSES, PERF_LLC_MISSES };
+        for (int j = 0; j < 4; j++) {
+            const int event = per_item[j];
+            if (stage.items > 0 && this->perf->hasEvent(event)) {
+                snprintf(buf, sizeof(buf), " %12.3f",
+                         (double)v[event] / stage.items);
+            } else {
+                snprintf(buf, sizeof(buf), " %12s", "-");
+            }
+            os << buf;
+        }
+        os << std::endl;
+    }
+}
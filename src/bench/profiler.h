@@ -0,0 +1,114 @@
+#ifndef PROFILER_H_261018
+#define PROFILER_H_261018
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "alloc_tracker.h"
+#include "perf_counters.h"
+
+// Per-stage wall clock profiler for the frame loop.
+// Stages are registered by name on first use and accumulated every frame.
+// Only one profiler is active at a time, on the thread which activated it
+// (the rendering thread); scopes opened on other threads do nothing.
+// With hardware counters attached, every stage also accumulates the counter
+// deltas and the number of processed items (samples, vertices).
+// Heap allocations are attributed to stages and frames when the allocation
+// hooks are linked (see alloc_tracker.h).
+// Scopes opened while not recording only register their stages.
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler() : n_frames(0), depth(0), total_frame_sec(0.0), perf(NULL),
+                 recording(true) {}
+
+    void setPerfCounters(PerfCounters* perf) { this->perf = perf; }
+    PerfCounters* getPerfCounters() { return perf; }
+
+    void beginFrame();
+    void endFrame();
+
+    int stageIndex(const char* name);
+    void beginStage(int stage_idx);
+    void endStage(int stage_idx, double sec, long n_items,
+                  const AllocStats& begin_allocs,
+                  const PerfCounterValues* begin_values=NULL);
+
+    void setRecording(bool recording) { this->recording = recording; }
+    bool isRecording() const { return recording; }
+
+    int getFrameCount() const { return n_frames; }
+    const AllocStats& getLastFrameAllocs() const { return last_frame_allocs; }
+    void reset();
+    void report(std::ostream& os) const;
+
+    static Profiler* active() { return active_profiler; }
+    static void setActive(Profiler* profiler) { active_profiler = profiler; }
+
+private:
+    struct Stage {
+        std::string name;
+        int depth;
+        long calls;
+        long items;
+        double total_sec;
+        PerfCounterValues counters;
+        AllocStats allocs;
+    };
+    std::vector<Stage> stages;
+    int n_frames;
+    int depth;
+    double total_frame_sec;
+    Clock::time_point frame_start;
+    PerfCounters* perf;
+    bool recording;
+    AllocStats frame_begin_allocs, last_frame_allocs, total_allocs;
+
+    void reportCounters(std::ostream& os) const;
+
+    static thread_local Profiler* active_profiler;
+};
+
+// Scoped stage timer. Does nothing when no profiler is active.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, long n_items=0)
+        : profiler(Profiler::active()), n_items(n_items) {
+        if (profiler) {
+            stage_idx = profiler->stageIndex(name);
+            profiler->beginStage(stage_idx);
+            has_counters = profiler->getPerfCounters() &&
+                           profiler->getPerfCounters()->read(begin_values);
+            begin_allocs = getAllocStats();
+            start = Profiler::Clock::now();
+        }
+    }
+    ~ProfileScope() {
+        if (profiler) {
+            std::chrono::duration<double> d = Profiler::Clock::now() - start;
+            profiler->endStage(stage_idx, d.count(), n_items, begin_allocs,
+                               has_counters ? &begin_values : NULL);
+        }
+    }
+private:
+    Profiler* profiler;
+    int stage_idx;
+    long n_items;
+    bool has_counters;
+    PerfCounterValues begin_values;
+    AllocStats begin_allocs;
+    Profiler::Clock::time_point start;
+};
+
+#define PROFILE_SCOPE_CAT_(a, b) a##b
+#define PROFILE_SCOPE_CAT(a, b) PROFILE_SCOPE_CAT_(a, b)
+#define PROFILE_SCOPE(name) \
+    ProfileScope PROFILE_SCOPE_CAT(profile_scope_, __LINE__)(name)
+// Scope processing `n` items (reported per item with hardware counters)
+#define PROFILE_SCOPE_N(name, n) \
+    ProfileScope PROFILE_SCOPE_CAT(profile_scope_, __LINE__)(name, n)
+
+#endif
@@ -0,0 +1,211 @@
+#include "eval_client.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Ring allocations keep 64 byte alignment
+inline uint64_t aligned(uint64_t bytes) {
+    return (bytes + 63) & ~(uint64_t)63;
+}
+
+} // namespace
+
+EvalParam evalParam(const std::string& name, float value) {
+    EvalParam param;
+    memset(&param, 0, sizeof(param));
+    strncpy(param.name, name.c_str(), sizeof(param.name) - 1);
+    param.value = value;
+    return param;
+}
+
+EvalClient::EvalClient() : n_submitted(0), head(0) {}
+
+EvalClient::~EvalClient() {
+    this->close();
+}
+
+bool EvalClient::connect(const std::string& address, size_t ring_bytes) {
+    this->close();
+    if (!this->channel.connect(address)) {
+        this->error = this->channel.getError();
+        return false;
+    }
+    // the ring, named by this process
+    static int n_rings = 0;
+    char name[32];
+#ifdef _WIN32
+    snprintf(name, sizeof(name), "/brdfeval.%d", n_rings++);
+#else
+    snprintf(name, sizeof(name), "/brdfeval.%d.%d", (int)getpid(),
+             n_rings++);
+#endif
+    if (!this->ring.create(name, ring_bytes)) {
+        this->error = this->ring.getError();
+        this->close();
+        return false;
+    }
+    EvalHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.version = EVAL_PROTOCOL_VERSION;
+    hello.ring_bytes = ring_bytes;
+    strncpy(hello.ring_name, name, sizeof(hello.ring_name) - 1);
+    uint32_t type;
+    std::vector<char> payload;
+    if (!this->channel.send(EVAL_MSG_HELLO, &hello, sizeof(hello)) ||
+        !this->channel.receive(type, payload)) {
+        this->error = "No answer from " + address;
+        this->close();
+        return false;
+    }
+    if (type != EVAL_MSG_READY) {
+        this->error = std::string(payload.begin(), payload.end());
+        this->close();
+        return false;
+    }
+    // mapped by the server: the name is no longer needed
+    this->ring.unlink();
+    for (size_t i = 0; i < payload.size();) {
+        const size_t len = strnlen(&payload[i], payload.size() - i);
+        this->names.push_back(std::string(&payload[i], len));
+        i += len + 1;
+    }
+    return true;
+}
+
+void EvalClient::close() {
+    this->channel.close();
+    this->ring.close();
+    this->names.clear();
+    this->pending.clear();
+    this->n_submitted = 0;
+    this->head = 0;
+}
+
+int EvalClient::findShader(const std::string& name) const {
+    for (int i = 0; i < this->names.size(); i++) {
+        if (this->names[i] == name) return i;
+    }
+    return -1;
+}
+
+bool EvalClient::allocate(int n, int values, EvalBatch& batch) {
+    const uint64_t dirs_bytes = aligned((uint64_t)n * 3 * sizeof(float));
+    const uint64_t bytes = dirs_bytes +
+                           aligned((uint64_t)n * values * sizeof(float));
+    const uint64_t size = this->ring.getSize();
+    if (!this->ring.isOpen() || n < 0 || bytes > size) {
+        this->error = "Batch larger than the ring";
+        return false;
+    }
+    // free space: [head, tail) or [head, size) and [0, tail); the ranges
+    // never end at the tail, so head == tail means empty
+    uint64_t offset;
+    if (this->pending.empty()) {
+        offset = 0;
+    } else {
+        const uint64_t tail = this->pending.front().begin;
+        if (this->head >= tail && size - this->head >= bytes) {
+            offset = this->head;
+        } else if (this->head >= tail && bytes < tail) {
+            offset = 0;
+        } else if (this->head < tail && tail - this->head > bytes) {
+            offset = this->head;
+        } else {
+            this->error = "Ring full";
+            return false;
+        }
+    }
+    Range range;
+    range.begin = offset;
+    range.end = offset + bytes;
+    this->pending.push_back(range);
+    this->head = range.end;
+
+    char* data = (char*)this->ring.getData();
+    batch.n = n;
+    batch.values = values;
+    batch.dirs_offset = offset;
+    batch.out_offset = offset + dirs_bytes;
+    batch.dirs = (float*)(data + batch.dirs_offset);
+    batch.out = (float*)(data + batch.out_offset);
+    return true;
+}
+
+bool EvalClient::submit(const EvalBatch& batch, int shader,
+                        const float light[3], const float normal[3],
+                        const std::vector<EvalParam>& params) {
+    std::vector<char> msg(sizeof(EvalRequest) +
+                          params.size() * sizeof(EvalParam));
+    EvalRequest request;
+    memset(&request, 0, sizeof(request));
+    request.shader = shader;
+    request.values = batch.values;
+    request.n_params = params.size();
+    request.n_dirs = batch.n;
+    memcpy(request.light, light, sizeof(request.light));
+    memcpy(request.normal, normal, sizeof(request.normal));
+    request.dirs_offset = batch.dirs_offset;
+    request.out_offset = batch.out_offset;
+    memcpy(&msg[0], &request, sizeof(request));
+    if (!params.empty()) {
+        memcpy(&msg[sizeof(request)], &params[0],
+               params.size() * sizeof(EvalParam));
+    }
+    if (!this->channel.send(EVAL_MSG_EVAL, &msg[0], msg.size())) {
+        this->error = this->channel.getError();
+        return false;
+    }
+    this->n_submitted++;
+    return true;
+}
+
+bool EvalClient::wait(uint64_t* eval_ns) {
+    if (this->n_submitted == 0) {
+        this->error = "No batch in flight";
+        return false;
+    }
+    uint32_t type;
+    std::vector<char> payload;
+    if (!this->channel.receive(type, payload)) {
+        this->error = this->channel.getError();
+        return false;
+    }
+    this->n_submitted--;
+    this->pending.pop_front();
+    if (type == EVAL_MSG_RESULT && payload.size() == sizeof(EvalResult)) {
+        EvalResult result;
+        memcpy(&result, &payload[0], sizeof(result));
+        if (eval_ns) *eval_ns = result.eval_ns;
+        return true;
+    }
+    this->error = type == EVAL_MSG_ERROR
+        ? std::string(payload.begin(), payload.end())
+        : "Invalid answer of the server";
+    return false;
+}
+
+bool EvalClient::evaluate(int shader, const float light[3],
+                          const float normal[3], const float* dirs, int n,
+                          int values, float* out,
+                          const std::vector<EvalParam>& params) {
+    EvalBatch batch;
+    if (!this->allocate(n, values, batch)) return false;
+    memcpy(batch.dirs, dirs, (size_t)n * 3 * sizeof(float));
+    if (!this->submit(batch, shader, light, normal, params)) {
+        this->pending.pop_back();
+        return false;
+    }
+    // earlier batches of the caller complete first
+    while (this->n_submitted > 1) {
+        if (!this->wait()) return false;
+    }
+    if (!this->wait()) return false;
+    memcpy(out, batch.out, (size_t)n * values * sizeof(float));
+    return true;
+}
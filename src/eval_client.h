@@ -0,0 +1,119 @@
+#ifndef EVAL_CLIENT_H_261018
+#define EVAL_CLIENT_H_261018
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "io/message_channel.h"
+#include "io/shared_memory.h"
+
+// Batched shader evaluation by a brdfserve process. Control messages go
+// over a socket (io/message_channel.h); directions and values stay in a
+// ring buffer of shared memory created by the client, so a batch is
+// written and read in place.
+//
+//   client  HELLO   EvalHello (the ring)
+//   server  READY   shader names, '\0' separated (ids in order)
+//   client  EVAL    EvalRequest, EvalParam[n_params]
+//   server  RESULT  EvalResult, or ERROR (message text)
+// Requests are answered in order, so several can be in flight. Parameters
+// persist per connection and shader until they are set again.
+enum EvalMessageType {
+    EVAL_MSG_HELLO = 1,
+    EVAL_MSG_READY,
+    EVAL_MSG_EVAL,
+    EVAL_MSG_RESULT,
+    EVAL_MSG_ERROR
+};
+
+const uint32_t EVAL_PROTOCOL_VERSION = 1;
+
+struct EvalHello {
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t ring_bytes;
+    char ring_name[64];  // SharedMemory name
+};
+
+struct EvalParam {
+    char name[32];
+    float value;
+};
+
+struct EvalRequest {
+    uint32_t shader;
+    uint32_t values;    // per direction: 1 (sampleBatch) or 3 (RGB)
+    uint32_t n_params;
+    uint32_t n_dirs;
+    float light[3];     // unit directions
+    float normal[3];
+    uint64_t dirs_offset;  // n_dirs x 3 floats in the ring
+    uint64_t out_offset;   // n_dirs x values floats in the ring
+};
+
+struct EvalResult {
+    uint32_t n_dirs;
+    uint32_t reserved;
+    uint64_t eval_ns;  // evaluation time in the server
+};
+
+// Space of one batch in the ring
+struct EvalBatch {
+    float* dirs;  // n * 3 floats to fill
+    float* out;   // n * values floats, valid after wait()
+    int n;
+    int values;
+    uint64_t dirs_offset, out_offset;
+};
+
+class EvalClient {
+public:
+    EvalClient();
+    ~EvalClient();
+    bool connect(const std::string& address, size_t ring_bytes = 64 << 20);
+    void close();
+    const std::vector<std::string>& shaderNames() const { return names; }
+    // Shader id of a name, -1 if the server has none
+    int findShader(const std::string& name) const;
+
+    // Space for n directions and their values, false while the batches in
+    // flight fill the ring. Batches are submitted in allocation order.
+    bool allocate(int n, int values, EvalBatch& batch);
+    bool submit(const EvalBatch& batch, int shader, const float light[3],
+                const float normal[3],
+                const std::vector<EvalParam>& params =
+                    std::vector<EvalParam>());
+    // Completion of the oldest submitted batch
+    bool wait(uint64_t* eval_ns = NULL);
+    // Submitted batches not waited for
+    int numPending() const { return n_submitted; }
+
+    // Copying round trip: dirs (n x 3) in, out (n x values) back
+    bool evaluate(int shader, const float light[3], const float normal[3],
+                  const float* dirs, int n, int values, float* out,
+                  const std::vector<EvalParam>& params =
+                      std::vector<EvalParam>());
+    const std::string& getError() const { return error; }
+
+private:
+    EvalClient(const EvalClient&);
+    EvalClient& operator=(const EvalClient&);
+
+    struct Range {
+        uint64_t begin, end;
+    };
+    MessageChannel channel;
+    SharedMemory ring;
+    std::vector<std::string> names;
+    std::deque<Range> pending;  // allocated, oldest first
+    int n_submitted;
+    uint64_t head;
+    std::string error;
+};
+
+// Parameter of a request
+EvalParam evalParam(const std::string& name, float value);
+
+#endif
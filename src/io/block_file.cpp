@@ -0,0 +1,148 @@
+#include "block_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+BlockFile::BlockFile() : handle(NULL) {}
+
+BlockFile::~BlockFile() {
+    this->close();
+}
+
+bool BlockFile::open(const std::string& path, bool write, bool truncate) {
+    this->close();
+    HANDLE h = CreateFileA(path.c_str(),
+                           write ? (GENERIC_READ | GENERIC_WRITE)
+                                 : GENERIC_READ,
+                           FILE_SHARE_READ, NULL,
+                           !write ? OPEN_EXISTING
+                                  : truncate ? CREATE_ALWAYS : OPEN_ALWAYS,
+                           FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        this->error = "Failed to open " + path;
+        return false;
+    }
+    this->handle = h;
+    return true;
+}
+
+void BlockFile::close() {
+    if (this->handle) CloseHandle((HANDLE)this->handle);
+    this->handle = NULL;
+}
+
+bool BlockFile::isOpen() const {
+    return this->handle != NULL;
+}
+
+uint64_t BlockFile::getSize() const {
+    LARGE_INTEGER size;
+    if (!this->handle || !GetFileSizeEx((HANDLE)this->handle, &size)) {
+        return 0;
+    }
+    return (uint64_t)size.QuadPart;
+}
+
+bool BlockFile::read(uint64_t offset, void* data, size_t size) const {
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD n = 0;
+    return this->handle &&
+           ReadFile((HANDLE)this->handle, data, (DWORD)size, &n, &ov) &&
+           n == size;
+}
+
+bool BlockFile::write(uint64_t offset, const void* data, size_t size) {
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD n = 0;
+    return this->handle &&
+           WriteFile((HANDLE)this->handle, data, (DWORD)size, &n, &ov) &&
+           n == size;
+}
+
+bool BlockFile::resize(uint64_t size) {
+    LARGE_INTEGER pos;
+    pos.QuadPart = (LONGLONG)size;
+    return this->handle &&
+           SetFilePointerEx((HANDLE)this->handle, pos, NULL, FILE_BEGIN) &&
+           SetEndOfFile((HANDLE)this->handle);
+}
+
+#else
+
+BlockFile::BlockFile() : fd(-1) {}
+
+BlockFile::~BlockFile() {
+    this->close();
+}
+
+bool BlockFile::open(const std::string& path, bool write, bool truncate) {
+    this->close();
+    const int flags = O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0);
+    this->fd = write ? ::open(path.c_str(), flags, 0644)
+                     : ::open(path.c_str(), O_RDONLY);
+    if (this->fd < 0) {
+        this->error = "Failed to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void BlockFile::close() {
+    if (this->fd >= 0) ::close(this->fd);
+    this->fd = -1;
+}
+
+bool BlockFile::isOpen() const {
+    return this->fd >= 0;
+}
+
+uint64_t BlockFile::getSize() const {
+    struct stat st;
+    if (this->fd < 0 || fstat(this->fd, &st) != 0) return 0;
+    return (uint64_t)st.st_size;
+}
+
+bool BlockFile::read(uint64_t offset, void* data, size_t size) const {
+    char* p = (char*)data;
+    while (size > 0) {
+        const ssize_t n = pread(this->fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool BlockFile::write(uint64_t offset, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        const ssize_t n = pwrite(this->fd, p, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool BlockFile::resize(uint64_t size) {
+    return this->fd >= 0 && ftruncate(this->fd, (off_t)size) == 0;
+}
+
+#endif
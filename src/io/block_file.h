@@ -0,0 +1,40 @@
+#ifndef BLOCK_FILE_H_261018
+#define BLOCK_FILE_H_261018
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// File read and written at explicit offsets (pread / pwrite), so threads
+// can share one handle. For data that should not be mapped as a whole.
+class BlockFile {
+public:
+    BlockFile();
+    ~BlockFile();
+
+    // Read only, or created for writing (existing data kept unless
+    // `truncate`)
+    bool open(const std::string& path, bool write=false, bool truncate=true);
+    void close();
+    bool isOpen() const;
+    uint64_t getSize() const;
+    // False on errors and short reads
+    bool read(uint64_t offset, void* data, size_t size) const;
+    bool write(uint64_t offset, const void* data, size_t size);
+    // Truncates or extends (with zeros) the file
+    bool resize(uint64_t size);
+    const std::string& getError() const { return error; }
+
+private:
+    BlockFile(const BlockFile&);
+    BlockFile& operator=(const BlockFile&);
+
+#ifdef _WIN32
+    void* handle;
+#else
+    int fd;
+#endif
+    std::string error;
+};
+
+#endif
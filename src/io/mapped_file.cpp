@@ -0,0 +1,105 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+    this->file_handle = NULL;
+    this->map_handle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    this->close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, bool random_access) {
+    this->close();
+    this->path = path;
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              NULL, OPEN_EXISTING,
+                              random_access ? FILE_FLAG_RANDOM_ACCESS
+                                            : FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        this->error = "Failed to open " + path;
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        this->error = "Empty or unreadable file " + path;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* data =
+        map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data) {
+        this->error = "Failed to map " + path;
+        if (map) CloseHandle(map);
+        CloseHandle(file);
+        return false;
+    }
+    this->file_handle = file;
+    this->map_handle = map;
+    this->data = data;
+    this->size = (size_t)file_size.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->data) UnmapViewOfFile(this->data);
+    if (this->map_handle) CloseHandle((HANDLE)this->map_handle);
+    if (this->file_handle) CloseHandle((HANDLE)this->file_handle);
+    this->data = NULL;
+    this->size = 0;
+    this->file_handle = NULL;
+    this->map_handle = NULL;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, bool random_access) {
+    this->close();
+    this->path = path;
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        this->error = "Failed to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        this->error = "Empty or unreadable file " + path;
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // the mapping keeps the file
+    if (data == MAP_FAILED) {
+        this->error = "Failed to map " + path + ": " + strerror(errno);
+        return false;
+    }
+    if (random_access) madvise(data, (size_t)st.st_size, MADV_RANDOM);
+    this->data = data;
+    this->size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->data) munmap((void*)this->data, this->size);
+    this->data = NULL;
+    this->size = 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H_261018
+#define MAPPED_FILE_H_261018
+
+#include <stddef.h>
+#include <string>
+
+// Read-only memory map of a whole file. open() costs the same for any file
+// size; pages are read by the OS on first access and stay in its page
+// cache. Not copyable (the mapping is owned).
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Random access hint (no read-ahead) for table lookups
+    bool open(const std::string& path, bool random_access=false);
+    void close();
+    bool isOpen() const { return data != NULL; }
+    const void* getData() const { return data; }
+    size_t getSize() const { return size; }
+    const std::string& getPath() const { return path; }
+    const std::string& getError() const { return error; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const void* data;
+    size_t size;
+    std::string path;
+    std::string error;
+#ifdef _WIN32
+    void* file_handle;
+    void* map_handle;
+#endif
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "message_channel.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MessageChannel::MessageChannel() : fd(-1) {}
+MessageChannel::~MessageChannel() {}
+
+bool MessageChannel::connect(const std::string& address) {
+    this->error = "Message sockets need a POSIX system";
+    return false;
+}
+
+void MessageChannel::attach(int fd) {}
+void MessageChannel::close() {}
+
+bool MessageChannel::send(uint32_t type, const void* data, size_t bytes) {
+    return false;
+}
+
+bool MessageChannel::receive(uint32_t& type, std::vector<char>& payload) {
+    return false;
+}
+
+bool MessageChannel::poll(int timeout_ms) const {
+    return false;
+}
+
+int listenMessageSocket(const std::string& address, std::string& error) {
+    error = "Message sockets need a POSIX system";
+    return -1;
+}
+
+int acceptMessageSocket(int listen_fd, int timeout_ms) {
+    return -1;
+}
+
+void closeMessageSocket(int fd, const std::string& address) {}
+
+#else
+
+namespace {
+
+const char MESSAGE_MAGIC[4] = {'B', 'M', 'S', 'G'};
+// larger payloads are a corrupt stream
+const uint64_t MAX_MESSAGE_BYTES = (uint64_t)1 << 32;
+
+// a peer that is gone fails the send instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+// Socket file path of a "unix:" address
+std::string unixPath(const std::string& address) {
+    return address.compare(0, 5, "unix:") == 0 ? address.substr(5) : address;
+}
+
+bool unixAddress(const std::string& address, sockaddr_un& addr,
+                 std::string& error) {
+    const std::string path = unixPath(address);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        error = "Invalid socket address: " + address;
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+    char* p = (char*)data;
+    while (size > 0) {
+        const ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        const ssize_t n = ::send(fd, p, size, SEND_FLAGS);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+} // namespace
+
+MessageChannel::MessageChannel() : fd(-1) {}
+
+MessageChannel::~MessageChannel() {
+    this->close();
+}
+
+bool MessageChannel::connect(const std::string& address) {
+    this->close();
+    sockaddr_un addr;
+    if (!unixAddress(address, addr, this->error)) return false;
+    this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->fd < 0 ||
+        ::connect(this->fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        this->error = "Failed to connect to " + address + ": " +
+                      strerror(errno);
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void MessageChannel::attach(int fd) {
+    this->close();
+    this->fd = fd;
+}
+
+void MessageChannel::close() {
+    if (this->fd >= 0) ::close(this->fd);
+    this->fd = -1;
+}
+
+bool MessageChannel::send(uint32_t type, const void* data, size_t bytes) {
+    MessageHeader header;
+    memcpy(header.magic, MESSAGE_MAGIC, 4);
+    header.type = type;
+    header.bytes = bytes;
+    const bool ok = this->fd >= 0 &&
+                    writeAll(this->fd, &header, sizeof(header)) &&
+                    (bytes == 0 || writeAll(this->fd, data, bytes));
+    if (!ok) this->error = "Connection lost";
+    return ok;
+}
+
+bool MessageChannel::receive(uint32_t& type, std::vector<char>& payload) {
+    MessageHeader header;
+    bool ok = this->fd >= 0 && readAll(this->fd, &header, sizeof(header)) &&
+              memcmp(header.magic, MESSAGE_MAGIC, 4) == 0 &&
+              header.bytes <= MAX_MESSAGE_BYTES;
+    if (ok) {
+        type = header.type;
+        payload.resize(header.bytes);
+        ok = header.bytes == 0 ||
+             readAll(this->fd, &payload[0], header.bytes);
+    }
+    if (!ok) this->error = "Connection lost";
+    return ok;
+}
+
+bool MessageChannel::poll(int timeout_ms) const {
+    pollfd p;
+    p.fd = this->fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    return this->fd >= 0 && ::poll(&p, 1, timeout_ms) > 0;
+}
+
+int listenMessageSocket(const std::string& address, std::string& error) {
+    sockaddr_un addr;
+    if (!unixAddress(address, addr, error)) return -1;
+    unlink(addr.sun_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 64) != 0) {
+        error = "Failed to listen on " + address + ": " + strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    // accept() must not block when a client gave up
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int acceptMessageSocket(int listen_fd, int timeout_ms) {
+    if (timeout_ms != 0) {
+        pollfd p;
+        p.fd = listen_fd;
+        p.events = POLLIN;
+        p.revents = 0;
+        if (::poll(&p, 1, timeout_ms) <= 0) return -1;
+    }
+    const int fd = accept(listen_fd, NULL, NULL);
+    // blocking reads of the messages
+    if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
+
+void closeMessageSocket(int fd, const std::string& address) {
+    if (fd >= 0) ::close(fd);
+    unlink(unixPath(address).c_str());
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MESSAGE_CHANNEL_H_261018
+#define MESSAGE_CHANNEL_H_261018
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Framed messages over a stream socket: a MessageHeader (type and payload
+// size) and the payload. Addresses are "unix:<path>" (or a plain path) for
+// local processes; other transports only need to produce a connected
+// stream, the framing stays the same. POSIX only (open fails on Windows).
+struct MessageHeader {
+    char magic[4];  // "BMSG"
+    uint32_t type;
+    uint64_t bytes;
+};
+
+class MessageChannel {
+public:
+    MessageChannel();
+    ~MessageChannel();
+
+    // Connected end of a listening address
+    bool connect(const std::string& address);
+    // Takes ownership of a connected socket
+    void attach(int fd);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    int getFd() const { return fd; }
+
+    // Blocking; false when the peer is gone
+    bool send(uint32_t type, const void* data, size_t bytes);
+    bool receive(uint32_t& type, std::vector<char>& payload);
+    // A message (or the end of the stream) can be read within timeout_ms
+    bool poll(int timeout_ms) const;
+    const std::string& getError() const { return error; }
+
+private:
+    MessageChannel(const MessageChannel&);
+    MessageChannel& operator=(const MessageChannel&);
+
+    int fd;
+    std::string error;
+};
+
+// Listening socket of an address (fd, -1 with error). A stale unix socket
+// file is replaced.
+int listenMessageSocket(const std::string& address, std::string& error);
+// Connected socket of a listening one, -1 if none is pending within
+// timeout_ms (-1: waits)
+int acceptMessageSocket(int listen_fd, int timeout_ms=0);
+void closeMessageSocket(int fd, const std::string& address);
+
+#endif
@@ -0,0 +1,89 @@
+#include "shared_memory.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::SharedMemory() : data(NULL), size(0), linked(false) {}
+
+SharedMemory::~SharedMemory() {
+    this->close();
+}
+
+#ifdef _WIN32
+
+bool SharedMemory::create(const std::string& name, size_t size) {
+    this->error = "Shared memory needs a POSIX system";
+    return false;
+}
+
+bool SharedMemory::open(const std::string& name) {
+    this->error = "Shared memory needs a POSIX system";
+    return false;
+}
+
+void SharedMemory::unlink() {}
+void SharedMemory::close() {}
+
+bool SharedMemory::map(int fd, size_t size) {
+    return false;
+}
+
+#else
+
+bool SharedMemory::create(const std::string& name, size_t size) {
+    this->close();
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        this->error = "Failed to create " + name + ": " + strerror(errno);
+        return false;
+    }
+    this->name = name;
+    this->linked = true;
+    const bool ok = ftruncate(fd, (off_t)size) == 0 && this->map(fd, size);
+    ::close(fd);
+    if (!ok) {
+        this->error = "Failed to map " + name + ": " + strerror(errno);
+        this->close();
+    }
+    return ok;
+}
+
+bool SharedMemory::open(const std::string& name) {
+    this->close();
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    struct stat st;
+    const bool ok = fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0 &&
+                    this->map(fd, (size_t)st.st_size);
+    if (!ok) this->error = "Failed to open " + name + ": " + strerror(errno);
+    if (fd >= 0) ::close(fd);
+    this->name = name;
+    return ok;
+}
+
+void SharedMemory::unlink() {
+    if (this->linked) shm_unlink(this->name.c_str());
+    this->linked = false;
+}
+
+void SharedMemory::close() {
+    if (this->data) munmap(this->data, this->size);
+    this->unlink();
+    this->data = NULL;
+    this->size = 0;
+}
+
+bool SharedMemory::map(int fd, size_t size) {
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+    this->data = p;
+    this->size = size;
+    return true;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SHARED_MEMORY_H_261018
+#define SHARED_MEMORY_H_261018
+
+#include <stddef.h>
+#include <string>
+
+// Named shared memory segment mapped read-write (POSIX shm_open). One
+// process creates it, the others open it by name; once all have it mapped
+// the name can be unlinked and the memory lives until the last unmapping.
+// POSIX only (create / open fail on Windows).
+class SharedMemory {
+public:
+    SharedMemory();
+    ~SharedMemory();
+
+    // name: "/name" without further slashes
+    bool create(const std::string& name, size_t size);
+    bool open(const std::string& name);
+    // Removes the name (the mapping stays)
+    void unlink();
+    void close();
+    bool isOpen() const { return data != NULL; }
+    void* getData() const { return data; }
+    size_t getSize() const { return size; }
+    const std::string& getName() const { return name; }
+    const std::string& getError() const { return error; }
+
+private:
+    SharedMemory(const SharedMemory&);
+    SharedMemory& operator=(const SharedMemory&);
+
+    bool map(int fd, size_t size);
+
+    void* data;
+    size_t size;
+    std::string name;
+    bool linked;  // the name exists (created here)
+    std::string error;
+};
+
+#endif
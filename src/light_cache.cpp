@@ -0,0 +1,178 @@
+#include "light_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// As lightPosFromDeg() of the viewer
+glm::vec3 lightDirFromDeg(float theta_deg, float phi_deg) {
+    const float theta = glm::radians(theta_deg), phi = glm::radians(phi_deg);
+    return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                     std::sin(theta) * std::sin(phi));
+}
+
+// Angle in [-180, 180)
+inline float wrapDeg(float deg) {
+    return deg - 360.f * std::floor((deg + 180.f) / 360.f);
+}
+
+// The same light direction with theta in [0, 180] and phi in [-180, 180)
+inline void gridLight(const float light_deg[2], float& theta, float& phi) {
+    theta = wrapDeg(light_deg[0]);
+    phi = light_deg[1];
+    if (theta < 0.f) {
+        theta = -theta;
+        phi += 180.f;
+    }
+    phi = wrapDeg(phi);
+}
+
+// Grid cell of x (in steps from the first node) and the weight of its
+// upper node
+inline void gridCell(float x, int n_cells, int& i, float& t) {
+    i = glm::clamp((int)std::floor(x), 0, n_cells - 1);
+    t = glm::clamp(x - i, 0.f, 1.f);
+}
+
+} // namespace
+
+
+LightLobeCache::LightLobeCache()
+    : up_dir(0.f, 1.f, 0.f), n_phi(0), step_deg(10.f), n_theta(0),
+      n_phi_steps(0), n_vertices(0), next(0), n_done(0), cancel(false),
+      finish_seconds(-1.0) {}
+
+LightLobeCache::~LightLobeCache() {
+    this->stop();
+}
+
+void LightLobeCache::start(const BaseShader& shader, const glm::vec3& up_dir,
+                           int n_phi, const float light_deg[2],
+                           float step_deg, int n_threads) {
+    this->stop();
+    this->shader.reset(shader.clone());
+    this->up_dir = up_dir;
+    this->n_phi = n_phi;
+    this->n_theta = std::max((int)std::ceil(180.f / step_deg), 1) + 1;
+    this->n_phi_steps = 2 * (this->n_theta - 1);
+    this->step_deg = 180.f / (this->n_theta - 1);
+    brdfGridDirections(this->directions, 1.f, n_phi, up_dir);
+    this->n_vertices = this->directions.size();
+    const int n_entries = this->numEntries();
+    this->intensities.resize((size_t)n_entries * this->n_vertices);
+    this->done.reset(new std::atomic<bool>[n_entries]);
+    for (int i = 0; i < n_entries; i++) this->done[i] = false;
+
+    // nearest to the light first (phi wraps around)
+    float light_theta, light_phi;
+    gridLight(light_deg, light_theta, light_phi);
+    std::vector<std::pair<float, int> > by_distance(n_entries);
+    for (int i_theta = 0; i_theta < this->n_theta; i_theta++) {
+        for (int i_phi = 0; i_phi < this->n_phi_steps; i_phi++) {
+            const float d_theta = i_theta * this->step_deg - light_theta;
+            float d_phi = std::fabs(-180.f + i_phi * this->step_deg -
+                                    light_phi);
+            d_phi = std::min(d_phi, 360.f - d_phi);
+            const int e = this->entryIndex(i_theta, i_phi);
+            by_distance[e] = std::make_pair(
+                d_theta * d_theta + d_phi * d_phi, e);
+        }
+    }
+    std::sort(by_distance.begin(), by_distance.end());
+    this->order.resize(n_entries);
+    for (int i = 0; i < n_entries; i++) {
+        this->order[i] = by_distance[i].second;
+    }
+
+    this->next = 0;
+    this->n_done = 0;
+    this->cancel = false;
+    this->finish_seconds = -1.0;
+    this->start_time = std::chrono::steady_clock::now();
+    if (n_threads <= 0) n_threads = std::thread::hardware_concurrency();
+    n_threads = std::max(n_threads, 1);
+    for (int i = 0; i < n_threads; i++) {
+        this->threads.push_back(std::thread(&LightLobeCache::worker, this));
+    }
+}
+
+void LightLobeCache::stop() {
+    this->cancel = true;
+    for (int i = 0; i < this->threads.size(); i++) this->threads[i].join();
+    this->threads.clear();
+}
+
+float LightLobeCache::progress() const {
+    const int n_entries = this->numEntries();
+    return (n_entries > 0) ? (float)this->n_done / n_entries : 0.f;
+}
+
+void LightLobeCache::wait() const {
+    const int n_entries = this->numEntries();
+    while (this->started() && this->n_done < n_entries && !this->cancel) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+double LightLobeCache::seconds() const {
+    const double finished = this->finish_seconds;
+    if (finished >= 0.0 || !this->started()) return std::max(finished, 0.0);
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - this->start_time).count();
+}
+
+bool LightLobeCache::interpolate(const float light_deg[2], float* out) const {
+    if (!this->started() || this->n_theta < 2) return false;
+    float theta, phi;
+    gridLight(light_deg, theta, phi);
+    int i_theta, i_phi;
+    float t_theta, t_phi;
+    gridCell(theta / this->step_deg, this->n_theta - 1, i_theta, t_theta);
+    gridCell((phi + 180.f) / this->step_deg, this->n_phi_steps, i_phi,
+             t_phi);
+    const int j_phi = (i_phi + 1) % this->n_phi_steps;
+    const int e00 = this->entryIndex(i_theta, i_phi);
+    const int e01 = this->entryIndex(i_theta, j_phi);
+    const int e10 = this->entryIndex(i_theta + 1, i_phi);
+    const int e11 = this->entryIndex(i_theta + 1, j_phi);
+    if (!this->done[e00] || !this->done[e01] || !this->done[e10] ||
+        !this->done[e11]) {
+        return false;
+    }
+    const float w00 = (1.f - t_theta) * (1.f - t_phi);
+    const float w01 = (1.f - t_theta) * t_phi;
+    const float w10 = t_theta * (1.f - t_phi);
+    const float w11 = t_theta * t_phi;
+    const int n = this->n_vertices;
+    const float* v00 = &this->intensities[(size_t)e00 * n];
+    const float* v01 = &this->intensities[(size_t)e01 * n];
+    const float* v10 = &this->intensities[(size_t)e10 * n];
+    const float* v11 = &this->intensities[(size_t)e11 * n];
+    for (int v = 0; v < n; v++) {
+        out[v] = w00 * v00[v] + w01 * v01[v] + w10 * v10[v] + w11 * v11[v];
+    }
+    return true;
+}
+
+void LightLobeCache::worker() {
+    BaseShader* shader = this->shader->clone();
+    const int n_entries = this->order.size();
+    for (int i = this->next++; i < n_entries && !this->cancel;
+         i = this->next++) {
+        const int e = this->order[i];
+        const float theta_deg = (e / this->n_phi_steps) * this->step_deg;
+        const float phi_deg =
+            -180.f + (e % this->n_phi_steps) * this->step_deg;
+        float* out = &this->intensities[(size_t)e * this->n_vertices];
+        shader->sampleBatch(lightDirFromDeg(theta_deg, phi_deg),
+                            &this->directions[0], this->up_dir, out,
+                            this->n_vertices);
+        this->done[e] = true;
+        if (++this->n_done == n_entries) {
+            this->finish_seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - this->start_time).count();
+        }
+    }
+    delete shader;
+}
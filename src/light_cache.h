@@ -0,0 +1,74 @@
+#ifndef LIGHT_CACHE_H_261018
+#define LIGHT_CACHE_H_261018
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.h"
+#include "shader.h"
+
+// Lobes of a shader over a grid of light directions, evaluated in the
+// background on all cores: theta in [0, 180] and phi in [-180, 180)
+// degrees every `step_deg` (the "Light (deg)" of the viewer, a negative
+// theta is the same direction as -theta at phi + 180), n_phi as
+// createBRDFMesh(). The entries nearest to the light at start() come
+// first. Lobes in between are interpolated bilinearly from the four
+// neighbouring entries (phi wraps around), e.g. while the light is
+// dragged; 10 degree steps at n_phi 100 take 19 x 36 x 5002 floats
+// (14 MB).
+class LightLobeCache {
+public:
+    LightLobeCache();
+    ~LightLobeCache();  // cancels the workers
+
+    // Evaluates a copy of the shader (cancels the previous run)
+    void start(const BaseShader& shader, const glm::vec3& up_dir, int n_phi,
+               const float light_deg[2], float step_deg=10.f,
+               int n_threads=0);
+    void stop();
+    bool started() const { return !threads.empty(); }
+    // Finished entries / all entries
+    float progress() const;
+    // Blocks until every entry is evaluated (or the run is cancelled)
+    void wait() const;
+    double seconds() const;  // since start(), until finished
+    int numVertices() const { return n_vertices; }
+
+    // Intensities of the lobe at the light (numVertices() floats). False
+    // while a neighbouring entry is not evaluated yet.
+    bool interpolate(const float light_deg[2], float* out) const;
+
+private:
+    LightLobeCache(const LightLobeCache&);
+    LightLobeCache& operator=(const LightLobeCache&);
+
+    void worker();
+    int numEntries() const { return n_theta * n_phi_steps; }
+    int entryIndex(int i_theta, int i_phi) const {
+        return i_theta * n_phi_steps + i_phi;
+    }
+
+    std::unique_ptr<BaseShader> shader;
+    glm::vec3 up_dir;
+    int n_phi;
+    float step_deg;
+    int n_theta;      // grid nodes over [0, 180]
+    int n_phi_steps;  // grid nodes over [-180, 180)
+    int n_vertices;
+    std::vector<glm::vec3> directions;
+    std::vector<float> intensities;  // entry * n_vertices
+    std::vector<int> order;  // of evaluation
+    std::unique_ptr<std::atomic<bool>[]> done;
+    std::atomic<int> next;
+    std::atomic<int> n_done;
+    std::atomic<bool> cancel;
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start_time;
+    std::atomic<double> finish_seconds;  // < 0 while running
+};
+
+#endif
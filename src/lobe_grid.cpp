@@ -0,0 +1,121 @@
+#include "lobe_grid.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "bench/profiler.h"
+
+namespace {
+
+struct LobeGridWork {
+    const BaseShader* shader;
+    const LobeGridSettings* settings;
+    glm::vec3 up_dir;
+    const std::vector<glm::vec3>* directions;
+    LobeGrid* grid;
+    std::atomic<int> next;
+};
+
+void lobeGridWorker(LobeGridWork& work) {
+    const LobeGridSettings& settings = *work.settings;
+    LobeGrid& grid = *work.grid;
+    const std::vector<glm::vec3>& directions = *work.directions;
+    BaseShader* shader = work.shader->clone();
+    for (int i = work.next++; i < grid.numLobes(); i = work.next++) {
+        const int row = i / grid.n_cols, col = i % grid.n_cols;
+        if (!settings.param.empty()) {
+            shader->setParam(settings.param, grid.row_values[row]);
+        }
+        // as lightPosFromDeg() of the viewer
+        const float theta = glm::radians(grid.col_theta_deg[col]);
+        const float phi = glm::radians(settings.light_phi_deg);
+        const glm::vec3 light_dir(std::sin(theta) * std::cos(phi),
+                                  std::cos(theta),
+                                  std::sin(theta) * std::sin(phi));
+        float* out = &grid.intensities[i * grid.n_vertices];
+        shader->sampleBatch(light_dir, &directions[0], work.up_dir, out,
+                            grid.n_vertices);
+        float lobe_max = 0.f;
+        for (int v = 0; v < grid.n_vertices; v++) {
+            // NaN and negative values collapse to the center
+            if (!(out[v] >= 0.f) || std::isinf(out[v])) out[v] = 0.f;
+            lobe_max = std::max(lobe_max, out[v]);
+        }
+        grid.lobe_max[i] = lobe_max;
+    }
+    delete shader;
+}
+
+} // namespace
+
+
+bool computeLobeGrid(const BaseShader& shader, const glm::vec3& up_dir,
+                     const LobeGridSettings& settings, LobeGrid& grid,
+                     std::string& error) {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    if (!settings.param.empty()) {
+        BaseShader* probe = shader.clone();
+        float value;
+        const bool found = probe->getParam(settings.param, value);
+        delete probe;
+        if (!found) {
+            error = "Unknown parameter: " + settings.param;
+            return false;
+        }
+    }
+    grid.n_rows = std::max(settings.n_rows, 1);
+    grid.n_cols = std::max(settings.n_cols, 1);
+    grid.n_phi = std::max(settings.n_phi, 2);
+    grid.up_dir = up_dir;
+    const int n_lobes = grid.numLobes();
+    PROFILE_SCOPE_N("computeLobeGrid", n_lobes);
+
+    std::vector<glm::vec3> directions;
+    brdfGridDirections(directions, 1.f, grid.n_phi, up_dir);
+    grid.n_vertices = directions.size();
+    grid.intensities.resize((size_t)n_lobes * grid.n_vertices);
+    grid.lobe_max.assign(n_lobes, 0.f);
+    grid.row_values.resize(grid.n_rows);
+    for (int r = 0; r < grid.n_rows; r++) {
+        const float t = (grid.n_rows > 1) ? (float)r / (grid.n_rows - 1)
+                                          : 0.f;
+        grid.row_values[r] = settings.param_min +
+                             (settings.param_max - settings.param_min) * t;
+    }
+    grid.col_theta_deg.resize(grid.n_cols);
+    for (int c = 0; c < grid.n_cols; c++) {
+        const float t = (grid.n_cols > 1) ? (float)c / (grid.n_cols - 1)
+                                          : 0.5f;
+        grid.col_theta_deg[c] =
+            settings.theta_min_deg +
+            (settings.theta_max_deg - settings.theta_min_deg) * t;
+    }
+
+    // lobes on the workers
+    LobeGridWork work;
+    work.shader = &shader;
+    work.settings = &settings;
+    work.up_dir = up_dir;
+    work.directions = &directions;
+    work.grid = &grid;
+    work.next = 0;
+    int n_threads = settings.n_threads > 0
+        ? settings.n_threads : (int)std::thread::hardware_concurrency();
+    n_threads = std::max(std::min(n_threads, n_lobes), 1);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_threads; i++) {
+        threads.push_back(std::thread(lobeGridWorker, std::ref(work)));
+    }
+    lobeGridWorker(work);
+    for (int i = 0; i < threads.size(); i++) threads[i].join();
+
+    grid.max_intensity = *std::max_element(grid.lobe_max.begin(),
+                                           grid.lobe_max.end());
+    grid.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return true;
+}
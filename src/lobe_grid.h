@@ -0,0 +1,61 @@
+#ifndef LOBE_GRID_H_261018
+#define LOBE_GRID_H_261018
+
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "shader.h"
+
+// Small multiples of a shader: row r sets `param` to
+// param_min + (param_max - param_min) * r / (n_rows - 1), column c puts the
+// light at theta_min + (theta_max - theta_min) * c / (n_cols - 1) degrees
+// from the up direction (at light_phi, as the "Light (deg)" of the viewer).
+// Without `param` every row is the shader as it is.
+struct LobeGridSettings {
+    LobeGridSettings() : n_rows(4), n_cols(6), n_phi(48), param_min(0.f),
+                         param_max(1.f), theta_min_deg(-75.f),
+                         theta_max_deg(75.f), light_phi_deg(0.f),
+                         n_threads(0) {}
+    bool operator==(const LobeGridSettings& o) const {
+        return param == o.param && n_rows == o.n_rows &&
+               n_cols == o.n_cols && n_phi == o.n_phi &&
+               param_min == o.param_min && param_max == o.param_max &&
+               theta_min_deg == o.theta_min_deg &&
+               theta_max_deg == o.theta_max_deg &&
+               light_phi_deg == o.light_phi_deg && n_threads == o.n_threads;
+    }
+    bool operator!=(const LobeGridSettings& o) const { return !(*this == o); }
+    std::string param;
+    int n_rows, n_cols;
+    int n_phi;  // lobe resolution (brdfGridTopology())
+    float param_min, param_max;
+    float theta_min_deg, theta_max_deg, light_phi_deg;
+    int n_threads;  // 0: hardware concurrency
+};
+
+// Intensities of every lobe over the unit sphere of brdfGridDirections(),
+// lobe i = row * n_cols + col
+struct LobeGrid {
+    LobeGrid() : n_rows(0), n_cols(0), n_phi(0), n_vertices(0),
+                 up_dir(0.f, 1.f, 0.f), max_intensity(0.f), seconds(0.0) {}
+    int numLobes() const { return n_rows * n_cols; }
+    const float* lobe(int i) const { return &intensities[i * n_vertices]; }
+
+    int n_rows, n_cols, n_phi, n_vertices;
+    glm::vec3 up_dir;
+    std::vector<float> intensities;  // numLobes() * n_vertices
+    std::vector<float> lobe_max;     // per lobe (finite values)
+    std::vector<float> row_values;   // of the parameter
+    std::vector<float> col_theta_deg;
+    float max_intensity;
+    double seconds;
+};
+
+// Evaluates the lobes on worker threads (a clone of the shader each).
+// Returns false when the shader has no parameter `param`.
+bool computeLobeGrid(const BaseShader& shader, const glm::vec3& up_dir,
+                     const LobeGridSettings& settings, LobeGrid& grid,
+                     std::string& error);
+
+#endif
@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <limits>
+#include <memory>
 
 #include <GL/glew.h>
 #define GLM_FORCE_RADIANS 
@@ -13,19 +17,42 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "albedo.h"
+#include "bench/frame_bench.h"
+#include "bench/perf_counters.h"
+#include "bench/profiler.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
 #include "io/gl_fps.h"
+#include "light_cache.h"
+#include "lobe_grid.h"
+#include "measured.h"
+#include "tiled.h"
 #include "mesh.h"
+#include "mesh_export.h"
 #include "render/camera.h"
 #include "render/gl_utils.h"
 #include "render/gl_window.h"
+#include "render/gpu_mesh.h"
+#include "render/lobe_grid_renderer.h"
+#include "result_store.h"
 #include "shader.h"
+#include "simd/cpu_dispatch.h"
+#include "sweep.h"
 
 
 const float LIGHT_LENGTH = sqrtf(2.f);
 
 
+glm::vec3 lightPosFromDeg(const float light_deg[2]) {
+    float theta = light_deg[0] * glm::pi<float>() / 180.f;
+    float phi = light_deg[1] * glm::pi<float>() / 180.f;
+    return glm::vec3(sin(theta) * cos(phi) * LIGHT_LENGTH,
+                     cos(theta) * LIGHT_LENGTH,
+                     sin(theta) * sin(phi) * LIGHT_LENGTH);
+}
+
+
 void setCameraMatrix(Camera& camera) {
     glm::mat4 mv_mat = camera.getViewMatrix() * glm::mat4(1.0);
     glm::mat4 p_mat = camera.getProjectionMatrix();
@@ -40,25 +67,19 @@ void setCameraMatrix(Camera& camera) {
     checkGlError(101);
 }
 
-void drawMesh(Mesh &mesh, glm::vec3 color) {
+void drawMesh(const Mesh& mesh, GpuMesh& gpu_mesh,
+              const GpuVertexFormat& format, glm::vec3 color) {
     // enable light and material
     glEnable(GL_LIGHTING);
     glEnable(GL_LIGHT0);
     glColorMaterial(GL_FRONT, GL_DIFFUSE);
     glEnable(GL_COLOR_MATERIAL);
-    // color
+    // color (per vertex when the mesh has colors)
     glColor3fv(&color[0]);
 
     // draw
-    glBegin(GL_TRIANGLES);
-    for (int tri = 0; tri < mesh.indices.size(); tri++) {
-        for (int i = 0; i < 3; i++) {
-            unsigned int v_idx = mesh.indices[tri][i];
-            glNormal3fv(&(mesh.normals[v_idx][0]));
-            glVertex3fv(&(mesh.vertices[v_idx][0]));
-        }
-    }
-    glEnd();
+    gpu_mesh.upload(mesh, format);
+    gpu_mesh.draw();
 
     // disable light and material
     glDisable(GL_LIGHT0);
@@ -110,7 +131,277 @@ void updateIO(GLWindow& window) {
 }
 
 
+// Parameters of a shader back to those of a pristine clone
+void copyShaderParams(BaseShader& dst, BaseShader& src) {
+    std::vector<ShaderParam> dst_params, src_params;
+    dst.getParams(dst_params);
+    src.getParams(src_params);
+    assert(dst_params.size() == src_params.size());
+    for (int i = 0; i < dst_params.size(); i++) {
+        *(dst_params[i].value) = *(src_params[i].value);
+    }
+}
+
+
+// ACMR / ATVR of the lobe mesh topology (the draw order in use marked)
+void reportVertexCache(std::ostream& os, int n_phi, bool strips) {
+    const BRDFGridTopology& topology = brdfGridTopology(n_phi);
+    os << "* Vertex cache (lobe n_phi " << n_phi << ", "
+       << topology.n_vertices << " vertices, FIFO " << VERTEX_CACHE_SIZE
+       << ")" << std::endl;
+    const char* names[3] = {"grid order", "optimized list", "strips"};
+    const VertexCacheStats* stats[3] = {&topology.grid_stats,
+                                        &topology.list_stats,
+                                        &topology.strip_stats};
+    const size_t n_indices[3] = {topology.triangles.size() * 3,
+                                 topology.triangles.size() * 3,
+                                 topology.strips.size()};
+    for (int i = 0; i < 3; i++) {
+        char buf[128];
+        snprintf(buf, sizeof(buf),
+                 "  %-15s ACMR %.3f  ATVR %.3f  %zu indices%s\n", names[i],
+                 stats[i]->acmr, stats[i]->atvr, n_indices[i],
+                 (i == (strips ? 2 : 1)) ? "  (drawn)" : "");
+        os << buf;
+    }
+}
+
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl
+              << "  --bench <frames>        run the frame benchmark offscreen"
+              << std::endl
+              << "  --bench-script <file>   benchmark state script"
+              << std::endl
+              << "  --bench-warmup <frames> warmup frames per state (5)"
+              << std::endl
+              << "  --perf                  read hardware counters (Linux)"
+              << std::endl
+              << "  --bench-check-allocs    fail if a steady-state frame "
+                 "allocates" << std::endl
+              << "  --fast-math             fast tier of the SIMD shader math"
+              << std::endl
+              << "  --isa <name>            SIMD kernels: scalar, sse2, "
+                 "sse4.2, avx2, avx512" << std::endl
+              << "                          (default: best supported, or "
+                 "$BRDF_ISA)" << std::endl
+              << "  --color <mode>          mono, rgb or spectral (8 "
+                 "wavelengths)" << std::endl
+              << "  --channel-lobes         one lobe per RGB channel "
+                 "(color modes)" << std::endl
+              << "  --merl <path>           MERL .binary or .btab file, or "
+                 "directory (repeatable)" << std::endl
+              << "  --tiled <file>          4D tabulated BRDF (.b4d)"
+              << std::endl
+              << "  --tile-cache-mb <n>     tile cache of --tiled (256)"
+              << std::endl
+              << "  --store <file>          result store of brdfbake (.bres)"
+              << std::endl
+              << "  --float-vertices        float positions and normals "
+                 "(no packed vertices)" << std::endl
+              << "  --strips                draw the lobes as triangle strips"
+              << std::endl
+              << "  --light-cache           interpolate the lobe while the "
+                 "light is dragged" << std::endl;
+}
+
+// Combo item of a measured file path (its file name)
+bool measuredFileName(void* data, int idx, const char** out_text) {
+    const std::vector<std::string>& files =
+        *(const std::vector<std::string>*)data;
+    const std::string& path = files[idx];
+    const size_t slash = path.find_last_of("/\\");
+    *out_text = path.c_str() + ((slash == std::string::npos) ? 0 : slash + 1);
+    return true;
+}
+
+// Color evaluation modes of the viewer
+enum ViewColorMode { VIEW_MONO = 0, VIEW_RGB, VIEW_SPECTRAL };
+const int N_VIEW_SPECTRAL = 8;
+
+// Scrubbing through the records of one schema of a result store: the
+// stored values of every parameter and the stored light directions
+struct StoreBrowser {
+    StoreBrowser() : schema(-1), table_record(-1) {}
+    int schema;
+    std::vector<std::string> names;
+    std::vector<std::vector<float> > values;  // per parameter, sorted
+    std::vector<int> value_idx;  // chosen value per parameter
+    std::vector<glm::vec3> lights;
+    int table_record;  // loaded into the table shader
+};
+
+void browseSchema(const ResultStore& store, int schema,
+                  StoreBrowser& browser) {
+    browser.schema = schema;
+    browser.names = store.schemaParams(schema);
+    browser.values.assign(browser.names.size(), std::vector<float>());
+    browser.value_idx.assign(browser.names.size(), 0);
+    browser.lights.clear();
+    for (int i = 0; i < store.numRecords(); i++) {
+        const StoreRecord& r = store.record(i);
+        if (r.kind == STORE_SCHEMA || r.schema != schema ||
+            r.n_params != browser.names.size()) {
+            continue;
+        }
+        for (int p = 0; p < r.n_params; p++) {
+            browser.values[p].push_back(r.params[p]);
+        }
+        if (r.kind == STORE_LOBE) {
+            browser.lights.push_back(
+                glm::vec3(r.light[0], r.light[1], r.light[2]));
+        }
+    }
+    for (int p = 0; p < browser.values.size(); p++) {
+        std::vector<float>& v = browser.values[p];
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+    std::vector<glm::vec3>& l = browser.lights;
+    std::sort(l.begin(), l.end(), [](const glm::vec3& a, const glm::vec3& b) {
+        return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+    });
+    l.erase(std::unique(l.begin(), l.end()), l.end());
+}
+
+// Stored light nearest to a light position (zero when none)
+glm::vec3 nearestStoredLight(const StoreBrowser& browser,
+                             const glm::vec3& light_pos) {
+    const glm::vec3 light_dir = glm::normalize(light_pos);
+    glm::vec3 nearest(0.f);
+    float max_cos = -2.f;
+    for (int i = 0; i < browser.lights.size(); i++) {
+        const float c = glm::dot(light_dir, browser.lights[i]);
+        if (c > max_cos) {
+            max_cos = c;
+            nearest = browser.lights[i];
+        }
+    }
+    return nearest;
+}
+
+// Record of the chosen values and light, -1 if not stored (every frame,
+// without allocating)
+int findStoredRecord(const ResultStore& store, const StoreBrowser& browser,
+                     const glm::vec3& light_pos) {
+    const int n_params = (int)browser.values.size();
+    if (browser.schema < 0 || n_params > STORE_MAX_PARAMS) return -1;
+    float params[STORE_MAX_PARAMS];
+    for (int p = 0; p < n_params; p++) {
+        if (browser.values[p].empty()) return -1;
+        params[p] = browser.values[p][browser.value_idx[p]];
+    }
+    return store.find(browser.schema, params, n_params,
+                      nearestStoredLight(browser, light_pos));
+}
+
+// "lobe.ply" -> "lobe_<suffix>.ply"
+std::string exportPath(const std::string& path, const std::string& suffix) {
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return path + "_" + suffix;
+    return path.substr(0, dot) + "_" + suffix + path.substr(dot);
+}
+
+
 int main(int argc, char const* argv[]) {
+    // arguments
+    int bench_frames = 0;
+    int bench_warmup = 5;
+    std::string bench_script;
+    bool use_perf = false;
+    bool check_allocs = false;
+    bool fast_math = false;
+    int color_mode = VIEW_MONO;
+    bool channel_lobes = false;
+    std::vector<std::string> measured_files;
+    std::string tiled_path;
+    int tile_cache_mb = 256;
+    std::string store_path;
+    bool float_vertices = false;
+    bool strips = false;
+    bool use_light_cache = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench" && i + 1 < argc) {
+            bench_frames = atoi(argv[++i]);
+        } else if (arg == "--bench-script" && i + 1 < argc) {
+            bench_script = argv[++i];
+        } else if (arg == "--bench-warmup" && i + 1 < argc) {
+            bench_warmup = atoi(argv[++i]);
+        } else if (arg == "--perf") {
+            use_perf = true;
+        } else if (arg == "--bench-check-allocs") {
+            check_allocs = true;
+        } else if (arg == "--fast-math") {
+            fast_math = true;
+        } else if (arg == "--isa" && i + 1 < argc) {
+            int isa;
+            if (!simd::parseSimdIsa(argv[++i], isa)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            simd::setSimdIsa(isa);
+        } else if (arg == "--color" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "mono") {
+                color_mode = VIEW_MONO;
+            } else if (mode == "rgb") {
+                color_mode = VIEW_RGB;
+            } else if (mode == "spectral") {
+                color_mode = VIEW_SPECTRAL;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--channel-lobes") {
+            channel_lobes = true;
+        } else if (arg == "--tiled" && i + 1 < argc) {
+            tiled_path = argv[++i];
+        } else if (arg == "--tile-cache-mb" && i + 1 < argc) {
+            tile_cache_mb = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--store" && i + 1 < argc) {
+            store_path = argv[++i];
+        } else if (arg == "--float-vertices") {
+            float_vertices = true;
+        } else if (arg == "--strips") {
+            strips = true;
+        } else if (arg == "--light-cache") {
+            use_light_cache = true;
+        } else if (arg == "--merl" && i + 1 < argc) {
+            if (!listMeasuredFiles(argv[++i], measured_files)) {
+                std::cerr << "No measured BRDF files at " << argv[i]
+                          << std::endl;
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // benchmark
+    FrameBench* bench = NULL;
+    if (bench_frames > 0) {
+        std::vector<BenchState> states;
+        if (bench_script.empty()) {
+            defaultBenchScript(states);
+        } else if (!loadBenchScript(bench_script, states)) {
+            return 1;
+        }
+        bench = new FrameBench(states, bench_frames, bench_warmup);
+        std::cout << "* SIMD kernels: "
+                  << simd::simdIsaName(simd::getSimdIsa()) << std::endl;
+    }
+    PerfCounters perf;
+    if (bench && use_perf) {
+        if (perf.open()) {
+            bench->getProfiler().setPerfCounters(&perf);
+        } else {
+            std::cout << "* Hardware counters unavailable: "
+                      << perf.getError() << std::endl;
+        }
+    }
+
     // parameters
     glm::vec3 org_pos(0, 0, 0);
     glm::vec3 light_pos(0);
@@ -121,22 +412,66 @@ int main(int argc, char const* argv[]) {
     SpecularShader specular_shader;
     KajiyaKayShader kajiyakay_shader;
     AFMarschnerShader afmarschner_shader;
+    MeasuredShader measured_shader;
+    int measured_idx = 0;
+    if (!measured_files.empty() && !measured_shader.load(measured_files[0])) {
+        std::cerr << measured_shader.getError() << std::endl;
+    }
+    TiledShader tiled_shader;
+    if (!tiled_path.empty() &&
+        !tiled_shader.load(tiled_path, (size_t)tile_cache_mb << 20)) {
+        std::cerr << tiled_shader.getError() << std::endl;
+    }
+    // result store (lobes drawn from the mapping, tables through a shader)
+    ResultStore store;
+    StoreBrowser browser;
+    TiledShader stored_table_shader;
+    if (!store_path.empty()) {
+        if (!store.open(store_path)) {
+            std::cerr << store.getError() << std::endl;
+        } else if (store.numSchemas() > 0) {
+            browseSchema(store, 0, browser);
+        }
+        if (store.numInvalid() > 0) {
+            std::cerr << "Skipping " << store.numInvalid()
+                      << " lobe records of an invalid layout" << std::endl;
+        }
+    }
+    bool lobe_colors = false;
+    const ColorChannels rgb_channels;
+    const ColorChannels spectral_channels =
+        spectralChannels(N_VIEW_SPECTRAL);
     // shader array
     int shader_idx = 0;
     std::vector<BaseShader*> shaders{
         &specular_shader,
         &kajiyakay_shader,
         &afmarschner_shader,
+        &measured_shader,
+        &tiled_shader,
+        &stored_table_shader,
     };
     const char* shader_names[] = {
         "Specular Shader",
         "Kajiyakay Shader",
         "AF Marschner Shader",
+        "Measured (MERL)",
+        "Tabulated 4D",
+        "Stored sweep",
     };
+    // shaders with a tangent
+    const bool fiber_shaders[] = {false, true, true, false, true, false};
+    // default parameters restored on every scripted state
+    std::vector<std::unique_ptr<BaseShader> > bench_defaults;
+    if (bench) {
+        for (int i = 0; i < shaders.size(); i++) {
+            bench_defaults.emplace_back(shaders[i]->clone());
+        }
+    }
 
-    // gl window
+    // gl window (fixed size and hidden while benchmarking)
     GLWindow window(1024, 512);
-    bool gl_ret = window.init("title", true, 0);
+    bool gl_ret = window.init("title", bench == NULL, 0, bench == NULL);
     if (!gl_ret) return false;
 
     // camera
@@ -149,9 +484,100 @@ int main(int argc, char const* argv[]) {
     // imgui
     ImGui_ImplGlfw_Init(window.getRawRef(), false);
 
+    // directional albedo per parameter set (integrated in the background)
+    AlbedoCache albedo_cache;
+    AlbedoJob albedo_job;
+    const AlbedoSettings albedo_settings;
+
+    // meshes (retained over frames)
+    Mesh brdf_mesh;
+    Mesh channel_meshes[3];  // green and blue channels use [1] and [2]
+    Mesh ground_mesh;
+    // their vertex buffers (packed where the GL supports it)
+    GpuVertexFormat vertex_format;
+    vertex_format.half_positions = !float_vertices &&
+        (GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex);
+    vertex_format.packed_normals = !float_vertices;
+    // primitive restart
+    vertex_format.strips = strips && GLEW_VERSION_3_1;
+    if (strips && !vertex_format.strips) {
+        std::cerr << "No primitive restart (GL 3.1), drawing triangles"
+                  << std::endl;
+    }
+    GpuMesh brdf_gpu_mesh;
+    GpuMesh channel_gpu_meshes[3];
+    GpuMesh ground_gpu_mesh;
+    std::cout << "* Vertex format: "
+              << (vertex_format.half_positions ? "half" : "float")
+              << " positions, "
+              << (vertex_format.packed_normals ? "snorm8" : "float")
+              << " normals, "
+              << gpuVertexLayout(vertex_format, false).stride << " bytes, "
+              << (vertex_format.strips ? "strips" : "triangles")
+              << std::endl;
+
+    // mesh export (written on a background thread)
+    MeshExportJob export_job;
+    char export_path[256] = "lobe.ply";
+    bool export_quantize = false;
+    std::string export_status;
+
+    // small multiples, evaluated again when the shader or settings change
+    LobeGridRenderer grid_renderer;
+    LobeGridSettings grid_settings;
+    LobeGridSettings grid_computed;  // of lobe_grid
+    LobeGrid lobe_grid;
+    uint64_t grid_shader_hash = 0;
+    bool grid_view = false;
+    bool grid_normalize = false;
+    bool grid_uploaded_normalize = false;
+    std::string grid_status;
+
+    // lobes over light directions, interpolated while the light is dragged
+    LightLobeCache light_cache;
+    uint64_t light_cache_hash = 0;  // of the cached shader
+    bool light_dragging = false;
+    bool bench_dragging = false;  // scripted drag of the light
+    std::vector<float> light_lobe;  // interpolated intensities
+
     // rendering loop
     while (!window.shouldClose()) {
-        fps.update();
+        if (bench) {
+            if (bench->finished()) break;
+            // scripted state
+            if (bench->stateChanged()) {
+                const BenchState& state = bench->currentState();
+                shader_idx = glm::clamp(state.shader_idx, 0,
+                                        (int)shaders.size() - 1);
+                light_deg[0] = state.light_deg[0];
+                light_deg[1] = state.light_deg[1];
+                light_pos = lightPosFromDeg(light_deg);
+                for (int i = 0; i < shaders.size(); i++) {
+                    copyShaderParams(*shaders[i], *bench_defaults[i]);
+                }
+                for (int i = 0; i < state.params.size(); i++) {
+                    const std::string& name = state.params[i].first;
+                    if (!shaders[shader_idx]->setParam(
+                            name, state.params[i].second)) {
+                        std::cerr << "Unknown parameter: " << name
+                                  << std::endl;
+                    }
+                }
+                grid_view = state.grid_view;
+                if (grid_view && !grid_renderer.init()) {
+                    std::cerr << grid_renderer.getError() << std::endl;
+                    grid_view = false;
+                }
+                use_light_cache = state.light_cache;
+                bench_dragging = state.light_cache;
+                if (!use_light_cache) light_cache.stop();
+            }
+            // the light cache fills during the warmup frames
+            if (use_light_cache) light_cache.wait();
+            bench->beginFrame();
+        } else {
+            fps.update();
+        }
         window.active();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -159,35 +585,139 @@ int main(int argc, char const* argv[]) {
         setCameraMatrix(camera);
 
         // create mesh
-        Mesh brdf_mesh;  // brdf mesh
-        createBRDFMesh(brdf_mesh, *(shaders[shader_idx]), light_pos, 1.f, 100,
-                       normal);
-        Mesh ground_mesh;  // ground mesh
-        createGround(ground_mesh, 1);
+        shaders[shader_idx]->fast_math = fast_math;
+        const ColorChannels& channels =
+            (color_mode == VIEW_SPECTRAL) ? spectral_channels : rgb_channels;
+        // stored sweep: the record of the chosen values and light
+        const StoreRecord* stored = NULL;
+        if (shader_idx == 5) {
+            const int r = findStoredRecord(store, browser, light_pos);
+            stored = (r < 0) ? NULL : &store.record(r);
+            if (stored && stored->kind == STORE_TABLE &&
+                browser.table_record != r) {
+                if (!stored_table_shader.load(store.getPath(),
+                                              (size_t)tile_cache_mb << 20,
+                                              stored->offset)) {
+                    std::cerr << stored_table_shader.getError() << std::endl;
+                }
+                browser.table_record = r;
+            }
+        }
+        const bool stored_lobe = (shader_idx == 5) &&
+                                 (!stored || stored->kind == STORE_LOBE);
+        const bool draw_channels = (color_mode != VIEW_MONO &&
+                                    channel_lobes && !stored_lobe);
+        const bool draw_grid = grid_view && !stored_lobe;
+        if (draw_grid) {
+            grid_settings.light_phi_deg = light_deg[1];
+            BaseShader& shader = *(shaders[shader_idx]);
+            const uint64_t h = shaderHash(shader);
+            if (h != grid_shader_hash || grid_settings != grid_computed ||
+                grid_normalize != grid_uploaded_normalize) {
+                if (computeLobeGrid(shader, normal, grid_settings, lobe_grid,
+                                    grid_status)) {
+                    grid_renderer.upload(lobe_grid, grid_normalize);
+                    grid_status.clear();
+                }
+                grid_shader_hash = h;
+                grid_computed = grid_settings;
+                grid_uploaded_normalize = grid_normalize;
+            }
+        } else if (stored_lobe) {
+            const float* values = stored ? store.lobeValues(*stored) : NULL;
+            if (values) {
+                createStoredBRDFMesh(brdf_mesh, values, stored->n_values,
+                                     stored->values == SWEEP_LOBES, 1.f,
+                                     stored->n_phi, normal);
+            } else {
+                brdf_mesh.clear();
+            }
+        } else if (draw_channels) {
+            createBRDFChannelMeshes(channel_meshes, *(shaders[shader_idx]),
+                                    light_pos, 1.f, 100, channels, normal);
+        } else if (color_mode != VIEW_MONO) {
+            createBRDFColorMesh(brdf_mesh, *(shaders[shader_idx]), light_pos,
+                                1.f, 100, channels, normal);
+        } else if (shader_idx == 2 && lobe_colors) {
+            createBRDFLobeMesh(brdf_mesh, afmarschner_shader, light_pos, 1.f,
+                               100, normal);
+        } else {
+            // the cache follows the shader, exact lobes once the light stops
+            BaseShader& shader = *(shaders[shader_idx]);
+            bool interpolated = false;
+            if (use_light_cache) {
+                const uint64_t h = shaderHash(shader);
+                if (h != light_cache_hash || !light_cache.started()) {
+                    light_cache.start(shader, normal, 100, light_deg);
+                    light_cache_hash = h;
+                }
+                if (light_dragging) {
+                    PROFILE_SCOPE("interpolateLobe");
+                    light_lobe.resize(light_cache.numVertices());
+                    interpolated =
+                        light_cache.interpolate(light_deg, &light_lobe[0]);
+                }
+            }
+            if (interpolated) {
+                createStoredBRDFMesh(brdf_mesh, &light_lobe[0], 1, false,
+                                     1.f, 100, normal);
+            } else {
+                createBRDFMesh(brdf_mesh, shader, light_pos, 1.f, 100,
+                               normal);
+            }
+        }
+        {
+            PROFILE_SCOPE("createGround");
+            createGround(ground_mesh, 1);
+        }
 
         // draw meshes
-        drawMesh(brdf_mesh, glm::vec3(0.f, 1.f, 0.f));
-        drawMesh(ground_mesh, glm::vec3(0.5f));
+        if (draw_grid) {
+            PROFILE_SCOPE("drawLobeGrid");
+            grid_renderer.draw(camera.getViewMatrix(), window.getWidth(),
+                               window.getHeight(), glm::vec3(0.f, 1.f, 0.f));
+        } else {
+            PROFILE_SCOPE("drawMesh");
+            if (draw_channels) {
+                const glm::vec3 rgb[3] = {glm::vec3(1.f, 0.f, 0.f),
+                                          glm::vec3(0.f, 1.f, 0.f),
+                                          glm::vec3(0.f, 0.f, 1.f)};
+                for (int c = 0; c < 3; c++) {
+                    drawMesh(channel_meshes[c], channel_gpu_meshes[c],
+                             vertex_format, rgb[c]);
+                }
+            } else {
+                drawMesh(brdf_mesh, brdf_gpu_mesh, vertex_format,
+                         glm::vec3(0.f, 1.f, 0.f));
+            }
+            drawMesh(ground_mesh, ground_gpu_mesh, vertex_format,
+                     glm::vec3(0.5f));
+        }
         checkGlError(102);
 
-        // draw lines
-        // light
-        drawLine(org_pos, light_pos, 5.f, glm::vec3(1.f), 10.f);
-        // inverse light lines
-        glm::vec3 light_inv_pos = glm::reflect(org_pos - light_pos, normal)
-                                  + org_pos;
-        drawLine(org_pos, light_inv_pos, 5.f, glm::vec3(0.5f), 10.f);
-        // normal
-        drawLine(org_pos, normal, 5.f, glm::vec3(0.f, 1.f, 0.f), 10.f);
-        // tangent
-        if (shader_idx != 0) {
-            glm::vec3 neg_tangent = -tangent;
-            drawLine(neg_tangent, tangent, 10.f, glm::vec3(1.f, 0.3f, 0.1f), 13.f);
-        }
-        // binormal
-        if (shader_idx != 0) {
-            glm::vec3 binormal = glm::normalize(glm::cross(tangent, normal));
-            drawLine(org_pos, binormal, 5.f, glm::vec3(0.f, 0.f, 1.0f), 10.f);
+        // draw lines (single lobe)
+        if (!draw_grid) {
+            // light
+            drawLine(org_pos, light_pos, 5.f, glm::vec3(1.f), 10.f);
+            // inverse light lines
+            glm::vec3 light_inv_pos = glm::reflect(org_pos - light_pos, normal)
+                                      + org_pos;
+            drawLine(org_pos, light_inv_pos, 5.f, glm::vec3(0.5f), 10.f);
+            // normal
+            drawLine(org_pos, normal, 5.f, glm::vec3(0.f, 1.f, 0.f), 10.f);
+            // tangent
+            if (fiber_shaders[shader_idx]) {
+                glm::vec3 neg_tangent = -tangent;
+                drawLine(neg_tangent, tangent, 10.f,
+                         glm::vec3(1.f, 0.3f, 0.1f), 13.f);
+            }
+            // binormal
+            if (fiber_shaders[shader_idx]) {
+                glm::vec3 binormal =
+                    glm::normalize(glm::cross(tangent, normal));
+                drawLine(org_pos, binormal, 5.f, glm::vec3(0.f, 0.f, 1.0f),
+                         10.f);
+            }
         }
 
         // imgui
@@ -195,17 +725,28 @@ int main(int argc, char const* argv[]) {
         {
             ImGui::Text("BRDF View");
             ImGui::ListBox("Shader", &shader_idx, shader_names, shaders.size(),
-                           std::min((int)shaders.size(), 5));
+                           std::min((int)shaders.size(), 6));
             assert(0 <= shader_idx && shader_idx < shaders.size());
+            ImGui::Checkbox("Fast math", &fast_math);
+            ImGui::Combo("Color", &color_mode, "Mono\0RGB\0Spectral (8)\0\0");
+            if (color_mode != VIEW_MONO) {
+                ImGui::Checkbox("Per-channel lobes", &channel_lobes);
+            }
             // Light
             ImGui::DragFloat2("Light (deg)", light_deg, 1.f);
+            light_dragging = ImGui::IsItemActive() || bench_dragging;
             light_deg[0] = glm::clamp(light_deg[0], -180.f, 180.f);
             light_deg[1] = glm::clamp(light_deg[1], -180.f, 180.f);
-            float theta = light_deg[0] * glm::pi<float>() / 180.f;
-            float phi = light_deg[1] * glm::pi<float>() / 180.f;
-            light_pos[0] = sin(theta) * cos(phi) * LIGHT_LENGTH;
-            light_pos[1] = cos(theta) * LIGHT_LENGTH;
-            light_pos[2] = sin(theta) * sin(phi) * LIGHT_LENGTH;
+            light_pos = lightPosFromDeg(light_deg);
+            if (ImGui::Checkbox("Interpolate while dragging",
+                                &use_light_cache) && !use_light_cache) {
+                light_cache.stop();
+            }
+            if (use_light_cache && light_cache.started()) {
+                ImGui::Text("Light cache: %.0f%% (%.1f s)",
+                            light_cache.progress() * 100.f,
+                            light_cache.seconds());
+            }
             // shader parameters
             if (shader_idx == 0) {
                 // Specular
@@ -227,21 +768,234 @@ int main(int argc, char const* argv[]) {
                                  &(afmarschner_shader.hp->intensityTT), 0.01f);
                 ImGui::DragFloat("Intensity TRT",
                                  &(afmarschner_shader.hp->intensityTRT), 0.01f);
+                ImGui::DragFloat("Sigma a",
+                                 &(afmarschner_shader.hp->sigma_a), 0.01f);
+                ImGui::DragFloat3("Sigma a (RGB)",
+                                  &(afmarschner_shader.hp->sigma_a_rgb[0]),
+                                  0.01f);
+                ImGui::Checkbox("Lobe colors (R/TT/TRT)", &lobe_colors);
+            } else if (shader_idx == 3) {
+                // Measured (files stay mapped once opened)
+                if (measured_files.empty()) {
+                    ImGui::Text("No measured files (--merl <path>)");
+                } else {
+                    const int prev_idx = measured_idx;
+                    ImGui::Combo("Material", &measured_idx, measuredFileName,
+                                 &measured_files, measured_files.size(), 10);
+                    if (measured_idx != prev_idx &&
+                        !measured_shader.load(measured_files[measured_idx])) {
+                        std::cerr << measured_shader.getError() << std::endl;
+                    }
+                }
+                ImGui::DragFloat("Scale", &(measured_shader.scale), 0.01f);
+            } else if (shader_idx == 4) {
+                // Tabulated 4D (tiles read on demand)
+                tiled_shader.tangent = tangent;
+                if (!tiled_shader.loaded()) {
+                    ImGui::Text("No table (--tiled <file>)");
+                } else {
+                    const TileCacheStats stats = tiled_shader.getStats();
+                    ImGui::Text("Tiles: %d resident (%.1f MB)",
+                                stats.resident_tiles,
+                                stats.resident_bytes / 1048576.0);
+                    ImGui::Text("%llu misses, %llu prefetched",
+                                (unsigned long long)stats.misses,
+                                (unsigned long long)stats.prefetched);
+                }
+                ImGui::DragFloat("Scale", &(tiled_shader.scale), 0.01f);
+            } else if (shader_idx == 5) {
+                // Stored sweep (records of the nearest stored light)
+                if (store.numSchemas() == 0) {
+                    ImGui::Text("No stored sweep (--store <file>)");
+                } else {
+                    std::string items;
+                    for (int i = 0; i < store.numSchemas(); i++) {
+                        std::string name = store.schemaShader(i);
+                        const std::vector<std::string> params =
+                            store.schemaParams(i);
+                        for (int p = 0; p < params.size(); p++) {
+                            name += (p == 0 ? ": " : ", ") + params[p];
+                        }
+                        items += name + '\0';
+                    }
+                    int schema = browser.schema;
+                    ImGui::Combo("Sweep", &schema, (items + '\0').c_str());
+                    if (schema != browser.schema) {
+                        browseSchema(store, schema, browser);
+                    }
+                    for (int p = 0; p < browser.names.size(); p++) {
+                        const std::vector<float>& values = browser.values[p];
+                        if (values.empty()) continue;
+                        ImGui::SliderInt(browser.names[p].c_str(),
+                                         &browser.value_idx[p], 0,
+                                         (int)values.size() - 1, "");
+                        browser.value_idx[p] = glm::clamp(
+                            browser.value_idx[p], 0, (int)values.size() - 1);
+                        ImGui::SameLine();
+                        ImGui::Text("%g", values[browser.value_idx[p]]);
+                    }
+                    if (!browser.lights.empty()) {
+                        const glm::vec3 l =
+                            nearestStoredLight(browser, light_pos);
+                        ImGui::Text("Stored light: %.1f, %.1f deg",
+                                    glm::degrees(std::acos(glm::clamp(
+                                        l.y, -1.f, 1.f))),
+                                    glm::degrees(std::atan2(l.z, l.x)));
+                    }
+                    if (!stored) {
+                        ImGui::Text("Not stored");
+                    } else if (stored->kind == STORE_TABLE) {
+                        ImGui::DragFloat("Scale",
+                                         &(stored_table_shader.scale), 0.01f);
+                    }
+                }
+            }
+            // energy conservation
+            if (ImGui::CollapsingHeader("Albedo")) {
+                BaseShader& shader = *(shaders[shader_idx]);
+                albedo_job.finished(albedo_cache);
+                if (albedo_job.busy()) {
+                    ImGui::Text("Computing albedo...");
+                } else if (ImGui::Button("Compute albedo")) {
+                    albedo_job.start(shader, albedo_settings);
+                }
+                const AlbedoResult* albedo =
+                    albedo_cache.find(shader, albedo_settings);
+                if (albedo) {
+                    ImGui::PlotLines("Albedo (0-90 deg)", &albedo->albedo[0],
+                                     albedo->albedo.size(), 0, NULL, 0.f,
+                                     std::max(albedo->max_albedo, 1.f),
+                                     ImVec2(0, 80));
+                    ImGui::Text("White furnace: %.4f +- %.1e",
+                                albedo->furnace, albedo->furnace_error);
+                    ImGui::Text("Max %.4f at %.0f deg (%s)",
+                                albedo->max_albedo, albedo->max_angle_deg,
+                                albedo->conserving ? "conserving"
+                                                   : "NOT conserving");
+                    ImGui::Text("%.2f s", albedo->seconds);
+                } else {
+                    ImGui::Text("Not computed for these parameters");
+                }
+            }
+            // lobes side by side: rows vary a parameter, columns the light
+            if (ImGui::CollapsingHeader("Small multiples")) {
+                if (ImGui::Checkbox("Grid view", &grid_view) && grid_view &&
+                    !grid_renderer.init()) {
+                    grid_status = grid_renderer.getError();
+                    std::cerr << grid_status << std::endl;
+                    grid_view = false;
+                }
+                std::vector<ShaderParam> params;
+                shaders[shader_idx]->getParams(params);
+                std::vector<const char*> param_names(1, "(none)");
+                int param_idx = 0;
+                for (int i = 0; i < params.size(); i++) {
+                    param_names.push_back(params[i].name);
+                    if (grid_settings.param == params[i].name) {
+                        param_idx = i + 1;
+                    }
+                }
+                // not a parameter of this shader
+                if (param_idx == 0) grid_settings.param.clear();
+                if (ImGui::Combo("Row parameter", &param_idx,
+                                 &param_names[0], param_names.size()) &&
+                    param_idx > 0) {
+                    // around the current value
+                    const float v = *(params[param_idx - 1].value);
+                    grid_settings.param = param_names[param_idx];
+                    grid_settings.param_min = (v != 0.f) ? 0.5f * v : 0.f;
+                    grid_settings.param_max = (v != 0.f) ? 1.5f * v : 1.f;
+                } else if (param_idx == 0) {
+                    grid_settings.param.clear();
+                }
+                if (param_idx > 0) {
+                    ImGui::DragFloat2("Row range", &grid_settings.param_min,
+                                      0.01f);
+                }
+                ImGui::DragFloat2("Light theta range",
+                                  &grid_settings.theta_min_deg, 1.f, -180.f,
+                                  180.f);
+                ImGui::SliderInt("Rows", &grid_settings.n_rows, 1, 8);
+                ImGui::SliderInt("Columns", &grid_settings.n_cols, 1, 12);
+                ImGui::SliderInt("Lobe n_phi", &grid_settings.n_phi, 8, 100);
+                ImGui::Checkbox("Normalize each lobe", &grid_normalize);
+                if (grid_view && lobe_grid.numLobes() > 0) {
+                    ImGui::Text("%d lobes in %.1f ms, max %.3g",
+                                lobe_grid.numLobes(),
+                                lobe_grid.seconds * 1000.0,
+                                lobe_grid.max_intensity);
+                }
+                if (!grid_status.empty()) {
+                    ImGui::Text("%s", grid_status.c_str());
+                }
+            }
+            // lobe and ground meshes as drawn
+            if (ImGui::CollapsingHeader("Export")) {
+                ImGui::InputText("File (.ply/.obj)", export_path,
+                                 sizeof(export_path));
+                ImGui::Checkbox("Quantize (PLY)", &export_quantize);
+                const bool lobe = ImGui::Button("Export lobe");
+                ImGui::SameLine();
+                const bool ground = ImGui::Button("Export ground");
+                MeshExportOptions options;
+                options.format = meshFormatOfPath(export_path);
+                options.quantize = export_quantize;
+                if ((lobe || ground) && options.format < 0) {
+                    export_status = "Not a .ply or .obj file";
+                } else if ((lobe || ground) && export_job.busy()) {
+                    export_status = "Export in progress";
+                } else if (ground) {
+                    const std::string path =
+                        exportPath(export_path, "ground");
+                    export_job.start(&ground_mesh, &path, 1, options);
+                } else if (lobe && draw_channels) {
+                    const std::string paths[3] = {
+                        exportPath(export_path, "r"),
+                        exportPath(export_path, "g"),
+                        exportPath(export_path, "b")};
+                    export_job.start(channel_meshes, paths, 3, options);
+                } else if (lobe) {
+                    const std::string path = export_path;
+                    export_job.start(&brdf_mesh, &path, 1, options);
+                }
+                bool ok;
+                if (export_job.finished(ok, export_status) && !ok) {
+                    std::cerr << export_status << std::endl;
+                }
+                ImGui::Text("%s", export_job.busy() ? "Exporting..."
+                                                    : export_status.c_str());
             }
         }
-        ImGui::Render();
+        {
+            PROFILE_SCOPE("imgui");
+            ImGui::Render();
+        }
         checkGlError(103);
 
         // Check input type
         updateIO(window);
 
         // show
-        window.update();
+        {
+            PROFILE_SCOPE("swap");
+            if (bench) glFinish();  // count the GPU work of this frame
+            window.update();
+        }
+        if (bench) bench->endFrame();
+    }
+
+    // report
+    int ret = 0;
+    if (bench) {
+        bench->report(std::cout);
+        reportVertexCache(std::cout, 100, vertex_format.strips);
+        if (check_allocs && !bench->checkZeroAlloc(std::cout)) ret = 1;
+        delete bench;
     }
 
     // exit
     std::cout << "* Exit" << std::endl;
     ImGui_ImplGlfw_Shutdown();
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,291 @@
+#include "measured.h"
+#include "tabulated.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "simd/coord_kernels.h"
+
+namespace {
+
+const int MERL_TABLE_SIZE = MERL_THETA_H * MERL_THETA_D * MERL_PHI_D;
+const size_t MERL_HEADER_BYTES = 3 * sizeof(int32_t);
+const double MERL_SCALE[3] = {1.0 / 1500.0, 1.15 / 1500.0, 1.66 / 1500.0};
+
+// Unaligned double of the table (the header is 12 bytes)
+inline double merlValue(const unsigned char* table, int idx) {
+    double v;
+    memcpy(&v, table + (size_t)idx * sizeof(double), sizeof(double));
+    return v;
+}
+
+// Samples and weights at x, clamped to [0, n - 1]
+inline void clampedLerp(float x, int n, int* i, float* w) {
+    x = glm::clamp(x, 0.f, (float)(n - 1));
+    i[0] = std::min((int)x, n - 1);
+    i[1] = std::min(i[0] + 1, n - 1);
+    w[1] = x - i[0];
+    w[0] = 1.f - w[1];
+}
+
+bool hasSuffix(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::mutex measured_cache_mutex;
+std::map<std::string, std::shared_ptr<const MeasuredBRDF> > measured_cache;
+
+} // namespace
+
+void halfDiffCorners(int n_h, int n_d, int n_p, float theta_h, float theta_d,
+                     float phi_d, HalfDiffCorners& corners) {
+    const float half_pi = 0.5f * glm::pi<float>();
+    const float h = (theta_h > 0.f) ? std::sqrt(theta_h / half_pi) * n_h : 0.f;
+    clampedLerp(h, n_h, corners.h, corners.wh);
+    clampedLerp(theta_d / half_pi * n_d, n_d, corners.d, corners.wd);
+    // reciprocity: phi_d and phi_d + pi are the same sample (wraps around)
+    if (phi_d < 0.f) phi_d += glm::pi<float>();
+    const float p = phi_d / glm::pi<float>() * n_p;
+    corners.p[0] = glm::clamp((int)p, 0, n_p - 1);
+    corners.p[1] = (corners.p[0] + 1) % n_p;
+    corners.wp[1] = glm::clamp(p - corners.p[0], 0.f, 1.f);
+    corners.wp[0] = 1.f - corners.wp[1];
+}
+
+// === MerlBRDF ===
+bool MerlBRDF::open(const std::string& path) {
+    this->tables = NULL;
+    if (!this->file.open(path, true)) {
+        this->error = this->file.getError();
+        return false;
+    }
+    const size_t expected =
+        MERL_HEADER_BYTES + 3 * (size_t)MERL_TABLE_SIZE * sizeof(double);
+    int32_t dims[3] = {0, 0, 0};
+    if (this->file.getSize() >= MERL_HEADER_BYTES) {
+        memcpy(dims, this->file.getData(), sizeof(dims));
+    }
+    if (dims[0] != MERL_THETA_H || dims[1] != MERL_THETA_D ||
+        dims[2] != MERL_PHI_D || this->file.getSize() != expected) {
+        this->error = "Not a MERL BRDF file: " + path;
+        this->file.close();
+        return false;
+    }
+    this->tables =
+        (const unsigned char*)this->file.getData() + MERL_HEADER_BYTES;
+    return true;
+}
+
+glm::vec3 MerlBRDF::lookup(float theta_h, float theta_d, float phi_d) const {
+    if (!this->tables) return glm::vec3(0.f);
+    HalfDiffCorners cs;
+    halfDiffCorners(MERL_THETA_H, MERL_THETA_D, MERL_PHI_D, theta_h, theta_d,
+                    phi_d, cs);
+    double rgb[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < 8; i++) {
+        const int a = i >> 2, b = (i >> 1) & 1, c = i & 1;
+        const float w = cs.wh[a] * cs.wd[b] * cs.wp[c];
+        if (w == 0.f) continue;
+        const int idx = (cs.h[a] * MERL_THETA_D + cs.d[b]) * MERL_PHI_D +
+                        cs.p[c];
+        for (int c = 0; c < 3; c++) {
+            const double v = merlValue(this->tables, c * MERL_TABLE_SIZE + idx);
+            if (v > 0.0) rgb[c] += w * v;  // negative: not measured
+        }
+    }
+    return glm::vec3((float)(rgb[0] * MERL_SCALE[0]),
+                     (float)(rgb[1] * MERL_SCALE[1]),
+                     (float)(rgb[2] * MERL_SCALE[2]));
+}
+
+float MerlBRDF::value(int channel, int h, int d, int p) const {
+    if (!this->tables) return 0.f;
+    const int idx = (h * MERL_THETA_D + d) * MERL_PHI_D + p;
+    return (float)(merlValue(this->tables, channel * MERL_TABLE_SIZE + idx) *
+                   MERL_SCALE[channel]);
+}
+
+std::shared_ptr<const MeasuredBRDF> openMeasuredBRDF(const std::string& path,
+                                                    std::string& error) {
+    std::lock_guard<std::mutex> lock(measured_cache_mutex);
+    std::map<std::string, std::shared_ptr<const MeasuredBRDF> >::iterator it =
+        measured_cache.find(path);
+    if (it != measured_cache.end()) return it->second;
+    std::shared_ptr<const MeasuredBRDF> brdf;
+    bool ok;
+    if (isTabulatedBRDF(path)) {
+        TabulatedBRDF* tab = new TabulatedBRDF();
+        brdf.reset(tab);
+        ok = tab->open(path);
+        if (!ok) error = tab->getError();
+    } else {
+        MerlBRDF* merl = new MerlBRDF();
+        brdf.reset(merl);
+        ok = merl->open(path);
+        if (!ok) error = merl->getError();
+    }
+    if (!ok) return std::shared_ptr<const MeasuredBRDF>();
+    measured_cache[path] = brdf;
+    return brdf;
+}
+
+bool listMeasuredFiles(const std::string& path,
+                       std::vector<std::string>& files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    if (!S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return true;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return false;
+    std::vector<std::string> found;
+    for (struct dirent* e = readdir(dir); e; e = readdir(dir)) {
+        const std::string name = e->d_name;
+        if (hasSuffix(name, ".binary") || hasSuffix(name, ".btab")) {
+            found.push_back(path + "/" + name);
+        }
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return true;
+}
+
+// === Rusinkiewicz angles ===
+bool halfDiffAngles(const glm::vec3& in_dir, const glm::vec3& out_dir,
+                    const glm::vec3& normal, float& theta_h, float& theta_d,
+                    float& phi_d) {
+    glm::vec3 s, t;
+    makeFrame(normal, s, t);
+    // local frame, z up
+    const glm::vec3 wi(glm::dot(in_dir, s), glm::dot(in_dir, t),
+                       glm::dot(in_dir, normal));
+    const glm::vec3 wo(glm::dot(out_dir, s), glm::dot(out_dir, t),
+                       glm::dot(out_dir, normal));
+    if (wi[2] <= 0.f || wo[2] <= 0.f) return false;
+    const glm::vec3 h = glm::normalize(wi + wo);
+    // rotations by -phi_h around z and -theta_h around y, without
+    // trigonometry: sin / cos of the half vector angles
+    const float sin_h = std::sqrt(h[0] * h[0] + h[1] * h[1]);
+    float cos_phi = 1.f, sin_phi = 0.f;
+    if (sin_h > 1e-7f) {
+        cos_phi = h[0] / sin_h;
+        sin_phi = h[1] / sin_h;
+    }
+    const glm::vec3 u(h[2] * cos_phi, h[2] * sin_phi, -sin_h);
+    const glm::vec3 v(-sin_phi, cos_phi, 0.f);
+    const float dx = glm::dot(wi, u);
+    const float dy = glm::dot(wi, v);
+    const float dz = glm::dot(wi, h);
+    theta_h = std::acos(glm::clamp(h[2], -1.f, 1.f));
+    theta_d = std::acos(glm::clamp(dz, -1.f, 1.f));
+    phi_d = std::atan2(dy, dx);
+    return true;
+}
+
+// === MeasuredShader ===
+const std::string& MeasuredShader::getPath() const {
+    static const std::string none;
+    return this->brdf ? this->brdf->getPath() : none;
+}
+
+bool MeasuredShader::load(const std::string& path) {
+    std::shared_ptr<const MeasuredBRDF> brdf =
+        openMeasuredBRDF(path, this->error);
+    if (!brdf) return false;
+    this->brdf = brdf;
+    return true;
+}
+
+glm::vec3 MeasuredShader::sampleRGB(const glm::vec3& light_dir,
+                                    const glm::vec3& out_dir,
+                                    const glm::vec3& normal) const {
+    float theta_h, theta_d, phi_d;
+    if (!this->brdf ||
+        !halfDiffAngles(light_dir, out_dir, normal, theta_h, theta_d, phi_d)) {
+        return glm::vec3(0.f);
+    }
+    return this->scale * this->brdf->lookup(theta_h, theta_d, phi_d);
+}
+
+float MeasuredShader::sample(const glm::vec3& light_dir,
+                             const glm::vec3& out_dir,
+                             const glm::vec3& normal) {
+    const glm::vec3 rgb = this->sampleRGB(light_dir, out_dir, normal);
+    return (rgb[0] + rgb[1] + rgb[2]) / 3.f;
+}
+
+void MeasuredShader::sampleRGBBlock(const glm::vec3& light_dir,
+                                    const glm::vec3* out_dirs,
+                                    const glm::vec3& normal, glm::vec3* rgb,
+                                    int n) const {
+    if (!this->brdf) {
+        std::fill(rgb, rgb + n, glm::vec3(0.f));
+        return;
+    }
+    float x[RGB_BLOCK], y[RGB_BLOCK], z[RGB_BLOCK];
+    float theta_h[RGB_BLOCK], theta_d[RGB_BLOCK], phi_d[RGB_BLOCK];
+    simd::splitDirs(out_dirs, n, x, y, z);
+    simd::HalfDiffKernelArgs args;
+    makeFrame(normal, args.frame.s, args.frame.t);
+    args.frame.n = normal;
+    args.in_dir = light_dir;
+    simd::HalfDiffAngles angles;
+    angles.theta_h = theta_h;
+    angles.phi_h = NULL;
+    angles.theta_d = theta_d;
+    angles.phi_d = phi_d;
+    const int tier = this->fast_math ? simd::MATH_FAST : simd::MATH_ACCURATE;
+    simd::getCoordKernels().half_diff[tier](args, simd::DirBlock(x, y, z),
+                                            angles, n);
+    for (int i = 0; i < n; i++) {
+        rgb[i] = (theta_h[i] < 0.f) ? glm::vec3(0.f) : this->scale *
+            this->brdf->lookup(theta_h[i], theta_d[i], phi_d[i]);
+    }
+}
+
+void MeasuredShader::sampleBatch(const glm::vec3& light_dir,
+                                 const glm::vec3* out_dirs,
+                                 const glm::vec3& normal, float* out, int n) {
+    glm::vec3 rgb[RGB_BLOCK];
+    for (int i0 = 0; i0 < n; i0 += RGB_BLOCK) {
+        const int m = std::min(RGB_BLOCK, n - i0);
+        this->sampleRGBBlock(light_dir, out_dirs + i0, normal, rgb, m);
+        for (int i = 0; i < m; i++) {
+            out[i0 + i] = (rgb[i][0] + rgb[i][1] + rgb[i][2]) / 3.f;
+        }
+    }
+}
+
+void MeasuredShader::sampleColorBatch(const glm::vec3& light_dir,
+                                      const glm::vec3* out_dirs,
+                                      const glm::vec3& normal,
+                                      const ColorChannels& channels,
+                                      float* out, int n) {
+    int bands[MAX_COLOR_CHANNELS];
+    const int nc = channels.n;
+    for (int c = 0; c < nc; c++) bands[c] = channelBand(channels, c);
+    glm::vec3 rgb[RGB_BLOCK];
+    for (int i0 = 0; i0 < n; i0 += RGB_BLOCK) {
+        const int m = std::min(RGB_BLOCK, n - i0);
+        this->sampleRGBBlock(light_dir, out_dirs + i0, normal, rgb, m);
+        for (int i = 0; i < m; i++) {
+            for (int c = 0; c < nc; c++) {
+                out[(i0 + i) * nc + c] = rgb[i][bands[c]];
+            }
+        }
+    }
+}
+
+void MeasuredShader::getParams(std::vector<ShaderParam>& params) {
+    params.push_back(ShaderParam("scale", &this->scale));
+}
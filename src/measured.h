@@ -0,0 +1,113 @@
+#ifndef MEASURED_H_261018
+#define MEASURED_H_261018
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "io/mapped_file.h"
+#include "shader.h"
+
+// Tables over the Rusinkiewicz angles (theta_half, theta_diff, phi_diff) as
+// in the MERL database: theta_half is indexed non-linearly (sqrt of the
+// angle), phi_diff over [0, pi) by reciprocity.
+const int MERL_THETA_H = 90;
+const int MERL_THETA_D = 90;
+const int MERL_PHI_D = 180;
+
+// Trilinear corners on a (n_h, n_d, n_p) table of that parameterization:
+// cell (h[i], d[j], p[k]) has the weight wh[i] * wd[j] * wp[k]
+struct HalfDiffCorners {
+    int h[2], d[2], p[2];
+    float wh[2], wd[2], wp[2];
+};
+void halfDiffCorners(int n_h, int n_d, int n_p, float theta_h, float theta_d,
+                     float phi_d, HalfDiffCorners& corners);
+
+// Isotropic measured BRDF, read-only (shared between threads)
+class MeasuredBRDF {
+public:
+    virtual ~MeasuredBRDF() {}
+    // RGB reflectance at the Rusinkiewicz angles, trilinear between the
+    // table samples (missing samples count as zero)
+    virtual glm::vec3 lookup(float theta_h, float theta_d,
+                             float phi_d) const = 0;
+    virtual const std::string& getPath() const = 0;
+};
+
+// MERL BRDF database file (.binary): int32 dimensions (90, 90, 180), then
+// the red, green and blue tables of doubles
+class MerlBRDF : public MeasuredBRDF {
+public:
+    MerlBRDF() : tables(NULL) {}
+    // Maps the file and checks its header and size (no table is read)
+    bool open(const std::string& path);
+    virtual glm::vec3 lookup(float theta_h, float theta_d, float phi_d) const;
+    // Scaled reflectance of a table cell, negative when not measured
+    float value(int channel, int h, int d, int p) const;
+    virtual const std::string& getPath() const { return file.getPath(); }
+    const std::string& getError() const { return error; }
+
+private:
+    MappedFile file;
+    const unsigned char* tables;  // 4 byte aligned in the file
+    std::string error;
+};
+
+// Measured BRDF file of `path` (MERL or tabulated.h format, by its
+// header), shared and kept open for the process: opening a material again
+// (switching back and forth) does not map or read it again. Thread safe.
+// NULL with `error` on failure.
+std::shared_ptr<const MeasuredBRDF> openMeasuredBRDF(const std::string& path,
+                                                    std::string& error);
+// `path` itself or the .binary and .btab files in the directory `path`,
+// sorted
+bool listMeasuredFiles(const std::string& path,
+                       std::vector<std::string>& files);
+
+// Rusinkiewicz half / difference angles of (in_dir, out_dir) around the
+// normal (isotropic: the tangent is arbitrary). False below the horizon.
+bool halfDiffAngles(const glm::vec3& in_dir, const glm::vec3& out_dir,
+                    const glm::vec3& normal, float& theta_h, float& theta_d,
+                    float& phi_d);
+
+// Measured isotropic BRDF (openMeasuredBRDF()). Unloaded shaders return
+// zero. Clones share the mapping.
+class MeasuredShader : public BaseShader {
+public:
+    MeasuredShader() : scale(1.f) {}
+    // False (with getError()) keeps the current material
+    bool load(const std::string& path);
+    bool loaded() const { return (bool)brdf; }
+    const std::string& getPath() const;  // empty when not loaded
+    const std::string& getError() const { return error; }
+
+    virtual BaseShader* clone() const { return new MeasuredShader(*this); }
+    // Mean of the RGB reflectance
+    virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                         const glm::vec3& normal);
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    // RGB, spectral samples take the channel of their band (channelBand())
+    virtual void sampleColorBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal,
+                                  const ColorChannels& channels, float* out,
+                                  int n);
+    virtual void getParams(std::vector<ShaderParam>& params);
+    float scale;  // exposure of the data
+
+private:
+    glm::vec3 sampleRGB(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                        const glm::vec3& normal) const;
+    // RGB of n <= RGB_BLOCK directions (angles by the batched kernels)
+    static const int RGB_BLOCK = 256;
+    void sampleRGBBlock(const glm::vec3& light_dir, const glm::vec3* out_dirs,
+                        const glm::vec3& normal, glm::vec3* rgb, int n) const;
+
+    std::shared_ptr<const MeasuredBRDF> brdf;
+    std::string error;
+};
+
+#endif
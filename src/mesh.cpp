@@ -1,10 +1,19 @@
 #include "mesh.h"
 
+#include <map>
+#include <mutex>
+
+#include "bench/profiler.h"
+#include "simd/mesh_kernels.h"
+
 
 void updateNormals(Mesh& mesh) {
+    PROFILE_SCOPE_N("updateNormals", mesh.vertices.size());
     std::vector<glm::uvec3> &indices = mesh.indices;
     std::vector<glm::vec3> &vertices = mesh.vertices;
     std::vector<glm::vec3> &normals = mesh.normals;
+    std::vector<int> &normals_weight = mesh.normals_weight;
+    std::vector<glm::vec3> &face_normals = mesh.face_normals;
 
     // initialize normals
     normals.resize(vertices.size());
@@ -12,21 +21,22 @@ void updateNormals(Mesh& mesh) {
         normals[i] = glm::vec3(0.f, 0.f, 0.f);
     }
     // initialize normals weight
-    std::vector<int> normals_weight(vertices.size());
+    normals_weight.resize(vertices.size());
     for (int i = 0; i < normals_weight.size(); i++) {
         normals_weight[i] = 0;
     }
+    // face normals (SIMD)
+    face_normals.resize(indices.size());
+    if (!indices.empty()) {
+        simd::getMeshKernels().face_normals(&vertices[0], &indices[0],
+                                            &face_normals[0], indices.size());
+    }
     // compute normals based on the faces
     for (int tri_idx = 0; tri_idx < indices.size(); tri_idx++) {
         unsigned int v_idx0 = indices[tri_idx][0];
         unsigned int v_idx1 = indices[tri_idx][1];
         unsigned int v_idx2 = indices[tri_idx][2];
-        glm::vec3 v0 = vertices[v_idx0];
-        glm::vec3 v1 = vertices[v_idx1];
-        glm::vec3 v2 = vertices[v_idx2];
-        glm::vec3 e1 = v1 - v0;
-        glm::vec3 e2 = v2 - v0;
-        glm::vec3 n = glm::normalize(glm::cross(e1, e2));
+        const glm::vec3& n = face_normals[tri_idx];
         // accumulate normals
         normals[v_idx0] += n;
         normals[v_idx1] += n;
@@ -67,13 +77,125 @@ void createGround(Mesh& mesh, float scale, float eps) {
 }
 
 
-// Create intensity sphere
-void createBRDFMesh(Mesh& mesh, BaseShader& shader, const glm::vec3& light_pos,
-                    float scale, int n_phi, const glm::vec3& up_dir) {
-    mesh.clear();
+namespace {
 
-    glm::vec3 light_dir = glm::normalize(light_pos);
+// Triangles of the sphere, phi column by phi column with the pole fans
+void gridTriangles(int n_phi, int n_theta, std::vector<glm::uvec3>& indices) {
+    for (int i_phi = 0; i_phi < n_phi; i_phi++) {
+        int i_phi2 = (i_phi + 1) % n_phi; // rotation
+
+        for (int i_theta = 0; i_theta < n_theta; i_theta++) {
+            int i_theta2 = i_theta + 1;
+
+            // bottom
+            if (i_theta == 0) {
+                unsigned int idx0 = n_phi * n_theta; // bottom
+                unsigned int idx1 = i_phi2 * n_theta + i_theta;
+                unsigned int idx2 = i_phi * n_theta + i_theta;
+                glm::uvec3 triangle0(idx0, idx1, idx2);
+                indices.push_back(triangle0);
+            }
+
+            if (i_theta2 != n_theta) {
+                unsigned int idx0 = i_phi * n_theta + i_theta;
+                unsigned int idx1 = i_phi2 * n_theta + i_theta;
+                unsigned int idx2 = i_phi * n_theta + i_theta2;
+                unsigned int idx3 = i_phi2 * n_theta + i_theta2;
 
+                glm::uvec3 triangle0(idx0, idx1, idx2); // counterclock-wise
+                glm::uvec3 triangle1(idx1, idx3, idx2);
+                indices.push_back(triangle0);
+                indices.push_back(triangle1);
+            } else {
+                // top
+                unsigned int idx0 = i_phi * n_theta + i_theta;
+                unsigned int idx1 = i_phi2 * n_theta + i_theta;
+                unsigned int idx2 = n_phi * n_theta + 1; // top
+
+                glm::uvec3 triangle0(idx0, idx1, idx2);
+                indices.push_back(triangle0);
+            }
+        }
+    }
+}
+
+// The same triangles as one strip per phi column. The repeated vertex after
+// the bottom triangle is a degenerate triangle that fixes the winding.
+void gridStrips(int n_phi, int n_theta, std::vector<unsigned int>& strips) {
+    const unsigned int bottom = n_phi * n_theta, top = n_phi * n_theta + 1;
+    for (int i_phi = 0; i_phi < n_phi; i_phi++) {
+        const unsigned int col = i_phi * n_theta;
+        const unsigned int col2 = ((i_phi + 1) % n_phi) * n_theta;
+        strips.push_back(bottom);
+        strips.push_back(col2);
+        strips.push_back(col);
+        strips.push_back(col2);
+        for (int i_theta = 1; i_theta < n_theta; i_theta++) {
+            strips.push_back(col + i_theta);
+            strips.push_back(col2 + i_theta);
+        }
+        strips.push_back(top);
+        if (i_phi + 1 < n_phi) strips.push_back(RESTART_INDEX);
+    }
+}
+
+void initBRDFGridTopology(BRDFGridTopology& topology, int n_phi) {
+    const int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    topology.n_phi = n_phi;
+    topology.n_theta = n_theta;
+    topology.n_vertices = n_phi * n_theta + 2;
+    std::vector<glm::uvec3>& triangles = topology.triangles;
+    gridTriangles(n_phi, n_theta, triangles);
+    if (triangles.empty()) return;
+    topology.grid_stats = simulateVertexCache(
+        (const unsigned int*)&triangles[0], triangles.size() * 3,
+        topology.n_vertices);
+    optimizeVertexCache(triangles, topology.n_vertices);
+    topology.list_stats = simulateVertexCache(
+        (const unsigned int*)&triangles[0], triangles.size() * 3,
+        topology.n_vertices);
+    gridStrips(n_phi, n_theta, topology.strips);
+    topology.strip_stats = simulateVertexCache(
+        &topology.strips[0], topology.strips.size(), topology.n_vertices,
+        true);
+}
+
+// Sphere of sampling directions (vertices) and its triangles
+void initBRDFGrid(Mesh& mesh, float scale, int n_phi, int n_theta,
+                  const glm::vec3& up_dir) {
+    // vertices
+    brdfGridDirections(mesh.vertices, scale, n_phi, up_dir);
+
+    // indices
+    const BRDFGridTopology& topology = brdfGridTopology(n_phi);
+    mesh.indices.assign(topology.triangles.begin(),
+                        topology.triangles.end());
+    mesh.strips = &topology.strips;
+}
+
+// Scale the directions by the sampled intensities
+void applyIntensities(Mesh& mesh) {
+    if (mesh.vertices.empty()) return;
+    simd::getMeshKernels().scale_vec3(&mesh.vertices[0],
+                                      &mesh.intensities[0],
+                                      mesh.vertices.size());
+}
+
+// Color evaluation of the grid directions into mesh.channel_samples
+void sampleColors(Mesh& mesh, BaseShader& shader, const glm::vec3& light_dir,
+                  const ColorChannels& channels, const glm::vec3& up_dir) {
+    const int n_vertices = mesh.vertices.size();
+    mesh.channel_samples.resize(n_vertices * channels.n);
+    PROFILE_SCOPE_N("sampleColorBatch", n_vertices);
+    shader.sampleColorBatch(light_dir, &mesh.vertices[0], up_dir, channels,
+                            &mesh.channel_samples[0], n_vertices);
+}
+
+} // namespace
+
+
+void brdfGridDirections(std::vector<glm::vec3>& directions, float scale,
+                        int n_phi, const glm::vec3& up_dir) {
     // y direction step
     int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
 
@@ -87,7 +209,7 @@ void createBRDFMesh(Mesh& mesh, BaseShader& shader, const glm::vec3& light_pos,
     }
 
     // vertices
-    mesh.vertices.resize(n_phi * n_theta + 2);
+    directions.resize(n_phi * n_theta + 2);
     for (int i_phi = 0; i_phi < n_phi; i_phi++) {
         float phi_rad = 2.0 * glm::pi<float>() * i_phi / n_phi;
 
@@ -101,62 +223,200 @@ void createBRDFMesh(Mesh& mesh, BaseShader& shader, const glm::vec3& light_pos,
             float y = scale * sin(theta_rad);
             float z = scale * cos(theta_rad) * cos(phi_rad);
             glm::vec3 pos = glm::mat3(rot) * glm::vec3(x, y, z); // rotation
-            // sampling
-            float intensity = shader.sample(light_dir, pos, up_dir);
-            // set
-            mesh.vertices[i_phi * n_theta + i_theta] = pos * intensity;
+            directions[i_phi * n_theta + i_theta] = pos;
         }
     }
+    // the bottom one
+    directions[n_phi * n_theta] = glm::mat3(rot) * glm::vec3(0, -scale, 0);
+    // the top one
+    directions[n_phi * n_theta + 1] = glm::mat3(rot) * glm::vec3(0, scale, 0);
+}
+
+const BRDFGridTopology& brdfGridTopology(int n_phi) {
+    static std::mutex mutex;
+    static std::map<int, BRDFGridTopology> topologies;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<int, BRDFGridTopology>::iterator it = topologies.find(n_phi);
+    if (it == topologies.end()) {
+        PROFILE_SCOPE("brdfGridTopology");
+        it = topologies.insert(
+            std::make_pair(n_phi, BRDFGridTopology())).first;
+        initBRDFGridTopology(it->second, n_phi);
+    }
+    return it->second;
+}
+
+
+// Create intensity sphere
+void createBRDFMesh(Mesh& mesh, BaseShader& shader, const glm::vec3& light_pos,
+                    float scale, int n_phi, const glm::vec3& up_dir) {
+    // y direction step
+    int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    const int n_vertices = n_phi * n_theta + 2;
+
+    PROFILE_SCOPE_N("createBRDFMesh", n_vertices);
+    mesh.clear();
+
+    glm::vec3 light_dir = glm::normalize(light_pos);
+
+    // vertices (sampling directions first) and indices
+    initBRDFGrid(mesh, scale, n_phi, n_theta, up_dir);
+
+    // sampling
+    mesh.intensities.resize(n_vertices);
     {
-        // the bottom one
-        glm::vec3 bottom_pos = glm::mat3(rot) * glm::vec3(0, -scale, 0); // rotation
-        float intensity = shader.sample(light_dir, bottom_pos, up_dir);
-        mesh.vertices[n_phi * n_theta] = glm::vec3(bottom_pos) * intensity;
+        PROFILE_SCOPE_N("sampleBatch", n_vertices);
+        shader.sampleBatch(light_dir, &mesh.vertices[0], up_dir,
+                           &mesh.intensities[0], n_vertices);
     }
+    applyIntensities(mesh);
+
+    // normals
+    updateNormals(mesh);
+}
+
+
+// Create intensity sphere colored by the Marschner lobes
+void createBRDFLobeMesh(Mesh& mesh, AFMarschnerShader& shader,
+                        const glm::vec3& light_pos, float scale, int n_phi,
+                        const glm::vec3& up_dir) {
+    // y direction step
+    int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    const int n_vertices = n_phi * n_theta + 2;
+
+    PROFILE_SCOPE_N("createBRDFMesh", n_vertices);
+    mesh.clear();
+
+    glm::vec3 light_dir = glm::normalize(light_pos);
+
+    // vertices (sampling directions first) and indices
+    initBRDFGrid(mesh, scale, n_phi, n_theta, up_dir);
+
+    // sampling
+    mesh.lobes.resize(n_vertices);
     {
-        // the top one
-        glm::vec3 top_pos = glm::mat3(rot) * glm::vec3(0, scale, 0); // rotation
-        float intensity = shader.sample(light_dir, top_pos, up_dir);
-        mesh.vertices[n_phi * n_theta + 1] = glm::vec3(top_pos) * intensity;
+        PROFILE_SCOPE_N("sampleBatch", n_vertices);
+        shader.sampleLobesBatch(light_dir, &mesh.vertices[0], up_dir,
+                                &mesh.lobes[0], n_vertices);
     }
+    // R: red, TT: green, TRT: blue
+    mesh.intensities.resize(n_vertices);
+    mesh.colors.resize(n_vertices);
+    for (int i = 0; i < n_vertices; i++) {
+        const AFMarschnerLobes& lobes = mesh.lobes[i];
+        const float sum = lobes.R + lobes.TT + lobes.TRT;
+        mesh.intensities[i] = sum;
+        mesh.colors[i] = glm::vec3(lobes.R, lobes.TT, lobes.TRT) /
+                         std::max(sum, 1e-20f);
+    }
+    applyIntensities(mesh);
 
-    // register indices
-    for (int i_phi = 0; i_phi < n_phi; i_phi++) {
-        int i_phi2 = (i_phi + 1) % n_phi; // rotation
+    // normals
+    updateNormals(mesh);
+}
 
-        for (int i_theta = 0; i_theta < n_theta; i_theta++) {
-            int i_theta2 = i_theta + 1;
 
-            // bottom
-            if (i_theta == 0) {
-                unsigned int idx0 = n_phi * n_theta; // bottom
-                unsigned int idx1 = i_phi2 * n_theta + i_theta;
-                unsigned int idx2 = i_phi * n_theta + i_theta;
-                glm::uvec3 triangle0(idx0, idx1, idx2);
-                mesh.indices.push_back(triangle0);
-            }
+// Create intensity sphere colored by the color evaluation
+void createBRDFColorMesh(Mesh& mesh, BaseShader& shader,
+                         const glm::vec3& light_pos, float scale, int n_phi,
+                         const ColorChannels& channels,
+                         const glm::vec3& up_dir) {
+    // y direction step
+    int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    const int n_vertices = n_phi * n_theta + 2;
 
-            if (i_theta2 != n_theta) {
-                unsigned int idx0 = i_phi * n_theta + i_theta;
-                unsigned int idx1 = i_phi2 * n_theta + i_theta;
-                unsigned int idx2 = i_phi * n_theta + i_theta2;
-                unsigned int idx3 = i_phi2 * n_theta + i_theta2;
+    PROFILE_SCOPE_N("createBRDFMesh", n_vertices);
+    mesh.clear();
 
-                glm::uvec3 triangle0(idx0, idx1, idx2); // counterclock-wise
-                glm::uvec3 triangle1(idx1, idx3, idx2);
-                mesh.indices.push_back(triangle0);
-                mesh.indices.push_back(triangle1);
-            } else {
-                // top
-                unsigned int idx0 = i_phi * n_theta + i_theta;
-                unsigned int idx1 = i_phi2 * n_theta + i_theta;
-                unsigned int idx2 = n_phi * n_theta + 1; // top
+    glm::vec3 light_dir = glm::normalize(light_pos);
 
-                glm::uvec3 triangle0(idx0, idx1, idx2);
-                mesh.indices.push_back(triangle0);
-            }
+    // vertices (sampling directions first) and indices
+    initBRDFGrid(mesh, scale, n_phi, n_theta, up_dir);
+
+    // sampling
+    sampleColors(mesh, shader, light_dir, channels, up_dir);
+    mesh.intensities.resize(n_vertices);
+    mesh.colors.resize(n_vertices);
+    for (int i = 0; i < n_vertices; i++) {
+        const glm::vec3 rgb =
+            channelsToRGB(channels, &mesh.channel_samples[i * channels.n]);
+        mesh.intensities[i] = (rgb[0] + rgb[1] + rgb[2]) / 3.f;
+        const float max_c = std::max(std::max(rgb[0], rgb[1]), rgb[2]);
+        mesh.colors[i] = rgb / std::max(max_c, 1e-20f);
+    }
+    applyIntensities(mesh);
+
+    // normals
+    updateNormals(mesh);
+}
+
+
+// Create one intensity sphere per RGB channel
+void createBRDFChannelMeshes(Mesh* meshes, BaseShader& shader,
+                             const glm::vec3& light_pos, float scale,
+                             int n_phi, const ColorChannels& channels,
+                             const glm::vec3& up_dir) {
+    // y direction step
+    int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    const int n_vertices = n_phi * n_theta + 2;
+
+    PROFILE_SCOPE_N("createBRDFMesh", n_vertices);
+    glm::vec3 light_dir = glm::normalize(light_pos);
+
+    // sampling on the grid of the first mesh
+    Mesh& first = meshes[0];
+    first.clear();
+    initBRDFGrid(first, scale, n_phi, n_theta, up_dir);
+    sampleColors(first, shader, light_dir, channels, up_dir);
+    for (int c = 0; c < 3; c++) {
+        Mesh& mesh = meshes[c];
+        if (c > 0) {
+            mesh.clear();
+            initBRDFGrid(mesh, scale, n_phi, n_theta, up_dir);
+        }
+        mesh.intensities.resize(n_vertices);
+    }
+    for (int i = 0; i < n_vertices; i++) {
+        const glm::vec3 rgb =
+            channelsToRGB(channels, &first.channel_samples[i * channels.n]);
+        for (int c = 0; c < 3; c++) meshes[c].intensities[i] = rgb[c];
+    }
+    for (int c = 0; c < 3; c++) {
+        applyIntensities(meshes[c]);
+        updateNormals(meshes[c]);
+    }
+}
+
+
+// Create intensity sphere of stored values
+void createStoredBRDFMesh(Mesh& mesh, const float* values, int n_values,
+                          bool lobes, float scale, int n_phi,
+                          const glm::vec3& up_dir) {
+    // y direction step
+    int n_theta = std::max(n_phi / 2, 1); // 2 PI -> 1 PI
+    const int n_vertices = n_phi * n_theta + 2;
+
+    PROFILE_SCOPE_N("createBRDFMesh", n_vertices);
+    mesh.clear();
+
+    // vertices (the stored directions) and indices
+    initBRDFGrid(mesh, scale, n_phi, n_theta, up_dir);
+
+    mesh.intensities.resize(n_vertices);
+    if (n_values == 3) mesh.colors.resize(n_vertices);
+    for (int i = 0; i < n_vertices; i++) {
+        if (n_values != 3) {
+            mesh.intensities[i] = values[i * n_values];
+            continue;
         }
+        const glm::vec3 v(values[3 * i], values[3 * i + 1],
+                          values[3 * i + 2]);
+        const float sum = v[0] + v[1] + v[2];
+        const float max_c = std::max(std::max(v[0], v[1]), v[2]);
+        mesh.intensities[i] = lobes ? sum : sum / 3.f;
+        mesh.colors[i] = v / std::max(lobes ? sum : max_c, 1e-20f);
     }
+    applyIntensities(mesh);
 
     // normals
     updateNormals(mesh);
@@ -7,25 +7,81 @@
 #include <glm/gtx/rotate_vector.hpp> 
 
 #include "shader.h"
+#include "vertex_cache.h"
 
 
+// Meshes are rebuilt every frame. clear() keeps the vector capacities, so
+// rebuilding a mesh of unchanged resolution does not touch the heap.
 class Mesh {
 public:
-    Mesh() {};
+    Mesh() : strips(NULL) {};
     ~Mesh() {};
     void clear() {
         indices.clear();
         vertices.clear();
         normals.clear();
+        intensities.clear();
+        colors.clear();
+        lobes.clear();
+        channel_samples.clear();
+        strips = NULL;
     }
     std::vector<glm::uvec3> indices;
+    // The same triangles as strips (BRDF meshes, BRDFGridTopology)
+    const std::vector<unsigned int>* strips;
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
+    std::vector<float> intensities;  // shader samples (BRDF meshes only)
+    std::vector<glm::vec3> colors;   // optional per-vertex colors
+    std::vector<AFMarschnerLobes> lobes;  // per-lobe samples (lobe meshes)
+    std::vector<float> channel_samples;  // sampleColorBatch() (color meshes)
+    std::vector<int> normals_weight;  // scratch for updateNormals()
+    std::vector<glm::vec3> face_normals;  // scratch for updateNormals()
 };
 
+// Triangles of the BRDF sphere, built once per resolution: the list in
+// vertex cache order (optimizeVertexCache()) and one strip per phi column
+// from pole to pole, RESTART_INDEX separated. The stats compare them with
+// the column by column order of the grid.
+struct BRDFGridTopology {
+    int n_phi, n_theta, n_vertices;
+    std::vector<glm::uvec3> triangles;
+    std::vector<unsigned int> strips;
+    VertexCacheStats grid_stats, list_stats, strip_stats;
+};
+// Thread safe; the topology stays for the lifetime of the program
+const BRDFGridTopology& brdfGridTopology(int n_phi);
+// Vertices of the BRDF sphere before the intensities: the sampling
+// directions times `scale`, in the order of brdfGridTopology()
+void brdfGridDirections(std::vector<glm::vec3>& directions, float scale,
+                        int n_phi,
+                        const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
+
 void updateNormals(Mesh& mesh);
 void createGround(Mesh& mesh, float scale, float eps=0.01f);
 void createBRDFMesh(Mesh& mesh, BaseShader& shader, const glm::vec3& light_pos,
                     float scale, int n_phi,
                     const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
+// Same sphere as createBRDFMesh() with per-vertex colors showing the share
+// of the R (red), TT (green) and TRT (blue) lobes.
+void createBRDFLobeMesh(Mesh& mesh, AFMarschnerShader& shader,
+                        const glm::vec3& light_pos, float scale, int n_phi,
+                        const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
+// Color evaluation (RGB or spectral, see ColorChannels): the radius is
+// the mean of the RGB channels and the vertex colors their hue.
+void createBRDFColorMesh(Mesh& mesh, BaseShader& shader,
+                         const glm::vec3& light_pos, float scale, int n_phi,
+                         const ColorChannels& channels,
+                         const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
+// One sphere per RGB channel (meshes[0..2]) from a single color evaluation
+void createBRDFChannelMeshes(Mesh* meshes, BaseShader& shader,
+                             const glm::vec3& light_pos, float scale,
+                             int n_phi, const ColorChannels& channels,
+                             const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
+// Sphere of stored values over its directions (brdfbake lobes): one value
+// per direction, or 3 drawn as createBRDFColorMesh() (RGB) or
+// createBRDFLobeMesh() (`lobes`: R, TT, TRT)
+void createStoredBRDFMesh(Mesh& mesh, const float* values, int n_values,
+                          bool lobes, float scale, int n_phi,
+                          const glm::vec3& up_dir=glm::vec3(0.f, 1.f, 0.f));
 #endif
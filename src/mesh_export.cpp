@@ -0,0 +1,289 @@
+#include "mesh_export.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Buffered file output: records and formatted text go straight into the
+// buffer, which is written when full
+class StreamWriter {
+public:
+    explicit StreamWriter(FILE* file)
+        : file(file), buffer(1 << 16), used(0), ok(true) {}
+
+    void write(const void* data, size_t bytes) {
+        if (this->used + bytes > this->buffer.size()) this->flush();
+        memcpy(&this->buffer[this->used], data, bytes);
+        this->used += bytes;
+    }
+    template <typename T>
+    void put(const T& value) { this->write(&value, sizeof(value)); }
+
+    // At most MAX_TEXT characters
+    void print(const char* format, ...) {
+        if (this->used + MAX_TEXT > this->buffer.size()) this->flush();
+        va_list args;
+        va_start(args, format);
+        const int n = vsnprintf(&this->buffer[this->used], MAX_TEXT, format,
+                                args);
+        va_end(args);
+        if (n > 0) this->used += (n < MAX_TEXT) ? n : MAX_TEXT - 1;
+    }
+
+    bool flush() {
+        if (this->used > 0 &&
+            fwrite(&this->buffer[0], 1, this->used, this->file) !=
+                this->used) {
+            this->ok = false;
+        }
+        this->used = 0;
+        return this->ok;
+    }
+
+private:
+    static const int MAX_TEXT = 256;
+    FILE* file;
+    std::vector<char> buffer;
+    size_t used;
+    bool ok;
+};
+
+bool hostLittleEndian() {
+    const uint16_t one = 1;
+    return *(const uint8_t*)&one == 1;
+}
+
+// Bounding box of the finite positions
+void positionBounds(const std::vector<glm::vec3>& vertices, glm::vec3& lo,
+                    glm::vec3& hi) {
+    lo = glm::vec3(0.f);
+    hi = glm::vec3(0.f);
+    bool first = true;
+    for (int i = 0; i < vertices.size(); i++) {
+        const glm::vec3& v = vertices[i];
+        if (!std::isfinite(v.x) || !std::isfinite(v.y) ||
+            !std::isfinite(v.z)) {
+            continue;
+        }
+        lo = first ? v : glm::min(lo, v);
+        hi = first ? v : glm::max(hi, v);
+        first = false;
+    }
+}
+
+inline uint16_t quantizeUnorm16(float v, float lo, float hi) {
+    const float t = (hi > lo) ? (v - lo) / (hi - lo) : 0.f;
+    // NaN to 0
+    if (!(t > 0.f)) return 0;
+    return (uint16_t)(std::min(t, 1.f) * 65535.f + 0.5f);
+}
+
+inline int16_t quantizeSnorm16(float v) {
+    if (!(v == v)) return 0;
+    return (int16_t)std::floor(glm::clamp(v, -1.f, 1.f) * 32767.f + 0.5f);
+}
+
+inline uint8_t quantizeUnorm8(float v) {
+    if (!(v > 0.f)) return 0;
+    return (uint8_t)(std::min(v, 1.f) * 255.f + 0.5f);
+}
+
+void writePly(const Mesh& mesh, const MeshExportOptions& options,
+              StreamWriter& out) {
+    const int n_vertices = mesh.vertices.size();
+    const bool normals = mesh.normals.size() == n_vertices;
+    const bool colors = mesh.colors.size() == n_vertices;
+    const bool intensities = mesh.intensities.size() == n_vertices;
+    glm::vec3 lo, hi;
+    if (options.quantize) positionBounds(mesh.vertices, lo, hi);
+
+    // header
+    out.print("ply\nformat %s 1.0\ncomment brdfview mesh\n",
+              hostLittleEndian() ? "binary_little_endian"
+                                 : "binary_big_endian");
+    if (options.quantize) {
+        out.print("comment bbox %.9g %.9g %.9g %.9g %.9g %.9g\n", lo.x, lo.y,
+                  lo.z, hi.x, hi.y, hi.z);
+    }
+    out.print("element vertex %d\n", n_vertices);
+    const char* position_type = options.quantize ? "ushort" : "float";
+    out.print("property %s x\nproperty %s y\nproperty %s z\n", position_type,
+              position_type, position_type);
+    if (normals && options.quantize) {
+        out.print("property short nu\nproperty short nv\n");
+    } else if (normals) {
+        out.print("property float nx\nproperty float ny\n"
+                  "property float nz\n");
+    }
+    if (colors) {
+        out.print("property uchar red\nproperty uchar green\n"
+                  "property uchar blue\n");
+    }
+    if (intensities) out.print("property float intensity\n");
+    out.print("element face %d\n"
+              "property list uchar uint vertex_indices\nend_header\n",
+              (int)mesh.indices.size());
+
+    // vertices
+    for (int i = 0; i < n_vertices; i++) {
+        const glm::vec3& v = mesh.vertices[i];
+        if (options.quantize) {
+            out.put(quantizeUnorm16(v.x, lo.x, hi.x));
+            out.put(quantizeUnorm16(v.y, lo.y, hi.y));
+            out.put(quantizeUnorm16(v.z, lo.z, hi.z));
+        } else {
+            out.write(&v[0], 3 * sizeof(float));
+        }
+        if (normals && options.quantize) {
+            const glm::vec2 e = octEncode(mesh.normals[i]);
+            out.put(quantizeSnorm16(e.x));
+            out.put(quantizeSnorm16(e.y));
+        } else if (normals) {
+            out.write(&mesh.normals[i][0], 3 * sizeof(float));
+        }
+        if (colors) {
+            const glm::vec3& c = mesh.colors[i];
+            out.put(quantizeUnorm8(c[0]));
+            out.put(quantizeUnorm8(c[1]));
+            out.put(quantizeUnorm8(c[2]));
+        }
+        if (intensities) out.put(mesh.intensities[i]);
+    }
+    // faces
+    for (int i = 0; i < mesh.indices.size(); i++) {
+        const uint8_t n = 3;
+        out.put(n);
+        out.write(&mesh.indices[i][0], 3 * sizeof(uint32_t));
+    }
+}
+
+void writeObj(const Mesh& mesh, StreamWriter& out) {
+    const int n_vertices = mesh.vertices.size();
+    const bool normals = mesh.normals.size() == n_vertices;
+    out.print("# brdfview mesh\n");
+    for (int i = 0; i < n_vertices; i++) {
+        const glm::vec3& v = mesh.vertices[i];
+        out.print("v %.7g %.7g %.7g\n", v.x, v.y, v.z);
+    }
+    for (int i = 0; normals && i < n_vertices; i++) {
+        const glm::vec3& n = mesh.normals[i];
+        out.print("vn %.5g %.5g %.5g\n", n.x, n.y, n.z);
+    }
+    // 1-based, normals share the vertex indices
+    for (int i = 0; i < mesh.indices.size(); i++) {
+        const glm::uvec3 t = mesh.indices[i] + glm::uvec3(1);
+        if (normals) {
+            out.print("f %u//%u %u//%u %u//%u\n", t.x, t.x, t.y, t.y, t.z,
+                      t.z);
+        } else {
+            out.print("f %u %u %u\n", t.x, t.y, t.z);
+        }
+    }
+}
+
+} // namespace
+
+
+int meshFormatOfPath(const std::string& path) {
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return -1;
+    std::string ext = path.substr(dot + 1);
+    for (int i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+    if (ext == "ply") return MESH_PLY;
+    if (ext == "obj") return MESH_OBJ;
+    return -1;
+}
+
+bool exportMesh(const Mesh& mesh, const std::string& path,
+                const MeshExportOptions& options, std::string& error) {
+    if (options.quantize && options.format != MESH_PLY) {
+        error = "Quantized export needs PLY: " + path;
+        return false;
+    }
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "Failed to open " + path;
+        return false;
+    }
+    StreamWriter out(file);
+    if (options.format == MESH_OBJ) {
+        writeObj(mesh, out);
+    } else {
+        writePly(mesh, options, out);
+    }
+    const bool ok = out.flush();
+    if (fclose(file) != 0 || !ok) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+glm::vec2 octEncode(const glm::vec3& n) {
+    const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (!(sum > 0.f)) return glm::vec2(0.f);
+    glm::vec2 e = glm::vec2(n.x, n.y) / sum;
+    if (n.z < 0.f) {
+        // fold the lower hemisphere over the diagonals
+        e = glm::vec2((1.f - std::abs(e.y)) * (e.x >= 0.f ? 1.f : -1.f),
+                      (1.f - std::abs(e.x)) * (e.y >= 0.f ? 1.f : -1.f));
+    }
+    return e;
+}
+
+glm::vec3 octDecode(const glm::vec2& e) {
+    glm::vec3 n(e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y));
+    if (n.z < 0.f) {
+        n.x = (1.f - std::abs(e.y)) * (e.x >= 0.f ? 1.f : -1.f);
+        n.y = (1.f - std::abs(e.x)) * (e.y >= 0.f ? 1.f : -1.f);
+    }
+    return glm::normalize(n);
+}
+
+
+// === MeshExportJob ===
+
+MeshExportJob::~MeshExportJob() {
+    if (this->thread.joinable()) this->thread.join();
+}
+
+bool MeshExportJob::start(const Mesh* meshes, const std::string* paths,
+                          int n_meshes, const MeshExportOptions& options) {
+    if (this->running || n_meshes <= 0) return false;
+    if (this->thread.joinable()) this->thread.join();
+    this->meshes.assign(meshes, meshes + n_meshes);
+    this->paths.assign(paths, paths + n_meshes);
+    this->options = options;
+    this->running = true;
+    this->thread = std::thread(&MeshExportJob::run, this);
+    return true;
+}
+
+bool MeshExportJob::finished(bool& ok, std::string& message) {
+    if (this->running || !this->thread.joinable()) return false;
+    this->thread.join();
+    ok = this->ok;
+    message = this->message;
+    return true;
+}
+
+void MeshExportJob::run() {
+    this->ok = true;
+    this->message.clear();
+    for (int i = 0; i < this->meshes.size() && this->ok; i++) {
+        this->ok = exportMesh(this->meshes[i], this->paths[i], this->options,
+                              this->message);
+    }
+    if (this->ok) {
+        this->message = "Exported " + this->paths[0];
+        if (this->paths.size() > 1) this->message += " ...";
+    }
+    // the copies are not kept
+    this->meshes.clear();
+    this->running = false;
+}
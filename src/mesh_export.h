@@ -0,0 +1,67 @@
+#ifndef MESH_EXPORT_H_261018
+#define MESH_EXPORT_H_261018
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.h"
+
+// Mesh files for DCC tools, streamed through a fixed buffer (no string per
+// vertex): binary PLY with the vertices, normals, colors and intensities of
+// a Mesh, or Wavefront OBJ (positions, normals and faces).
+//
+// Quantized PLY stores positions as ushort over the bounding box of the
+// mesh, recorded in the header as
+//   comment bbox <min x> <min y> <min z> <max x> <max y> <max z>
+// (x = min + (max - min) * qx / 65535), and normals octahedral encoded
+// (octEncode(), two snorm16 `nu nv`).
+enum MeshFormat { MESH_PLY = 0, MESH_OBJ };
+
+struct MeshExportOptions {
+    MeshExportOptions() : format(MESH_PLY), quantize(false) {}
+    int format;
+    bool quantize;  // PLY only
+};
+
+// Format of a file name (.ply or .obj), -1 if neither
+int meshFormatOfPath(const std::string& path);
+
+bool exportMesh(const Mesh& mesh, const std::string& path,
+                const MeshExportOptions& options, std::string& error);
+
+// Octahedral unit vector encoding in [-1, 1]^2
+glm::vec2 octEncode(const glm::vec3& n);
+glm::vec3 octDecode(const glm::vec2& e);
+
+// Exports copies of meshes on a background thread, so the frame that
+// starts it only pays for the copy
+class MeshExportJob {
+public:
+    MeshExportJob() : running(false) {}
+    ~MeshExportJob();
+    // false while the previous export runs
+    bool start(const Mesh* meshes, const std::string* paths, int n_meshes,
+               const MeshExportOptions& options);
+    bool busy() const { return running; }
+    // Result of the last export once it finished (false while busy)
+    bool finished(bool& ok, std::string& message);
+
+private:
+    MeshExportJob(const MeshExportJob&);
+    MeshExportJob& operator=(const MeshExportJob&);
+
+    void run();
+
+    std::vector<Mesh> meshes;
+    std::vector<std::string> paths;
+    MeshExportOptions options;
+    std::thread thread;
+    std::atomic<bool> running;
+    bool ok;
+    std::string message;
+};
+
+#endif
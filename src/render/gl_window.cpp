@@ -5,7 +5,7 @@ bool GLWindow::glfw_inited = false;
 bool GLWindow::glew_inited = false;
 
 bool GLWindow::init(const std::string& title, bool user_input, 
-                      int vsync_interval) {
+                      int vsync_interval, bool visible) {
     if (!GLWindow::glfw_inited) {
         std::cout << "* Initialize glfw" << std::endl;
         // Initialize GLFW
@@ -23,6 +23,10 @@ bool GLWindow::init(const std::string& title, bool user_input,
     }
 
 
+    // Hidden windows are used for offscreen benchmarking at a fixed size
+    glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, visible ? GL_TRUE : GL_FALSE);
+
     // Open a window and create its OpenGL context
     this->window = glfwCreateWindow(this->width, this->height, title.c_str(),
                                     NULL, NULL);
@@ -33,8 +33,11 @@ public:
     ~GLWindow() { exit(); }
 
     bool init(const std::string& title="window", bool user_input=true,
-              int vsync_interval=0);
-    void setCamera(GLCamera *camera) { this->camera = camera; }
+              int vsync_interval=0, bool visible=true);
+    void setCamera(GLCamera *camera) {
+        this->camera = camera;
+        if (camera) camera->reshapeScreen(width, height);
+    }
     bool shouldClose();
     void active();
     void update();
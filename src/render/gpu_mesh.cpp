@@ -0,0 +1,195 @@
+#include "gpu_mesh.h"
+
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+#include "../bench/profiler.h"
+
+namespace {
+
+inline int align16(int bytes) {
+    return (bytes + 15) & ~15;
+}
+
+} // namespace
+
+
+GpuVertexLayout gpuVertexLayout(const GpuVertexFormat& format, bool colors) {
+    GpuVertexLayout layout;
+    int offset = 0;
+    layout.position_offset = offset;
+    offset += format.half_positions ? 4 * sizeof(uint16_t)
+                                    : 3 * sizeof(float);
+    layout.normal_offset = offset;
+    offset += format.packed_normals ? sizeof(uint32_t) : 3 * sizeof(float);
+    layout.color_offset = colors ? offset : -1;
+    if (colors) offset += sizeof(uint32_t);
+    layout.stride = align16(offset);
+    return layout;
+}
+
+void packVertices(const Mesh& mesh, const GpuVertexFormat& format,
+                  const GpuVertexLayout& layout, std::vector<uint8_t>& out) {
+    const int n_vertices = mesh.vertices.size();
+    const bool normals = mesh.normals.size() == n_vertices;
+    out.resize((size_t)n_vertices * layout.stride);
+    if (out.empty()) return;
+    // padding included
+    memset(&out[0], 0, out.size());
+    for (int i = 0; i < n_vertices; i++) {
+        uint8_t* v = &out[(size_t)i * layout.stride];
+        const glm::vec3& p = mesh.vertices[i];
+        if (format.half_positions) {
+            const uint16_t h[4] = {
+                (uint16_t)glm::packHalf1x16(p.x),
+                (uint16_t)glm::packHalf1x16(p.y),
+                (uint16_t)glm::packHalf1x16(p.z),
+                (uint16_t)glm::packHalf1x16(1.f)};
+            memcpy(v + layout.position_offset, h, sizeof(h));
+        } else {
+            memcpy(v + layout.position_offset, &p[0], 3 * sizeof(float));
+        }
+        const glm::vec3 n = normals ? mesh.normals[i] : glm::vec3(0.f);
+        if (format.packed_normals) {
+            const uint32_t packed =
+                glm::packSnorm4x8(glm::vec4(n.x, n.y, n.z, 0.f));
+            memcpy(v + layout.normal_offset, &packed, sizeof(packed));
+        } else {
+            memcpy(v + layout.normal_offset, &n[0], 3 * sizeof(float));
+        }
+        if (layout.color_offset >= 0) {
+            const glm::vec3& c = mesh.colors[i];
+            const uint32_t packed =
+                glm::packUnorm4x8(glm::vec4(c.x, c.y, c.z, 1.f));
+            memcpy(v + layout.color_offset, &packed, sizeof(packed));
+        }
+    }
+}
+
+int packIndices(const Mesh& mesh, bool strips, std::vector<uint8_t>& out) {
+    // the largest 16 bit index restarts strips
+    const bool small = mesh.vertices.size() < 0xffff;
+    const unsigned int* indices;
+    size_t n_indices;
+    if (strips) {
+        indices = mesh.strips->empty() ? NULL : &(*mesh.strips)[0];
+        n_indices = mesh.strips->size();
+    } else {
+        indices = mesh.indices.empty() ? NULL
+                                       : (const unsigned int*)&mesh.indices[0];
+        n_indices = mesh.indices.size() * 3;
+    }
+    if (!small) {
+        out.resize(n_indices * sizeof(uint32_t));
+        if (n_indices) memcpy(&out[0], indices, out.size());
+        return sizeof(uint32_t);
+    }
+    out.resize(n_indices * sizeof(uint16_t));
+    uint16_t* out_indices = n_indices ? (uint16_t*)&out[0] : NULL;
+    for (size_t i = 0; i < n_indices; i++) {
+        // RESTART_INDEX to 0xffff
+        out_indices[i] = (uint16_t)indices[i];
+    }
+    return sizeof(uint16_t);
+}
+
+
+// === GpuMesh ===
+
+GpuMesh::GpuMesh() : vbo(0), ibo(0), index_bytes(sizeof(uint16_t)),
+                     strips(false), n_indices(0), uploaded_bytes(0) {
+    this->layout = gpuVertexLayout(this->format, false);
+}
+
+GpuMesh::~GpuMesh() {
+    this->release();
+}
+
+void GpuMesh::release() {
+    if (this->vbo) glDeleteBuffers(1, &this->vbo);
+    if (this->ibo) glDeleteBuffers(1, &this->ibo);
+    this->vbo = 0;
+    this->ibo = 0;
+    this->index_data.clear();
+    this->n_indices = 0;
+}
+
+void GpuMesh::upload(const Mesh& mesh, const GpuVertexFormat& format) {
+    PROFILE_SCOPE_N("uploadMesh", mesh.vertices.size());
+    if (!this->vbo) glGenBuffers(1, &this->vbo);
+    if (!this->ibo) glGenBuffers(1, &this->ibo);
+    this->format = format;
+    this->layout = gpuVertexLayout(
+        format, mesh.colors.size() == mesh.vertices.size() &&
+                !mesh.colors.empty());
+    packVertices(mesh, format, this->layout, this->vertex_data);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    // orphaned, the previous frame may still draw from it
+    glBufferData(GL_ARRAY_BUFFER, this->vertex_data.size(), NULL,
+                 GL_STREAM_DRAW);
+    if (!this->vertex_data.empty()) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, this->vertex_data.size(),
+                        &this->vertex_data[0]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    this->uploaded_bytes = this->vertex_data.size();
+
+    // the topology mostly stays
+    const bool strips = format.strips && mesh.strips &&
+                        !mesh.strips->empty();
+    this->index_bytes = packIndices(mesh, strips, this->index_scratch);
+    this->n_indices = this->index_scratch.size() / this->index_bytes;
+    if (strips != this->strips ||
+        this->index_scratch.size() != this->index_data.size() ||
+        (!this->index_data.empty() &&
+         memcmp(&this->index_scratch[0], &this->index_data[0],
+                this->index_data.size()) != 0)) {
+        this->index_data.swap(this->index_scratch);
+        this->strips = strips;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->index_data.size(),
+                     this->index_data.empty() ? NULL : &this->index_data[0],
+                     GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        this->uploaded_bytes += this->index_data.size();
+    }
+}
+
+void GpuMesh::draw() const {
+    if (!this->vbo || this->n_indices == 0) return;
+    const GpuVertexLayout& layout = this->layout;
+    const char* base = NULL;
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    if (this->format.half_positions) {
+        glVertexPointer(4, GL_HALF_FLOAT, layout.stride,
+                        base + layout.position_offset);
+    } else {
+        glVertexPointer(3, GL_FLOAT, layout.stride,
+                        base + layout.position_offset);
+    }
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(this->format.packed_normals ? GL_BYTE : GL_FLOAT,
+                    layout.stride, base + layout.normal_offset);
+    if (layout.color_offset >= 0) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(4, GL_UNSIGNED_BYTE, layout.stride,
+                       base + layout.color_offset);
+    }
+    const bool small = this->index_bytes == sizeof(uint16_t);
+    if (this->strips) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(small ? 0xffff : RESTART_INDEX);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
+    glDrawElements(this->strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES,
+                   (GLsizei)this->n_indices,
+                   small ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (this->strips) glDisable(GL_PRIMITIVE_RESTART);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
@@ -0,0 +1,71 @@
+#ifndef GPU_MESH_H_261018
+#define GPU_MESH_H_261018
+
+#include <stdint.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "../mesh.h"
+
+// Interleaved vertex buffers of a Mesh for the fixed function pipeline.
+// Packed vertices are 16 bytes: half float positions (w = 1), snorm8
+// normals (glNormalPointer() rejects the 3 component 10:10:10:2 types) and
+// RGBA8 colors. Indices are 16 bit while every vertex fits. Float
+// positions remain for GL without ARB_half_float_vertex. `strips` draws
+// the strips of BRDF meshes with primitive restart (GL 3.1).
+struct GpuVertexFormat {
+    GpuVertexFormat() : half_positions(true), packed_normals(true),
+                        strips(false) {}
+    bool half_positions;
+    bool packed_normals;
+    bool strips;
+};
+
+// Byte offsets in a vertex (-1: not stored); the stride is a multiple of 16
+struct GpuVertexLayout {
+    int stride;
+    int position_offset;
+    int normal_offset;
+    int color_offset;
+};
+
+GpuVertexLayout gpuVertexLayout(const GpuVertexFormat& format, bool colors);
+// Vertices of the mesh in the layout (n_vertices * layout.stride bytes)
+void packVertices(const Mesh& mesh, const GpuVertexFormat& format,
+                  const GpuVertexLayout& layout, std::vector<uint8_t>& out);
+// Triangle indices, or the strips (RESTART_INDEX becomes the largest
+// index), uint16 when every vertex fits (bytes per index)
+int packIndices(const Mesh& mesh, bool strips, std::vector<uint8_t>& out);
+
+// A mesh uploaded every frame. Buffers are orphaned on upload and the
+// indices only uploaded when they change. The scratch keeps its capacity,
+// so steady uploads do not allocate.
+class GpuMesh {
+public:
+    GpuMesh();
+    ~GpuMesh();  // the GL context must be current
+    void upload(const Mesh& mesh, const GpuVertexFormat& format);
+    // Meshes without colors take the current color
+    void draw() const;
+    void release();
+    // Sent to the GPU by the last upload
+    size_t uploadedBytes() const { return uploaded_bytes; }
+
+private:
+    GpuMesh(const GpuMesh&);
+    GpuMesh& operator=(const GpuMesh&);
+
+    GLuint vbo, ibo;
+    GpuVertexFormat format;
+    GpuVertexLayout layout;
+    int index_bytes;
+    bool strips;  // of the uploaded indices
+    size_t n_indices;
+    size_t uploaded_bytes;
+    std::vector<uint8_t> vertex_data;
+    std::vector<uint8_t> index_data;  // as uploaded
+    std::vector<uint8_t> index_scratch;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "lobe_grid_renderer.h"
+
+#include <algorithm>
+
+#include "../bench/profiler.h"
+
+namespace {
+
+// Lobe radius from the texture buffer, placed in its cell
+const char* VERTEX_SOURCE =
+    "#version 140\n"
+    "uniform samplerBuffer intensities;\n"
+    "uniform mat3 rotation;\n"
+    "uniform int n_cols;\n"
+    "uniform int n_rows;\n"
+    "uniform int n_vertices;\n"
+    "uniform vec2 lobe_scale;\n"
+    "in vec3 direction;\n"
+    "out vec3 view_pos;\n"
+    "void main() {\n"
+    "    float r = texelFetch(intensities,\n"
+    "                         gl_InstanceID * n_vertices + gl_VertexID).r;\n"
+    "    vec3 p = rotation * (direction * r);\n"
+    "    int col = gl_InstanceID % n_cols;\n"
+    "    int row = gl_InstanceID / n_cols;\n"
+    "    vec2 cell = vec2(2.0 / float(n_cols), 2.0 / float(n_rows));\n"
+    "    vec2 center = vec2(-1.0 + cell.x * (float(col) + 0.5),\n"
+    "                       1.0 - cell.y * (float(row) + 0.5));\n"
+    "    view_pos = p;\n"
+    "    gl_Position = vec4(center + p.xy * lobe_scale, -0.5 * p.z, 1.0);\n"
+    "}\n";
+
+// Facet normals from the derivatives, lit from the viewer
+const char* FRAGMENT_SOURCE =
+    "#version 140\n"
+    "uniform vec3 color;\n"
+    "in vec3 view_pos;\n"
+    "out vec4 frag_color;\n"
+    "void main() {\n"
+    "    vec3 n = cross(dFdx(view_pos), dFdy(view_pos));\n"
+    "    float len = length(n);\n"
+    "    float ndl = (len > 0.0) ? abs(n.z) / len : 1.0;\n"
+    "    frag_color = vec4(color * (0.25 + 0.75 * ndl), 1.0);\n"
+    "}\n";
+
+GLuint compileShader(GLenum type, const char* source, std::string& error) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[1024] = "";
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        error = std::string("Failed to compile the lobe grid shader: ") + log;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+} // namespace
+
+
+LobeGridRenderer::LobeGridRenderer()
+    : program(0), vbo(0), ibo(0), tbo(0), tbo_texture(0), n_phi(0),
+      up_dir(0.f), n_indices(0), n_rows(0), n_cols(0), n_vertices(0) {}
+
+LobeGridRenderer::~LobeGridRenderer() {
+    this->release();
+}
+
+bool LobeGridRenderer::supported() {
+    return GLEW_VERSION_3_1;
+}
+
+bool LobeGridRenderer::init() {
+    if (this->program) return true;
+    if (!supported()) {
+        this->error = "The lobe grid needs GL 3.1";
+        return false;
+    }
+    GLuint vs = compileShader(GL_VERTEX_SHADER, VERTEX_SOURCE, this->error);
+    if (!vs) return false;
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SOURCE,
+                              this->error);
+    if (!fs) {
+        glDeleteShader(vs);
+        return false;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glBindAttribLocation(program, 0, "direction");
+    glBindFragDataLocation(program, 0, "frag_color");
+    glLinkProgram(program);
+    // flagged for deletion with the program
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[1024] = "";
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        this->error = std::string("Failed to link the lobe grid shader: ") +
+                      log;
+        glDeleteProgram(program);
+        return false;
+    }
+    this->program = program;
+    this->intensities_loc = glGetUniformLocation(program, "intensities");
+    this->rotation_loc = glGetUniformLocation(program, "rotation");
+    this->n_cols_loc = glGetUniformLocation(program, "n_cols");
+    this->n_rows_loc = glGetUniformLocation(program, "n_rows");
+    this->n_vertices_loc = glGetUniformLocation(program, "n_vertices");
+    this->lobe_scale_loc = glGetUniformLocation(program, "lobe_scale");
+    this->color_loc = glGetUniformLocation(program, "color");
+
+    glGenBuffers(1, &this->vbo);
+    glGenBuffers(1, &this->ibo);
+    glGenBuffers(1, &this->tbo);
+    glGenTextures(1, &this->tbo_texture);
+    return true;
+}
+
+void LobeGridRenderer::upload(const LobeGrid& grid, bool normalize) {
+    if (!this->program || grid.numLobes() == 0) return;
+    PROFILE_SCOPE_N("uploadLobeGrid", grid.numLobes());
+    // the sphere, once per resolution
+    if (grid.n_phi != this->n_phi || grid.up_dir != this->up_dir) {
+        std::vector<glm::vec3> directions;
+        brdfGridDirections(directions, 1.f, grid.n_phi, grid.up_dir);
+        const std::vector<glm::uvec3>& triangles =
+            brdfGridTopology(grid.n_phi).triangles;
+        glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+        glBufferData(GL_ARRAY_BUFFER, directions.size() * sizeof(glm::vec3),
+                     &directions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     triangles.size() * sizeof(glm::uvec3), &triangles[0],
+                     GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        this->n_phi = grid.n_phi;
+        this->up_dir = grid.up_dir;
+        this->n_indices = triangles.size() * 3;
+    }
+
+    // the intensities in [0, 1]
+    const int n_lobes = grid.numLobes();
+    this->scaled.resize(grid.intensities.size());
+    for (int i = 0; i < n_lobes; i++) {
+        const float max_value = normalize ? grid.lobe_max[i]
+                                          : grid.max_intensity;
+        const float s = (max_value > 0.f) ? 1.f / max_value : 0.f;
+        const float* src = grid.lobe(i);
+        float* dst = &this->scaled[(size_t)i * grid.n_vertices];
+        for (int v = 0; v < grid.n_vertices; v++) dst[v] = src[v] * s;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, this->tbo);
+    glBufferData(GL_TEXTURE_BUFFER, this->scaled.size() * sizeof(float),
+                 &this->scaled[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, this->tbo_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, this->tbo);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    this->n_rows = grid.n_rows;
+    this->n_cols = grid.n_cols;
+    this->n_vertices = grid.n_vertices;
+}
+
+void LobeGridRenderer::draw(const glm::mat4& view_mat, int width,
+                            int height, const glm::vec3& color) const {
+    if (!this->program || this->n_indices == 0 || this->n_vertices == 0 ||
+        width <= 0 || height <= 0) {
+        return;
+    }
+    // lobe radius: 45% of the smaller side of a cell
+    const float cell_px = std::min((float)width / this->n_cols,
+                                   (float)height / this->n_rows);
+    const float radius_px = 0.45f * cell_px;
+    const glm::mat3 rotation(view_mat);
+
+    glUseProgram(this->program);
+    glUniformMatrix3fv(this->rotation_loc, 1, GL_FALSE, &rotation[0][0]);
+    glUniform1i(this->n_cols_loc, this->n_cols);
+    glUniform1i(this->n_rows_loc, this->n_rows);
+    glUniform1i(this->n_vertices_loc, this->n_vertices);
+    glUniform2f(this->lobe_scale_loc, 2.f * radius_px / width,
+                2.f * radius_px / height);
+    glUniform3fv(this->color_loc, 1, &color[0]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, this->tbo_texture);
+    glUniform1i(this->intensities_loc, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo);
+    glDrawElementsInstanced(GL_TRIANGLES, this->n_indices, GL_UNSIGNED_INT,
+                            NULL, this->n_rows * this->n_cols);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void LobeGridRenderer::release() {
+    if (this->program) glDeleteProgram(this->program);
+    if (this->vbo) glDeleteBuffers(1, &this->vbo);
+    if (this->ibo) glDeleteBuffers(1, &this->ibo);
+    if (this->tbo) glDeleteBuffers(1, &this->tbo);
+    if (this->tbo_texture) glDeleteTextures(1, &this->tbo_texture);
+    this->program = this->vbo = this->ibo = this->tbo = 0;
+    this->tbo_texture = 0;
+    this->n_phi = 0;
+    this->n_indices = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef LOBE_GRID_RENDERER_H_261018
+#define LOBE_GRID_RENDERER_H_261018
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "../lobe_grid.h"
+
+// Draws every lobe of a LobeGrid in one instanced call. The unit sphere
+// (brdfGridDirections() and the triangles of brdfGridTopology()) is
+// uploaded once per resolution; the intensities of all lobes go to a
+// texture buffer the vertex shader reads by gl_InstanceID and gl_VertexID.
+// Lobe i is drawn in cell (i / n_cols, i % n_cols) of the viewport, rotated
+// as the camera. Needs GL 3.1 (instancing, texture buffers).
+class LobeGridRenderer {
+public:
+    LobeGridRenderer();
+    ~LobeGridRenderer();  // the GL context must be current
+
+    static bool supported();
+    // Compiles the program (false: getError())
+    bool init();
+    // Each lobe scaled to its maximum (`normalize`) or to the grid maximum
+    void upload(const LobeGrid& grid, bool normalize);
+    void draw(const glm::mat4& view_mat, int width, int height,
+              const glm::vec3& color) const;
+    void release();
+    const std::string& getError() const { return error; }
+
+private:
+    LobeGridRenderer(const LobeGridRenderer&);
+    LobeGridRenderer& operator=(const LobeGridRenderer&);
+
+    GLuint program, vbo, ibo, tbo, tbo_texture;
+    GLint intensities_loc, rotation_loc, n_cols_loc, n_rows_loc,
+          n_vertices_loc, lobe_scale_loc, color_loc;
+    int n_phi;  // of the uploaded sphere
+    glm::vec3 up_dir;
+    int n_indices;
+    int n_rows, n_cols, n_vertices;
+    std::vector<float> scaled;  // upload scratch
+    std::string error;
+};
+
+#endif
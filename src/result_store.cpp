@@ -0,0 +1,575 @@
+#include "result_store.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char STORE_MAGIC[4] = {'B', 'R', 'E', 'S'};
+const char CHUNK_MAGIC[4] = {'C', 'H', 'N', 'K'};
+const char INDEX_MAGIC[4] = {'B', 'R', 'S', 'I'};
+
+inline uint64_t padded(uint64_t bytes) {
+    return (bytes + 7) & ~(uint64_t)7;
+}
+
+// Raw bytes of (schema, parameter values, light)
+std::string recordKey(uint32_t schema, const float* params, int n_params,
+                      const float* light) {
+    std::string key((const char*)&schema, sizeof(schema));
+    key.append((const char*)params, n_params * sizeof(float));
+    key.append((const char*)light, 3 * sizeof(float));
+    return key;
+}
+
+const float NO_LIGHT[3] = {0.f, 0.f, 0.f};
+
+// Light of the key (tables match any light)
+inline const float* keyLight(const StoreRecord& record) {
+    return record.kind == STORE_LOBE ? record.light : NO_LIGHT;
+}
+
+std::string recordKey(const StoreRecord& record) {
+    return recordKey(record.schema, record.params, record.n_params,
+                     keyLight(record));
+}
+
+// FNV-1a of the bytes of recordKey(), for lookups without a string
+uint64_t recordKeyHash(uint32_t schema, const float* params, int n_params,
+                       const float* light) {
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char* parts[3] = {
+        (const unsigned char*)&schema, (const unsigned char*)params,
+        (const unsigned char*)light
+    };
+    const size_t sizes[3] = {
+        sizeof(schema), n_params * sizeof(float), 3 * sizeof(float)
+    };
+    for (int p = 0; p < 3; p++) {
+        for (size_t i = 0; i < sizes[p]; i++) {
+            h = (h ^ parts[p][i]) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+bool recordHasKey(const StoreRecord& record, uint32_t schema,
+                  const float* params, int n_params, const float* light) {
+    return record.schema == schema && record.n_params == n_params &&
+           (n_params == 0 ||
+            memcmp(record.params, params, n_params * sizeof(float)) == 0) &&
+           memcmp(keyLight(record), light, 3 * sizeof(float)) == 0;
+}
+
+std::string schemaKey(const std::string& shader,
+                      const std::vector<std::string>& params) {
+    std::string key = shader;
+    for (int p = 0; p < params.size(); p++) key += '\0' + params[p];
+    return key;
+}
+
+// Shader and parameter names of a schema payload
+std::vector<std::string> splitSchema(const char* data, uint64_t size) {
+    std::vector<std::string> names;
+    uint64_t start = 0;
+    for (uint64_t i = 0; i <= size; i++) {
+        if (i == size || data[i] == '\0') {
+            names.push_back(std::string(data + start, i - start));
+            start = i + 1;
+        }
+    }
+    return names;
+}
+
+StoreRecord newRecord(StoreRecordKind kind, int schema, const float* params,
+                      int n_params) {
+    StoreRecord record;
+    memset(&record, 0, sizeof(record));
+    record.kind = kind;
+    record.schema = schema;
+    record.n_params = n_params;
+    if (n_params > 0) {
+        memcpy(record.params, params, n_params * sizeof(float));
+    }
+    return record;
+}
+
+// Payload of a lobe record matching its n_phi and n_values
+inline bool lobeLayoutValid(const StoreRecord& r) {
+    const uint64_t bytes = storeLobeBytes(r.n_phi, r.n_values);
+    return bytes > 0 && r.payload_bytes == bytes;
+}
+
+// Drops the lobe records of a payload other than their layout, which
+// would be read past the mapping
+int dropInvalidLobes(std::vector<StoreRecord>& records) {
+    const size_t n_old = records.size();
+    size_t n = 0;
+    for (size_t i = 0; i < n_old; i++) {
+        const StoreRecord& r = records[i];
+        if (r.kind == STORE_LOBE && !lobeLayoutValid(r)) continue;
+        records[n++] = r;
+    }
+    records.resize(n);
+    return (int)(n_old - n);
+}
+
+// Records of the chunk at `pos` (false when incomplete)
+bool readChunk(const char* data, size_t size, uint64_t pos,
+               std::vector<StoreRecord>& records, uint64_t& next) {
+    StoreChunkHeader chunk;
+    if (size - pos < sizeof(chunk)) return false;
+    memcpy(&chunk, data + pos, sizeof(chunk));
+    if (memcmp(chunk.magic, CHUNK_MAGIC, 4) != 0 ||
+        chunk.bytes > size - pos - sizeof(chunk)) {
+        return false;
+    }
+    const uint64_t end = pos + sizeof(chunk) + chunk.bytes;
+    uint64_t p = pos + sizeof(chunk);
+    const size_t n_old = records.size();
+    for (uint32_t r = 0; r < chunk.n_records; r++) {
+        StoreRecord record;
+        bool ok = end - p >= sizeof(record);
+        if (ok) {
+            memcpy(&record, data + p, sizeof(record));
+            p += sizeof(record);
+            ok = record.n_params <= STORE_MAX_PARAMS &&
+                 record.payload_bytes <= end - p;
+        }
+        if (!ok) {
+            records.resize(n_old);
+            return false;
+        }
+        record.offset = p;
+        records.push_back(record);
+        p += std::min(padded(record.payload_bytes), end - p);
+    }
+    next = end;
+    return true;
+}
+
+} // namespace
+
+// === Reading ===
+uint64_t storeLobeBytes(uint32_t n_phi, uint32_t n_values) {
+    // bounded, so the product cannot overflow
+    if (n_phi < 3 || n_phi > (1u << 16) || n_values < 1 ||
+        n_values > (1u << 16)) {
+        return 0;
+    }
+    const uint64_t n_theta = std::max(n_phi / 2, 1u);
+    return ((uint64_t)n_phi * n_theta + 2) * n_values * sizeof(float);
+}
+
+bool readStoreRecords(const char* data, size_t size,
+                      std::vector<StoreRecord>& records, uint64_t& end,
+                      bool& indexed, int& n_invalid) {
+    StoreFileHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, STORE_MAGIC, 4) != 0 ||
+        header.version != STORE_VERSION) {
+        return false;
+    }
+    records.clear();
+    n_invalid = 0;
+
+    // index of a closed file
+    StoreTrailer trailer;
+    if (size >= sizeof(header) + sizeof(trailer)) {
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        const uint64_t index_end = size - sizeof(trailer);
+        if (memcmp(trailer.magic, INDEX_MAGIC, 4) == 0 &&
+            trailer.version == STORE_VERSION &&
+            trailer.index_offset >= sizeof(header) &&
+            trailer.index_offset <= index_end &&
+            trailer.n_records == (index_end - trailer.index_offset) /
+                                     sizeof(StoreRecord) &&
+            (index_end - trailer.index_offset) % sizeof(StoreRecord) == 0) {
+            records.resize(trailer.n_records);
+            if (!records.empty()) {
+                memcpy(&records[0], data + trailer.index_offset,
+                       records.size() * sizeof(StoreRecord));
+            }
+            bool ok = true;
+            for (int i = 0; i < records.size() && ok; i++) {
+                const StoreRecord& r = records[i];
+                ok = r.n_params <= STORE_MAX_PARAMS &&
+                     r.offset <= trailer.index_offset &&
+                     r.payload_bytes <= trailer.index_offset - r.offset;
+            }
+            if (ok) {
+                end = trailer.index_offset;
+                indexed = true;
+                n_invalid = dropInvalidLobes(records);
+                return true;
+            }
+            records.clear();
+        }
+    }
+
+    // chunks of an interrupted writer
+    uint64_t pos = sizeof(header);
+    while (readChunk(data, size, pos, records, pos)) {}
+    end = pos;
+    indexed = false;
+    n_invalid = dropInvalidLobes(records);
+    return true;
+}
+
+bool ResultStore::open(const std::string& path) {
+    this->records.clear();
+    this->by_key.clear();
+    this->schema_records.clear();
+    if (!this->file.open(path, true)) {
+        this->error = this->file.getError();
+        return false;
+    }
+    uint64_t end;
+    if (!readStoreRecords((const char*)this->file.getData(),
+                          this->file.getSize(), this->records, end,
+                          this->has_index, this->n_invalid)) {
+        this->error = "Not a result store: " + path;
+        this->file.close();
+        return false;
+    }
+    for (int i = 0; i < this->records.size(); i++) {
+        const StoreRecord& r = this->records[i];
+        if (r.kind == STORE_SCHEMA) {
+            if (r.schema >= this->schema_records.size()) {
+                this->schema_records.resize(r.schema + 1, -1);
+            }
+            this->schema_records[r.schema] = i;
+        } else {
+            // the latest record of a key replaces the earlier ones
+            const uint64_t h = recordKeyHash(r.schema, r.params, r.n_params,
+                                             keyLight(r));
+            std::pair<KeyIndex::iterator, KeyIndex::iterator> range =
+                this->by_key.equal_range(h);
+            KeyIndex::iterator it = range.first;
+            while (it != range.second &&
+                   !recordHasKey(this->records[it->second], r.schema,
+                                 r.params, r.n_params, keyLight(r))) {
+                ++it;
+            }
+            if (it != range.second) {
+                it->second = i;
+            } else {
+                this->by_key.insert(std::make_pair(h, i));
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> ResultStore::schemaNames(int schema) const {
+    if (schema < 0 || schema >= this->schema_records.size() ||
+        this->schema_records[schema] < 0) {
+        return std::vector<std::string>();
+    }
+    const StoreRecord& r = this->records[this->schema_records[schema]];
+    return splitSchema((const char*)this->file.getData() + r.offset,
+                       r.payload_bytes);
+}
+
+std::string ResultStore::schemaShader(int schema) const {
+    const std::vector<std::string> names = this->schemaNames(schema);
+    return names.empty() ? "" : names[0];
+}
+
+std::vector<std::string> ResultStore::schemaParams(int schema) const {
+    std::vector<std::string> names = this->schemaNames(schema);
+    if (!names.empty()) names.erase(names.begin());
+    return names;
+}
+
+int ResultStore::find(int schema, const float* params, int n_params,
+                      const glm::vec3& light) const {
+    const float l[3] = {light.x, light.y, light.z};
+    const int r = this->findKey(schema, params, n_params, l);
+    return (r >= 0) ? r : this->findKey(schema, params, n_params, NO_LIGHT);
+}
+
+int ResultStore::findKey(uint32_t schema, const float* params, int n_params,
+                         const float* light) const {
+    std::pair<KeyIndex::const_iterator, KeyIndex::const_iterator> range =
+        this->by_key.equal_range(recordKeyHash(schema, params, n_params,
+                                               light));
+    for (KeyIndex::const_iterator it = range.first; it != range.second;
+         ++it) {
+        if (recordHasKey(this->records[it->second], schema, params, n_params,
+                         light)) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+const float* ResultStore::lobeValues(const StoreRecord& record) const {
+    if (record.kind != STORE_LOBE || !lobeLayoutValid(record) ||
+        record.offset > this->file.getSize() ||
+        record.payload_bytes > this->file.getSize() - record.offset) {
+        return NULL;
+    }
+    return (const float*)((const char*)this->file.getData() + record.offset);
+}
+
+// === ResultStoreWriter ===
+ResultStoreWriter::ResultStoreWriter() : end(0), blocks(NULL), failed(false),
+                                         n_schemas(0) {}
+
+ResultStoreWriter::~ResultStoreWriter() {
+    this->close();
+}
+
+bool ResultStoreWriter::open(const std::string& path) {
+    this->close();
+    this->path = path;
+    this->failed = false;
+    this->old_records.clear();
+    this->old_keys.clear();
+    this->schemas.clear();
+    this->n_schemas = 0;
+    if (!this->file.open(path, true, false)) {
+        this->error = this->file.getError();
+        return false;
+    }
+    if (this->file.getSize() == 0) {
+        StoreFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STORE_MAGIC, 4);
+        header.version = STORE_VERSION;
+        this->end = sizeof(header);
+        if (!this->file.write(0, &header, sizeof(header))) {
+            this->error = "Failed to write " + path;
+            this->file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // existing records; new chunks replace the old index
+    MappedFile existing;
+    uint64_t data_end = 0;
+    bool indexed;
+    int n_invalid;  // recomputed when resuming
+    bool ok = existing.open(path) &&
+              readStoreRecords((const char*)existing.getData(),
+                               existing.getSize(), this->old_records,
+                               data_end, indexed, n_invalid);
+    for (int i = 0; ok && i < this->old_records.size(); i++) {
+        const StoreRecord& r = this->old_records[i];
+        if (r.kind == STORE_SCHEMA) {
+            const std::vector<std::string> names = splitSchema(
+                (const char*)existing.getData() + r.offset, r.payload_bytes);
+            const std::vector<std::string> params(names.begin() + 1,
+                                                  names.end());
+            this->schemas[schemaKey(names[0], params)] = r.schema;
+            this->n_schemas = std::max(this->n_schemas, (int)r.schema + 1);
+        } else {
+            this->old_keys[recordKey(r)] = i;
+        }
+    }
+    existing.close();
+    if (!ok) {
+        this->error = "Not a result store: " + path;
+        this->file.close();
+        return false;
+    }
+    this->end = data_end;
+    // a stale index would look valid after short appends
+    if (!this->file.resize(data_end)) {
+        this->error = "Failed to truncate " + path;
+        this->file.close();
+        return false;
+    }
+    return true;
+}
+
+bool ResultStoreWriter::close() {
+    if (!this->file.isOpen()) return true;
+    // index: earlier records, then the chunks in publication order
+    std::vector<IndexBlock*> published;
+    for (IndexBlock* b = this->blocks.exchange(NULL); b; b = b->next) {
+        published.push_back(b);
+    }
+    std::vector<StoreRecord> index = this->old_records;
+    for (int b = (int)published.size() - 1; b >= 0; b--) {
+        index.insert(index.end(), published[b]->records.begin(),
+                     published[b]->records.end());
+        delete published[b];
+    }
+    StoreTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.index_offset = this->end;
+    trailer.n_records = index.size();
+    memcpy(trailer.magic, INDEX_MAGIC, 4);
+    trailer.version = STORE_VERSION;
+    const uint64_t index_bytes = index.size() * sizeof(StoreRecord);
+    bool ok = !this->failed &&
+              (index.empty() ||
+               this->file.write(trailer.index_offset, &index[0],
+                                index_bytes)) &&
+              this->file.write(trailer.index_offset + index_bytes, &trailer,
+                               sizeof(trailer)) &&
+              this->file.resize(trailer.index_offset + index_bytes +
+                                sizeof(trailer));
+    this->file.close();
+    if (!ok) this->error = "Failed to write " + this->path;
+    return ok;
+}
+
+int ResultStoreWriter::addSchema(const std::string& shader,
+                                 const std::vector<std::string>& params) {
+    const std::string key = schemaKey(shader, params);
+    std::unordered_map<std::string, int>::const_iterator it =
+        this->schemas.find(key);
+    if (it != this->schemas.end()) return it->second;
+    if (params.size() > STORE_MAX_PARAMS) {
+        this->error = "Too many parameters for a result store";
+        return -1;
+    }
+
+    // its own chunk: header, record, names
+    const int id = this->n_schemas;
+    StoreRecord record = newRecord(STORE_SCHEMA, id, NULL, 0);
+    record.n_params = params.size();
+    record.payload_bytes = key.size();
+    StoreChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, CHUNK_MAGIC, 4);
+    chunk.n_records = 1;
+    chunk.bytes = sizeof(record) + padded(key.size());
+    std::vector<char> bytes(sizeof(chunk) + chunk.bytes, 0);
+    memcpy(&bytes[0], &chunk, sizeof(chunk));
+    memcpy(&bytes[sizeof(chunk)], &record, sizeof(record));
+    memcpy(&bytes[sizeof(chunk) + sizeof(record)], key.data(), key.size());
+    const uint64_t pos = this->reserve(bytes.size());
+    if (!this->file.write(pos, &bytes[0], bytes.size())) {
+        this->error = "Failed to write " + this->path;
+        this->failed = true;
+        return -1;
+    }
+    record.offset = pos + sizeof(chunk) + sizeof(record);
+    std::vector<StoreRecord> records(1, record);
+    this->publish(records);
+    this->schemas[key] = id;
+    this->n_schemas++;
+    return id;
+}
+
+bool ResultStoreWriter::contains(int schema, const float* params,
+                                 int n_params, const glm::vec3& light) const {
+    const float l[3] = {light.x, light.y, light.z};
+    return this->old_keys.count(recordKey(schema, params, n_params, l)) > 0;
+}
+
+uint64_t ResultStoreWriter::reserve(uint64_t bytes) {
+    return this->end.fetch_add(bytes);
+}
+
+void ResultStoreWriter::publish(std::vector<StoreRecord>& records) {
+    IndexBlock* block = new IndexBlock();
+    block->records.swap(records);
+    block->next = this->blocks.load();
+    while (!this->blocks.compare_exchange_weak(block->next, block)) {}
+}
+
+// === StoreAppender ===
+StoreAppender::StoreAppender(ResultStoreWriter& store, size_t chunk_bytes)
+    : store(store), chunk_bytes(chunk_bytes) {}
+
+StoreAppender::~StoreAppender() {
+    this->flush();
+}
+
+bool StoreAppender::appendLobe(int schema, const float* params, int n_params,
+                               const glm::vec3& light, int n_phi, int n_dirs,
+                               int n_values, int values_kind,
+                               const float* data) {
+    if (n_params > STORE_MAX_PARAMS) return false;
+    StoreRecord record = newRecord(STORE_LOBE, schema, params, n_params);
+    record.light[0] = light.x;
+    record.light[1] = light.y;
+    record.light[2] = light.z;
+    record.n_phi = n_phi;
+    record.n_values = n_values;
+    record.values = values_kind;
+    record.payload_bytes = (uint64_t)n_dirs * n_values * sizeof(float);
+    const size_t bytes = sizeof(record) + padded(record.payload_bytes);
+    bool ok = true;
+    if (!this->buffer.empty() &&
+        this->buffer.size() + bytes > this->chunk_bytes) {
+        ok = this->flush();
+    }
+    const size_t pos = this->buffer.size();
+    this->buffer.resize(pos + bytes, 0);
+    memcpy(&this->buffer[pos], &record, sizeof(record));
+    memcpy(&this->buffer[pos + sizeof(record)], data, record.payload_bytes);
+    record.offset = pos + sizeof(record);
+    this->records.push_back(record);
+    return ok;
+}
+
+bool StoreAppender::appendTable(int schema, const float* params,
+                                int n_params, const TiledHeader& header,
+                                const BaseShader& shader,
+                                std::string& error) {
+    if (n_params > STORE_MAX_PARAMS) {
+        error = "Too many parameters for a result store";
+        return false;
+    }
+    StoreRecord record = newRecord(STORE_TABLE, schema, params, n_params);
+    record.payload_bytes = tiledFileSize(header);
+    StoreChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, CHUNK_MAGIC, 4);
+    chunk.n_records = 1;
+    chunk.bytes = sizeof(record) + padded(record.payload_bytes);
+    const uint64_t pos = this->store.reserve(sizeof(chunk) + chunk.bytes);
+    record.offset = pos + sizeof(chunk) + sizeof(record);
+
+    // the chunk header last: a scan skips a table that was not completed;
+    // a failed one stays as an empty chunk
+    BlockFile& file = this->store.file;
+    bool ok = file.write(pos + sizeof(chunk), &record, sizeof(record)) &&
+              bakeTiledBRDF(file, record.offset, header, shader, 1, error);
+    if (!ok) chunk.n_records = 0;
+    if (!file.write(pos, &chunk, sizeof(chunk))) {
+        this->store.failed = true;
+        ok = false;
+    }
+    if (!ok) {
+        if (error.empty()) error = "Failed to write " + this->store.path;
+        return false;
+    }
+    std::vector<StoreRecord> records(1, record);
+    this->store.publish(records);
+    return true;
+}
+
+bool StoreAppender::flush() {
+    if (this->records.empty()) return true;
+    StoreChunkHeader chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, CHUNK_MAGIC, 4);
+    chunk.n_records = this->records.size();
+    chunk.bytes = this->buffer.size();
+    const uint64_t pos = this->store.reserve(sizeof(chunk) + chunk.bytes);
+    // records before the header (see appendTable())
+    BlockFile& file = this->store.file;
+    const bool ok = file.write(pos + sizeof(chunk), &this->buffer[0],
+                               this->buffer.size()) &&
+                    file.write(pos, &chunk, sizeof(chunk));
+    if (ok) {
+        for (int r = 0; r < this->records.size(); r++) {
+            this->records[r].offset += pos + sizeof(chunk);
+        }
+        this->store.publish(this->records);
+    } else {
+        this->store.failed = true;
+    }
+    this->records.clear();
+    this->buffer.clear();
+    return ok;
+}
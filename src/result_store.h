@@ -0,0 +1,197 @@
+#ifndef RESULT_STORE_H_261018
+#define RESULT_STORE_H_261018
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "io/block_file.h"
+#include "io/mapped_file.h"
+#include "tiled.h"
+
+// Append-only container of sweep results (.bres): lobes (float values over
+// the directions of sweepLobeDirs()) and 4D tables (.b4d images), keyed by
+// (shader, parameter values, light direction).
+//
+//   StoreFileHeader
+//   chunks: StoreChunkHeader, records (StoreRecord, payload)...
+//   index: StoreRecord[n_records] with the payload offsets
+//   StoreTrailer (last bytes of the file)
+//
+// Every chunk is written by one thread at a range reserved with one atomic
+// add on the end of the file, so threads append without a lock. The index
+// is written by close(); the file of an interrupted writer is indexed by
+// scanning the chunks up to the first incomplete one. A schema record
+// (the shader name and parameter names, '\0' separated) precedes the
+// records that refer to it. Little endian.
+enum StoreRecordKind {
+    STORE_SCHEMA = 1,
+    STORE_LOBE,
+    STORE_TABLE
+};
+
+const int STORE_MAX_PARAMS = 16;
+
+struct StoreFileHeader {
+    char magic[4];  // "BRES"
+    uint32_t version;
+    uint64_t reserved;
+};
+
+struct StoreChunkHeader {
+    char magic[4];  // "CHNK"
+    uint32_t n_records;
+    uint64_t bytes;  // of the records
+};
+
+struct StoreRecord {
+    uint32_t kind;     // StoreRecordKind
+    uint32_t schema;   // id of the schema (0, 1, ... in file order)
+    uint32_t n_params;
+    uint32_t n_phi;     // lobes: direction grid
+    uint32_t n_values;  // lobes: values per direction
+    uint32_t values;    // lobes: SweepValues (sweep.h)
+    float light[3];     // light direction (lobes)
+    float params[STORE_MAX_PARAMS];
+    uint32_t reserved;
+    uint64_t payload_bytes;
+    uint64_t offset;  // of the payload in the file (index only)
+};
+
+struct StoreTrailer {
+    uint64_t index_offset;
+    uint64_t n_records;
+    char magic[4];  // "BRSI"
+    uint32_t version;
+};
+
+const uint32_t STORE_VERSION = 1;
+
+// Appends to a new or existing store. append*() of different threads go
+// through their own StoreAppender.
+class ResultStoreWriter {
+public:
+    ResultStoreWriter();
+    ~ResultStoreWriter();
+    // Existing records (index or scan) are kept
+    bool open(const std::string& path);
+    // Writes the index
+    bool close();
+    bool isOpen() const { return file.isOpen(); }
+    // Schema record index of a shader / parameter list (the existing one
+    // when already stored). Not thread safe.
+    int addSchema(const std::string& shader,
+                  const std::vector<std::string>& params);
+    // Record of the file when opened (resuming)
+    bool contains(int schema, const float* params, int n_params,
+                  const glm::vec3& light) const;
+    const std::string& getError() const { return error; }
+
+private:
+    friend class StoreAppender;
+    ResultStoreWriter(const ResultStoreWriter&);
+    ResultStoreWriter& operator=(const ResultStoreWriter&);
+
+    // Range of `bytes` at the end of the file
+    uint64_t reserve(uint64_t bytes);
+    // Index of a written chunk (lock free)
+    void publish(std::vector<StoreRecord>& records);
+
+    struct IndexBlock {
+        std::vector<StoreRecord> records;
+        IndexBlock* next;
+    };
+    BlockFile file;
+    std::string path;
+    std::string error;
+    std::atomic<uint64_t> end;
+    std::atomic<IndexBlock*> blocks;
+    std::atomic<bool> failed;
+    std::vector<StoreRecord> old_records;  // of the file when opened
+    std::unordered_map<std::string, int> old_keys;
+    int n_schemas;
+    std::unordered_map<std::string, int> schemas;  // by name and params
+};
+
+// Buffers the records of one thread into chunks
+class StoreAppender {
+public:
+    explicit StoreAppender(ResultStoreWriter& store,
+                           size_t chunk_bytes = 1 << 20);
+    ~StoreAppender();
+    // n_dirs * n_values floats
+    bool appendLobe(int schema, const float* params, int n_params,
+                    const glm::vec3& light, int n_phi, int n_dirs,
+                    int n_values, int values_kind, const float* data);
+    // Bakes a table straight into its own chunk
+    bool appendTable(int schema, const float* params, int n_params,
+                     const TiledHeader& header, const BaseShader& shader,
+                     std::string& error);
+    bool flush();
+
+private:
+    StoreAppender(const StoreAppender&);
+    StoreAppender& operator=(const StoreAppender&);
+
+    ResultStoreWriter& store;
+    size_t chunk_bytes;
+    std::vector<char> buffer;  // records of the chunk
+    std::vector<StoreRecord> records;  // offsets relative to the buffer
+};
+
+// Read-only view of a store through a memory map
+class ResultStore {
+public:
+    ResultStore() : has_index(false), n_invalid(0) {}
+    bool open(const std::string& path);
+    const std::string& getPath() const { return file.getPath(); }
+    const std::string& getError() const { return error; }
+    // false when the index was rebuilt by scanning
+    bool indexed() const { return has_index; }
+    // Lobe records skipped for a payload which does not match the layout
+    int numInvalid() const { return n_invalid; }
+
+    int numRecords() const { return (int)records.size(); }
+    const StoreRecord& record(int i) const { return records[i]; }
+    int numSchemas() const { return (int)schema_records.size(); }
+    std::string schemaShader(int schema) const;
+    std::vector<std::string> schemaParams(int schema) const;
+    // Record of a key (the latest one; tables match any light), -1 if none.
+    // Does not allocate.
+    int find(int schema, const float* params, int n_params,
+             const glm::vec3& light) const;
+    // Lobe values in the mapping (n_phi grid * n_values floats), NULL when
+    // the record is not a lobe of a valid layout
+    const float* lobeValues(const StoreRecord& record) const;
+
+private:
+    typedef std::unordered_multimap<uint64_t, int> KeyIndex;
+
+    // Shader and parameter names
+    std::vector<std::string> schemaNames(int schema) const;
+    int findKey(uint32_t schema, const float* params, int n_params,
+                const float* light) const;
+
+    MappedFile file;
+    std::string error;
+    bool has_index;
+    int n_invalid;
+    std::vector<StoreRecord> records;
+    KeyIndex by_key;  // records by the hash of their key
+    std::vector<int> schema_records;  // by schema id
+};
+
+// Payload bytes of a lobe over the sweepLobeDirs() of n_phi (at least 3)
+// with n_values floats per direction, 0 for an invalid layout
+uint64_t storeLobeBytes(uint32_t n_phi, uint32_t n_values);
+
+// Records of a store file: the index, or a scan of the chunks (`indexed`
+// false); `end` is the end of the last chunk. Lobe records whose payload
+// does not match their layout are dropped and counted in `n_invalid`.
+bool readStoreRecords(const char* data, size_t size,
+                      std::vector<StoreRecord>& records, uint64_t& end,
+                      bool& indexed, int& n_invalid);
+
+#endif
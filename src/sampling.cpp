@@ -0,0 +1,99 @@
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+// === Distribution1D ===
+void Distribution1D::init(const float* values, int n) {
+    this->func.resize(n);
+    this->cdf.resize(n + 1);
+    this->cdf[0] = 0.f;
+    for (int i = 0; i < n; i++) {
+        this->func[i] = (values[i] > 0.f) ? values[i] : 0.f;  // NaN too
+        this->cdf[i + 1] = this->cdf[i] + this->func[i] / n;
+    }
+    this->integral = this->cdf[n];
+    if (this->integral > 0.f) {
+        for (int i = 1; i <= n; i++) this->cdf[i] /= this->integral;
+    } else {
+        for (int i = 1; i <= n; i++) this->cdf[i] = (float)i / n;
+    }
+    this->cdf[n] = 1.f;
+}
+
+float Distribution1D::sample(float u, float& pdf) const {
+    const int n = this->size();
+    // last bin whose cdf <= u, skipping empty bins
+    const int bin = std::min(
+        (int)(std::upper_bound(this->cdf.begin(), this->cdf.end(), u) -
+              this->cdf.begin()) - 1,
+        n - 1);
+    const float width = this->cdf[bin + 1] - this->cdf[bin];
+    float du = u - this->cdf[bin];
+    if (width > 0.f) du /= width;
+    pdf = (this->integral > 0.f) ? this->func[bin] / this->integral : 1.f;
+    return std::min((bin + du) / n, 1.f - 1e-7f);
+}
+
+float Distribution1D::pdf(float x) const {
+    const int n = this->size();
+    const int bin = glm::clamp((int)(x * n), 0, n - 1);
+    return (this->integral > 0.f) ? this->func[bin] / this->integral : 1.f;
+}
+
+// === Directions ===
+glm::vec3 sampleUniformSphere(float u1, float u2) {
+    const float z = 1.f - 2.f * u1;
+    const float r = std::sqrt(std::max(1.f - z * z, 0.f));
+    const float phi = 2.f * glm::pi<float>() * u2;
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+void makeFrame(const glm::vec3& n, glm::vec3& s, glm::vec3& t) {
+    const glm::vec3 a = (std::fabs(n.x) > 0.9f) ? glm::vec3(0.f, 1.f, 0.f)
+                                                : glm::vec3(1.f, 0.f, 0.f);
+    s = glm::normalize(glm::cross(n, a));
+    t = glm::cross(n, s);
+}
+
+// === erfInv ===
+double erfInv(double x) {
+    // single precision polynomial (M. Giles, 2010) ...
+    const float xf = (float)x;
+    float w = -std::log((1.f - xf) * (1.f + xf));
+    float p;
+    if (w < 5.f) {
+        w = w - 2.5f;
+        p = 2.81022636e-08f;
+        p = 3.43273939e-07f + p * w;
+        p = -3.5233877e-06f + p * w;
+        p = -4.39150654e-06f + p * w;
+        p = 0.00021858087f + p * w;
+        p = -0.00125372503f + p * w;
+        p = -0.00417768164f + p * w;
+        p = 0.246640727f + p * w;
+        p = 1.50140941f + p * w;
+    } else {
+        w = std::sqrt(w) - 3.f;
+        p = -0.000200214257f;
+        p = 0.000100950558f + p * w;
+        p = 0.00134934322f + p * w;
+        p = -0.00367342844f + p * w;
+        p = 0.00573950773f + p * w;
+        p = -0.0076224613f + p * w;
+        p = 0.00943887047f + p * w;
+        p = 1.00167406f + p * w;
+        p = 2.83297682f + p * w;
+    }
+    double y = p * xf;
+    if (!std::isfinite(y)) return y;
+    // ... refined by Newton steps on erf() in double
+    for (int i = 0; i < 2; i++) {
+        const double d = 1.12837916709551257 * std::exp(-y * y);  // erf'
+        if (d <= 0.0) break;
+        y -= (std::erf(y) - x) / d;
+    }
+    return y;
+}
@@ -0,0 +1,35 @@
+#ifndef SAMPLING_H_261018
+#define SAMPLING_H_261018
+
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// Piecewise constant distribution over [0, 1) with `n` equal bins,
+// sampled by inverting its CDF.
+class Distribution1D {
+public:
+    Distribution1D() : integral(0.f) {}
+    // Negative and NaN values count as zero. All zero: uniform.
+    void init(const float* values, int n);
+    // x in [0, 1) for u in [0, 1) and its density
+    float sample(float u, float& pdf) const;
+    float pdf(float x) const;
+    int size() const { return (int)this->func.size(); }
+
+    std::vector<float> func;
+    std::vector<float> cdf;  // size() + 1 entries
+    float integral;          // mean of func (0 when uniform)
+};
+
+const float UNIFORM_SPHERE_PDF = 0.0795774715f;  // 1 / (4 pi)
+glm::vec3 sampleUniformSphere(float u1, float u2);
+
+// Orthonormal s, t perpendicular to the unit vector n
+void makeFrame(const glm::vec3& n, glm::vec3& s, glm::vec3& t);
+
+// Inverse of erf() on (-1, 1)
+double erfInv(double x);
+
+#endif
@@ -1,5 +1,132 @@
 #include "shader.h"
 
+#include <cmath>
+#include <cstring>
+
+#include "simd/coord_kernels.h"
+#include "simd/shader_kernels.h"
+
+namespace {
+
+inline int mathTier(const BaseShader& shader) {
+    return shader.fast_math ? simd::MATH_FAST : simd::MATH_ACCURATE;
+}
+
+// Centers of the red, green and blue bands of channelBand() (nm)
+const float BAND_CENTER[3] = { 610.f, 530.f, 450.f };
+
+} // namespace
+
+// === Color ===
+ColorChannels spectralChannels(int n, float lambda_min, float lambda_max) {
+    ColorChannels channels;
+    channels.mode = COLOR_SPECTRAL;
+    channels.n = std::min(std::max(n, 1), MAX_COLOR_CHANNELS);
+    const float step = (lambda_max - lambda_min) / channels.n;
+    for (int c = 0; c < channels.n; c++) {
+        channels.lambda[c] = lambda_min + (c + 0.5f) * step;
+    }
+    return channels;
+}
+
+glm::vec3 channelsToRGB(const ColorChannels& channels, const float* values) {
+    if (channels.mode == COLOR_RGB) {
+        return glm::vec3(values[0], values[1], values[2]);
+    }
+    glm::vec3 sum(0.f), count(0.f);
+    for (int c = 0; c < channels.n; c++) {
+        const int band = channelBand(channels, c);
+        sum[band] += values[c];
+        count[band] += 1.f;
+    }
+    // empty bands take the sample nearest to their center (the
+    // wavelengths may come in any order)
+    glm::vec3 rgb;
+    for (int band = 0; band < 3; band++) {
+        if (count[band] > 0.f) {
+            rgb[band] = sum[band] / count[band];
+            continue;
+        }
+        int nearest = 0;
+        for (int c = 1; c < channels.n; c++) {
+            if (std::fabs(channels.lambda[c] - BAND_CENTER[band]) <
+                std::fabs(channels.lambda[nearest] - BAND_CENTER[band])) {
+                nearest = c;
+            }
+        }
+        rgb[band] = values[nearest];
+    }
+    return rgb;
+}
+
+int channelBand(const ColorChannels& channels, int c) {
+    if (channels.mode == COLOR_RGB) return std::min(c, 2);
+    const float l = channels.lambda[c];
+    return (l >= 580.f) ? 0 : (l >= 490.f) ? 1 : 2;
+}
+
+
+// === Base ===
+void BaseShader::sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = this->sample(light_dir, out_dirs[i], normal);
+    }
+}
+
+void BaseShader::sampleColorBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal,
+                                  const ColorChannels& channels, float* out,
+                                  int n) {
+    this->sampleBatch(light_dir, out_dirs, normal, out, n);
+    // spread in place from the back (out[i] is read before it is written)
+    const int nc = channels.n;
+    for (int i = n - 1; i >= 0; i--) {
+        const float v = out[i];
+        for (int c = nc - 1; c >= 0; c--) out[i * nc + c] = v;
+    }
+}
+
+bool BaseShader::sampleDirection(const glm::vec3& light_dir,
+                                 const glm::vec3& normal, float u1, float u2,
+                                 glm::vec3& out_dir, float& pdf) {
+    out_dir = sampleUniformSphere(u1, u2);
+    pdf = UNIFORM_SPHERE_PDF;
+    return true;
+}
+
+float BaseShader::pdf(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                      const glm::vec3& normal) {
+    return UNIFORM_SPHERE_PDF;
+}
+
+bool BaseShader::setParam(const std::string& name, float value) {
+    std::vector<ShaderParam> params;
+    this->getParams(params);
+    for (int i = 0; i < params.size(); i++) {
+        if (name == params[i].name) {
+            *(params[i].value) = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BaseShader::getParam(const std::string& name, float& value) {
+    std::vector<ShaderParam> params;
+    this->getParams(params);
+    for (int i = 0; i < params.size(); i++) {
+        if (name == params[i].name) {
+            value = *(params[i].value);
+            return true;
+        }
+    }
+    return false;
+}
+
+
 // === Specular ===
 float SpecularShader::sample(const glm::vec3& light_dir,
                              const glm::vec3& out_dir,
@@ -14,6 +141,48 @@ float SpecularShader::sample(const glm::vec3& light_dir,
     return glm::pow(l_specular, this->spec_factor);
 }
 
+void SpecularShader::sampleBatch(const glm::vec3& light_dir,
+                                 const glm::vec3* out_dirs,
+                                 const glm::vec3& normal, float* out, int n) {
+    // parameter check
+    this->spec_factor = std::max(this->spec_factor, 0.f);
+
+    simd::SpecularKernelArgs args;
+    args.reflect_dir = glm::reflect(-light_dir, normal);
+    args.spec_factor = this->spec_factor;
+    simd::getShaderKernels().specular[mathTier(*this)](args, out_dirs, out, n);
+}
+
+bool SpecularShader::sampleDirection(const glm::vec3& light_dir,
+                                     const glm::vec3& normal, float u1,
+                                     float u2, glm::vec3& out_dir,
+                                     float& pdf) {
+    const float e = std::max(this->spec_factor, 0.f);
+    const glm::vec3 r = glm::normalize(glm::reflect(-light_dir, normal));
+    glm::vec3 s, t;
+    makeFrame(r, s, t);
+    // density (e + 1) / (2 pi) cos^e around r
+    const float cos_a = std::pow(u1, 1.f / (e + 1.f));
+    const float sin_a = std::sqrt(std::max(1.f - cos_a * cos_a, 0.f));
+    const float phi = 2.f * glm::pi<float>() * u2;
+    out_dir = cos_a * r + sin_a * (std::cos(phi) * s + std::sin(phi) * t);
+    pdf = (e + 1.f) / (2.f * glm::pi<float>()) * std::pow(cos_a, e);
+    return pdf > 0.f;
+}
+
+float SpecularShader::pdf(const glm::vec3& light_dir,
+                          const glm::vec3& out_dir, const glm::vec3& normal) {
+    const float e = std::max(this->spec_factor, 0.f);
+    const glm::vec3 r = glm::normalize(glm::reflect(-light_dir, normal));
+    const float cos_a = glm::dot(glm::normalize(out_dir), r);
+    if (cos_a <= 0.f) return 0.f;
+    return (e + 1.f) / (2.f * glm::pi<float>()) * std::pow(cos_a, e);
+}
+
+void SpecularShader::getParams(std::vector<ShaderParam>& params) {
+    params.push_back(ShaderParam("spec_factor", &this->spec_factor));
+}
+
 
 // === KajiyaKay ===
 inline float KajiyaKayDiffuse(glm::vec3 tangent, glm::vec3 light_dir) {
@@ -56,6 +225,99 @@ float KajiyaKayShader::sample(const glm::vec3& light_dir,
     return intensity;
 }
 
+void KajiyaKayShader::sampleBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal, float* out, int n) {
+    // parameter check
+    this->spec_factor = std::max(this->spec_factor, 0.f);
+    this->kd = std::max(this->kd, 0.f);
+    this->ks = std::max(this->ks, 0.f);
+
+    // light terms
+    simd::KajiyaKayKernelArgs args;
+    args.tangent = this->tangent;
+    args.sin_tl = KajiyaKayDiffuse(this->tangent, light_dir);
+    args.cos_tl = glm::dot(glm::normalize(light_dir), this->tangent);
+    args.diffuse = this->kd * args.sin_tl;
+    args.ks = this->ks;
+    args.spec_factor = this->spec_factor;
+    simd::getShaderKernels().kajiya_kay[mathTier(*this)](args, out_dirs, out,
+                                                         n);
+}
+
+namespace {
+
+const int KAJIYA_KAY_SAMPLING_BINS = 256;
+
+} // namespace
+
+void KajiyaKayShader::updateSampling(const glm::vec3& light_dir) {
+    if (this->sampling_valid && this->sampling_light_dir == light_dir &&
+        this->sampling_tangent == this->tangent &&
+        this->sampling_params[0] == this->spec_factor &&
+        this->sampling_params[1] == this->kd &&
+        this->sampling_params[2] == this->ks) {
+        return;
+    }
+    // sample() at the bin centers of cos(angle to the tangent)
+    const glm::vec3 T = glm::normalize(this->tangent);
+    const float sin_tl = KajiyaKayDiffuse(T, light_dir);
+    const float cos_tl = glm::dot(glm::normalize(light_dir), T);
+    const float e = std::max(this->spec_factor, 0.f);
+    const float diffuse = std::max(this->kd, 0.f) * sin_tl;
+    const int n = KAJIYA_KAY_SAMPLING_BINS;
+    this->sampling_values.resize(n);
+    for (int i = 0; i < n; i++) {
+        const float vt = -1.f + 2.f * (i + 0.5f) / n;
+        const float sin_te = std::sqrt(std::max(1.f - vt * vt, 0.f));
+        const float kspec = std::max(sin_tl * sin_te - cos_tl * vt, 0.f);
+        this->sampling_values[i] = diffuse + std::max(this->ks, 0.f) *
+                                             std::pow(kspec, e);
+    }
+    this->sampling_cos.init(&this->sampling_values[0], n);
+
+    this->sampling_light_dir = light_dir;
+    this->sampling_tangent = this->tangent;
+    this->sampling_params[0] = this->spec_factor;
+    this->sampling_params[1] = this->kd;
+    this->sampling_params[2] = this->ks;
+    this->sampling_valid = true;
+}
+
+bool KajiyaKayShader::sampleDirection(const glm::vec3& light_dir,
+                                      const glm::vec3& normal, float u1,
+                                      float u2, glm::vec3& out_dir,
+                                      float& pdf) {
+    this->updateSampling(light_dir);
+    const glm::vec3 T = glm::normalize(this->tangent);
+    glm::vec3 s, t;
+    makeFrame(T, s, t);
+    float pdf_x;
+    const float vt = -1.f + 2.f * this->sampling_cos.sample(u1, pdf_x);
+    const float sin_te = std::sqrt(std::max(1.f - vt * vt, 0.f));
+    const float phi = 2.f * glm::pi<float>() * u2;
+    out_dir = vt * T + sin_te * (std::cos(phi) * s + std::sin(phi) * t);
+    // d(omega) = d(vt) d(phi), vt = 2 x - 1
+    pdf = pdf_x / (4.f * glm::pi<float>());
+    return pdf > 0.f;
+}
+
+float KajiyaKayShader::pdf(const glm::vec3& light_dir,
+                           const glm::vec3& out_dir,
+                           const glm::vec3& normal) {
+    this->updateSampling(light_dir);
+    const float vt = glm::dot(glm::normalize(out_dir),
+                              glm::normalize(this->tangent));
+    return this->sampling_cos.pdf((vt + 1.f) * 0.5f) /
+           (4.f * glm::pi<float>());
+}
+
+void KajiyaKayShader::getParams(std::vector<ShaderParam>& params) {
+    params.push_back(ShaderParam("spec_factor", &this->spec_factor));
+    params.push_back(ShaderParam("kd", &this->kd));
+    params.push_back(ShaderParam("ks", &this->ks));
+}
+
 
 // === AF Marschner ===
 namespace {
@@ -132,11 +394,11 @@ inline float F_(float etad, float etadd, float gamma, bool inv) {
 }
 
 inline float A_(int p, float h, float gamma_i, float gamma_t, float etad,
-                float etadd, float theta_d, float sigma_a) {
+                float etadd, double cos_theta_d_, float sigma_a) {
     if (p == 0) {
         return F_(etad, etadd, gamma_i, false);
     } else {
-        const float cos_theta_d = std::max(fabs(cos(theta_d)), 1e-30);
+        const float cos_theta_d = std::max(fabs(cos_theta_d_), 1e-30);
         const float T = exp(-2 * sigma_a/cos_theta_d * (1 + cos(2 * gamma_t)));
         const float fres = F_(etad, etadd, gamma_i, false);
         const float fres_inv = F_(etad, etadd, gamma_t, true);
@@ -162,14 +424,28 @@ inline float dphi_dh_inv_(int p, float h, float etad) {
 }
 
 
-inline float N_p_(int p, float theta_d, float phi, float eta, float sigma_a) {
-    const float etad  = sqrt(eta * eta - sin(theta_d) * sin(theta_d)) /
-                        std::max(fabs(cos(theta_d)), 1e-20);
-    const float etadd = eta * eta / std::max(sqrt(eta * eta -
-                        sin(theta_d) * sin(theta_d)), 1e-20)
-                        * fabs(cos(theta_d));
-    dumpifbadassertionf(etad)
-    dumpifbadassertionf(etadd)
+// theta_d dependent terms shared by all the lobes
+struct ThetaDTerms {
+    double cos_theta_d;
+    float etad;   // Bravais index (perpendicular)
+    float etadd;  // Bravais index (parallel)
+};
+
+inline void thetaDTerms(float theta_d, float eta, ThetaDTerms& td) {
+    const double sin_theta_d = sin(theta_d);
+    td.cos_theta_d = cos(theta_d);
+    td.etad  = sqrt(eta * eta - sin_theta_d * sin_theta_d) /
+               std::max(fabs(td.cos_theta_d), 1e-20);
+    td.etadd = eta * eta / std::max(sqrt(eta * eta -
+               sin_theta_d * sin_theta_d), 1e-20)
+               * fabs(td.cos_theta_d);
+    dumpifbadassertionf(td.etad)
+    dumpifbadassertionf(td.etadd)
+}
+
+inline float N_p_(int p, const ThetaDTerms& td, float phi, float sigma_a) {
+    const float etad = td.etad;
+    const float etadd = td.etadd;
 
     float h_solutions[3];
     const int num_of_solutions = h_(h_solutions, p, phi, etad);
@@ -180,8 +456,8 @@ inline float N_p_(int p, float theta_d, float phi, float eta, float sigma_a) {
         const float gamma_i = asin(ClampUnitAbs(h));
         const float gamma_t = asin(ClampUnitAbs(h / etad));
         const float dphi_dh_inv = dphi_dh_inv_(p, h, etad);
-        const float A = A_(p, h, gamma_i, gamma_t, etad, etadd, theta_d,
-                           sigma_a);
+        const float A = A_(p, h, gamma_i, gamma_t, etad, etadd,
+                           td.cos_theta_d, sigma_a);
         N_p += A * dphi_dh_inv * 0.5;
         // Debug
         if(fabs(h) > 1) dump(h)
@@ -203,78 +479,55 @@ inline float rnd() {
 }
 
 // #define af_marschner_hair_shader_approx_dist
-inline float AFMarschner(float phi, float theta_d, float theta_h,
-                         AFMarschnerHairParams *hp) {
-    const int NUM_JITTER = 1;
-    const float JITTER = 0.f;
-    float R, TT, TRT;
+const int NUM_JITTER = 1;
+const float JITTER = 0.f;
 
-    // R
+// Evaluates R, TT and TRT in one pass. The theta_d terms (etad, etadd,
+// cos(theta_d)) are computed once per jitter sample for all the lobes.
+// The returned terms are M_p * N_p with the cos^2(theta_d) normalization but
+// without the lobe intensities, which are pure linear scales (see
+// applyIntensities()).
+inline AFMarschnerLobes AFMarschnerTerms(float phi, float theta_d,
+                                         float theta_h,
+                                         const AFMarschnerHairParams *hp) {
+    // M_p
     float M_R = gaussian(theta_h, hp->longitudinalShiftR,
                          hp->longitudinalWidthR);
-#ifdef af_marschner_hair_shader_approx_dist
-    float N_R = cos(phi * 0.5);
-#else
-    float N_R = 0;
-    {
-        const float jitter_theta = JITTER * (1 - 2 * rnd());
-        const float jitter_phi = JITTER * (1 - 2 * rnd());
-        for (int i = 0; i < NUM_JITTER; i++) {
-            N_R += N_p_(0, theta_d + jitter_theta, phi + jitter_phi,
-                        hp->eta, hp->sigma_a);
-        }
-        N_R /= NUM_JITTER;
-    }
-#endif
-    R = hp->intensityR * M_R * N_R;
-    R = std::max(R, 0.f); // Prevent negative value
-
-    // TT
     float M_TT = gaussian(theta_h, hp->longitudinalShiftTT,
                           hp->longitudinalWidthTT);
-#ifdef af_marschner_hair_shader_approx_dist
-    float N_TT = gaussian(glm::pi<float>(), fabs(phi), hp->azimuthalWidthTT);
-#else
-//     float N_TT = N_p_(1, theta_d, phi, hp->eta, hp->sigma_a);
-    float N_TT = 0;
-    {
-        const float jitter_theta = JITTER*(1-2*rnd());
-        const float jitter_phi = JITTER*(1-2*rnd());
-        for (int i = 0; i < NUM_JITTER; i++) {
-            N_TT += N_p_(1, theta_d + jitter_theta, phi + jitter_phi,
-                         hp->eta, hp->sigma_a);
-        }
-        N_TT /= NUM_JITTER;
-    }
-#endif
-    TT = hp->intensityTT * M_TT * N_TT;
-    TT = std::max(TT, 0.f); // Prevent negative value
-
-    // TRT
     float M_TRT = gaussian(theta_h, hp->longitudinalShiftTRT,
                            hp->longitudinalWidthTRT);
+
+    // N_p
 #ifdef af_marschner_hair_shader_approx_dist
+    float N_R = cos(phi * 0.5);
+    float N_TT = gaussian(glm::pi<float>(), fabs(phi), hp->azimuthalWidthTT);
     float N_TRGNG = cos(phi * 0.5);
     float N_G = hp->intensityG * gaussian(hp->azimuthalShiftG, fabs(phi),
                                           hp->azimuthalWidthG);
     float N_TRT = N_TRGNG + N_G;
 #else
-//     float N_TRT = N_p_(2, theta_d, phi, hp->eta, hp->sigma_a);
-    float N_TRT = 0;
-    {
-        const float jitter_theta = JITTER*(1-2*rnd());
-        const float jitter_phi = JITTER*(1-2*rnd());
-        for (int i = 0; i < NUM_JITTER; i++) {
-            N_TRT += N_p_(0, theta_d + jitter_theta, phi+jitter_phi,
-                          hp->eta, hp->sigma_a);
+    float N_R = 0, N_TT = 0, N_TRT = 0;
+    for (int i = 0; i < NUM_JITTER; i++) {
+        float jitter_theta = 0.f, jitter_phi = 0.f;
+        if (JITTER > 0.f) {
+            jitter_theta = JITTER * (1 - 2 * rnd());
+            jitter_phi = JITTER * (1 - 2 * rnd());
         }
-        N_TRT /= NUM_JITTER;
+        ThetaDTerms td;
+        thetaDTerms(theta_d + jitter_theta, hp->eta, td);
+        const float N_0 = N_p_(0, td, phi + jitter_phi, hp->sigma_a);
+        N_R += N_0;
+        N_TT += N_p_(1, td, phi + jitter_phi, hp->sigma_a);
+        // TRT uses the p = 0 solution as well
+        // (p = 2: N_p_(2, td, phi + jitter_phi, hp->sigma_a))
+        N_TRT += N_0;
     }
+    N_R /= NUM_JITTER;
+    N_TT /= NUM_JITTER;
+    N_TRT /= NUM_JITTER;
 #endif
 
-    TRT = hp->intensityTRT * M_TRT * N_TRT;
-    TRT = std::max(TRT, 0.f); // Prevent negative value
-
     // Normalize.
     //
     // Scale factor: c.f. Mar2003 p.6, 7.
@@ -282,12 +535,51 @@ inline float AFMarschner(float phi, float theta_d, float theta_h,
     // TODO: clampling scale significantly alters the scale of values for some
     //       theta_d probably the cause of dot noises
     float scale = 1.0 / std::max(cosThetaD * cosThetaD, 1e-1f);
-
     dumpifbadassertionf(scale);
-    dumpifbadassertionf(R);
-    dumpifbadassertionf(TT);
-    dumpifbadassertionf(TRT);
-    return (R + TT + TRT) * scale;
+
+    AFMarschnerLobes terms;
+    terms.R = M_R * N_R * scale;
+    terms.TT = M_TT * N_TT * scale;
+    terms.TRT = M_TRT * N_TRT * scale;
+    return terms;
+}
+
+// Lobe values from the unscaled terms
+inline AFMarschnerLobes applyIntensities(const AFMarschnerLobes& terms,
+                                         const AFMarschnerHairParams *hp) {
+    AFMarschnerLobes lobes;
+    lobes.R = std::max(hp->intensityR * terms.R, 0.f); // Prevent negative value
+    lobes.TT = std::max(hp->intensityTT * terms.TT, 0.f);
+    lobes.TRT = std::max(hp->intensityTRT * terms.TRT, 0.f);
+    dumpifbadassertionf(lobes.R);
+    dumpifbadassertionf(lobes.TT);
+    dumpifbadassertionf(lobes.TRT);
+    return lobes;
+}
+
+inline AFMarschnerLobes AFMarschnerFused(float phi, float theta_d,
+                                         float theta_h,
+                                         const AFMarschnerHairParams *hp) {
+    return applyIntensities(AFMarschnerTerms(phi, theta_d, theta_h, hp), hp);
+}
+
+inline float AFMarschner(float phi, float theta_d, float theta_h,
+                         AFMarschnerHairParams *hp) {
+    AFMarschnerLobes lobes = AFMarschnerFused(phi, theta_d, theta_h, hp);
+    return lobes.R + lobes.TT + lobes.TRT;
+}
+
+// True when the parameters differ only in the lobe intensities or the
+// absorption (the cached terms are unscaled and unabsorbed)
+inline bool sameNonLinearParams(const AFMarschnerHairParams& a,
+                                const AFMarschnerHairParams& b) {
+    AFMarschnerHairParams a_ = a, b_ = b;
+    a_.intensityR = b_.intensityR = 0.f;
+    a_.intensityTT = b_.intensityTT = 0.f;
+    a_.intensityTRT = b_.intensityTRT = 0.f;
+    a_.sigma_a = b_.sigma_a = 0.f;
+    a_.sigma_a_rgb = b_.sigma_a_rgb = glm::vec3(0.f);
+    return memcmp(&a_, &b_, sizeof(AFMarschnerHairParams)) == 0;
 }
 
 inline glm::vec3 local_spherical(const glm::vec3& v, const glm::vec3& x,
@@ -301,12 +593,9 @@ inline glm::vec3 local_spherical(const glm::vec3& v, const glm::vec3& x,
                      0);
 }
 
-inline void findAngles(float& phi, float& theta_d, float& theta_h,
-                       float& theta_t, glm::vec3& Vn, glm::vec3& Ln,
-                       glm::vec3& U, glm::vec3& V, glm::vec3& W){
-    glm::vec3 omegaO = local_spherical(Vn, V, W, U);
-    glm::vec3 omegaI = local_spherical(Ln, V, W, U);
-      
+inline void anglesFromSpherical(float& phi, float& theta_d, float& theta_h,
+                                float& theta_t, const glm::vec3& omegaO,
+                                const glm::vec3& omegaI) {
     // phi = fmod( fabs( omegaO[0] - omegaI[0] ), 2.0 * PI );
     phi = fabs(omegaO[0] - omegaI[0]);
     if (phi > glm::pi<float>()) phi -= 2.f * glm::pi<float>();
@@ -319,8 +608,36 @@ inline void findAngles(float& phi, float& theta_d, float& theta_h,
     theta_t = omegaI[1];
 }
 
+inline void findAngles(float& phi, float& theta_d, float& theta_h,
+                       float& theta_t, glm::vec3& Vn, glm::vec3& Ln,
+                       glm::vec3& U, glm::vec3& V, glm::vec3& W){
+    glm::vec3 omegaO = local_spherical(Vn, V, W, U);
+    glm::vec3 omegaI = local_spherical(Ln, V, W, U);
+    anglesFromSpherical(phi, theta_d, theta_h, theta_t, omegaO, omegaI);
+}
+
 } // namespace 
 
+AFMarschnerShader::AFMarschnerShader(const AFMarschnerShader& other)
+    : BaseShader(other), tangent(other.tangent), cached_fast_math(false),
+      terms_valid(false) {
+    this->hp = new AFMarschnerHairParams(*other.hp);
+}
+
+AFMarschnerShader& AFMarschnerShader::operator=(
+        const AFMarschnerShader& other) {
+    if (this != &other) {
+        BaseShader::operator=(other);
+        this->tangent = other.tangent;
+        *this->hp = *other.hp;
+        // caches are rebuilt on use
+        this->cached_dirs.clear();
+        this->terms_valid = false;
+        this->sampling.valid = false;
+    }
+    return *this;
+}
+
 float AFMarschnerShader::sample(const glm::vec3& light_dir,
                                 const glm::vec3& out_dir,
                                 const glm::vec3& normal) {
@@ -338,3 +655,425 @@ float AFMarschnerShader::sample(const glm::vec3& light_dir,
 
     return AFMarschner(phi, theta_d, theta_h, hp);
 }
+
+void AFMarschnerShader::getParams(std::vector<ShaderParam>& params) {
+    params.push_back(ShaderParam("intensityR", &hp->intensityR));
+    params.push_back(ShaderParam("longitudinalShiftR", &hp->longitudinalShiftR));
+    params.push_back(ShaderParam("longitudinalWidthR", &hp->longitudinalWidthR));
+    params.push_back(ShaderParam("intensityTT", &hp->intensityTT));
+    params.push_back(ShaderParam("longitudinalShiftTT",
+                                 &hp->longitudinalShiftTT));
+    params.push_back(ShaderParam("longitudinalWidthTT",
+                                 &hp->longitudinalWidthTT));
+    params.push_back(ShaderParam("azimuthalWidthTT", &hp->azimuthalWidthTT));
+    params.push_back(ShaderParam("intensityTRT", &hp->intensityTRT));
+    params.push_back(ShaderParam("longitudinalShiftTRT",
+                                 &hp->longitudinalShiftTRT));
+    params.push_back(ShaderParam("longitudinalWidthTRT",
+                                 &hp->longitudinalWidthTRT));
+    params.push_back(ShaderParam("intensityG", &hp->intensityG));
+    params.push_back(ShaderParam("azimuthalShiftG", &hp->azimuthalShiftG));
+    params.push_back(ShaderParam("azimuthalWidthG", &hp->azimuthalWidthG));
+    params.push_back(ShaderParam("attenuationFromRoot",
+                                 &hp->attenuationFromRoot));
+    params.push_back(ShaderParam("eta", &hp->eta));
+    params.push_back(ShaderParam("sigma_a", &hp->sigma_a));
+    params.push_back(ShaderParam("sigma_a_r", &hp->sigma_a_rgb[0]));
+    params.push_back(ShaderParam("sigma_a_g", &hp->sigma_a_rgb[1]));
+    params.push_back(ShaderParam("sigma_a_b", &hp->sigma_a_rgb[2]));
+    params.push_back(ShaderParam("thickness", &hp->thickness));
+}
+
+void AFMarschnerShader::prepare(const glm::vec3& light_dir,
+                                const glm::vec3& normal,
+                                AFMarschnerPrepared& prepared) const {
+    prepared.U = glm::normalize(this->tangent);// dPdv
+    prepared.V = glm::normalize(normal); // N
+    prepared.W = glm::normalize(glm::cross(prepared.U, prepared.V));
+    glm::vec3 Ln = glm::normalize(light_dir);
+    glm::vec3 omegaI = local_spherical(Ln, prepared.V, prepared.W,
+                                       prepared.U);
+    prepared.phi_i = omegaI[0];
+    prepared.theta_i = omegaI[1];
+}
+
+float AFMarschnerShader::samplePrepared(const AFMarschnerPrepared& prepared,
+                                        float phi_o, float theta_o) const {
+    float phi;
+    float theta_d;
+    float theta_h;
+    float theta_t;
+    anglesFromSpherical(phi, theta_d, theta_h, theta_t,
+                        glm::vec3(phi_o, theta_o, 0),
+                        glm::vec3(prepared.phi_i, prepared.theta_i, 0));
+    return AFMarschner(phi, theta_d, theta_h, hp);
+}
+
+AFMarschnerLobes AFMarschnerShader::sampleLobesPrepared(
+        const AFMarschnerPrepared& prepared, float phi_o,
+        float theta_o) const {
+    float phi;
+    float theta_d;
+    float theta_h;
+    float theta_t;
+    anglesFromSpherical(phi, theta_d, theta_h, theta_t,
+                        glm::vec3(phi_o, theta_o, 0),
+                        glm::vec3(prepared.phi_i, prepared.theta_i, 0));
+    return AFMarschnerTerms(phi, theta_d, theta_h, hp);
+}
+
+bool AFMarschnerShader::updateAngles(const AFMarschnerPrepared& prepared,
+                                     const glm::vec3& light_dir,
+                                     const glm::vec3* out_dirs, int n) {
+    // the direction grid of createBRDFMesh() is the same every frame
+    if (this->cached_dirs.size() == n && this->cached_U == prepared.U &&
+        this->cached_V == prepared.V &&
+        this->cached_angles_light == light_dir &&
+        this->cached_fast_math == this->fast_math &&
+        (n == 0 || memcmp(&this->cached_dirs[0], out_dirs,
+                          n * sizeof(glm::vec3)) == 0)) {
+        return false;
+    }
+    this->cached_dirs.assign(out_dirs, out_dirs + n);
+    this->cached_phi.resize(n);
+    this->cached_theta_d.resize(n);
+    this->cached_theta_h.resize(n);
+    this->cached_U = prepared.U;
+    this->cached_V = prepared.V;
+    this->cached_angles_light = light_dir;
+    this->cached_fast_math = this->fast_math;
+    // normalization of the directions is not needed for the angles
+    simd::HairFrameKernelArgs args;
+    args.U = prepared.U;
+    args.V = prepared.V;
+    args.W = prepared.W;
+    args.in_dir = light_dir;
+    const simd::HairFrameKernel kernel =
+        simd::getCoordKernels().hair_frame[mathTier(*this)];
+    const int block = 256;  // directions split per kernel call
+    float x[block], y[block], z[block];
+    for (int i0 = 0; i0 < n; i0 += block) {
+        const int m = std::min(block, n - i0);
+        simd::splitDirs(out_dirs + i0, m, x, y, z);
+        simd::HairFrameAngles angles;
+        angles.phi = &this->cached_phi[i0];
+        angles.theta_d = &this->cached_theta_d[i0];
+        angles.theta_h = &this->cached_theta_h[i0];
+        kernel(args, simd::DirBlock(x, y, z), angles, m);
+    }
+    return true;
+}
+
+const AFMarschnerLobes* AFMarschnerShader::updateTerms(
+        const glm::vec3& light_dir, const glm::vec3* out_dirs,
+        const glm::vec3& normal, int n) {
+    AFMarschnerPrepared prepared;
+    this->prepare(light_dir, normal, prepared);
+    const bool angles_changed = this->updateAngles(prepared, light_dir,
+                                                   out_dirs, n);
+    // intensity-only changes keep the terms
+    if (!angles_changed && this->terms_valid &&
+        this->cached_light_dir == light_dir &&
+        sameNonLinearParams(this->cached_hp, *this->hp)) {
+        return n > 0 ? &this->cached_terms[0] : NULL;
+    }
+    this->cached_terms.resize(n);
+    this->cached_tt_path.resize(n);
+    if (n > 0) {
+        simd::MarschnerKernelArgs args;
+        args.hp = this->hp;
+        simd::getShaderKernels().marschner_terms[mathTier(*this)](
+            args, &this->cached_phi[0], &this->cached_theta_d[0],
+            &this->cached_theta_h[0],
+            &this->cached_terms[0], &this->cached_tt_path[0], n);
+    }
+    this->cached_light_dir = light_dir;
+    this->cached_hp = *this->hp;
+    this->terms_valid = true;
+    return n > 0 ? &this->cached_terms[0] : NULL;
+}
+
+void AFMarschnerShader::sampleBatch(const glm::vec3& light_dir,
+                                    const glm::vec3* out_dirs,
+                                    const glm::vec3& normal, float* out,
+                                    int n) {
+    const AFMarschnerLobes* terms = this->updateTerms(light_dir, out_dirs,
+                                                      normal, n);
+    if (n == 0) return;
+    simd::MarschnerCombineArgs args;
+    args.intensity_r = this->hp->intensityR;
+    args.intensity_tt = this->hp->intensityTT;
+    args.intensity_trt = this->hp->intensityTRT;
+    args.sigma_a = &this->hp->sigma_a;
+    args.n_channels = 1;
+    simd::getShaderKernels().marschner_combine[mathTier(*this)](
+        args, terms, &this->cached_tt_path[0], out, n);
+}
+
+void AFMarschnerShader::sampleLobesBatch(const glm::vec3& light_dir,
+                                         const glm::vec3* out_dirs,
+                                         const glm::vec3& normal,
+                                         AFMarschnerLobes* out, int n) {
+    const AFMarschnerLobes* terms = this->updateTerms(light_dir, out_dirs,
+                                                      normal, n);
+    for (int i = 0; i < n; i++) {
+        AFMarschnerLobes absorbed = terms[i];
+        absorbed.TT *= std::exp(-this->hp->sigma_a * this->cached_tt_path[i]);
+        out[i] = applyIntensities(absorbed, this->hp);
+    }
+}
+
+void AFMarschnerShader::sampleColorBatch(const glm::vec3& light_dir,
+                                         const glm::vec3* out_dirs,
+                                         const glm::vec3& normal,
+                                         const ColorChannels& channels,
+                                         float* out, int n) {
+    const AFMarschnerLobes* terms = this->updateTerms(light_dir, out_dirs,
+                                                      normal, n);
+    if (n == 0) return;
+    float sigma_a[MAX_COLOR_CHANNELS];
+    this->channelSigmaA(channels, sigma_a);
+    simd::MarschnerCombineArgs args;
+    args.intensity_r = this->hp->intensityR;
+    args.intensity_tt = this->hp->intensityTT;
+    args.intensity_trt = this->hp->intensityTRT;
+    args.sigma_a = sigma_a;
+    args.n_channels = channels.n;
+    simd::getShaderKernels().marschner_color[mathTier(*this)](
+        args, terms, &this->cached_tt_path[0], out, n);
+}
+
+void AFMarschnerShader::channelSigmaA(const ColorChannels& channels,
+                                      float* sigma_a) const {
+    const glm::vec3& rgb = this->hp->sigma_a_rgb;
+    if (channels.mode == COLOR_RGB) {
+        for (int c = 0; c < channels.n; c++) sigma_a[c] = rgb[std::min(c, 2)];
+        return;
+    }
+    // piecewise linear over the band centers, constant outside
+    const float l_b = 465.f, l_g = 550.f, l_r = 610.f;
+    for (int c = 0; c < channels.n; c++) {
+        const float l = channels.lambda[c];
+        if (l <= l_b) {
+            sigma_a[c] = rgb[2];
+        } else if (l < l_g) {
+            sigma_a[c] = glm::mix(rgb[2], rgb[1], (l - l_b) / (l_g - l_b));
+        } else if (l < l_r) {
+            sigma_a[c] = glm::mix(rgb[1], rgb[0], (l - l_g) / (l_r - l_g));
+        } else {
+            sigma_a[c] = rgb[0];
+        }
+    }
+}
+
+
+// === AF Marschner sampling ===
+namespace {
+
+const int MARSCHNER_SAMPLING_THETA = 64;
+const int MARSCHNER_SAMPLING_PHI = 128;
+
+// Longitudinal shift and width of M_p (lobe 0: R, 1: TT, 2: TRT)
+inline void lobeGaussian(const AFMarschnerHairParams* hp, int lobe,
+                         float& shift, float& width) {
+    if (lobe == 0) {
+        shift = hp->longitudinalShiftR;
+        width = hp->longitudinalWidthR;
+    } else if (lobe == 1) {
+        shift = hp->longitudinalShiftTT;
+        width = hp->longitudinalWidthTT;
+    } else {
+        shift = hp->longitudinalShiftTRT;
+        width = hp->longitudinalWidthTRT;
+    }
+}
+
+inline double normalCdf(double x, double mu, double sigma) {
+    return 0.5 * (1.0 + std::erf((x - mu) / (sigma * std::sqrt(2.0))));
+}
+
+inline int thetaBin(float theta_o) {
+    const int n = MARSCHNER_SAMPLING_THETA;
+    return glm::clamp((int)((theta_o / glm::pi<float>() + 0.5f) * n), 0,
+                      n - 1);
+}
+
+} // namespace
+
+void AFMarschnerShader::updateSampling(const glm::vec3& light_dir,
+                                       const glm::vec3& normal) {
+    AFMarschnerSampling& smp = this->sampling;
+    if (smp.valid && smp.light_dir == light_dir && smp.normal == normal &&
+        smp.tangent == this->tangent && smp.fast_math == this->fast_math &&
+        memcmp(&smp.hp, this->hp, sizeof(AFMarschnerHairParams)) == 0) {
+        return;
+    }
+    this->prepare(light_dir, normal, smp.prepared);
+    const float pi = glm::pi<float>();
+    const int n_theta = MARSCHNER_SAMPLING_THETA;
+    const int n_phi = MARSCHNER_SAMPLING_PHI;
+    const int n = n_theta * n_phi;
+
+    // lobe values at the bin centers of (theta_o, phi_o)
+    smp.theta_o.resize(n);
+    smp.hair_phi.resize(n);
+    smp.theta_d.resize(n);
+    smp.theta_h.resize(n);
+    smp.tt_path.resize(n);
+    smp.terms.resize(n);
+    smp.values.resize(n);
+    for (int j = 0; j < n_theta; j++) {
+        for (int k = 0; k < n_phi; k++) {
+            const int i = j * n_phi + k;
+            smp.theta_o[i] = -0.5f * pi + (j + 0.5f) * pi / n_theta;
+            const float phi_o = -pi + (k + 0.5f) * 2.f * pi / n_phi;
+            float theta_t;
+            anglesFromSpherical(
+                smp.hair_phi[i], smp.theta_d[i], smp.theta_h[i], theta_t,
+                glm::vec3(phi_o, smp.theta_o[i], 0),
+                glm::vec3(smp.prepared.phi_i, smp.prepared.theta_i, 0));
+        }
+    }
+    simd::MarschnerKernelArgs args;
+    args.hp = this->hp;
+    simd::getShaderKernels().marschner_terms[mathTier(*this)](
+        args, &smp.hair_phi[0], &smp.theta_d[0], &smp.theta_h[0],
+        &smp.terms[0], &smp.tt_path[0], n);
+
+    // N_p per theta_o bin (M_p and the normalization are constant in phi)
+    smp.phi.resize(3 * n_theta);
+    float energy[3];
+    float total = 0.f;
+    const double theta_i = smp.prepared.theta_i;
+    for (int p = 0; p < 3; p++) {
+        for (int i = 0; i < n; i++) {
+            const AFMarschnerLobes& t = smp.terms[i];
+            smp.values[i] =
+                (p == 0) ? this->hp->intensityR * t.R :
+                (p == 1) ? this->hp->intensityTT * t.TT *
+                           std::exp(-this->hp->sigma_a * smp.tt_path[i]) :
+                           this->hp->intensityTRT * t.TRT;
+        }
+        energy[p] = 0.f;
+        for (int j = 0; j < n_theta; j++) {
+            Distribution1D& dist = smp.phi[p * n_theta + j];
+            dist.init(&smp.values[j * n_phi], n_phi);
+            energy[p] += dist.integral * 2.f * pi *
+                         std::cos(smp.theta_o[j * n_phi]) * pi / n_theta;
+        }
+        // theta_h = (theta_o + theta_i) / 2 with theta_o in [-pi/2, pi/2]
+        float shift, width;
+        lobeGaussian(this->hp, p, shift, width);
+        smp.cdf_lo[p] = smp.cdf_hi[p] = 0.0;
+        if (width > 0.f) {
+            smp.cdf_lo[p] = normalCdf((theta_i - pi * 0.5) * 0.5, shift,
+                                      width);
+            smp.cdf_hi[p] = normalCdf((theta_i + pi * 0.5) * 0.5, shift,
+                                      width);
+        }
+        if (!(smp.cdf_hi[p] > smp.cdf_lo[p]) || !std::isfinite(energy[p])) {
+            energy[p] = 0.f;
+        }
+        total += energy[p];
+    }
+    smp.uniform = !(total > 0.f);
+    for (int p = 0; p < 3; p++) {
+        smp.lobe_prob[p] = smp.uniform ? 0.f : energy[p] / total;
+    }
+
+    smp.light_dir = light_dir;
+    smp.normal = normal;
+    smp.tangent = this->tangent;
+    smp.fast_math = this->fast_math;
+    smp.hp = *this->hp;
+    smp.valid = true;
+}
+
+float AFMarschnerShader::pdfAngles(float phi_o, float theta_o) const {
+    const AFMarschnerSampling& smp = this->sampling;
+    const float pi = glm::pi<float>();
+    const float cos_theta = std::cos(theta_o);
+    if (!(cos_theta > 0.f)) return 0.f;
+    const int j = thetaBin(theta_o);
+    const double theta_h = (theta_o + smp.prepared.theta_i) * 0.5;
+    double sum = 0.0;
+    for (int p = 0; p < 3; p++) {
+        if (smp.lobe_prob[p] <= 0.f) continue;
+        float shift, width;
+        lobeGaussian(this->hp, p, shift, width);
+        const double z = (theta_h - shift) / width;
+        // d(theta_h) / d(theta_o) = 1/2
+        const double pdf_theta = 0.5 * std::exp(-0.5 * z * z) /
+                                 (width * std::sqrt(2.0 * pi)) /
+                                 (smp.cdf_hi[p] - smp.cdf_lo[p]);
+        const double pdf_phi =
+            smp.phi[p * MARSCHNER_SAMPLING_THETA + j].pdf(
+                (phi_o + pi) / (2.f * pi)) / (2.0 * pi);
+        sum += smp.lobe_prob[p] * pdf_theta * pdf_phi;
+    }
+    // d(omega) = cos(theta) d(theta) d(phi)
+    return (float)(sum / cos_theta);
+}
+
+bool AFMarschnerShader::sampleDirection(const glm::vec3& light_dir,
+                                        const glm::vec3& normal, float u1,
+                                        float u2, glm::vec3& out_dir,
+                                        float& pdf) {
+    this->updateSampling(light_dir, normal);
+    const AFMarschnerSampling& smp = this->sampling;
+    if (smp.uniform) {
+        return BaseShader::sampleDirection(light_dir, normal, u1, u2, out_dir,
+                                           pdf);
+    }
+    const float pi = glm::pi<float>();
+
+    // lobe, u1 is reused for theta
+    int p = -1;
+    float c = 0.f;
+    for (int i = 0; i < 3; i++) {
+        if (smp.lobe_prob[i] <= 0.f) continue;
+        p = i;
+        if (u1 < c + smp.lobe_prob[i]) break;
+        c += smp.lobe_prob[i];
+    }
+    u1 = glm::clamp((u1 - c) / smp.lobe_prob[p], 0.f, 1.f);
+
+    // theta_o from the truncated M_p
+    float shift, width;
+    lobeGaussian(this->hp, p, shift, width);
+    const double cdf = smp.cdf_lo[p] + u1 * (smp.cdf_hi[p] - smp.cdf_lo[p]);
+    const double theta_h = shift + width * std::sqrt(2.0) *
+                                   erfInv(glm::clamp(2.0 * cdf - 1.0,
+                                                     -1.0 + 1e-15,
+                                                     1.0 - 1e-15));
+    const float theta_o = glm::clamp((float)(2.0 * theta_h) -
+                                     smp.prepared.theta_i,
+                                     -0.5f * pi, 0.5f * pi);
+    // phi_o from N_p of the theta_o bin
+    float pdf_x;
+    const float phi_o = -pi + 2.f * pi *
+        smp.phi[p * MARSCHNER_SAMPLING_THETA + thetaBin(theta_o)].sample(
+            u2, pdf_x);
+
+    // -out_dir has the spherical angles (phi_o, theta_o) in the hair frame
+    const float cos_theta = std::cos(theta_o);
+    out_dir = -(cos_theta * std::cos(phi_o) * smp.prepared.V +
+                cos_theta * std::sin(phi_o) * smp.prepared.W +
+                std::sin(theta_o) * smp.prepared.U);
+    pdf = this->pdfAngles(phi_o, theta_o);
+    return pdf > 0.f;
+}
+
+float AFMarschnerShader::pdf(const glm::vec3& light_dir,
+                             const glm::vec3& out_dir,
+                             const glm::vec3& normal) {
+    this->updateSampling(light_dir, normal);
+    const AFMarschnerSampling& smp = this->sampling;
+    if (smp.uniform) return UNIFORM_SPHERE_PDF;
+    const glm::vec3 d = -glm::normalize(out_dir);
+    const float x = glm::dot(d, smp.prepared.V);
+    const float y = glm::dot(d, smp.prepared.W);
+    const float z = glm::dot(d, smp.prepared.U);
+    return this->pdfAngles(std::atan2(y, x),
+                           std::asin(glm::clamp(z, -1.f, 1.f)));
+}
@@ -5,24 +5,100 @@
 #include <string>
 #include <iostream>
 #include <cmath>
+#include <vector>
 
 #define GLM_FORCE_RADIANS 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include "sampling.h"
+
+// Channels of the color evaluation (sampleColorBatch()): RGB, or N
+// spectral samples at the given wavelengths. One SIMD lane per channel.
+const int MAX_COLOR_CHANNELS = 16;
+enum ColorMode { COLOR_RGB = 0, COLOR_SPECTRAL };
+struct ColorChannels {
+    ColorChannels() : mode(COLOR_RGB), n(3) {
+        for (int c = 0; c < MAX_COLOR_CHANNELS; c++) lambda[c] = 0.f;
+    }
+    int mode;
+    int n;
+    float lambda[MAX_COLOR_CHANNELS];  // nm (spectral)
+};
+// n samples at the centers of n equal bins of [lambda_min, lambda_max]
+ColorChannels spectralChannels(int n, float lambda_min=400.f,
+                               float lambda_max=700.f);
+// Channel values to display RGB (spectral: mean of the samples in the
+// blue < 490 nm <= green < 580 nm <= red bands, a coarse stand-in for
+// color matching functions; an empty band takes the sample nearest to its
+// center at 450 / 530 / 610 nm)
+glm::vec3 channelsToRGB(const ColorChannels& channels, const float* values);
+// RGB band of a channel (0 red, 1 green, 2 blue), as channelsToRGB(); for
+// data measured in RGB
+int channelBand(const ColorChannels& channels, int c);
+
+// Named scalar shader parameter (for scripts and sweeps)
+struct ShaderParam {
+    ShaderParam(const char* name, float* value) : name(name), value(value) {}
+    const char* name;
+    float* value;
+};
+
 class BaseShader {
 public:
-    BaseShader() {};
+    BaseShader() : fast_math(false) {};
+    virtual ~BaseShader() {};
+    // Copy with the same parameters (for worker threads, the caches are
+    // not shared)
+    virtual BaseShader* clone() const = 0;
     virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
                          const glm::vec3& normal) = 0;
+    // Evaluate `n` outgoing directions at once (out[i] for out_dirs[i])
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    // Evaluate every channel of `n` directions
+    // (out[i * channels.n + c], n * channels.n floats). Shaders without
+    // wavelength dependent parameters repeat the sampleBatch() value.
+    virtual void sampleColorBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal,
+                                  const ColorChannels& channels, float* out,
+                                  int n);
+    // Importance sampling of the outgoing direction from (u1, u2) in
+    // [0, 1)^2 with its solid angle density. Returns false (pdf 0) when no
+    // direction could be sampled. The default samples the sphere uniformly.
+    virtual bool sampleDirection(const glm::vec3& light_dir,
+                                 const glm::vec3& normal, float u1, float u2,
+                                 glm::vec3& out_dir, float& pdf);
+    // Density of sampleDirection()
+    virtual float pdf(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                      const glm::vec3& normal);
+    virtual void getParams(std::vector<ShaderParam>& params) {}
+    bool setParam(const std::string& name, float value);
+    bool getParam(const std::string& name, float& value);
+
+    // sampleBatch() with the fast tier of the SIMD math (simd/simd_math.h)
+    bool fast_math;
 };
 
 
 class SpecularShader : public BaseShader {
 public:
     SpecularShader() : spec_factor(5.f) {}
+    virtual BaseShader* clone() const { return new SpecularShader(*this); }
     virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
                          const glm::vec3& normal);
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    // Phong lobe around the mirror direction
+    virtual bool sampleDirection(const glm::vec3& light_dir,
+                                 const glm::vec3& normal, float u1, float u2,
+                                 glm::vec3& out_dir, float& pdf);
+    virtual float pdf(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                      const glm::vec3& normal);
+    virtual void getParams(std::vector<ShaderParam>& params);
     float spec_factor;
 };
 
@@ -30,12 +106,35 @@ public:
 class KajiyaKayShader : public BaseShader {
 public:
     KajiyaKayShader() : tangent(0, 0, 1), spec_factor(25.f),
-                        kd(0.3f), ks(0.3f) {}
+                        kd(0.3f), ks(0.3f), sampling_valid(false) {}
+    virtual BaseShader* clone() const { return new KajiyaKayShader(*this); }
     virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
                          const glm::vec3& normal);
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    // The shader depends only on the angle to the tangent: tabulated
+    // cos(angle) and a uniform azimuth. The table is cached per light and
+    // parameters (not thread safe).
+    virtual bool sampleDirection(const glm::vec3& light_dir,
+                                 const glm::vec3& normal, float u1, float u2,
+                                 glm::vec3& out_dir, float& pdf);
+    virtual float pdf(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                      const glm::vec3& normal);
+    virtual void getParams(std::vector<ShaderParam>& params);
     glm::vec3 tangent;
     float spec_factor;
     float kd, ks;
+
+private:
+    void updateSampling(const glm::vec3& light_dir);
+
+    // cos(angle to the tangent) over [-1, 1]
+    Distribution1D sampling_cos;
+    std::vector<float> sampling_values;
+    glm::vec3 sampling_light_dir, sampling_tangent;
+    float sampling_params[3];  // spec_factor, kd, ks
+    bool sampling_valid;
 };
 
 
@@ -60,6 +159,7 @@ struct AFMarschnerHairParams {
 
         thickness = 0.2f;
         sigma_a = 0.2f;
+        sigma_a_rgb = glm::vec3(0.2f, 0.35f, 0.6f);
     }
     ~AFMarschnerHairParams() {}
 
@@ -85,18 +185,126 @@ struct AFMarschnerHairParams {
     float eta;
     float sigma_a;
     float thickness;
+
+    // absorption of the color evaluation (red, green, blue). Spectral
+    // samples interpolate it over the band centers (610, 550, 465 nm).
+    glm::vec3 sigma_a_rgb;
+};
+
+// Separate Marschner lobe contributions (their sum is the sample value).
+// Also used for the lobe terms without intensities.
+struct AFMarschnerLobes {
+    float R, TT, TRT;
+};
+
+// Hair frame and light angles shared by every direction of one lobe.
+struct AFMarschnerPrepared {
+    glm::vec3 U, V, W;  // tangent (dPdv), normal, binormal
+    float phi_i;        // light azimuth around the tangent
+    float theta_i;      // light inclination from the normal plane
+};
+
+// Importance sampling tables of AFMarschnerShader for one light
+struct AFMarschnerSampling {
+    AFMarschnerSampling() : valid(false) {}
+    // key
+    bool valid;
+    glm::vec3 light_dir, normal, tangent;
+    AFMarschnerHairParams hp;
+    bool fast_math;
+
+    AFMarschnerPrepared prepared;
+    bool uniform;         // no lobe has energy
+    float lobe_prob[3];   // R, TT, TRT
+    // truncated M_p: CDF range of theta_h over theta_o in [-pi/2, pi/2]
+    double cdf_lo[3], cdf_hi[3];
+    // N_p over phi_o per lobe and theta_o bin
+    std::vector<Distribution1D> phi;
+    // scratch of the table evaluation, the hair frame angles (hair_phi,
+    // theta_d, theta_h) of the bin centers
+    std::vector<float> theta_o, hair_phi, theta_d, theta_h, tt_path, values;
+    std::vector<AFMarschnerLobes> terms;
 };
 
 class AFMarschnerShader : public BaseShader {
 public:
-    AFMarschnerShader() : tangent(0, 0, 1){
+    AFMarschnerShader() : tangent(0, 0, 1), cached_fast_math(false),
+                          terms_valid(false) {
         this->hp = new AFMarschnerHairParams();
     }
+    // deep copies of the hair parameters
+    AFMarschnerShader(const AFMarschnerShader& other);
+    AFMarschnerShader& operator=(const AFMarschnerShader& other);
     ~AFMarschnerShader() { delete this->hp; }
+    virtual BaseShader* clone() const { return new AFMarschnerShader(*this); }
     virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
                          const glm::vec3& normal);
+    // Prepares the frame and light once, then evaluates only the lobe math
+    // per direction. The hair frame angles of the last direction set are
+    // cached until the directions, light, tangent or normal change, and the
+    // unscaled R/TT/TRT terms until anything but the lobe intensities or
+    // the absorption changes. Those only rescale the cached terms (TT is
+    // kept without absorption, with its absorption path length).
+    // Angles and terms are evaluated by the SIMD kernels.
+    // Not thread safe (the caches are shared).
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    // Per-lobe outputs of the fused evaluator at the cost of sampleBatch()
+    void sampleLobesBatch(const glm::vec3& light_dir,
+                          const glm::vec3* out_dirs, const glm::vec3& normal,
+                          AFMarschnerLobes* out, int n);
+    // TT absorption per channel from sigma_a_rgb, on the same term cache
+    virtual void sampleColorBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal,
+                                  const ColorChannels& channels, float* out,
+                                  int n);
+    // Lobe by energy, theta_o from the lobe Gaussian M_p and phi_o from a
+    // table of N_p per theta_o bin. The tables are cached per light and
+    // parameters (not thread safe).
+    virtual bool sampleDirection(const glm::vec3& light_dir,
+                                 const glm::vec3& normal, float u1, float u2,
+                                 glm::vec3& out_dir, float& pdf);
+    virtual float pdf(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                      const glm::vec3& normal);
+    virtual void getParams(std::vector<ShaderParam>& params);
+
+    void prepare(const glm::vec3& light_dir, const glm::vec3& normal,
+                 AFMarschnerPrepared& prepared) const;
+    // (phi_o, theta_o) are the spherical angles of -out_dir in the hair frame
+    float samplePrepared(const AFMarschnerPrepared& prepared, float phi_o,
+                         float theta_o) const;
+    // Lobe terms without intensities
+    AFMarschnerLobes sampleLobesPrepared(const AFMarschnerPrepared& prepared,
+                                         float phi_o, float theta_o) const;
+
     glm::vec3 tangent;
     AFMarschnerHairParams *hp;
+
+private:
+    bool updateAngles(const AFMarschnerPrepared& prepared,
+                      const glm::vec3& light_dir, const glm::vec3* out_dirs,
+                      int n);
+    void updateSampling(const glm::vec3& light_dir, const glm::vec3& normal);
+    float pdfAngles(float phi_o, float theta_o) const;
+    void channelSigmaA(const ColorChannels& channels, float* sigma_a) const;
+    const AFMarschnerLobes* updateTerms(const glm::vec3& light_dir,
+                                        const glm::vec3* out_dirs,
+                                        const glm::vec3& normal, int n);
+
+    // hair frame angle cache (phi, theta_d, theta_h) of cached_dirs
+    std::vector<glm::vec3> cached_dirs;
+    std::vector<float> cached_phi, cached_theta_d, cached_theta_h;
+    glm::vec3 cached_U, cached_V, cached_angles_light;
+    bool cached_fast_math;
+    // lobe term cache of cached_dirs, keyed by the non-linear parameters
+    std::vector<AFMarschnerLobes> cached_terms;  // TT without absorption
+    std::vector<float> cached_tt_path;  // T = exp(-sigma_a * path)
+    glm::vec3 cached_light_dir;
+    AFMarschnerHairParams cached_hp;
+    bool terms_valid;
+    AFMarschnerSampling sampling;
 };
 
 #endif
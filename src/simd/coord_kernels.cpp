@@ -0,0 +1,39 @@
+#include "coord_kernels.h"
+#include "coord_kernels_impl.h"
+
+#include "cpu_dispatch.h"
+#include "kernels_isa.h"
+
+namespace simd {
+
+const CoordKernels& getCoordKernels() {
+    static const CoordKernels scalar = makeCoordKernels<VFloat1>("scalar");
+#ifdef BRDF_SIMD_SSE2
+    static const CoordKernels sse2 = makeCoordKernels<VFloat4>("sse2");
+#endif
+    // getSimdIsa() only returns compiled and supported levels
+    switch (getSimdIsa()) {
+#ifdef BRDF_SIMD_SSE2
+        case ISA_SSE2:
+            return sse2;
+#endif
+        case ISA_SSE42:
+            return *coordKernelsSSE42();
+        case ISA_AVX2:
+            return *coordKernelsAVX2();
+        case ISA_AVX512:
+            return *coordKernelsAVX512();
+        default:
+            return scalar;
+    }
+}
+
+void splitDirs(const glm::vec3* dirs, int n, float* x, float* y, float* z) {
+    for (int i = 0; i < n; i++) {
+        x[i] = dirs[i].x;
+        y[i] = dirs[i].y;
+        z[i] = dirs[i].z;
+    }
+}
+
+} // namespace simd
@@ -0,0 +1,88 @@
+#ifndef COORD_KERNELS_H_261018
+#define COORD_KERNELS_H_261018
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "simd_common.h"
+
+// Batched coordinate transforms on SIMD lanes (one direction or direction
+// pair per lane). Directions come in structure of arrays blocks, so a lane
+// load is one vector load; splitDirs() converts the glm::vec3 arrays.
+namespace simd {
+
+// Directions d[i] = (x[i], y[i], z[i])
+struct DirBlock {
+    DirBlock() : x(NULL), y(NULL), z(NULL) {}
+    DirBlock(const float* x, const float* y, const float* z)
+        : x(x), y(y), z(z) {}
+    const float* x;
+    const float* y;
+    const float* z;
+};
+
+// Orthonormal frame, local coordinates (dot(d, s), dot(d, t), dot(d, n))
+struct CoordFrame {
+    glm::vec3 s, t, n;
+};
+
+// Spherical angles in the frame: theta from n in [0, pi], phi from s in
+// [0, 2 pi). The directions need not be unit.
+typedef void (*SphericalKernel)(const CoordFrame& frame, const DirBlock& dirs,
+                                float* theta, float* phi, int n);
+
+// Rusinkiewicz half / difference angles of (in, out) pairs, the
+// halfDiffAngles() of measured.h: theta_h, theta_d in [0, pi/2], phi_h
+// (may be NULL) and phi_d in [-pi, pi]. theta_h is -1 for the pairs below
+// the horizon. The directions are unit.
+struct HalfDiffKernelArgs {
+    CoordFrame frame;
+    DirBlock in;        // one light direction per pair, or when in.x is NULL
+    glm::vec3 in_dir;   // the same for all pairs
+};
+struct HalfDiffAngles {
+    float* theta_h;
+    float* phi_h;
+    float* theta_d;
+    float* phi_d;
+};
+typedef void (*HalfDiffKernel)(const HalfDiffKernelArgs& args,
+                               const DirBlock& out_dirs,
+                               const HalfDiffAngles& out, int n);
+
+// Hair frame angles of (light, view) pairs, the findAngles() of
+// AFMarschnerShader: phi, theta_d, theta_h from the longitudinal (to the
+// normal plane) and azimuthal angles in the frame. The view directions
+// point at the surface (-out_dir of the other shaders).
+struct HairFrameKernelArgs {
+    glm::vec3 U, V, W;  // tangent, normal, binormal
+    DirBlock in;        // as in HalfDiffKernelArgs
+    glm::vec3 in_dir;
+};
+struct HairFrameAngles {
+    float* phi;
+    float* theta_d;
+    float* theta_h;
+};
+typedef void (*HairFrameKernel)(const HairFrameKernelArgs& args,
+                                const DirBlock& out_dirs,
+                                const HairFrameAngles& out, int n);
+
+// Kernels of one instruction set, indexed by MathTier
+// (the table is chosen at run time, see cpu_dispatch.h)
+struct CoordKernels {
+    const char* isa;
+    int width;
+    SphericalKernel spherical[MATH_NUM_TIERS];
+    HalfDiffKernel half_diff[MATH_NUM_TIERS];
+    HairFrameKernel hair_frame[MATH_NUM_TIERS];
+};
+
+const CoordKernels& getCoordKernels();
+
+// Structure of arrays copy of n directions
+void splitDirs(const glm::vec3* dirs, int n, float* x, float* y, float* z);
+
+} // namespace simd
+
+#endif
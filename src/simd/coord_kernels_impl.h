@@ -0,0 +1,159 @@
+#ifndef COORD_KERNELS_IMPL_H_261018
+#define COORD_KERNELS_IMPL_H_261018
+
+// Kernel templates of coord_kernels.h. Included only by the translation
+// units that instantiate a kernel table (makeCoordKernels<V>()). Like all
+// the kernels they use no glm functions, only the vector members.
+
+#include "coord_kernels.h"
+#include "shader_kernels_impl.h"
+
+namespace simd {
+inline namespace BRDF_SIMD_ISA_NS {
+
+namespace kernels {
+
+// m <= width lanes of an array (one vector load for full blocks)
+template <class V>
+inline V loadLanes(const float* p, int m) {
+    return m == V::width ? V::load(p) : V::loadPartial(p, m);
+}
+
+// Local coordinates of the lanes i.. of a block
+template <class V>
+inline void loadLocal(const DirBlock& dirs, const glm::vec3& s,
+                      const glm::vec3& t, const glm::vec3& n, int i, int m,
+                      V& lx, V& ly, V& lz) {
+    const V x = loadLanes<V>(dirs.x + i, m);
+    const V y = loadLanes<V>(dirs.y + i, m);
+    const V z = loadLanes<V>(dirs.z + i, m);
+    lx = x * V(s.x) + y * V(s.y) + z * V(s.z);
+    ly = x * V(t.x) + y * V(t.y) + z * V(t.z);
+    lz = x * V(n.x) + y * V(n.y) + z * V(n.z);
+}
+
+// === Spherical ===
+template <int Tier, class V>
+void spherical(const CoordFrame& frame, const DirBlock& dirs, float* theta,
+               float* phi, int n) {
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        V x, y, z;
+        loadLocal(dirs, frame.s, frame.t, frame.n, i, m, x, y, z);
+        const V r = vsqrt(x * x + y * y + z * z);
+        vacos<Tier>(clampUnitAbs(z / r)).storePartial(theta + i, m);
+        const V p = vatan2<Tier>(y, x);
+        select(p < V(0.f), p + V(2.f * MATH_PI), p).storePartial(phi + i, m);
+    }
+}
+
+// === Half / difference angles ===
+template <int Tier, class V>
+void halfDiff(const HalfDiffKernelArgs& args, const DirBlock& out_dirs,
+              const HalfDiffAngles& out, int n) {
+    const CoordFrame& f = args.frame;
+    // a single light direction is projected once
+    const glm::vec3& l = args.in_dir;
+    const V lx(l.x * f.s.x + l.y * f.s.y + l.z * f.s.z);
+    const V ly(l.x * f.t.x + l.y * f.t.y + l.z * f.t.z);
+    const V lz(l.x * f.n.x + l.y * f.n.y + l.z * f.n.z);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        V ix = lx, iy = ly, iz = lz;
+        if (args.in.x) loadLocal(args.in, f.s, f.t, f.n, i, m, ix, iy, iz);
+        V ox, oy, oz;
+        loadLocal(out_dirs, f.s, f.t, f.n, i, m, ox, oy, oz);
+        const typename V::Mask above = (iz > V(0.f)) & (oz > V(0.f));
+        // half vector
+        V hx = ix + ox, hy = iy + oy, hz = iz + oz;
+        const V inv_len = V(1.f) / vsqrt(hx * hx + hy * hy + hz * hz);
+        hx = hx * inv_len;
+        hy = hy * inv_len;
+        hz = hz * inv_len;
+        // rotations by -phi_h around z and -theta_h around y from the
+        // sin / cos of the half vector angles
+        const V sin_h = vsqrt(hx * hx + hy * hy);
+        const typename V::Mask pole = sin_h > V(1e-7f);
+        const V cos_phi = select(pole, hx / sin_h, V(1.f));
+        const V sin_phi = select(pole, hy / sin_h, V(0.f));
+        const V dx = (ix * cos_phi + iy * sin_phi) * hz - iz * sin_h;
+        const V dy = iy * cos_phi - ix * sin_phi;
+        const V dz = ix * hx + iy * hy + iz * hz;
+        const V theta_h = vacos<Tier>(clampUnitAbs(hz));
+        select(above, theta_h, V(-1.f)).storePartial(out.theta_h + i, m);
+        if (out.phi_h) vatan2<Tier>(hy, hx).storePartial(out.phi_h + i, m);
+        vacos<Tier>(clampUnitAbs(dz)).storePartial(out.theta_d + i, m);
+        vatan2<Tier>(dy, dx).storePartial(out.phi_d + i, m);
+    }
+}
+
+// === Hair frame angles ===
+// local_spherical() of shader.cpp in the (V, W, U) frame
+template <int Tier, class V>
+inline void hairSpherical(V x, V y, V z, const HairFrameKernelArgs& args,
+                          V& phi, V& theta) {
+    const glm::vec3& N = args.V;
+    const glm::vec3& W = args.W;
+    const glm::vec3& U = args.U;
+    const V xd = x * V(N.x) + y * V(N.y) + z * V(N.z);
+    const V yd = x * V(W.x) + y * V(W.y) + z * V(W.z);
+    const V zd = x * V(U.x) + y * V(U.y) + z * V(U.z);
+    const V r = vsqrt(xd * xd + yd * yd + zd * zd);
+    phi = vatan2<Tier>(yd, xd);
+    // pi/2 - acos(t) == asin(t)
+    theta = vasin<Tier>(clampUnitAbs(zd / r));
+}
+
+template <int Tier, class V>
+void hairFrame(const HairFrameKernelArgs& args, const DirBlock& out_dirs,
+               const HairFrameAngles& out, int n) {
+    // the shared light once, at full accuracy
+    const glm::vec3& l = args.in_dir;
+    V phi_i, theta_i;
+    hairSpherical<MATH_ACCURATE>(V(l.x), V(l.y), V(l.z), args, phi_i,
+                                 theta_i);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        if (args.in.x) {
+            hairSpherical<Tier>(loadLanes<V>(args.in.x + i, m),
+                                loadLanes<V>(args.in.y + i, m),
+                                loadLanes<V>(args.in.z + i, m), args,
+                                phi_i, theta_i);
+        }
+        V phi_o, theta_o;
+        hairSpherical<Tier>(-loadLanes<V>(out_dirs.x + i, m),
+                            -loadLanes<V>(out_dirs.y + i, m),
+                            -loadLanes<V>(out_dirs.z + i, m), args, phi_o,
+                            theta_o);
+        // anglesFromSpherical()
+        V phi = vabs(phi_o - phi_i);
+        phi = select(phi > V(MATH_PI), phi - V(2.f * MATH_PI), phi);
+        V theta_d = vabs(theta_o - theta_i) * V(0.5f);
+        theta_d = select(theta_d > V(MATH_PI_2), theta_d - V(MATH_PI),
+                         theta_d);
+        phi.storePartial(out.phi + i, m);
+        theta_d.storePartial(out.theta_d + i, m);
+        ((theta_o + theta_i) * V(0.5f)).storePartial(out.theta_h + i, m);
+    }
+}
+
+} // namespace kernels
+
+template <class V>
+CoordKernels makeCoordKernels(const char* isa) {
+    CoordKernels k;
+    k.isa = isa;
+    k.width = V::width;
+    k.spherical[MATH_ACCURATE] = kernels::spherical<MATH_ACCURATE, V>;
+    k.spherical[MATH_FAST] = kernels::spherical<MATH_FAST, V>;
+    k.half_diff[MATH_ACCURATE] = kernels::halfDiff<MATH_ACCURATE, V>;
+    k.half_diff[MATH_FAST] = kernels::halfDiff<MATH_FAST, V>;
+    k.hair_frame[MATH_ACCURATE] = kernels::hairFrame<MATH_ACCURATE, V>;
+    k.hair_frame[MATH_FAST] = kernels::hairFrame<MATH_FAST, V>;
+    return k;
+}
+
+} // namespace BRDF_SIMD_ISA_NS
+} // namespace simd
+
+#endif
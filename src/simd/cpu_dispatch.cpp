@@ -0,0 +1,126 @@
+#include "cpu_dispatch.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+#include "kernels_isa.h"
+#include "vfloat.h"  // BRDF_SIMD_SSE2
+
+namespace simd {
+
+namespace {
+
+// resolved once (best level, BRDF_ISA) before the first read; worker
+// threads of every job reach getShaderKernels() concurrently
+std::once_flag g_isa_once;
+std::atomic<int> g_isa(ISA_SCALAR);
+
+bool usableIsa(int isa, int current) {
+    if (simdIsaCompiled(isa) && cpuSupportsIsa(isa)) return true;
+    std::cerr << "SIMD level " << simdIsaName(isa)
+              << " is not available, using " << simdIsaName(current)
+              << std::endl;
+    return false;
+}
+
+void initSimdIsa() {
+    int isa = bestSimdIsa();
+    const char* env = getenv("BRDF_ISA");
+    if (env && *env) {
+        int requested;
+        if (!parseSimdIsa(env, requested)) {
+            std::cerr << "Unknown BRDF_ISA: " << env << std::endl;
+        } else if (usableIsa(requested, isa)) {
+            isa = requested;
+        }
+    }
+    g_isa.store(isa, std::memory_order_relaxed);
+}
+
+} // namespace
+
+const char* simdIsaName(int isa) {
+    static const char* names[ISA_NUM] = {
+        "scalar", "sse2", "sse4.2", "avx2", "avx512",
+    };
+    return (0 <= isa && isa < ISA_NUM) ? names[isa] : "?";
+}
+
+bool parseSimdIsa(const std::string& name, int& isa) {
+    for (int i = 0; i < ISA_NUM; i++) {
+        if (name == simdIsaName(i)) {
+            isa = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cpuSupportsIsa(int isa) {
+    if (isa == ISA_SCALAR) return true;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // also checks that the OS saves the AVX / AVX-512 registers
+    __builtin_cpu_init();
+    switch (isa) {
+        case ISA_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case ISA_SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        case ISA_AVX2:
+            return __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma");
+        case ISA_AVX512:
+            return __builtin_cpu_supports("avx512f");
+        default:
+            return false;
+    }
+#elif defined(_M_X64)
+    return isa == ISA_SSE2;
+#else
+    return false;
+#endif
+}
+
+bool simdIsaCompiled(int isa) {
+    switch (isa) {
+        case ISA_SCALAR:
+            return true;
+        case ISA_SSE2:
+#ifdef BRDF_SIMD_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case ISA_SSE42:
+            return shaderKernelsSSE42() != NULL;
+        case ISA_AVX2:
+            return shaderKernelsAVX2() != NULL;
+        case ISA_AVX512:
+            return shaderKernelsAVX512() != NULL;
+        default:
+            return false;
+    }
+}
+
+int bestSimdIsa() {
+    for (int isa = ISA_NUM - 1; isa > ISA_SCALAR; isa--) {
+        if (simdIsaCompiled(isa) && cpuSupportsIsa(isa)) return isa;
+    }
+    return ISA_SCALAR;
+}
+
+int getSimdIsa() {
+    std::call_once(g_isa_once, initSimdIsa);
+    return g_isa.load(std::memory_order_relaxed);
+}
+
+bool setSimdIsa(int isa) {
+    const int current = getSimdIsa();
+    if (!usableIsa(isa, current)) return false;
+    g_isa.store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace simd
@@ -0,0 +1,38 @@
+#ifndef CPU_DISPATCH_H_261018
+#define CPU_DISPATCH_H_261018
+
+#include <string>
+
+// Runtime selection of the kernel instruction set.
+// The best level supported by both the CPU and the build is chosen on first
+// use unless the BRDF_ISA environment variable (or setSimdIsa(), e.g. from
+// --isa) asks for another one. Unsupported requests fall back to the best
+// level with a warning.
+namespace simd {
+
+enum SimdIsa {
+    ISA_SCALAR = 0,
+    ISA_SSE2,
+    ISA_SSE42,
+    ISA_AVX2,    // with FMA
+    ISA_AVX512,  // AVX-512F
+    ISA_NUM
+};
+
+const char* simdIsaName(int isa);
+// "scalar", "sse2", "sse4.2", "avx2", "avx512"
+bool parseSimdIsa(const std::string& name, int& isa);
+
+// CPU (and OS register state) support
+bool cpuSupportsIsa(int isa);
+// Kernels of the instruction set are part of this build
+bool simdIsaCompiled(int isa);
+int bestSimdIsa();
+
+int getSimdIsa();
+// Returns false (and keeps the current level) when not usable here
+bool setSimdIsa(int isa);
+
+} // namespace simd
+
+#endif
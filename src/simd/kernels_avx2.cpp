@@ -0,0 +1,32 @@
+// Compiled with -mavx2 -mfma (premake5.lua). Nothing here runs unless the
+// dispatcher found avx2 support on the CPU.
+#define BRDF_SIMD_ISA_NS avx2
+#include "kernels_isa.h"
+#include "coord_kernels_impl.h"
+#include "mesh_kernels_impl.h"
+#include "shader_kernels_impl.h"
+
+namespace simd {
+
+#if defined(__AVX2__) && defined(__FMA__)
+const ShaderKernels* shaderKernelsAVX2() {
+    static const ShaderKernels kernels = makeShaderKernels<VFloat8>("avx2");
+    return &kernels;
+}
+
+const MeshKernels* meshKernelsAVX2() {
+    static const MeshKernels kernels = makeMeshKernels<VFloat8>("avx2");
+    return &kernels;
+}
+
+const CoordKernels* coordKernelsAVX2() {
+    static const CoordKernels kernels = makeCoordKernels<VFloat8>("avx2");
+    return &kernels;
+}
+#else
+const ShaderKernels* shaderKernelsAVX2() { return NULL; }
+const MeshKernels* meshKernelsAVX2() { return NULL; }
+const CoordKernels* coordKernelsAVX2() { return NULL; }
+#endif
+
+} // namespace simd
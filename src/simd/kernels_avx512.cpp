@@ -0,0 +1,32 @@
+// Compiled with -mavx512f (premake5.lua). Nothing here runs unless the
+// dispatcher found avx512 support on the CPU.
+#define BRDF_SIMD_ISA_NS avx512
+#include "kernels_isa.h"
+#include "coord_kernels_impl.h"
+#include "mesh_kernels_impl.h"
+#include "shader_kernels_impl.h"
+
+namespace simd {
+
+#if defined(__AVX512F__)
+const ShaderKernels* shaderKernelsAVX512() {
+    static const ShaderKernels kernels = makeShaderKernels<VFloat16>("avx512");
+    return &kernels;
+}
+
+const MeshKernels* meshKernelsAVX512() {
+    static const MeshKernels kernels = makeMeshKernels<VFloat16>("avx512");
+    return &kernels;
+}
+
+const CoordKernels* coordKernelsAVX512() {
+    static const CoordKernels kernels = makeCoordKernels<VFloat16>("avx512");
+    return &kernels;
+}
+#else
+const ShaderKernels* shaderKernelsAVX512() { return NULL; }
+const MeshKernels* meshKernelsAVX512() { return NULL; }
+const CoordKernels* coordKernelsAVX512() { return NULL; }
+#endif
+
+} // namespace simd
@@ -0,0 +1,24 @@
+#ifndef KERNELS_ISA_H_261018
+#define KERNELS_ISA_H_261018
+
+#include "coord_kernels.h"
+#include "mesh_kernels.h"
+#include "shader_kernels.h"
+
+// Kernel tables of the instruction set specific translation units
+// (kernels_*.cpp). NULL when the compiler could not target the set.
+namespace simd {
+
+const ShaderKernels* shaderKernelsSSE42();
+const MeshKernels* meshKernelsSSE42();
+const CoordKernels* coordKernelsSSE42();
+const ShaderKernels* shaderKernelsAVX2();
+const MeshKernels* meshKernelsAVX2();
+const CoordKernels* coordKernelsAVX2();
+const ShaderKernels* shaderKernelsAVX512();
+const MeshKernels* meshKernelsAVX512();
+const CoordKernels* coordKernelsAVX512();
+
+} // namespace simd
+
+#endif
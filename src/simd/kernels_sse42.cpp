@@ -0,0 +1,32 @@
+// Compiled with -msse4.2 (premake5.lua). Nothing here runs unless the
+// dispatcher found sse4.2 support on the CPU.
+#define BRDF_SIMD_ISA_NS sse42
+#include "kernels_isa.h"
+#include "coord_kernels_impl.h"
+#include "mesh_kernels_impl.h"
+#include "shader_kernels_impl.h"
+
+namespace simd {
+
+#if defined(__SSE4_2__)
+const ShaderKernels* shaderKernelsSSE42() {
+    static const ShaderKernels kernels = makeShaderKernels<VFloat4>("sse4.2");
+    return &kernels;
+}
+
+const MeshKernels* meshKernelsSSE42() {
+    static const MeshKernels kernels = makeMeshKernels<VFloat4>("sse4.2");
+    return &kernels;
+}
+
+const CoordKernels* coordKernelsSSE42() {
+    static const CoordKernels kernels = makeCoordKernels<VFloat4>("sse4.2");
+    return &kernels;
+}
+#else
+const ShaderKernels* shaderKernelsSSE42() { return NULL; }
+const MeshKernels* meshKernelsSSE42() { return NULL; }
+const CoordKernels* coordKernelsSSE42() { return NULL; }
+#endif
+
+} // namespace simd
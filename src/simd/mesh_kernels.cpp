@@ -0,0 +1,31 @@
+#include "mesh_kernels.h"
+#include "mesh_kernels_impl.h"
+
+#include "cpu_dispatch.h"
+#include "kernels_isa.h"
+
+namespace simd {
+
+const MeshKernels& getMeshKernels() {
+    static const MeshKernels scalar = makeMeshKernels<VFloat1>("scalar");
+#ifdef BRDF_SIMD_SSE2
+    static const MeshKernels sse2 = makeMeshKernels<VFloat4>("sse2");
+#endif
+    // getSimdIsa() only returns compiled and supported levels
+    switch (getSimdIsa()) {
+#ifdef BRDF_SIMD_SSE2
+        case ISA_SSE2:
+            return sse2;
+#endif
+        case ISA_SSE42:
+            return *meshKernelsSSE42();
+        case ISA_AVX2:
+            return *meshKernelsAVX2();
+        case ISA_AVX512:
+            return *meshKernelsAVX512();
+        default:
+            return scalar;
+    }
+}
+
+} // namespace simd
@@ -0,0 +1,31 @@
+#ifndef MESH_KERNELS_H_261018
+#define MESH_KERNELS_H_261018
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "simd_common.h"
+
+// Batched mesh kernels on SIMD lanes (one triangle or vertex per lane)
+namespace simd {
+
+// normalize(cross(v1 - v0, v2 - v0)) of each triangle
+typedef void (*FaceNormalsKernel)(const glm::vec3* vertices,
+                                  const glm::uvec3* indices,
+                                  glm::vec3* normals, int n_tris);
+// v[i] *= s[i]
+typedef void (*ScaleVec3Kernel)(glm::vec3* v, const float* s, int n);
+
+// Kernels of one instruction set (chosen at run time, see cpu_dispatch.h)
+struct MeshKernels {
+    const char* isa;
+    int width;
+    FaceNormalsKernel face_normals;
+    ScaleVec3Kernel scale_vec3;
+};
+
+const MeshKernels& getMeshKernels();
+
+} // namespace simd
+
+#endif
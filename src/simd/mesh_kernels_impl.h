@@ -0,0 +1,91 @@
+#ifndef MESH_KERNELS_IMPL_H_261018
+#define MESH_KERNELS_IMPL_H_261018
+
+// Kernel templates of mesh_kernels.h. Included only by the translation
+// units that instantiate a kernel table (makeMeshKernels<V>()). Like all
+// the kernels they use no glm functions, only the vector members, so no
+// inline function compiled for a wider instruction set is shared.
+
+#include "mesh_kernels.h"
+#include "vfloat.h"
+
+namespace simd {
+inline namespace BRDF_SIMD_ISA_NS {
+
+namespace kernels {
+
+template <class V>
+void faceNormals(const glm::vec3* vertices, const glm::uvec3* indices,
+                 glm::vec3* normals, int n_tris) {
+    const int W = V::width;
+    for (int i = 0; i < n_tris; i += W) {
+        const int m = (n_tris - i < W) ? n_tris - i : W;
+        // gather the corners (lanes >= m repeat the last triangle)
+        float b[9][V::width];
+        for (int k = 0; k < W; k++) {
+            const glm::uvec3& tri = indices[i + (k < m ? k : m - 1)];
+            const glm::vec3& v0 = vertices[tri.x];
+            const glm::vec3& v1 = vertices[tri.y];
+            const glm::vec3& v2 = vertices[tri.z];
+            b[0][k] = v0.x; b[1][k] = v0.y; b[2][k] = v0.z;
+            b[3][k] = v1.x; b[4][k] = v1.y; b[5][k] = v1.z;
+            b[6][k] = v2.x; b[7][k] = v2.y; b[8][k] = v2.z;
+        }
+        const V x0 = V::load(b[0]), y0 = V::load(b[1]), z0 = V::load(b[2]);
+        const V e1x = V::load(b[3]) - x0, e1y = V::load(b[4]) - y0,
+                e1z = V::load(b[5]) - z0;
+        const V e2x = V::load(b[6]) - x0, e2y = V::load(b[7]) - y0,
+                e2z = V::load(b[8]) - z0;
+        const V cx = e1y * e2z - e1z * e2y;
+        const V cy = e1z * e2x - e1x * e2z;
+        const V cz = e1x * e2y - e1y * e2x;
+        // glm::normalize(): v * inversesqrt(dot(v, v))
+        const V inv_len = V(1.f) / vsqrt(cx * cx + cy * cy + cz * cz);
+        (cx * inv_len).store(b[0]);
+        (cy * inv_len).store(b[1]);
+        (cz * inv_len).store(b[2]);
+        for (int k = 0; k < m; k++) {
+            normals[i + k].x = b[0][k];
+            normals[i + k].y = b[1][k];
+            normals[i + k].z = b[2][k];
+        }
+    }
+}
+
+template <class V>
+void scaleVec3(glm::vec3* v, const float* s, int n) {
+    // 3 * width floats of the packed vec3 array per block
+    const int W = V::width;
+    float* f = &v[0].x;
+    int i = 0;
+    for (; i + W <= n; i += W) {
+        float sb[3 * V::width];
+        for (int k = 0; k < 3 * W; k++) sb[k] = s[i + k / 3];
+        for (int j = 0; j < 3; j++) {
+            float* p = f + 3 * i + j * W;
+            (V::load(p) * V::load(sb + j * W)).store(p);
+        }
+    }
+    for (; i < n; i++) {
+        v[i].x *= s[i];
+        v[i].y *= s[i];
+        v[i].z *= s[i];
+    }
+}
+
+} // namespace kernels
+
+template <class V>
+MeshKernels makeMeshKernels(const char* isa) {
+    MeshKernels k;
+    k.isa = isa;
+    k.width = V::width;
+    k.face_normals = kernels::faceNormals<V>;
+    k.scale_vec3 = kernels::scaleVec3<V>;
+    return k;
+}
+
+} // namespace BRDF_SIMD_ISA_NS
+} // namespace simd
+
+#endif
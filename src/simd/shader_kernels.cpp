@@ -0,0 +1,31 @@
+#include "shader_kernels.h"
+#include "shader_kernels_impl.h"
+
+#include "cpu_dispatch.h"
+#include "kernels_isa.h"
+
+namespace simd {
+
+const ShaderKernels& getShaderKernels() {
+    static const ShaderKernels scalar = makeShaderKernels<VFloat1>("scalar");
+#ifdef BRDF_SIMD_SSE2
+    static const ShaderKernels sse2 = makeShaderKernels<VFloat4>("sse2");
+#endif
+    // getSimdIsa() only returns compiled and supported levels
+    switch (getSimdIsa()) {
+#ifdef BRDF_SIMD_SSE2
+        case ISA_SSE2:
+            return sse2;
+#endif
+        case ISA_SSE42:
+            return *shaderKernelsSSE42();
+        case ISA_AVX2:
+            return *shaderKernelsAVX2();
+        case ISA_AVX512:
+            return *shaderKernelsAVX512();
+        default:
+            return scalar;
+    }
+}
+
+} // namespace simd
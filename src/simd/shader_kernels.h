@@ -0,0 +1,80 @@
+#ifndef SHADER_KERNELS_H_261018
+#define SHADER_KERNELS_H_261018
+
+#include "../shader.h"
+#include "simd_common.h"
+
+// Batched shader kernels on SIMD lanes (one outgoing direction per lane).
+// The per-call scalar terms (light, frame, parameters) are hoisted by the
+// shaders and passed in the argument structs.
+namespace simd {
+
+// pow(max(dot(dir, reflect_dir), 0), spec_factor)
+struct SpecularKernelArgs {
+    glm::vec3 reflect_dir;
+    float spec_factor;
+};
+
+// diffuse + ks * pow(max(sin_tl * sin_te - cos_tl * cos_te, 0), spec_factor)
+struct KajiyaKayKernelArgs {
+    glm::vec3 tangent;
+    float sin_tl;   // light to tangent
+    float cos_tl;
+    float diffuse;  // kd * sin_tl
+    float ks;
+    float spec_factor;
+};
+
+// Unscaled Marschner lobe terms (see AFMarschnerShader::updateTerms()) of
+// the hair frame angles (phi, theta_d, theta_h) of coord_kernels.h.
+// TT is without absorption, tt_path its path length:
+// TT(sigma_a) = TT * exp(-sigma_a * tt_path).
+struct MarschnerKernelArgs {
+    const AFMarschnerHairParams* hp;
+};
+
+// Lobe intensities and absorption applied to the unscaled terms:
+// max(iR R, 0) + max(iTT TT exp(-sigma_a tt_path), 0) + max(iTRT TRT, 0)
+struct MarschnerCombineArgs {
+    float intensity_r, intensity_tt, intensity_trt;
+    const float* sigma_a;  // one per channel
+    int n_channels;
+};
+
+typedef void (*SpecularKernel)(const SpecularKernelArgs& args,
+                               const glm::vec3* dirs, float* out, int n);
+typedef void (*KajiyaKayKernel)(const KajiyaKayKernelArgs& args,
+                                const glm::vec3* dirs, float* out, int n);
+typedef void (*MarschnerTermsKernel)(const MarschnerKernelArgs& args,
+                                     const float* phi, const float* theta_d,
+                                     const float* theta_h,
+                                     AFMarschnerLobes* out, float* tt_path,
+                                     int n);
+// One direction per lane, sigma_a[0] (out[i])
+typedef void (*MarschnerCombineKernel)(const MarschnerCombineArgs& args,
+                                       const AFMarschnerLobes* terms,
+                                       const float* tt_path, float* out,
+                                       int n);
+// One channel per lane (out[i * n_channels + c])
+typedef void (*MarschnerColorKernel)(const MarschnerCombineArgs& args,
+                                     const AFMarschnerLobes* terms,
+                                     const float* tt_path, float* out,
+                                     int n);
+
+// Kernels of one instruction set, indexed by MathTier
+// (the table is chosen at run time, see cpu_dispatch.h)
+struct ShaderKernels {
+    const char* isa;
+    int width;
+    SpecularKernel specular[MATH_NUM_TIERS];
+    KajiyaKayKernel kajiya_kay[MATH_NUM_TIERS];
+    MarschnerTermsKernel marschner_terms[MATH_NUM_TIERS];
+    MarschnerCombineKernel marschner_combine[MATH_NUM_TIERS];
+    MarschnerColorKernel marschner_color[MATH_NUM_TIERS];
+};
+
+const ShaderKernels& getShaderKernels();
+
+} // namespace simd
+
+#endif
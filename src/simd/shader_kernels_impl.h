@@ -0,0 +1,289 @@
+#ifndef SHADER_KERNELS_IMPL_H_261018
+#define SHADER_KERNELS_IMPL_H_261018
+
+// Kernel templates of shader_kernels.h. Included only by the translation
+// units that instantiate a kernel table (makeShaderKernels<V>()). The
+// kernels use no glm functions, only the vector members (see
+// simd_common.h).
+
+#include "shader_kernels.h"
+#include "simd_math.h"
+
+namespace simd {
+inline namespace BRDF_SIMD_ISA_NS {
+
+namespace kernels {
+
+// Number of valid lanes of a block
+template <class V>
+inline int laneCount(int rest) {
+    return rest < V::width ? rest : (int)V::width;
+}
+
+// Loads n <= width directions (lanes >= n repeat the last one)
+template <class V>
+inline void loadDirs(const glm::vec3* dirs, int n, V& x, V& y, V& z) {
+    float bx[V::width], by[V::width], bz[V::width];
+    for (int k = 0; k < V::width; k++) {
+        const glm::vec3& d = dirs[k < n ? k : n - 1];
+        bx[k] = d.x;
+        by[k] = d.y;
+        bz[k] = d.z;
+    }
+    x = V::load(bx);
+    y = V::load(by);
+    z = V::load(bz);
+}
+
+template <class V>
+inline V clampUnitAbs(V x) {
+    return vmin(vmax(x, V(-1.f)), V(1.f));
+}
+
+// exp(k (x - mu)^2) * c, the gaussian() of shader.cpp with hoisted constants
+struct GaussianConst {
+    GaussianConst(float mu, float sigma)
+        : mu(mu), k(-0.5f / (sigma * sigma)),
+          c(1.f / (sqrtf(2.f * MATH_PI) * sigma)) {}
+    float mu, k, c;
+};
+
+template <int Tier, class V>
+inline V gaussian(V x, const GaussianConst& g) {
+    const V d = x - V(g.mu);
+    return vexp<Tier>(V(g.k) * d * d) * V(g.c);
+}
+
+// Fresnel() of shader.cpp from sin/cos of gamma
+template <class V>
+inline V fresnel(V eta_1, V eta_2, V sin_gamma, V cos_gamma) {
+    const V s = sin_gamma * eta_1 / eta_2;
+    const V a = eta_1 * cos_gamma;
+    const V b = eta_2 * vsqrt(V(1.f) - s * s);
+    const V r = (a - b) / (a + b);
+    return vmin(r * r, V(1.f));
+}
+
+// F_(etad, etadd, gamma, false)
+template <class V>
+inline V fresnelIn(V etad, V etadd, V sin_gamma, V cos_gamma) {
+    return V(0.5f) * (fresnel(V(1.f), etad, sin_gamma, cos_gamma) +
+                      fresnel(V(1.f), etadd, sin_gamma, cos_gamma));
+}
+
+// phi(h) - phi of the TT path (p = 1)
+template <int Tier, class V>
+inline V phiTT(V h, V etad, V phi) {
+    return V(2.f) * vasin<Tier>(clampUnitAbs(h / etad)) -
+           V(2.f) * vasin<Tier>(clampUnitAbs(h)) - phi;
+}
+
+// binsearch(true, ...) over [-1, 1] on all the lanes. Returns the lanes
+// with a root.
+template <int Tier, class V>
+inline typename V::Mask solveTT(V etad, V phi, V& h) {
+    typedef typename V::Mask M;
+    V lo(-1.f), hi(1.f);
+    const V f_lo = phiTT<Tier>(lo, etad, phi);
+    const V f_hi = phiTT<Tier>(hi, etad, phi);
+    const M found = ((f_lo > V(0.f)) & (f_hi < V(0.f))) |
+                    ((f_lo < V(0.f)) & (f_hi > V(0.f)));
+    M active = found;
+    for (int i = 0; i < 28 && any(active); i++) {
+        active = active & (vabs(hi - lo) > V(1e-7f));
+        const V mid = (hi + lo) * V(0.5f);
+        const M neg = phiTT<Tier>(mid, etad, phi) < V(0.f);
+        hi = select(active & neg, mid, hi);
+        lo = select(active & ~neg, mid, lo);
+    }
+    h = (hi + lo) * V(0.5f);
+    return found;
+}
+
+// === Specular ===
+template <int Tier, class V>
+void specular(const SpecularKernelArgs& args, const glm::vec3* dirs,
+              float* out, int n) {
+    const V rx(args.reflect_dir.x), ry(args.reflect_dir.y),
+            rz(args.reflect_dir.z);
+    const V e(args.spec_factor);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        V x, y, z;
+        loadDirs(dirs + i, m, x, y, z);
+        const V l = vmax(x * rx + y * ry + z * rz, V(0.f));
+        vpow<Tier>(l, e).storePartial(out + i, m);
+    }
+}
+
+// === KajiyaKay ===
+template <int Tier, class V>
+void kajiyaKay(const KajiyaKayKernelArgs& args, const glm::vec3* dirs,
+               float* out, int n) {
+    const V tx(args.tangent.x), ty(args.tangent.y), tz(args.tangent.z);
+    const V e(args.spec_factor);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        V x, y, z;
+        loadDirs(dirs + i, m, x, y, z);
+        const V vt = x * tx + y * ty + z * tz;
+        const V sin_te = vsqrt(vmax(V(1.f) - vt * vt, V(0.f)));
+        const V kspec = vmax(V(args.sin_tl) * sin_te - V(args.cos_tl) * vt,
+                             V(0.f));
+        const V res = V(args.diffuse) + V(args.ks) * vpow<Tier>(kspec, e);
+        res.storePartial(out + i, m);
+    }
+}
+
+// === AF Marschner ===
+template <int Tier, class V>
+void marschnerTerms(const MarschnerKernelArgs& args, const float* phi_in,
+                    const float* theta_d_in, const float* theta_h_in,
+                    AFMarschnerLobes* out, float* tt_path, int n) {
+    const AFMarschnerHairParams* hp = args.hp;
+    const GaussianConst g_r(hp->longitudinalShiftR, hp->longitudinalWidthR);
+    const GaussianConst g_tt(hp->longitudinalShiftTT,
+                             hp->longitudinalWidthTT);
+    const GaussianConst g_trt(hp->longitudinalShiftTRT,
+                              hp->longitudinalWidthTRT);
+    const V eta2(hp->eta * hp->eta);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        const V phi = V::loadPartial(phi_in + i, m);
+        const V theta_d = V::loadPartial(theta_d_in + i, m);
+        const V theta_h = V::loadPartial(theta_h_in + i, m);
+
+        // M_p
+        const V M_R = gaussian<Tier>(theta_h, g_r);
+        const V M_TT = gaussian<Tier>(theta_h, g_tt);
+        const V M_TRT = gaussian<Tier>(theta_h, g_trt);
+
+        // theta_d terms
+        V sin_td, cos_td;
+        vsincos<Tier>(theta_d, sin_td, cos_td);
+        const V abs_cos_td = vabs(cos_td);
+        const V eta_sin = vsqrt(eta2 - sin_td * sin_td);
+        const V etad = eta_sin / vmax(abs_cos_td, V(1e-20f));
+        const V etadd = eta2 / vmax(eta_sin, V(1e-20f)) * abs_cos_td;
+
+        // N_R (p = 0), gamma_i = asin(h)
+        const V h0 = vsin<Tier>(-phi * V(0.5f));
+        const V sin_gi0 = clampUnitAbs(h0);
+        const V cos_gi0 = vsqrt(V(1.f) - sin_gi0 * sin_gi0);
+        const V A0 = fresnelIn(etad, etadd, sin_gi0, cos_gi0);
+        const V N_0 = A0 * (vsqrt(V(1.f) - h0 * h0) * V(0.5f)) * V(0.5f);
+
+        // N_TT (p = 1), gamma_t = asin(h / etad)
+        V h1;
+        const typename V::Mask found = solveTT<Tier>(etad, phi, h1);
+        const V sin_gi1 = clampUnitAbs(h1);
+        const V cos_gi1 = vsqrt(V(1.f) - sin_gi1 * sin_gi1);
+        const V sin_gt1 = clampUnitAbs(h1 / etad);
+        const V a = vsqrt(V(1.f) - h1 * h1);
+        const V b = vsqrt(etad * etad - h1 * h1);
+        const V dphi_dh_inv = a * b / (V(2.f) * vmax(vabs(a - b),
+                                                     V(1e-20f)));
+        // T = exp(-sigma_a * path), 1 + cos(2 gamma_t) = 2 (1 - sin^2)
+        const V path = V(2.f) / vmax(abs_cos_td, V(1e-30f)) *
+                       (V(2.f) - V(2.f) * sin_gt1 * sin_gt1);
+        const V fres = fresnelIn(etad, etadd, sin_gi1, cos_gi1);
+        const V A1 = (V(1.f) - fres) * (V(1.f) - fres);
+        const V N_1 = select(found, A1 * dphi_dh_inv * V(0.5f), V(0.f));
+
+        // normalize
+        const V scale = V(1.f) / vmax(cos_td * cos_td, V(1e-1f));
+
+        // TRT uses the p = 0 solution as well
+        float r[V::width], tt[V::width], trt[V::width];
+        (M_R * N_0 * scale).store(r);
+        (M_TT * N_1 * scale).store(tt);
+        (M_TRT * N_0 * scale).store(trt);
+        path.storePartial(tt_path + i, m);
+        for (int k = 0; k < m; k++) {
+            out[i + k].R = r[k];
+            out[i + k].TT = tt[k];
+            out[i + k].TRT = trt[k];
+        }
+    }
+}
+
+template <int Tier, class V>
+void marschnerCombine(const MarschnerCombineArgs& args,
+                      const AFMarschnerLobes* terms, const float* tt_path,
+                      float* out, int n) {
+    const V ir(args.intensity_r), itt(args.intensity_tt),
+            itrt(args.intensity_trt);
+    const V neg_sigma_a(-args.sigma_a[0]);
+    for (int i = 0; i < n; i += V::width) {
+        const int m = laneCount<V>(n - i);
+        float r[V::width], tt[V::width], trt[V::width];
+        for (int k = 0; k < V::width; k++) {
+            const AFMarschnerLobes& t = terms[i + (k < m ? k : m - 1)];
+            r[k] = t.R;
+            tt[k] = t.TT;
+            trt[k] = t.TRT;
+        }
+        const V T = vexp<Tier>(neg_sigma_a * V::loadPartial(tt_path + i, m));
+        const V res = vmax(ir * V::load(r), V(0.f)) +
+                      vmax(itt * V::load(tt) * T, V(0.f)) +
+                      vmax(itrt * V::load(trt), V(0.f));
+        res.storePartial(out + i, m);
+    }
+}
+
+template <int Tier, class V>
+void marschnerColor(const MarschnerCombineArgs& args,
+                    const AFMarschnerLobes* terms, const float* tt_path,
+                    float* out, int n) {
+    const int nc = args.n_channels;
+    // -sigma_a of the channel blocks (most often a single vector)
+    V neg_sigma_a[MAX_COLOR_CHANNELS];
+    int n_blocks = 0;
+    for (int c = 0; c < nc; c += V::width) {
+        neg_sigma_a[n_blocks++] =
+            -V::loadPartial(args.sigma_a + c, laneCount<V>(nc - c));
+    }
+    for (int i = 0; i < n; i++) {
+        const AFMarschnerLobes& t = terms[i];
+        // channel independent lobes
+        const V rest = vmax(V(args.intensity_r * t.R), V(0.f)) +
+                       vmax(V(args.intensity_trt * t.TRT), V(0.f));
+        const V tt(args.intensity_tt * t.TT);
+        const V path(tt_path[i]);
+        float* o = out + i * nc;
+        for (int b = 0; b < n_blocks; b++) {
+            const int c = b * V::width;
+            const V T = vexp<Tier>(neg_sigma_a[b] * path);
+            (rest + vmax(tt * T, V(0.f))).storePartial(o + c,
+                                                       laneCount<V>(nc - c));
+        }
+    }
+}
+
+} // namespace kernels
+
+template <class V>
+ShaderKernels makeShaderKernels(const char* isa) {
+    ShaderKernels k;
+    k.isa = isa;
+    k.width = V::width;
+    k.specular[MATH_ACCURATE] = kernels::specular<MATH_ACCURATE, V>;
+    k.specular[MATH_FAST] = kernels::specular<MATH_FAST, V>;
+    k.kajiya_kay[MATH_ACCURATE] = kernels::kajiyaKay<MATH_ACCURATE, V>;
+    k.kajiya_kay[MATH_FAST] = kernels::kajiyaKay<MATH_FAST, V>;
+    k.marschner_terms[MATH_ACCURATE] =
+        kernels::marschnerTerms<MATH_ACCURATE, V>;
+    k.marschner_terms[MATH_FAST] = kernels::marschnerTerms<MATH_FAST, V>;
+    k.marschner_combine[MATH_ACCURATE] =
+        kernels::marschnerCombine<MATH_ACCURATE, V>;
+    k.marschner_combine[MATH_FAST] = kernels::marschnerCombine<MATH_FAST, V>;
+    k.marschner_color[MATH_ACCURATE] =
+        kernels::marschnerColor<MATH_ACCURATE, V>;
+    k.marschner_color[MATH_FAST] = kernels::marschnerColor<MATH_FAST, V>;
+    return k;
+}
+
+} // namespace BRDF_SIMD_ISA_NS
+} // namespace simd
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SIMD_COMMON_H_261018
+#define SIMD_COMMON_H_261018
+
+// Translation units compiled for another instruction set (kernels_*.cpp)
+// define BRDF_SIMD_ISA_NS before any include. The vector types, the math
+// and the kernel templates live in this inline namespace, so the inline
+// functions of each instruction set stay distinct symbols and the linker
+// never mixes an AVX copy into the baseline code.
+#ifndef BRDF_SIMD_ISA_NS
+#define BRDF_SIMD_ISA_NS base
+#endif
+
+namespace simd {
+
+enum MathTier {
+    MATH_ACCURATE = 0,
+    MATH_FAST,
+    MATH_NUM_TIERS
+};
+
+} // namespace simd
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef SIMD_MATH_H_261018
+#define SIMD_MATH_H_261018
+
+// Polynomial transcendental functions on the vector types of vfloat.h.
+//
+// The accurate tier follows the Cephes single precision algorithms (range
+// reduction + minimax polynomial), the fast tier keeps the reduction and
+// shortens the polynomials. Maximum errors measured against double precision
+// libm over the stated domains (ulp of the float result, abs = absolute):
+//
+//   function         domain          accurate          fast
+//   vexp             [-87, 88]       1.3 ulp           5.6e-5 rel
+//   vlog             normal x > 0    0.8 ulp           1.6e-6 abs
+//   vpow(x >= 0, y)  |y log x| < 87  (*)               6.3e-5 rel
+//   vsin/vcos        |x| < 4         1.5 ulp, 9e-8 abs 3.6e-5 abs
+//   vsin/vcos        |x| < 8192      9.2e-8 abs        4.7e-4 abs
+//   vasin            [-1, 1]         2.4 ulp           2.7e-5 abs
+//   vacos            [-1, 1]         1.3 ulp           2.7e-5 abs
+//   vatan            all             2.8 ulp           6.2e-6 abs
+//   vatan2           finite          3.1 ulp           6.3e-6 abs
+//
+// (*) 1e-7 * (1 + |y log x|) relative: the error of log(x) is scaled by y.
+// vsqrt is the hardware instruction (correctly rounded) in both tiers.
+// Denormal inputs are treated as zero by vlog and vexp results below FLT_MIN
+// flush to zero. vatan2(+-0, -0) returns +-0 (libm: +-pi). NaN propagates.
+
+#include "simd_common.h"
+#include "vfloat.h"
+
+namespace simd {
+inline namespace BRDF_SIMD_ISA_NS {
+
+const float MATH_PI = 3.14159265358979323846f;
+const float MATH_PI_2 = 1.57079632679489661923f;
+const float MATH_PI_4 = 0.78539816339744830962f;
+
+// === exp ===
+template <int Tier, class V>
+inline V vexp(V x) {
+    typedef typename V::Int VI;
+    const V x_in = x;
+    x = vmin(vmax(x, V(-87.33654f)), V(88.37626f));
+    // x = n ln2 + r, |r| <= ln2 / 2
+    const VI n = vround(x * V(1.44269504088896341f));
+    const V fn = vtofloat(n);
+    x = x - fn * V(0.693359375f);
+    x = x - fn * V(-2.12194440e-4f);
+    V y;
+    if (Tier == MATH_ACCURATE) {
+        const V z = x * x;
+        y = V(1.9875691500e-4f);
+        y = vmadd(y, x, V(1.3981999507e-3f));
+        y = vmadd(y, x, V(8.3334519073e-3f));
+        y = vmadd(y, x, V(4.1665795894e-2f));
+        y = vmadd(y, x, V(1.6666665459e-1f));
+        y = vmadd(y, x, V(5.0000001201e-1f));
+        y = vmadd(y, z, x + V(1.f));
+    } else {
+        y = V(1.f / 24.f);
+        y = vmadd(y, x, V(1.f / 6.f));
+        y = vmadd(y, x, V(0.5f));
+        y = vmadd(y, x, V(1.f));
+        y = vmadd(y, x, V(1.f));
+    }
+    // * 2^n
+    y = y * vasfloat((n + VI(127)) << 23);
+    y = select(x_in < V(-87.33654f), V(0.f), y);
+    y = select(x_in > V(88.37626f), V(HUGE_VALF), y);
+    return select(x_in != x_in, x_in, y);
+}
+
+// === log ===
+template <int Tier, class V>
+inline V vlog(V x) {
+    typedef typename V::Int VI;
+    // x = m 2^e, m in [sqrt(1/2), sqrt(2))
+    const VI bits = vasint(x);
+    V e = vtofloat(((bits >> 23) & VI(0xff)) - VI(126));
+    V m = vasfloat((bits & VI(0x807fffff)) | VI(0x3f000000));
+    const typename V::Mask small = m < V(0.707106781186547524f);
+    e = select(small, e - V(1.f), e);
+    m = select(small, m + m, m) - V(1.f);
+    V y;
+    if (Tier == MATH_ACCURATE) {
+        const V z = m * m;
+        V p = V(7.0376836292e-2f);
+        p = vmadd(p, m, V(-1.1514610310e-1f));
+        p = vmadd(p, m, V(1.1676998740e-1f));
+        p = vmadd(p, m, V(-1.2420140846e-1f));
+        p = vmadd(p, m, V(1.4249322787e-1f));
+        p = vmadd(p, m, V(-1.6668057665e-1f));
+        p = vmadd(p, m, V(2.0000714765e-1f));
+        p = vmadd(p, m, V(-2.4999993993e-1f));
+        p = vmadd(p, m, V(3.3333331174e-1f));
+        y = p * m * z;
+        y = vmadd(e, V(-2.12194440e-4f), y);
+        y = vmadd(z, V(-0.5f), y);
+        y = m + y;
+        y = vmadd(e, V(0.693359375f), y);
+    } else {
+        // log(1 + m) = 2 atanh(s), s = m / (2 + m), |s| <= 0.172
+        const V s = m / (m + V(2.f));
+        const V z = s * s;
+        V p = vmadd(z, V(2.f / 5.f), V(2.f / 3.f));
+        p = vmadd(p, z, V(2.f));
+        y = vmadd(e, V(0.693147180559945f), p * s);
+    }
+    y = select(x == V(0.f), V(-HUGE_VALF), y);
+    y = select(x == V(HUGE_VALF), x, y);
+    const V nan = vasfloat(VI(0x7fc00000));
+    return select((x < V(0.f)) | (x != x), nan, y);
+}
+
+// === pow (x >= 0) ===
+template <int Tier, class V>
+inline V vpow(V x, V y) {
+    V r = vexp<Tier>(y * vlog<Tier>(x));
+    // pow(0, y): 1 for y == 0, 0 for y > 0, inf for y < 0
+    const V r0 = select(y == V(0.f), V(1.f),
+                        select(y < V(0.f), V(HUGE_VALF), V(0.f)));
+    r = select(x == V(0.f), r0, r);
+    return select(y == V(0.f), V(1.f), r);
+}
+
+// === sin / cos ===
+template <int Tier, class V>
+inline void vsincos(V x, V& s, V& c) {
+    typedef typename V::Int VI;
+    const V x_in = x;
+    x = vabs(x);
+    // octant j (even), x - j pi/4 in [-pi/4, pi/4]
+    VI j = vtrunc(x * V(1.27323954473516f));
+    j = (j + VI(1)) & VI(~1);
+    const V y = vtofloat(j);
+    const typename V::Mask flip_sin = vcmpeq(j & VI(4), VI(4));
+    const typename V::Mask flip_cos = vcmpeq((j - VI(2)) & VI(4), VI(0));
+    const typename V::Mask poly_sin = vcmpeq(j & VI(2), VI(0));
+    V ps, pc;
+    if (Tier == MATH_ACCURATE) {
+        x = vmadd(y, V(-0.78515625f), x);
+        x = vmadd(y, V(-2.4187564849853515625e-4f), x);
+        x = vmadd(y, V(-3.77489497744594108e-8f), x);
+        const V z = x * x;
+        ps = V(-1.9515295891e-4f);
+        ps = vmadd(ps, z, V(8.3321608736e-3f));
+        ps = vmadd(ps, z, V(-1.6666654611e-1f));
+        ps = vmadd(ps * z, x, x);
+        pc = V(2.443315711809948e-5f);
+        pc = vmadd(pc, z, V(-1.388731625493765e-3f));
+        pc = vmadd(pc, z, V(4.166664568298827e-2f));
+        pc = vmadd(pc * z, z, vmadd(z, V(-0.5f), V(1.f)));
+    } else {
+        x = vmadd(y, V(-MATH_PI_4), x);
+        const V z = x * x;
+        ps = vmadd(z, V(1.f / 120.f), V(-1.f / 6.f));
+        ps = vmadd(ps * z, x, x);
+        pc = vmadd(z, V(-1.f / 720.f), V(1.f / 24.f));
+        pc = vmadd(pc, z, V(-0.5f));
+        pc = vmadd(pc, z, V(1.f));
+    }
+    s = select(poly_sin, ps, pc);
+    c = select(poly_sin, pc, ps);
+    s = vxorsign(select(flip_sin, -s, s), x_in);
+    c = select(flip_cos, -c, c);
+}
+
+template <int Tier, class V>
+inline V vsin(V x) {
+    V s, c;
+    vsincos<Tier>(x, s, c);
+    return s;
+}
+
+template <int Tier, class V>
+inline V vcos(V x) {
+    V s, c;
+    vsincos<Tier>(x, s, c);
+    return c;
+}
+
+// === asin / acos ===
+// asin(t) for |t| <= 0.5
+template <int Tier, class V>
+inline V vasinCore(V t) {
+    const V z = t * t;
+    V p;
+    if (Tier == MATH_ACCURATE) {
+        p = V(4.2163199048e-2f);
+        p = vmadd(p, z, V(2.4181311049e-2f));
+        p = vmadd(p, z, V(4.5470025998e-2f));
+        p = vmadd(p, z, V(7.4953002686e-2f));
+        p = vmadd(p, z, V(1.6666752422e-1f));
+    } else {
+        p = V(9.5892103e-2f);
+        p = vmadd(p, z, V(1.6470949e-1f));
+    }
+    return vmadd(p * z, t, t);
+}
+
+template <int Tier, class V>
+inline V vasin(V x) {
+    // asin(a) = pi/2 - 2 asin(sqrt((1 - a) / 2)) for a > 0.5
+    const V a = vabs(x);
+    const typename V::Mask big = a > V(0.5f);
+    const V t = select(big, vsqrt(V(0.5f) * (V(1.f) - a)), a);
+    V r = vasinCore<Tier>(t);
+    r = select(big, V(MATH_PI_2) - (r + r), r);
+    return vxorsign(r, x);
+}
+
+template <int Tier, class V>
+inline V vacos(V x) {
+    const V a = vabs(x);
+    const typename V::Mask big = a > V(0.5f);
+    const V t = select(big, vsqrt(V(0.5f) * (V(1.f) - a)), x);
+    const V r = vasinCore<Tier>(t);
+    const V r_big = select(x < V(0.f), V(MATH_PI) - (r + r), r + r);
+    return select(big, r_big, V(MATH_PI_2) - r);
+}
+
+// === atan / atan2 ===
+template <int Tier, class V>
+inline V vatan(V x) {
+    const V a = vabs(x);
+    const typename V::Mask big = a > V(2.414213562373095f);   // tan(3pi/8)
+    const typename V::Mask mid = a > V(0.4142135623730950f);  // tan(pi/8)
+    const V y0 = select(big, V(MATH_PI_2), select(mid, V(MATH_PI_4), V(0.f)));
+    const V t = select(big, V(-1.f) / a,
+                       select(mid, (a - V(1.f)) / (a + V(1.f)), a));
+    const V z = t * t;
+    V p;
+    if (Tier == MATH_ACCURATE) {
+        p = V(8.05374449538e-2f);
+        p = vmadd(p, z, V(-1.38776856032e-1f));
+        p = vmadd(p, z, V(1.99777106478e-1f));
+        p = vmadd(p, z, V(-3.33329491539e-1f));
+    } else {
+        p = V(1.6856653e-1f);
+        p = vmadd(p, z, V(-3.3156826e-1f));
+    }
+    return vxorsign(y0 + vmadd(p * z, t, t), x);
+}
+
+template <int Tier, class V>
+inline V vatan2(V y, V x) {
+    V r = vatan<Tier>(y / x);
+    r = r + select(x < V(0.f), vxorsign(V(MATH_PI), y), V(0.f));
+    const V r0 = select(y == V(0.f), y, vxorsign(V(MATH_PI_2), y));
+    return select(x == V(0.f), r0, r);
+}
+
+} // namespace BRDF_SIMD_ISA_NS
+} // namespace simd
+
+#endif
@@ -0,0 +1,540 @@
+#ifndef VFLOAT_H_261018
+#define VFLOAT_H_261018
+
+// Thin SIMD float vector types for the shader kernels.
+//
+// Every type V provides the same interface so kernels and the math
+// functions in simd_math.h are written once as templates:
+//   V::Mask, V::Int, V::width
+//   V(float) broadcast, V::load(p), V::loadPartial(p, n), store(p),
+//   storePartial(p, n), arithmetic and comparison operators,
+//   select(mask, a, b), any(mask), all(mask),
+//   vmin/vmax (std::min/std::max semantics for NaN), vabs, vsqrt,
+//   vxorsign(x, y) (flips the sign of x where y is negative),
+//   vround(x) -> Int (to nearest), vtrunc(x) -> Int, vtofloat(Int),
+//   vasint(x) / vasfloat(Int) bit casts and the Int operators
+//   + - & | << >> (arithmetic), vcmpeq(Int, Int) -> Mask,
+//   vmadd(a, b, c) = a * b + c (fused where the instruction set has FMA).
+//
+// VFloat1 is the portable scalar fallback, VFloat4 uses SSE2 (SSE4.1 blends
+// when compiled for it), VFloat8 AVX2 + FMA and VFloat16 AVX-512F. The wider
+// types exist only in the translation units compiled for them.
+
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+
+#include "simd_common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRDF_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#if (defined(__AVX2__) && defined(__FMA__)) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace simd {
+inline namespace BRDF_SIMD_ISA_NS {
+
+// === Scalar fallback ===
+struct VInt1 {
+    VInt1() {}
+    VInt1(int32_t i) : i(i) {}
+    int32_t i;
+};
+struct VMask1 {
+    VMask1() {}
+    explicit VMask1(bool m) : m(m) {}
+    bool m;
+};
+struct VFloat1 {
+    typedef VMask1 Mask;
+    typedef VInt1 Int;
+    enum { width = 1 };
+    VFloat1() {}
+    VFloat1(float v) : v(v) {}
+    static VFloat1 load(const float* p) { return VFloat1(p[0]); }
+    static VFloat1 loadPartial(const float* p, int n) { return VFloat1(p[0]); }
+    void store(float* p) const { p[0] = v; }
+    void storePartial(float* p, int n) const { p[0] = v; }
+    float lane(int i) const { return v; }
+    float v;
+};
+
+inline VFloat1 operator+(VFloat1 a, VFloat1 b) { return a.v + b.v; }
+inline VFloat1 operator-(VFloat1 a, VFloat1 b) { return a.v - b.v; }
+inline VFloat1 operator*(VFloat1 a, VFloat1 b) { return a.v * b.v; }
+inline VFloat1 operator/(VFloat1 a, VFloat1 b) { return a.v / b.v; }
+inline VFloat1 operator-(VFloat1 a) { return -a.v; }
+inline VMask1 operator<(VFloat1 a, VFloat1 b) { return VMask1(a.v < b.v); }
+inline VMask1 operator<=(VFloat1 a, VFloat1 b) { return VMask1(a.v <= b.v); }
+inline VMask1 operator>(VFloat1 a, VFloat1 b) { return VMask1(a.v > b.v); }
+inline VMask1 operator>=(VFloat1 a, VFloat1 b) { return VMask1(a.v >= b.v); }
+inline VMask1 operator==(VFloat1 a, VFloat1 b) { return VMask1(a.v == b.v); }
+inline VMask1 operator!=(VFloat1 a, VFloat1 b) { return VMask1(a.v != b.v); }
+inline VMask1 operator&(VMask1 a, VMask1 b) { return VMask1(a.m && b.m); }
+inline VMask1 operator|(VMask1 a, VMask1 b) { return VMask1(a.m || b.m); }
+inline VMask1 operator~(VMask1 a) { return VMask1(!a.m); }
+inline VFloat1 select(VMask1 m, VFloat1 a, VFloat1 b) { return m.m ? a : b; }
+inline bool any(VMask1 m) { return m.m; }
+inline bool all(VMask1 m) { return m.m; }
+inline VFloat1 vmin(VFloat1 a, VFloat1 b) { return (b.v < a.v) ? b : a; }
+inline VFloat1 vmax(VFloat1 a, VFloat1 b) { return (a.v < b.v) ? b : a; }
+inline VFloat1 vabs(VFloat1 a) { return std::fabs(a.v); }
+inline VFloat1 vsqrt(VFloat1 a) { return std::sqrt(a.v); }
+inline VFloat1 vxorsign(VFloat1 x, VFloat1 y) {
+    return std::signbit(y.v) ? -x.v : x.v;
+}
+inline VInt1 vround(VFloat1 a) { return (int32_t)std::nearbyint(a.v); }
+inline VInt1 vtrunc(VFloat1 a) { return (int32_t)a.v; }
+inline VFloat1 vtofloat(VInt1 a) { return (float)a.i; }
+inline VInt1 vasint(VFloat1 a) {
+    int32_t i;
+    memcpy(&i, &a.v, 4);
+    return i;
+}
+inline VFloat1 vasfloat(VInt1 a) {
+    float f;
+    memcpy(&f, &a.i, 4);
+    return f;
+}
+inline VInt1 operator+(VInt1 a, VInt1 b) { return a.i + b.i; }
+inline VInt1 operator-(VInt1 a, VInt1 b) { return a.i - b.i; }
+inline VInt1 operator&(VInt1 a, VInt1 b) { return a.i & b.i; }
+inline VInt1 operator|(VInt1 a, VInt1 b) { return a.i | b.i; }
+inline VInt1 operator<<(VInt1 a, int n) {
+    return (int32_t)((uint32_t)a.i << n);
+}
+inline VInt1 operator>>(VInt1 a, int n) { return a.i >> n; }
+inline VMask1 vcmpeq(VInt1 a, VInt1 b) { return VMask1(a.i == b.i); }
+inline VFloat1 vmadd(VFloat1 a, VFloat1 b, VFloat1 c) { return a.v * b.v + c.v; }
+
+
+#ifdef BRDF_SIMD_SSE2
+// === SSE2 (4 lanes) ===
+struct VInt4 {
+    VInt4() {}
+    VInt4(int32_t i) : v(_mm_set1_epi32(i)) {}
+    explicit VInt4(__m128i v) : v(v) {}
+    __m128i v;
+};
+struct VMask4 {
+    VMask4() {}
+    explicit VMask4(__m128 m) : m(m) {}
+    __m128 m;
+};
+struct VFloat4 {
+    typedef VMask4 Mask;
+    typedef VInt4 Int;
+    enum { width = 4 };
+    VFloat4() {}
+    VFloat4(float s) : v(_mm_set1_ps(s)) {}
+    explicit VFloat4(__m128 v) : v(v) {}
+    static VFloat4 load(const float* p) { return VFloat4(_mm_loadu_ps(p)); }
+    // lanes >= n repeat the last valid value
+    static VFloat4 loadPartial(const float* p, int n) {
+        float buf[4];
+        for (int i = 0; i < 4; i++) buf[i] = p[i < n ? i : n - 1];
+        return VFloat4(_mm_loadu_ps(buf));
+    }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    void storePartial(float* p, int n) const {
+        float buf[4];
+        _mm_storeu_ps(buf, v);
+        for (int i = 0; i < n; i++) p[i] = buf[i];
+    }
+    float lane(int i) const {
+        float buf[4];
+        _mm_storeu_ps(buf, v);
+        return buf[i];
+    }
+    __m128 v;
+};
+
+inline VFloat4 operator+(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_add_ps(a.v, b.v));
+}
+inline VFloat4 operator-(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_sub_ps(a.v, b.v));
+}
+inline VFloat4 operator*(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_mul_ps(a.v, b.v));
+}
+inline VFloat4 operator/(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_div_ps(a.v, b.v));
+}
+inline VFloat4 operator-(VFloat4 a) {
+    return VFloat4(_mm_xor_ps(a.v, _mm_set1_ps(-0.f)));
+}
+inline VMask4 operator<(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmplt_ps(a.v, b.v));
+}
+inline VMask4 operator<=(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmple_ps(a.v, b.v));
+}
+inline VMask4 operator>(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmpgt_ps(a.v, b.v));
+}
+inline VMask4 operator>=(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmpge_ps(a.v, b.v));
+}
+inline VMask4 operator==(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmpeq_ps(a.v, b.v));
+}
+inline VMask4 operator!=(VFloat4 a, VFloat4 b) {
+    return VMask4(_mm_cmpneq_ps(a.v, b.v));
+}
+inline VMask4 operator&(VMask4 a, VMask4 b) {
+    return VMask4(_mm_and_ps(a.m, b.m));
+}
+inline VMask4 operator|(VMask4 a, VMask4 b) {
+    return VMask4(_mm_or_ps(a.m, b.m));
+}
+inline VMask4 operator~(VMask4 a) {
+    return VMask4(_mm_xor_ps(a.m, _mm_castsi128_ps(_mm_set1_epi32(-1))));
+}
+inline VFloat4 select(VMask4 m, VFloat4 a, VFloat4 b) {
+#ifdef __SSE4_1__
+    return VFloat4(_mm_blendv_ps(b.v, a.v, m.m));
+#else
+    return VFloat4(_mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)));
+#endif
+}
+inline bool any(VMask4 m) { return _mm_movemask_ps(m.m) != 0; }
+inline bool all(VMask4 m) { return _mm_movemask_ps(m.m) == 0xf; }
+// _mm_min_ps(x, y) returns y when either is NaN, as std::min(y, x) does
+inline VFloat4 vmin(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_min_ps(b.v, a.v));
+}
+inline VFloat4 vmax(VFloat4 a, VFloat4 b) {
+    return VFloat4(_mm_max_ps(b.v, a.v));
+}
+inline VFloat4 vabs(VFloat4 a) {
+    return VFloat4(_mm_andnot_ps(_mm_set1_ps(-0.f), a.v));
+}
+inline VFloat4 vsqrt(VFloat4 a) { return VFloat4(_mm_sqrt_ps(a.v)); }
+inline VFloat4 vxorsign(VFloat4 x, VFloat4 y) {
+    return VFloat4(_mm_xor_ps(x.v, _mm_and_ps(y.v, _mm_set1_ps(-0.f))));
+}
+inline VInt4 vround(VFloat4 a) { return VInt4(_mm_cvtps_epi32(a.v)); }
+inline VInt4 vtrunc(VFloat4 a) { return VInt4(_mm_cvttps_epi32(a.v)); }
+inline VFloat4 vtofloat(VInt4 a) { return VFloat4(_mm_cvtepi32_ps(a.v)); }
+inline VInt4 vasint(VFloat4 a) { return VInt4(_mm_castps_si128(a.v)); }
+inline VFloat4 vasfloat(VInt4 a) { return VFloat4(_mm_castsi128_ps(a.v)); }
+inline VInt4 operator+(VInt4 a, VInt4 b) {
+    return VInt4(_mm_add_epi32(a.v, b.v));
+}
+inline VInt4 operator-(VInt4 a, VInt4 b) {
+    return VInt4(_mm_sub_epi32(a.v, b.v));
+}
+inline VInt4 operator&(VInt4 a, VInt4 b) {
+    return VInt4(_mm_and_si128(a.v, b.v));
+}
+inline VInt4 operator|(VInt4 a, VInt4 b) {
+    return VInt4(_mm_or_si128(a.v, b.v));
+}
+inline VInt4 operator<<(VInt4 a, int n) {
+    return VInt4(_mm_slli_epi32(a.v, n));
+}
+inline VInt4 operator>>(VInt4 a, int n) {
+    return VInt4(_mm_srai_epi32(a.v, n));
+}
+inline VMask4 vcmpeq(VInt4 a, VInt4 b) {
+    return VMask4(_mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v)));
+}
+inline VFloat4 vmadd(VFloat4 a, VFloat4 b, VFloat4 c) { return a * b + c; }
+#endif // BRDF_SIMD_SSE2
+
+
+#if defined(__AVX2__) && defined(__FMA__)
+// === AVX2 + FMA (8 lanes) ===
+struct VInt8 {
+    VInt8() {}
+    VInt8(int32_t i) : v(_mm256_set1_epi32(i)) {}
+    explicit VInt8(__m256i v) : v(v) {}
+    __m256i v;
+};
+struct VMask8 {
+    VMask8() {}
+    explicit VMask8(__m256 m) : m(m) {}
+    __m256 m;
+};
+struct VFloat8 {
+    typedef VMask8 Mask;
+    typedef VInt8 Int;
+    enum { width = 8 };
+    VFloat8() {}
+    VFloat8(float s) : v(_mm256_set1_ps(s)) {}
+    explicit VFloat8(__m256 v) : v(v) {}
+    static VFloat8 load(const float* p) {
+        return VFloat8(_mm256_loadu_ps(p));
+    }
+    // lanes >= n repeat the last valid value
+    static VFloat8 loadPartial(const float* p, int n) {
+        float buf[8];
+        for (int i = 0; i < 8; i++) buf[i] = p[i < n ? i : n - 1];
+        return VFloat8(_mm256_loadu_ps(buf));
+    }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    void storePartial(float* p, int n) const {
+        float buf[8];
+        _mm256_storeu_ps(buf, v);
+        for (int i = 0; i < n; i++) p[i] = buf[i];
+    }
+    float lane(int i) const {
+        float buf[8];
+        _mm256_storeu_ps(buf, v);
+        return buf[i];
+    }
+    __m256 v;
+};
+
+inline VFloat8 operator+(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_add_ps(a.v, b.v));
+}
+inline VFloat8 operator-(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_sub_ps(a.v, b.v));
+}
+inline VFloat8 operator*(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_mul_ps(a.v, b.v));
+}
+inline VFloat8 operator/(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_div_ps(a.v, b.v));
+}
+inline VFloat8 operator-(VFloat8 a) {
+    return VFloat8(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)));
+}
+inline VMask8 operator<(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ));
+}
+inline VMask8 operator<=(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+}
+inline VMask8 operator>(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));
+}
+inline VMask8 operator>=(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ));
+}
+inline VMask8 operator==(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ));
+}
+inline VMask8 operator!=(VFloat8 a, VFloat8 b) {
+    return VMask8(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ));
+}
+inline VMask8 operator&(VMask8 a, VMask8 b) {
+    return VMask8(_mm256_and_ps(a.m, b.m));
+}
+inline VMask8 operator|(VMask8 a, VMask8 b) {
+    return VMask8(_mm256_or_ps(a.m, b.m));
+}
+inline VMask8 operator~(VMask8 a) {
+    return VMask8(_mm256_xor_ps(a.m,
+                                _mm256_castsi256_ps(_mm256_set1_epi32(-1))));
+}
+inline VFloat8 select(VMask8 m, VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_blendv_ps(b.v, a.v, m.m));
+}
+inline bool any(VMask8 m) { return _mm256_movemask_ps(m.m) != 0; }
+inline bool all(VMask8 m) { return _mm256_movemask_ps(m.m) == 0xff; }
+inline VFloat8 vmin(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_min_ps(b.v, a.v));
+}
+inline VFloat8 vmax(VFloat8 a, VFloat8 b) {
+    return VFloat8(_mm256_max_ps(b.v, a.v));
+}
+inline VFloat8 vabs(VFloat8 a) {
+    return VFloat8(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v));
+}
+inline VFloat8 vsqrt(VFloat8 a) { return VFloat8(_mm256_sqrt_ps(a.v)); }
+inline VFloat8 vxorsign(VFloat8 x, VFloat8 y) {
+    return VFloat8(_mm256_xor_ps(x.v, _mm256_and_ps(y.v,
+                                                    _mm256_set1_ps(-0.f))));
+}
+inline VInt8 vround(VFloat8 a) { return VInt8(_mm256_cvtps_epi32(a.v)); }
+inline VInt8 vtrunc(VFloat8 a) { return VInt8(_mm256_cvttps_epi32(a.v)); }
+inline VFloat8 vtofloat(VInt8 a) { return VFloat8(_mm256_cvtepi32_ps(a.v)); }
+inline VInt8 vasint(VFloat8 a) { return VInt8(_mm256_castps_si256(a.v)); }
+inline VFloat8 vasfloat(VInt8 a) { return VFloat8(_mm256_castsi256_ps(a.v)); }
+inline VInt8 operator+(VInt8 a, VInt8 b) {
+    return VInt8(_mm256_add_epi32(a.v, b.v));
+}
+inline VInt8 operator-(VInt8 a, VInt8 b) {
+    return VInt8(_mm256_sub_epi32(a.v, b.v));
+}
+inline VInt8 operator&(VInt8 a, VInt8 b) {
+    return VInt8(_mm256_and_si256(a.v, b.v));
+}
+inline VInt8 operator|(VInt8 a, VInt8 b) {
+    return VInt8(_mm256_or_si256(a.v, b.v));
+}
+inline VInt8 operator<<(VInt8 a, int n) {
+    return VInt8(_mm256_slli_epi32(a.v, n));
+}
+inline VInt8 operator>>(VInt8 a, int n) {
+    return VInt8(_mm256_srai_epi32(a.v, n));
+}
+inline VMask8 vcmpeq(VInt8 a, VInt8 b) {
+    return VMask8(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)));
+}
+inline VFloat8 vmadd(VFloat8 a, VFloat8 b, VFloat8 c) {
+    return VFloat8(_mm256_fmadd_ps(a.v, b.v, c.v));
+}
+#endif // __AVX2__ && __FMA__
+
+
+#ifdef __AVX512F__
+// === AVX-512F (16 lanes) ===
+struct VInt16 {
+    VInt16() {}
+    VInt16(int32_t i) : v(_mm512_set1_epi32(i)) {}
+    explicit VInt16(__m512i v) : v(v) {}
+    __m512i v;
+};
+struct VMask16 {
+    VMask16() {}
+    explicit VMask16(__mmask16 m) : m(m) {}
+    __mmask16 m;
+};
+struct VFloat16 {
+    typedef VMask16 Mask;
+    typedef VInt16 Int;
+    enum { width = 16 };
+    VFloat16() {}
+    VFloat16(float s) : v(_mm512_set1_ps(s)) {}
+    explicit VFloat16(__m512 v) : v(v) {}
+    static VFloat16 load(const float* p) {
+        return VFloat16(_mm512_loadu_ps(p));
+    }
+    // lanes >= n repeat the last valid value
+    static VFloat16 loadPartial(const float* p, int n) {
+        float buf[16];
+        for (int i = 0; i < 16; i++) buf[i] = p[i < n ? i : n - 1];
+        return VFloat16(_mm512_loadu_ps(buf));
+    }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+    void storePartial(float* p, int n) const {
+        _mm512_mask_storeu_ps(p, (__mmask16)((1u << n) - 1), v);
+    }
+    float lane(int i) const {
+        float buf[16];
+        _mm512_storeu_ps(buf, v);
+        return buf[i];
+    }
+    __m512 v;
+};
+
+// float bit operations through the integer unit (AVX512DQ is not assumed)
+inline __m512 xor512(__m512 a, __m512 b) {
+    return _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(a),
+                                                _mm512_castps_si512(b)));
+}
+inline __m512 and512(__m512 a, __m512 b) {
+    return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(a),
+                                                _mm512_castps_si512(b)));
+}
+
+inline VFloat16 operator+(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_add_ps(a.v, b.v));
+}
+inline VFloat16 operator-(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_sub_ps(a.v, b.v));
+}
+inline VFloat16 operator*(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_mul_ps(a.v, b.v));
+}
+inline VFloat16 operator/(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_div_ps(a.v, b.v));
+}
+inline VFloat16 operator-(VFloat16 a) {
+    return VFloat16(xor512(a.v, _mm512_set1_ps(-0.f)));
+}
+inline VMask16 operator<(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ));
+}
+inline VMask16 operator<=(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ));
+}
+inline VMask16 operator>(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ));
+}
+inline VMask16 operator>=(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ));
+}
+inline VMask16 operator==(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ));
+}
+inline VMask16 operator!=(VFloat16 a, VFloat16 b) {
+    return VMask16(_mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ));
+}
+inline VMask16 operator&(VMask16 a, VMask16 b) {
+    return VMask16((__mmask16)(a.m & b.m));
+}
+inline VMask16 operator|(VMask16 a, VMask16 b) {
+    return VMask16((__mmask16)(a.m | b.m));
+}
+inline VMask16 operator~(VMask16 a) { return VMask16((__mmask16)~a.m); }
+inline VFloat16 select(VMask16 m, VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_mask_blend_ps(m.m, b.v, a.v));
+}
+inline bool any(VMask16 m) { return m.m != 0; }
+inline bool all(VMask16 m) { return m.m == 0xffff; }
+inline VFloat16 vmin(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_min_ps(b.v, a.v));
+}
+inline VFloat16 vmax(VFloat16 a, VFloat16 b) {
+    return VFloat16(_mm512_max_ps(b.v, a.v));
+}
+inline VFloat16 vabs(VFloat16 a) { return VFloat16(_mm512_abs_ps(a.v)); }
+inline VFloat16 vsqrt(VFloat16 a) { return VFloat16(_mm512_sqrt_ps(a.v)); }
+inline VFloat16 vxorsign(VFloat16 x, VFloat16 y) {
+    return VFloat16(xor512(x.v, and512(y.v, _mm512_set1_ps(-0.f))));
+}
+inline VInt16 vround(VFloat16 a) { return VInt16(_mm512_cvtps_epi32(a.v)); }
+inline VInt16 vtrunc(VFloat16 a) {
+    return VInt16(_mm512_cvttps_epi32(a.v));
+}
+inline VFloat16 vtofloat(VInt16 a) {
+    return VFloat16(_mm512_cvtepi32_ps(a.v));
+}
+inline VInt16 vasint(VFloat16 a) {
+    return VInt16(_mm512_castps_si512(a.v));
+}
+inline VFloat16 vasfloat(VInt16 a) {
+    return VFloat16(_mm512_castsi512_ps(a.v));
+}
+inline VInt16 operator+(VInt16 a, VInt16 b) {
+    return VInt16(_mm512_add_epi32(a.v, b.v));
+}
+inline VInt16 operator-(VInt16 a, VInt16 b) {
+    return VInt16(_mm512_sub_epi32(a.v, b.v));
+}
+inline VInt16 operator&(VInt16 a, VInt16 b) {
+    return VInt16(_mm512_and_epi32(a.v, b.v));
+}
+inline VInt16 operator|(VInt16 a, VInt16 b) {
+    return VInt16(_mm512_or_epi32(a.v, b.v));
+}
+inline VInt16 operator<<(VInt16 a, int n) {
+    return VInt16(_mm512_slli_epi32(a.v, n));
+}
+inline VInt16 operator>>(VInt16 a, int n) {
+    return VInt16(_mm512_srai_epi32(a.v, n));
+}
+inline VMask16 vcmpeq(VInt16 a, VInt16 b) {
+    return VMask16(_mm512_cmpeq_epi32_mask(a.v, b.v));
+}
+inline VFloat16 vmadd(VFloat16 a, VFloat16 b, VFloat16 c) {
+    return VFloat16(_mm512_fmadd_ps(a.v, b.v, c.v));
+}
+#endif // __AVX512F__
+
+} // namespace BRDF_SIMD_ISA_NS
+} // namespace simd
+
+#endif
@@ -0,0 +1,278 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "measured.h"
+
+namespace {
+
+// "min:max:n", "min:max" (n = 2) or "value"
+bool parseRange(const std::string& s, SweepRange& range) {
+    float min, max;
+    int n;
+    char end;
+    if (sscanf(s.c_str(), "%f:%f:%d%c", &min, &max, &n, &end) == 3) {
+        if (n < 1) return false;
+    } else if (sscanf(s.c_str(), "%f:%f%c", &min, &max, &end) == 2) {
+        n = 2;
+    } else if (sscanf(s.c_str(), "%f%c", &min, &end) == 1) {
+        max = min;
+        n = 1;
+    } else {
+        return false;
+    }
+    range.min = min;
+    range.max = max;
+    range.n = n;
+    return true;
+}
+
+bool parseInts(const std::string& s, int* values) {
+    return sscanf(s.c_str(), "%d,%d,%d,%d", &values[0], &values[1],
+                  &values[2], &values[3]) == 4;
+}
+
+} // namespace
+
+// === SweepSpec ===
+SweepSpec::SweepSpec() : shader("marschner"), mode(SWEEP_LOBE), n_phi(100),
+                         values(SWEEP_MONO), sphere(-1) {
+    this->light_theta.min = this->light_theta.max = 45.f;
+    const int default_dims[4] = {32, 64, 32, 64};
+    const int default_tile[4] = {4, 4, 16, 32};
+    for (int a = 0; a < 4; a++) {
+        this->dims[a] = default_dims[a];
+        this->tile[a] = default_tile[a];
+    }
+}
+
+int SweepSpec::numVariants() const {
+    int n = 1;
+    for (int p = 0; p < this->params.size(); p++) n *= this->params[p].n;
+    return n;
+}
+
+int SweepSpec::numLights() const {
+    return this->mode == SWEEP_TABLE
+        ? 1 : this->light_theta.n * this->light_phi.n;
+}
+
+void SweepSpec::variantParams(int variant, float* values) const {
+    for (int p = (int)this->params.size() - 1; p >= 0; p--) {
+        const SweepRange& r = this->params[p];
+        values[p] = r.value(variant % r.n);
+        variant /= r.n;
+    }
+}
+
+glm::vec3 SweepSpec::lightDir(int light) const {
+    const float theta = this->light_theta.value(light / this->light_phi.n);
+    const float phi = this->light_phi.value(light % this->light_phi.n);
+    // the light position of the viewer
+    const float t = glm::radians(theta), p = glm::radians(phi);
+    return glm::vec3(std::sin(t) * std::cos(p), std::cos(t),
+                     std::sin(t) * std::sin(p));
+}
+
+int SweepSpec::valuesPerDir() const {
+    return this->values == SWEEP_MONO ? 1 : 3;
+}
+
+bool SweepSpec::tableSphere() const {
+    if (this->sphere >= 0) return this->sphere != 0;
+    return this->shader == "kajiyakay" || this->shader == "marschner";
+}
+
+// === Options ===
+bool parseSweepOption(const std::vector<std::string>& args, int& i,
+                      SweepSpec& spec, std::string& error) {
+    const std::string& arg = args[i];
+    const bool has_value = i + 1 < args.size();
+    const std::string value = has_value ? args[i + 1] : "";
+    bool ok = true;
+    if (arg == "--shader" && has_value) {
+        spec.shader = value;
+    } else if (arg == "--merl" && has_value) {
+        spec.merl_path = value;
+    } else if ((arg == "--param" || arg == "--set") && has_value) {
+        const size_t eq = value.find('=');
+        SweepRange range;
+        ok = eq != std::string::npos && eq > 0 &&
+             parseRange(value.substr(eq + 1), range);
+        range.name = value.substr(0, eq);
+        // a later range of the same parameter replaces the earlier one
+        int p = 0;
+        while (p < spec.params.size() && spec.params[p].name != range.name) {
+            p++;
+        }
+        if (ok && p == spec.params.size()) spec.params.push_back(range);
+        if (ok) spec.params[p] = range;
+    } else if (arg == "--light-theta" && has_value) {
+        ok = parseRange(value, spec.light_theta);
+    } else if (arg == "--light-phi" && has_value) {
+        ok = parseRange(value, spec.light_phi);
+    } else if (arg == "--mode" && has_value) {
+        ok = value == "lobe" || value == "table";
+        spec.mode = (value == "table") ? SWEEP_TABLE : SWEEP_LOBE;
+    } else if (arg == "--n-phi" && has_value) {
+        spec.n_phi = atoi(value.c_str());
+        ok = spec.n_phi >= 2;
+    } else if (arg == "--values" && has_value) {
+        if (value == "mono") {
+            spec.values = SWEEP_MONO;
+        } else if (value == "rgb") {
+            spec.values = SWEEP_RGB;
+        } else if (value == "lobes") {
+            spec.values = SWEEP_LOBES;
+        } else {
+            ok = false;
+        }
+    } else if (arg == "--dims" && has_value) {
+        ok = parseInts(value, spec.dims);
+    } else if (arg == "--tile" && has_value) {
+        ok = parseInts(value, spec.tile);
+    } else if (arg == "--sphere" || arg == "--hemisphere") {
+        spec.sphere = (arg == "--sphere");
+        return true;
+    } else {
+        return false;
+    }
+    if (!ok) {
+        error = "Invalid value of " + arg + ": " + value;
+        return false;
+    }
+    i++;
+    return true;
+}
+
+bool readSweepSpecFile(const std::string& path,
+                       std::vector<std::string>& args, std::string& error) {
+    std::ifstream ifs(path.c_str());
+    if (!ifs) {
+        error = "Failed to open " + path;
+        return false;
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) line = line.substr(0, hash);
+        std::istringstream tokens(line);
+        std::string token;
+        for (int t = 0; tokens >> token; t++) {
+            args.push_back((t == 0 && token[0] != '-') ? "--" + token
+                                                       : token);
+        }
+    }
+    return true;
+}
+
+std::string sweepUsage() {
+    return
+        "  --shader <name>        specular, kajiyakay, marschner or measured\n"
+        "                         (marschner)\n"
+        "  --merl <file>          measured BRDF file (measured)\n"
+        "  --param <name=range>   parameter range min:max:n or value\n"
+        "                         (repeatable)\n"
+        "  --light-theta <range>  light degrees from the normal (45)\n"
+        "  --light-phi <range>    light degrees around the normal (0)\n"
+        "  --mode <name>          lobe or table (lobe)\n"
+        "  --n-phi <n>            lobe resolution as in the viewer (100)\n"
+        "  --values <name>        lobe values mono, rgb or lobes (mono)\n"
+        "  --dims <ti,pi,to,po>   table size (32,64,32,64)\n"
+        "  --tile <ti,pi,to,po>   table tile size (4,4,16,32)\n"
+        "  --sphere|--hemisphere  table directions (by the shader)\n";
+}
+
+// === Evaluation ===
+BaseShader* createSweepShader(const SweepSpec& spec, std::string& error) {
+    BaseShader* shader = NULL;
+    if (spec.shader == "specular") {
+        shader = new SpecularShader();
+    } else if (spec.shader == "kajiyakay") {
+        shader = new KajiyaKayShader();
+    } else if (spec.shader == "marschner") {
+        shader = new AFMarschnerShader();
+    } else if (spec.shader == "measured") {
+        MeasuredShader* measured = new MeasuredShader();
+        if (!measured->load(spec.merl_path)) {
+            error = measured->getError();
+            delete measured;
+            return NULL;
+        }
+        shader = measured;
+    } else {
+        error = "Unknown shader: " + spec.shader;
+        return NULL;
+    }
+    for (int p = 0; p < spec.params.size(); p++) {
+        float value;
+        if (!shader->getParam(spec.params[p].name, value)) {
+            error = "Unknown parameter: " + spec.params[p].name;
+            delete shader;
+            return NULL;
+        }
+    }
+    if (spec.values == SWEEP_LOBES && spec.mode == SWEEP_LOBE &&
+        !dynamic_cast<AFMarschnerShader*>(shader)) {
+        error = "Lobe values need the marschner shader";
+        delete shader;
+        return NULL;
+    }
+    return shader;
+}
+
+bool applySweepVariant(const SweepSpec& spec, int variant,
+                       BaseShader& shader) {
+    std::vector<float> values(spec.params.size());
+    if (!values.empty()) spec.variantParams(variant, &values[0]);
+    for (int p = 0; p < spec.params.size(); p++) {
+        if (!shader.setParam(spec.params[p].name, values[p])) return false;
+    }
+    return true;
+}
+
+void sweepLobeDirs(int n_phi, std::vector<glm::vec3>& dirs) {
+    // initBRDFGrid() of mesh.cpp with y up
+    const int n_theta = std::max(n_phi / 2, 1);
+    dirs.resize(n_phi * n_theta + 2);
+    for (int i_phi = 0; i_phi < n_phi; i_phi++) {
+        const float phi = 2.f * glm::pi<float>() * i_phi / n_phi;
+        for (int i_theta = 0; i_theta < n_theta; i_theta++) {
+            const float theta = glm::pi<float>() * (i_theta + 1) /
+                                (n_theta + 1) - 0.5f * glm::pi<float>();
+            dirs[i_phi * n_theta + i_theta] = glm::vec3(
+                std::cos(theta) * std::sin(phi), std::sin(theta),
+                std::cos(theta) * std::cos(phi));
+        }
+    }
+    dirs[n_phi * n_theta] = glm::vec3(0.f, -1.f, 0.f);
+    dirs[n_phi * n_theta + 1] = glm::vec3(0.f, 1.f, 0.f);
+}
+
+void evalSweepLobe(const SweepSpec& spec, BaseShader& shader,
+                   const glm::vec3& light_dir,
+                   const std::vector<glm::vec3>& dirs, float* out) {
+    const glm::vec3 normal(0.f, 1.f, 0.f);
+    const int n = (int)dirs.size();
+    if (spec.values == SWEEP_MONO) {
+        shader.sampleBatch(light_dir, &dirs[0], normal, out, n);
+    } else if (spec.values == SWEEP_RGB) {
+        shader.sampleColorBatch(light_dir, &dirs[0], normal, ColorChannels(),
+                                out, n);
+    } else {
+        AFMarschnerShader& marschner = dynamic_cast<AFMarschnerShader&>(
+            shader);
+        std::vector<AFMarschnerLobes> lobes(n);
+        marschner.sampleLobesBatch(light_dir, &dirs[0], normal, &lobes[0], n);
+        for (int i = 0; i < n; i++) {
+            out[3 * i] = lobes[i].R;
+            out[3 * i + 1] = lobes[i].TT;
+            out[3 * i + 2] = lobes[i].TRT;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef SWEEP_H_261018
+#define SWEEP_H_261018
+
+#include <string>
+#include <vector>
+
+#include "shader.h"
+
+// Parameter sweeps: every combination (variant) of the parameter ranges of
+// one shader, each evaluated as lobes over a set of light directions or as
+// a full 4D table (tiled.h).
+//
+// A sweep spec is a list of options, on the command line or in a file
+// (one option per line without the leading dashes, '#' comments):
+//   shader marschner
+//   param longitudinalShiftR=-10:-2:5
+//   param eta=1.55
+//   light-theta 0:80:9
+
+// n values evenly over [min, max] (n == 1: min)
+struct SweepRange {
+    SweepRange() : min(0.f), max(0.f), n(1) {}
+    float value(int i) const {
+        return n > 1 ? min + (max - min) * i / (n - 1) : min;
+    }
+    std::string name;  // parameter name (empty for the light ranges)
+    float min, max;
+    int n;
+};
+
+enum SweepMode {
+    SWEEP_LOBE = 0,  // values over the viewer directions per light
+    SWEEP_TABLE      // 4D table (.b4d) per variant
+};
+
+enum SweepValues {
+    SWEEP_MONO = 0,  // sampleBatch()
+    SWEEP_RGB,       // sampleColorBatch()
+    SWEEP_LOBES      // R, TT, TRT (Marschner)
+};
+
+struct SweepSpec {
+    SweepSpec();
+    std::string shader;
+    std::string merl_path;  // measured
+    std::vector<SweepRange> params;
+    SweepRange light_theta;  // degrees from the normal (+y)
+    SweepRange light_phi;    // degrees around the normal, from +x
+    int mode;
+    // lobes: directions of createBRDFMesh() (mesh.h) with n_phi
+    int n_phi;
+    int values;
+    // tables: layout of tiledHeader() (tiled.h)
+    int dims[4];
+    int tile[4];
+    int sphere;  // -1: by the shader
+
+    int numVariants() const;
+    int numLights() const;
+    // Parameter values of a variant (the last parameter varies fastest)
+    void variantParams(int variant, float* values) const;
+    glm::vec3 lightDir(int light) const;
+    // Floats per lobe direction
+    int valuesPerDir() const;
+    bool tableSphere() const;
+};
+
+// Parses the sweep option at args[i] (advancing i past its value);
+// false when args[i] is not a sweep option or its value is invalid (error
+// set)
+bool parseSweepOption(const std::vector<std::string>& args, int& i,
+                      SweepSpec& spec, std::string& error);
+// Appends the options of a spec file to args as command line tokens
+bool readSweepSpecFile(const std::string& path,
+                       std::vector<std::string>& args, std::string& error);
+// Usage lines of the sweep options
+std::string sweepUsage();
+
+// Shader of the spec (measured data loaded), NULL with error
+BaseShader* createSweepShader(const SweepSpec& spec, std::string& error);
+bool applySweepVariant(const SweepSpec& spec, int variant,
+                       BaseShader& shader);
+// Directions of the lobes (unit, normal +y)
+void sweepLobeDirs(int n_phi, std::vector<glm::vec3>& dirs);
+// Values of one light (dirs.size() * valuesPerDir() floats)
+void evalSweepLobe(const SweepSpec& spec, BaseShader& shader,
+                   const glm::vec3& light_dir,
+                   const std::vector<glm::vec3>& dirs, float* out);
+
+#endif
@@ -0,0 +1,518 @@
+#include "sweep_coordinator.h"
+
+#ifdef _WIN32
+
+bool runSweepCoordinator(const SweepSpec& spec,
+                         const std::vector<std::string>& spec_args,
+                         const std::set<int>& done, ResultStoreWriter& store,
+                         int schema, const SweepCoordinatorOptions& options,
+                         SweepRunStats& stats, std::string& error) {
+    error = "Sweep workers need a POSIX system";
+    return false;
+}
+
+int runSweepWorker(const std::string& address) {
+    return 1;
+}
+
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "io/message_channel.h"
+
+namespace {
+
+struct WorkUnit {
+    int id;
+    int begin, end;  // variants [begin, end)
+    int next;        // first variant without a result
+};
+
+struct WorkerSlot {
+    WorkerSlot() : pid(0), hello(false), has_unit(false) {}
+    MessageChannel channel;
+    int pid;     // of its hello
+    bool hello;  // the spec was sent
+    bool has_unit;
+    WorkUnit unit;
+};
+
+SweepUnitMessage unitMessage(const WorkUnit& unit) {
+    SweepUnitMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.unit = unit.id;
+    msg.begin = unit.begin;
+    msg.end = unit.end;
+    return msg;
+}
+
+class Coordinator {
+public:
+    Coordinator(const SweepSpec& spec,
+                const std::vector<std::string>& spec_args,
+                const std::set<int>& done, ResultStoreWriter& store,
+                int schema, const SweepCoordinatorOptions& options,
+                SweepRunStats& stats);
+    ~Coordinator();
+    bool run(std::string& error);
+
+private:
+    void spawnWorker();
+    // Children that exited (false when none is left)
+    bool reapWorkers();
+    void handle(WorkerSlot& worker, uint32_t type,
+                const std::vector<char>& payload);
+    void finish(int variant, bool ok);
+    // Next unit, or a stolen half; idle when there is none
+    void assign(WorkerSlot& worker);
+    void lost(WorkerSlot& worker);
+    void printProgress() const;
+
+    const SweepSpec& spec;
+    std::string spec_payload;
+    StoreAppender appender;
+    int schema;
+    const SweepCoordinatorOptions& options;
+    SweepRunStats& stats;
+    std::vector<glm::vec3> dirs;
+    std::vector<WorkerSlot*> workers;
+    std::set<int> children;
+    std::set<int> started;  // spawned workers that said hello
+    int n_spawn_failures;
+    std::deque<WorkUnit> queue;
+    std::vector<char> finished;   // per variant: stored or failed
+    std::map<int, int> crashes;   // per variant
+    int n_todo, n_remaining;
+    int next_unit;
+    std::chrono::steady_clock::time_point start;
+};
+
+Coordinator::Coordinator(const SweepSpec& spec,
+                         const std::vector<std::string>& spec_args,
+                         const std::set<int>& done, ResultStoreWriter& store,
+                         int schema, const SweepCoordinatorOptions& options,
+                         SweepRunStats& stats)
+    : spec(spec), appender(store), schema(schema),
+      options(options), stats(stats), n_spawn_failures(0), next_unit(0) {
+    for (int i = 0; i < spec_args.size(); i++) {
+        this->spec_payload += spec_args[i] + '\0';
+    }
+    sweepLobeDirs(spec.n_phi, this->dirs);
+
+    // units over the runs of variants to do
+    const int n_variants = spec.numVariants();
+    this->finished.assign(n_variants, 0);
+    for (std::set<int>::const_iterator it = done.begin(); it != done.end();
+         ++it) {
+        if (*it < n_variants) this->finished[*it] = 1;
+    }
+    this->n_todo = n_variants - (int)std::count(this->finished.begin(),
+                                                this->finished.end(), 1);
+    this->n_remaining = this->n_todo;
+    const int unit_size = options.unit_size > 0
+        ? options.unit_size
+        : std::max(this->n_todo / (4 * std::max(options.n_workers, 1)), 1);
+    for (int v = 0; v < n_variants;) {
+        if (this->finished[v]) {
+            v++;
+            continue;
+        }
+        WorkUnit unit;
+        unit.id = this->next_unit++;
+        unit.begin = unit.next = v;
+        while (v < n_variants && !this->finished[v] &&
+               v - unit.begin < unit_size) {
+            v++;
+        }
+        unit.end = v;
+        this->queue.push_back(unit);
+    }
+}
+
+Coordinator::~Coordinator() {
+    for (int w = 0; w < this->workers.size(); w++) delete this->workers[w];
+}
+
+bool Coordinator::run(std::string& error) {
+    const int listen_fd = listenMessageSocket(this->options.address, error);
+    if (listen_fd < 0) return false;
+    // a worker gone while sending to it is handled as a lost connection
+    signal(SIGPIPE, SIG_IGN);
+    this->start = std::chrono::steady_clock::now();
+    for (int w = 0; this->n_remaining > 0 && w < this->options.n_workers;
+         w++) {
+        this->spawnWorker();
+    }
+
+    std::chrono::steady_clock::time_point last_print = this->start;
+    bool ok = true;
+    while (this->n_remaining > 0) {
+        // nothing can finish the sweep any more
+        if (!this->reapWorkers() && this->workers.empty() &&
+            this->options.n_workers > 0) {
+            error = "No sweep worker is running";
+            ok = false;
+            break;
+        }
+        std::vector<pollfd> fds(this->workers.size() + 1);
+        fds[0].fd = listen_fd;
+        for (int w = 0; w < this->workers.size(); w++) {
+            fds[w + 1].fd = this->workers[w]->channel.getFd();
+        }
+        for (int i = 0; i < fds.size(); i++) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (::poll(&fds[0], fds.size(), 200) < 0) continue;
+
+        // new workers, messages of the connected ones
+        if (fds[0].revents & POLLIN) {
+            for (int fd; (fd = acceptMessageSocket(listen_fd)) >= 0;) {
+                WorkerSlot* worker = new WorkerSlot();
+                worker->channel.attach(fd);
+                this->workers.push_back(worker);
+            }
+        }
+        for (int w = 0; w + 1 < fds.size(); w++) {
+            if (!fds[w + 1].revents) continue;
+            WorkerSlot& worker = *this->workers[w];
+            uint32_t type;
+            std::vector<char> payload;
+            if (worker.channel.receive(type, payload)) {
+                this->handle(worker, type, payload);
+            } else {
+                this->lost(worker);
+            }
+        }
+        for (int w = 0; w < this->workers.size();) {
+            if (this->workers[w]->channel.isOpen()) {
+                w++;
+                continue;
+            }
+            delete this->workers[w];
+            this->workers.erase(this->workers.begin() + w);
+        }
+
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        if (now - last_print > std::chrono::milliseconds(200)) {
+            this->printProgress();
+            last_print = now;
+        }
+    }
+    this->printProgress();
+
+    for (int w = 0; w < this->workers.size(); w++) {
+        this->workers[w]->channel.send(SWEEP_MSG_DONE, NULL, 0);
+        this->workers[w]->channel.close();
+    }
+    for (std::set<int>::const_iterator it = this->children.begin();
+         it != this->children.end(); ++it) {
+        if (!ok) kill(*it, SIGTERM);
+        waitpid(*it, NULL, 0);
+    }
+    this->children.clear();
+    closeMessageSocket(listen_fd, this->options.address);
+    if (!this->appender.flush()) {
+        error = "Failed to write the result store";
+        ok = false;
+    }
+    return ok;
+}
+
+void Coordinator::spawnWorker() {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        execlp(this->options.worker_exe.c_str(),
+               this->options.worker_exe.c_str(), "--connect",
+               this->options.address.c_str(), (char*)NULL);
+        _exit(127);
+    }
+    if (pid > 0) this->children.insert(pid);
+}
+
+bool Coordinator::reapWorkers() {
+    int status;
+    for (pid_t pid; (pid = waitpid(-1, &status, WNOHANG)) > 0;) {
+        this->children.erase(pid);
+        // exited before its hello: it will not start
+        if (!this->started.count(pid) &&
+            ++this->n_spawn_failures <= this->options.n_workers) {
+            this->spawnWorker();
+        }
+    }
+    return !this->children.empty();
+}
+
+void Coordinator::handle(WorkerSlot& worker, uint32_t type,
+                         const std::vector<char>& payload) {
+    const int n_lights = this->spec.numLights();
+    const int n_values = (int)this->dirs.size() * this->spec.valuesPerDir();
+    int32_t variant = -1;
+    if (payload.size() >= sizeof(variant)) {
+        memcpy(&variant, &payload[0], sizeof(variant));
+    }
+    const bool known = variant >= 0 && variant < this->finished.size();
+
+    if (type == SWEEP_MSG_HELLO && payload.size() == sizeof(SweepHello)) {
+        SweepHello hello;
+        memcpy(&hello, &payload[0], sizeof(hello));
+        if (hello.version != SWEEP_PROTOCOL_VERSION) {
+            std::cerr << "Sweep worker " << hello.pid
+                      << " speaks another protocol" << std::endl;
+            worker.channel.close();
+            return;
+        }
+        worker.pid = hello.pid;
+        worker.hello = true;
+        if (this->children.count(hello.pid)) {
+            this->started.insert(hello.pid);
+        }
+        worker.channel.send(SWEEP_MSG_SPEC, this->spec_payload.data(),
+                            this->spec_payload.size());
+        this->assign(worker);
+    } else if (type == SWEEP_MSG_RESULT && known &&
+               payload.size() == sizeof(variant) +
+                                 (size_t)n_lights * n_values * sizeof(float)) {
+        if (!this->finished[variant]) {
+            std::vector<float> params(this->spec.params.size());
+            if (!params.empty()) this->spec.variantParams(variant, &params[0]);
+            const float* values = (const float*)&payload[sizeof(variant)];
+            bool ok = true;
+            for (int l = 0; l < n_lights && ok; l++) {
+                ok = this->appender.appendLobe(
+                    this->schema, params.empty() ? NULL : &params[0],
+                    (int)params.size(), this->spec.lightDir(l),
+                    this->spec.n_phi, (int)this->dirs.size(),
+                    this->spec.valuesPerDir(), this->spec.values,
+                    values + l * n_values);
+            }
+            this->finish(variant, ok);
+        }
+        if (worker.has_unit) {
+            worker.unit.next = std::max(worker.unit.next, variant + 1);
+        }
+    } else if (type == SWEEP_MSG_FAILED && known) {
+        if (!this->finished[variant]) this->finish(variant, false);
+        if (worker.has_unit) {
+            worker.unit.next = std::max(worker.unit.next, variant + 1);
+        }
+    } else if (type == SWEEP_MSG_UNIT_DONE) {
+        worker.has_unit = false;
+        this->assign(worker);
+    } else {
+        std::cerr << "Invalid message of sweep worker " << worker.pid
+                  << std::endl;
+        this->lost(worker);
+    }
+}
+
+void Coordinator::finish(int variant, bool ok) {
+    this->finished[variant] = 1;
+    this->n_remaining--;
+    if (ok) {
+        this->stats.n_done++;
+    } else {
+        std::cerr << "Variant " << variant << " failed" << std::endl;
+        this->stats.n_failed++;
+    }
+}
+
+void Coordinator::assign(WorkerSlot& worker) {
+    // queued units without their finished variants
+    while (!this->queue.empty()) {
+        WorkUnit& front = this->queue.front();
+        while (front.next < front.end && this->finished[front.next]) {
+            front.next++;
+        }
+        if (front.next < front.end) break;
+        this->queue.pop_front();
+    }
+    WorkUnit unit;
+    if (!this->queue.empty()) {
+        unit = this->queue.front();
+        this->queue.pop_front();
+        unit.begin = unit.next;
+    } else {
+        // the upper half of the largest unit in progress
+        WorkerSlot* victim = NULL;
+        for (int w = 0; w < this->workers.size(); w++) {
+            WorkerSlot* other = this->workers[w];
+            if (other == &worker || !other->has_unit) continue;
+            if (!victim || other->unit.end - other->unit.next >
+                               victim->unit.end - victim->unit.next) {
+                victim = other;
+            }
+        }
+        const int remaining = victim ? victim->unit.end - victim->unit.next
+                                     : 0;
+        if (remaining < 2) return;  // idle until a unit is requeued
+        unit.id = this->next_unit++;
+        unit.begin = unit.next = victim->unit.next + remaining / 2;
+        unit.end = victim->unit.end;
+        victim->unit.end = unit.begin;
+        const SweepUnitMessage shrink = unitMessage(victim->unit);
+        victim->channel.send(SWEEP_MSG_SHRINK, &shrink, sizeof(shrink));
+    }
+    worker.unit = unit;
+    worker.has_unit = true;
+    const SweepUnitMessage msg = unitMessage(unit);
+    if (!worker.channel.send(SWEEP_MSG_UNIT, &msg, sizeof(msg))) {
+        this->lost(worker);
+    }
+}
+
+void Coordinator::lost(WorkerSlot& worker) {
+    if (!worker.channel.isOpen()) return;
+    worker.channel.close();
+    this->stats.n_crashes += this->n_remaining > 0;
+    if (worker.has_unit && worker.unit.next < worker.unit.end) {
+        // the variant it was on may crash every worker
+        WorkUnit unit = worker.unit;
+        if (!this->finished[unit.next] &&
+            ++this->crashes[unit.next] > this->options.retries) {
+            this->finish(unit.next, false);
+        }
+        unit.id = this->next_unit++;
+        this->queue.push_front(unit);
+    }
+    worker.has_unit = false;
+    // a replacement, and the requeued unit for an idle worker
+    if (this->n_remaining > 0 && this->started.count(worker.pid)) {
+        this->spawnWorker();
+    }
+    for (int w = 0; w < this->workers.size(); w++) {
+        WorkerSlot& other = *this->workers[w];
+        if (other.hello && !other.has_unit && other.channel.isOpen()) {
+            this->assign(other);
+        }
+    }
+}
+
+void Coordinator::printProgress() const {
+    const int n = this->n_todo - this->n_remaining;
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - this->start).count();
+    std::cout << "\r" << n << "/" << this->n_todo << " variants, "
+              << this->workers.size() << " workers, "
+              << (seconds > 0 ? n / seconds : 0) << " /s   " << std::flush;
+}
+
+} // namespace
+
+bool runSweepCoordinator(const SweepSpec& spec,
+                         const std::vector<std::string>& spec_args,
+                         const std::set<int>& done, ResultStoreWriter& store,
+                         int schema, const SweepCoordinatorOptions& options,
+                         SweepRunStats& stats, std::string& error) {
+    Coordinator coordinator(spec, spec_args, done, store, schema, options,
+                            stats);
+    return coordinator.run(error);
+}
+
+// === Worker ===
+int runSweepWorker(const std::string& address) {
+    MessageChannel channel;
+    if (!channel.connect(address)) {
+        std::cerr << channel.getError() << std::endl;
+        return 1;
+    }
+    SweepHello hello;
+    hello.version = SWEEP_PROTOCOL_VERSION;
+    hello.pid = getpid();
+    uint32_t type;
+    std::vector<char> payload;
+    if (!channel.send(SWEEP_MSG_HELLO, &hello, sizeof(hello)) ||
+        !channel.receive(type, payload) || type != SWEEP_MSG_SPEC) {
+        std::cerr << "No sweep spec from " << address << std::endl;
+        return 1;
+    }
+
+    // the spec of the coordinator
+    std::vector<std::string> args;
+    for (size_t i = 0; i < payload.size();) {
+        const size_t end = std::find(payload.begin() + i, payload.end(),
+                                     '\0') - payload.begin();
+        args.push_back(std::string(&payload[i], end - i));
+        i = end + 1;
+    }
+    SweepSpec spec;
+    std::string error;
+    for (int i = 0; i < args.size(); i++) {
+        if (!parseSweepOption(args, i, spec, error)) {
+            std::cerr << "Invalid sweep spec: " << error << std::endl;
+            return 1;
+        }
+    }
+    BaseShader* shader = createSweepShader(spec, error);
+    if (!shader) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::vector<glm::vec3> dirs;
+    sweepLobeDirs(spec.n_phi, dirs);
+    const int n_lights = spec.numLights();
+    const int n_values = (int)dirs.size() * spec.valuesPerDir();
+    // variant, values of all lights
+    std::vector<char> result(sizeof(int32_t) +
+                             (size_t)n_lights * n_values * sizeof(float));
+    float* values = (float*)&result[sizeof(int32_t)];
+
+    int ret = 1;
+    bool running = true;
+    while (running && channel.receive(type, payload)) {
+        if (type == SWEEP_MSG_DONE) {
+            ret = 0;
+            break;
+        }
+        SweepUnitMessage unit;
+        if (type != SWEEP_MSG_UNIT || payload.size() != sizeof(unit)) {
+            continue;  // a late SHRINK of a finished unit
+        }
+        memcpy(&unit, &payload[0], sizeof(unit));
+        for (int32_t v = unit.begin; running && v < unit.end; v++) {
+            bool ok = applySweepVariant(spec, v, *shader);
+            for (int l = 0; ok && l < n_lights; l++) {
+                evalSweepLobe(spec, *shader, spec.lightDir(l), dirs,
+                              values + l * n_values);
+            }
+            memcpy(&result[0], &v, sizeof(v));
+            running = ok ? channel.send(SWEEP_MSG_RESULT, &result[0],
+                                        result.size())
+                         : channel.send(SWEEP_MSG_FAILED, &v, sizeof(v));
+            // the coordinator may have given the rest of the unit away
+            while (running && channel.poll(0)) {
+                SweepUnitMessage shrink;
+                running = channel.receive(type, payload);
+                if (running && type == SWEEP_MSG_DONE) {
+                    ret = 0;
+                    running = false;
+                } else if (running && type == SWEEP_MSG_SHRINK &&
+                           payload.size() == sizeof(shrink)) {
+                    memcpy(&shrink, &payload[0], sizeof(shrink));
+                    if (shrink.unit == unit.unit) {
+                        unit.end = std::min(unit.end, shrink.end);
+                    }
+                }
+            }
+        }
+        if (running) {
+            running = channel.send(SWEEP_MSG_UNIT_DONE, &unit, sizeof(unit));
+        }
+    }
+    delete shader;
+    return ret;
+}
+
+#endif
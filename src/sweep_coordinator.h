@@ -0,0 +1,82 @@
+#ifndef SWEEP_COORDINATOR_H_261018
+#define SWEEP_COORDINATOR_H_261018
+
+#include <stdint.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "result_store.h"
+#include "sweep.h"
+
+// Lobe sweeps over worker processes. The coordinator splits the variants
+// into work units (variant ranges) and hands them to the workers connected
+// to its socket (io/message_channel.h); an idle worker steals the upper
+// half of the largest unit in progress. The results are appended to one
+// result store by the coordinator. A worker that disconnects (crashed)
+// gets its unit requeued and is replaced; a variant that brought down
+// `retries` + 1 workers counts as failed.
+//
+// Protocol (MessageChannel types, little endian payloads):
+//   worker  HELLO      SweepHello
+//   coord   SPEC       sweep options, '\0' separated
+//   coord   UNIT       SweepUnitMessage: evaluate [begin, end)
+//   worker  RESULT     int32 variant, float lobe values of all lights
+//   worker  FAILED     int32 variant
+//   coord   SHRINK     SweepUnitMessage: the unit now ends at `end`
+//   worker  UNIT_DONE  SweepUnitMessage
+//   coord   DONE       no more work
+// Results of a variant past a late SHRINK are duplicates and dropped.
+enum SweepMessageType {
+    SWEEP_MSG_HELLO = 1,
+    SWEEP_MSG_SPEC,
+    SWEEP_MSG_UNIT,
+    SWEEP_MSG_RESULT,
+    SWEEP_MSG_FAILED,
+    SWEEP_MSG_SHRINK,
+    SWEEP_MSG_UNIT_DONE,
+    SWEEP_MSG_DONE
+};
+
+const uint32_t SWEEP_PROTOCOL_VERSION = 1;
+
+struct SweepHello {
+    uint32_t version;
+    uint32_t pid;
+};
+
+struct SweepUnitMessage {
+    uint32_t unit;
+    int32_t begin;
+    int32_t end;
+    uint32_t reserved;
+};
+
+struct SweepCoordinatorOptions {
+    SweepCoordinatorOptions() : n_workers(1), unit_size(0), retries(2) {}
+    std::string address;     // listening socket ("unix:<path>")
+    std::string worker_exe;  // spawned as `worker_exe --connect <address>`
+    int n_workers;           // spawned (more may connect)
+    int unit_size;           // variants per unit (0: by the worker count)
+    int retries;             // crashes per variant before it fails
+};
+
+struct SweepRunStats {
+    SweepRunStats() : n_done(0), n_failed(0), n_crashes(0) {}
+    int n_done;
+    int n_failed;
+    int n_crashes;
+};
+
+// Evaluates the variants not in `done` on workers into the store (lobes of
+// spec.lightDir() under `schema`); false when no worker could run
+bool runSweepCoordinator(const SweepSpec& spec,
+                         const std::vector<std::string>& spec_args,
+                         const std::set<int>& done, ResultStoreWriter& store,
+                         int schema, const SweepCoordinatorOptions& options,
+                         SweepRunStats& stats, std::string& error);
+// Worker process: evaluates the units of a coordinator until it is done
+// (exit code)
+int runSweepWorker(const std::string& address);
+
+#endif
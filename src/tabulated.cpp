@@ -0,0 +1,342 @@
+#include "tabulated.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char TABULATED_MAGIC[4] = {'B', 'T', 'A', 'B'};
+const float HALF_TARGET_MAX = 16384.f;  // max cell of the float16 encoding
+const float LOG16_RANGE = 1e4f;         // max / scale of the log encoding
+const int LOG16_MAX_CELL = 65535;
+const int VARINT_MAX_BYTES = 3;  // of a 16 bit zigzag difference
+
+size_t chunkTableBytes(int n_chunks) {
+    return (size_t)n_chunks * 2 * sizeof(uint64_t);
+}
+
+// === Delta varint ===
+// Differences of consecutive cells (mod 2^16) as zigzag LEB128, 1 byte for
+// smooth rows
+void compressChunk(const uint16_t* cells, int n,
+                   std::vector<unsigned char>& out) {
+    uint16_t prev = 0;
+    for (int i = 0; i < n; i++) {
+        const int16_t d = (int16_t)(uint16_t)(cells[i] - prev);
+        uint32_t z = (uint16_t)((d << 1) ^ (d >> 15));
+        while (z >= 0x80) {
+            out.push_back((unsigned char)(z | 0x80));
+            z >>= 7;
+        }
+        out.push_back((unsigned char)z);
+        prev = cells[i];
+    }
+}
+
+// False when the data ends early (the remaining cells are zero) or has
+// bytes left over
+bool decompressChunk(const unsigned char* data, size_t size, uint16_t* cells,
+                     int n) {
+    const unsigned char* end = data + size;
+    uint16_t prev = 0;
+    for (int i = 0; i < n; i++) {
+        uint32_t z = 0;
+        int shift = 0;
+        unsigned char byte = 0x80;
+        while ((byte & 0x80) && data < end && shift < 21) {
+            byte = *data++;
+            z |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        }
+        if (byte & 0x80) {
+            std::fill(cells + i, cells + n, 0);
+            return false;
+        }
+        const uint16_t u = (uint16_t)z;
+        prev = (uint16_t)(prev + (uint16_t)((u >> 1) ^ (uint16_t)-(u & 1)));
+        cells[i] = prev;
+    }
+    return data == end;
+}
+
+} // namespace
+
+// === float16 ===
+uint16_t floatToHalf(float x) {
+    uint32_t f;
+    memcpy(&f, &x, sizeof(f));
+    const uint16_t sign = (uint16_t)((f >> 16) & 0x8000);
+    f &= 0x7fffffff;
+    if (f > 0x7f800000) return sign | 0x7e00;   // NaN
+    if (f >= 0x477ff000) return sign | 0x7bff;  // rounds to inf: saturate
+    if (f < 0x38800000) {
+        // subnormal (< 2^-14) or zero
+        if (f < 0x33000000) return sign;
+        const int shift = 126 - (int)(f >> 23);
+        const uint32_t mant = (f & 0x7fffff) | 0x800000;
+        uint32_t h = mant >> shift;
+        const uint32_t rem = mant & ((1u << shift) - 1);
+        const uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1))) h++;
+        return sign | (uint16_t)h;
+    }
+    // rebias the exponent, round the mantissa to nearest even
+    uint32_t h = (f - 0x38000000) >> 13;
+    const uint32_t rem = f & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+    return sign | (uint16_t)h;
+}
+
+float halfToFloat(uint16_t h) {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exp = (h >> 10) & 0x1f;
+    const uint32_t mant = h & 0x3ff;
+    if (exp == 0) {
+        const float v = mant * 5.9604645e-8f;  // 2^-24
+        return sign ? -v : v;
+    }
+    const uint32_t f = (exp == 31)
+        ? (sign | 0x7f800000 | (mant << 13))
+        : (sign | ((exp + 112) << 23) | (mant << 13));
+    float x;
+    memcpy(&x, &f, sizeof(x));
+    return x;
+}
+
+// === TabulatedBRDF ===
+bool isTabulatedBRDF(const std::string& path) {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    char magic[4] = {0, 0, 0, 0};
+    ifs.read(magic, sizeof(magic));
+    return ifs && memcmp(magic, TABULATED_MAGIC, sizeof(magic)) == 0;
+}
+
+TabulatedBRDF::TabulatedBRDF() : chunk_table(NULL), chunk_cells(0) {
+    memset(&this->header, 0, sizeof(this->header));
+}
+
+TabulatedBRDF::~TabulatedBRDF() {
+    if (this->decoded) {
+        for (uint32_t h = 0; h < this->header.dims[0]; h++) {
+            delete[] this->decoded[h].load();
+        }
+    }
+}
+
+bool TabulatedBRDF::open(const std::string& path) {
+    if (!this->file.open(path, true)) {
+        this->error = this->file.getError();
+        return false;
+    }
+    const unsigned char* data = (const unsigned char*)this->file.getData();
+    const size_t size = this->file.getSize();
+    TabulatedHeader& hd = this->header;
+    bool ok = size >= sizeof(hd);
+    if (ok) memcpy(&hd, data, sizeof(hd));
+    ok = ok && memcmp(hd.magic, TABULATED_MAGIC, 4) == 0 &&
+         hd.version == TABULATED_VERSION && hd.n_channels == 3 &&
+         hd.encoding <= TAB_LOG16 && hd.compression <= TAB_DELTA_VARINT &&
+         hd.dims[0] > 0 && hd.dims[1] > 0 && hd.dims[2] > 0 &&
+         hd.dims[0] <= 4096 && hd.dims[1] <= 4096 && hd.dims[2] <= 4096 &&
+         size >= sizeof(hd) + chunkTableBytes(hd.dims[0]);
+    if (!ok) {
+        this->error = "Not a tabulated BRDF file: " + path;
+        this->file.close();
+        return false;
+    }
+    this->chunk_cells = 3 * hd.dims[1] * hd.dims[2];
+    this->chunk_table = (const uint64_t*)(data + sizeof(hd));
+    // every chunk inside the file, raw chunks 2 byte aligned and complete,
+    // compressed ones 1 to VARINT_MAX_BYTES bytes per cell
+    const uint64_t n_cells = this->chunk_cells;
+    for (uint32_t h = 0; h < hd.dims[0]; h++) {
+        const uint64_t offset = this->chunk_table[2 * h];
+        const uint64_t bytes = this->chunk_table[2 * h + 1];
+        if (offset > size || bytes > size - offset ||
+            (hd.compression == TAB_RAW &&
+             (offset % 2 || bytes != n_cells * sizeof(uint16_t))) ||
+            (hd.compression == TAB_DELTA_VARINT &&
+             (bytes < n_cells || bytes > n_cells * VARINT_MAX_BYTES))) {
+            this->error = "Corrupt chunk table: " + path;
+            this->file.close();
+            return false;
+        }
+    }
+    if (hd.compression != TAB_RAW) {
+        this->decoded.reset(new std::atomic<uint16_t*>[hd.dims[0]]);
+        for (uint32_t h = 0; h < hd.dims[0]; h++) this->decoded[h] = NULL;
+    }
+    return true;
+}
+
+const uint16_t* TabulatedBRDF::chunk(int h) const {
+    const unsigned char* data = (const unsigned char*)this->file.getData();
+    const unsigned char* chunk_data = data + this->chunk_table[2 * h];
+    if (this->header.compression == TAB_RAW) {
+        return (const uint16_t*)chunk_data;
+    }
+    uint16_t* cells = this->decoded[h].load(std::memory_order_acquire);
+    if (cells) return cells;
+    // decode; a thread that loses the race drops its copy
+    cells = new uint16_t[this->chunk_cells];
+    const bool ok = decompressChunk(chunk_data, this->chunk_table[2 * h + 1],
+                                    cells, this->chunk_cells);
+    uint16_t* expected = NULL;
+    if (!this->decoded[h].compare_exchange_strong(
+            expected, cells, std::memory_order_acq_rel)) {
+        delete[] cells;
+        return expected;
+    }
+    // reported by the thread that published the chunk, once
+    if (!ok) {
+        std::cerr << "Corrupt chunk " << h << " of " << this->getPath()
+                  << " (cells left zero)" << std::endl;
+    }
+    return cells;
+}
+
+float TabulatedBRDF::decode(int channel, uint16_t cell) const {
+    if (this->header.encoding == TAB_LOG16) {
+        return this->header.scale[channel] *
+               std::expm1(cell * this->header.log_step[channel]);
+    }
+    return halfToFloat(cell) * this->header.scale[channel];
+}
+
+int TabulatedBRDF::decodedChunks() const {
+    if (!this->decoded) return 0;
+    int n = 0;
+    for (uint32_t h = 0; h < this->header.dims[0]; h++) {
+        if (this->decoded[h].load()) n++;
+    }
+    return n;
+}
+
+glm::vec3 TabulatedBRDF::lookup(float theta_h, float theta_d,
+                                float phi_d) const {
+    if (!this->file.isOpen()) return glm::vec3(0.f);
+    const int n_d = this->header.dims[1], n_p = this->header.dims[2];
+    HalfDiffCorners cs;
+    halfDiffCorners(this->header.dims[0], n_d, n_p, theta_h, theta_d, phi_d,
+                    cs);
+    const uint16_t* chunks[2] = {this->chunk(cs.h[0]), this->chunk(cs.h[1])};
+    glm::vec3 rgb(0.f);
+    for (int i = 0; i < 8; i++) {
+        const int a = i >> 2, b = (i >> 1) & 1, c = i & 1;
+        const float w = cs.wh[a] * cs.wd[b] * cs.wp[c];
+        if (w == 0.f) continue;
+        for (int ch = 0; ch < 3; ch++) {
+            const uint16_t cell = chunks[a][(ch * n_d + cs.d[b]) * n_p +
+                                            cs.p[c]];
+            rgb[ch] += w * this->decode(ch, cell);
+        }
+    }
+    return rgb;
+}
+
+// === Conversion ===
+bool writeTabulatedBRDF(const std::string& path, const MerlBRDF& merl,
+                        const TabulatedOptions& options, std::string& error) {
+    TabulatedHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, TABULATED_MAGIC, 4);
+    hd.version = TABULATED_VERSION;
+    hd.encoding = options.encoding;
+    hd.compression = options.compression;
+    hd.dims[0] = MERL_THETA_H;
+    hd.dims[1] = MERL_THETA_D;
+    hd.dims[2] = MERL_PHI_D;
+    hd.n_channels = 3;
+    const int n_chunks = MERL_THETA_H;
+    const int chunk_cells = 3 * MERL_THETA_D * MERL_PHI_D;
+
+    // scale per channel from its largest value
+    for (int c = 0; c < 3; c++) {
+        float max_value = 0.f;
+        for (int h = 0; h < MERL_THETA_H; h++) {
+            for (int d = 0; d < MERL_THETA_D; d++) {
+                for (int p = 0; p < MERL_PHI_D; p++) {
+                    max_value = std::max(max_value, merl.value(c, h, d, p));
+                }
+            }
+        }
+        if (!(max_value > 0.f)) max_value = 1.f;
+        if (hd.encoding == TAB_LOG16) {
+            hd.scale[c] = max_value / LOG16_RANGE;
+            hd.log_step[c] = std::log1p(LOG16_RANGE) / LOG16_MAX_CELL;
+        } else {
+            hd.scale[c] = max_value / HALF_TARGET_MAX;
+        }
+    }
+
+    // chunks in parallel
+    std::vector<std::vector<unsigned char> > chunks(n_chunks);
+    std::atomic<int> next(0);
+    int n_threads = options.n_threads > 0
+        ? options.n_threads : (int)std::thread::hardware_concurrency();
+    n_threads = std::max(std::min(n_threads, n_chunks), 1);
+    auto worker = [&]() {
+        std::vector<uint16_t> cells(chunk_cells);
+        for (int h = next++; h < n_chunks; h = next++) {
+            int i = 0;
+            for (int c = 0; c < 3; c++) {
+                const float inv_scale = 1.f / hd.scale[c];
+                for (int d = 0; d < MERL_THETA_D; d++) {
+                    for (int p = 0; p < MERL_PHI_D; p++, i++) {
+                        // not measured (negative) and NaN as zero
+                        float v = merl.value(c, h, d, p) * inv_scale;
+                        if (!(v > 0.f)) v = 0.f;
+                        if (hd.encoding == TAB_LOG16) {
+                            const float cell = std::log1p(v) / hd.log_step[c];
+                            cells[i] = (uint16_t)std::min(
+                                (int)(cell + 0.5f), LOG16_MAX_CELL);
+                        } else {
+                            cells[i] = floatToHalf(v);
+                        }
+                    }
+                }
+            }
+            std::vector<unsigned char>& out = chunks[h];
+            if (hd.compression == TAB_DELTA_VARINT) {
+                compressChunk(&cells[0], chunk_cells, out);
+            } else {
+                out.resize(chunk_cells * sizeof(uint16_t));
+                memcpy(&out[0], &cells[0], out.size());
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_threads; t++) threads.push_back(std::thread(worker));
+    worker();
+    for (int t = 0; t < threads.size(); t++) threads[t].join();
+
+    // header, chunk table, chunks (8 byte aligned)
+    std::vector<uint64_t> table(2 * n_chunks);
+    uint64_t offset = sizeof(hd) + chunkTableBytes(n_chunks);
+    for (int h = 0; h < n_chunks; h++) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        table[2 * h] = offset;
+        table[2 * h + 1] = chunks[h].size();
+        offset += chunks[h].size();
+    }
+    std::ofstream ofs(path.c_str(), std::ios::binary);
+    ofs.write((const char*)&hd, sizeof(hd));
+    ofs.write((const char*)&table[0], chunkTableBytes(n_chunks));
+    uint64_t pos = sizeof(hd) + chunkTableBytes(n_chunks);
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (int h = 0; h < n_chunks; h++) {
+        ofs.write(zeros, table[2 * h] - pos);
+        ofs.write((const char*)&chunks[h][0], chunks[h].size());
+        pos = table[2 * h] + chunks[h].size();
+    }
+    if (!ofs) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
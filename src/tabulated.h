@@ -0,0 +1,88 @@
+#ifndef TABULATED_H_261018
+#define TABULATED_H_261018
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "measured.h"
+
+// Compact tabulated BRDF file (.btab): 16 bit RGB cells over the MERL
+// half / difference angle grid (measured.h), 4x smaller than MERL.
+//
+//   TabulatedHeader
+//   uint64 offset, uint64 size  per chunk (one theta_half row each)
+//   chunks (8 byte aligned): [channel][theta_diff][phi_diff] cells
+//
+// Little endian. Cells are float16 of value / scale, or log encoded
+// (value = scale * (exp(cell * log_step) - 1), relative precision over the
+// whole range), with a scale per channel. Compressed chunks store the cell
+// differences as zigzag varints and are decoded on first access.
+enum TabulatedEncoding { TAB_HALF = 0, TAB_LOG16 };
+enum TabulatedCompression { TAB_RAW = 0, TAB_DELTA_VARINT };
+
+struct TabulatedHeader {
+    char magic[4];  // "BTAB"
+    uint32_t version;
+    uint32_t encoding;
+    uint32_t compression;
+    uint32_t dims[3];  // theta_half, theta_diff, phi_diff
+    uint32_t n_channels;
+    float scale[3];
+    float log_step[3];
+};
+
+const uint32_t TABULATED_VERSION = 1;
+
+struct TabulatedOptions {
+    TabulatedOptions() : encoding(TAB_HALF), compression(TAB_RAW),
+                         n_threads(0) {}
+    int encoding;
+    int compression;
+    int n_threads;  // chunks converted in parallel (0: hardware)
+};
+
+// True when the file starts with the .btab magic
+bool isTabulatedBRDF(const std::string& path);
+
+class TabulatedBRDF : public MeasuredBRDF {
+public:
+    TabulatedBRDF();
+    virtual ~TabulatedBRDF();
+    // Maps the file and checks its header and chunk table
+    bool open(const std::string& path);
+    virtual glm::vec3 lookup(float theta_h, float theta_d, float phi_d) const;
+    virtual const std::string& getPath() const { return file.getPath(); }
+    const std::string& getError() const { return error; }
+    const TabulatedHeader& getHeader() const { return header; }
+    // Cells of the theta_half row `h` (decoded on first access when
+    // compressed, thread safe). Corrupt chunks are logged and left zero.
+    const uint16_t* chunk(int h) const;
+    float decode(int channel, uint16_t cell) const;
+    // Decoded chunks (for memory reports)
+    int decodedChunks() const;
+
+private:
+    TabulatedBRDF(const TabulatedBRDF&);
+    TabulatedBRDF& operator=(const TabulatedBRDF&);
+
+    MappedFile file;
+    TabulatedHeader header;
+    const uint64_t* chunk_table;  // offset, size per chunk
+    int chunk_cells;
+    // compressed: decoded chunks, NULL until first access
+    std::unique_ptr<std::atomic<uint16_t*>[]> decoded;
+    std::string error;
+};
+
+// Converts a MERL file. Cells are encoded in parallel chunks.
+bool writeTabulatedBRDF(const std::string& path, const MerlBRDF& merl,
+                        const TabulatedOptions& options, std::string& error);
+
+// IEEE half precision (round to nearest even, saturating to the largest
+// finite value)
+uint16_t floatToHalf(float x);
+float halfToFloat(uint16_t h);
+
+#endif
@@ -0,0 +1,587 @@
+#include "tiled.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd/coord_kernels.h"
+#include "tabulated.h"
+
+namespace {
+
+const char TILED_MAGIC[4] = {'B', '4', 'D', 'T'};
+const uint32_t TILED_DATA_ALIGN = 4096;
+
+inline int divUp(int a, int b) {
+    return (a + b - 1) / b;
+}
+
+// Samples and weights of theta, false outside the table
+inline bool thetaLerp(const TiledHeader& hd, int axis, float theta, int* j,
+                      float* w) {
+    if (!(theta <= hd.theta_max * (1.f + 1e-6f))) return false;
+    const int n = hd.dims[axis];
+    const float x = glm::clamp(theta / hd.theta_max * (n - 1), 0.f,
+                               (float)(n - 1));
+    j[0] = std::min((int)x, n - 1);
+    j[1] = std::min(j[0] + 1, n - 1);
+    w[1] = x - j[0];
+    w[0] = 1.f - w[1];
+    return true;
+}
+
+// Samples and weights of phi (wraps around)
+inline void phiLerp(const TiledHeader& hd, int axis, float phi, int* k,
+                    float* w) {
+    const int n = hd.dims[axis];
+    const float two_pi = 2.f * glm::pi<float>();
+    phi -= two_pi * std::floor(phi / two_pi);
+    const float x = phi / two_pi * n;
+    k[0] = glm::clamp((int)x, 0, n - 1);
+    k[1] = (k[0] + 1) % n;
+    w[1] = glm::clamp(x - k[0], 0.f, 1.f);
+    w[0] = 1.f - w[1];
+}
+
+// Local angles of a direction in the (t, b, n) frame, phi in [0, 2 pi)
+inline void localAngles(const glm::vec3& d, const glm::vec3& t,
+                        const glm::vec3& b, const glm::vec3& n, float& theta,
+                        float& phi) {
+    theta = std::acos(glm::clamp(glm::dot(d, n), -1.f, 1.f));
+    phi = std::atan2(glm::dot(d, b), glm::dot(d, t));
+    if (phi < 0.f) phi += 2.f * glm::pi<float>();
+}
+
+} // namespace
+
+// === Layout ===
+TiledHeader tiledHeader(const int* dims, const int* tile, int n_channels,
+                        bool sphere) {
+    TiledHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, TILED_MAGIC, 4);
+    hd.version = TILED_VERSION;
+    for (int a = 0; a < 4; a++) {
+        hd.dims[a] = std::max(dims[a], 2);
+        hd.tile[a] = glm::clamp(tile[a], 1, (int)hd.dims[a]);
+    }
+    hd.n_channels = (n_channels == 1) ? 1 : 3;
+    hd.theta_max = sphere ? glm::pi<float>() : 0.5f * glm::pi<float>();
+    for (int c = 0; c < 3; c++) hd.scale[c] = 1.f;
+    hd.data_offset = TILED_DATA_ALIGN;
+    return hd;
+}
+
+float tiledTheta(const TiledHeader& header, int axis, int j) {
+    return (float)j / (header.dims[axis] - 1) * header.theta_max;
+}
+
+float tiledPhi(const TiledHeader& header, int axis, int k) {
+    return 2.f * glm::pi<float>() * k / header.dims[axis];
+}
+
+// === TiledBRDF ===
+TiledBRDF::TiledBRDF() : offset(0), tile_cells(0), tile_bytes(0),
+                         max_tiles(0), stopping(false) {
+    memset(&this->header, 0, sizeof(this->header));
+    for (int a = 0; a < 4; a++) this->n_tiles[a] = 0;
+}
+
+TiledBRDF::~TiledBRDF() {
+    if (this->prefetch_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            this->stopping = true;
+        }
+        this->queue_cond.notify_all();
+        this->prefetch_thread.join();
+    }
+}
+
+bool TiledBRDF::open(const std::string& path, size_t cache_bytes,
+                     uint64_t offset) {
+    this->path = path;
+    this->offset = offset;
+    if (!this->file.open(path)) {
+        this->error = this->file.getError();
+        return false;
+    }
+    TiledHeader& hd = this->header;
+    bool ok = this->file.read(offset, &hd, sizeof(hd)) &&
+              memcmp(hd.magic, TILED_MAGIC, 4) == 0 &&
+              hd.version == TILED_VERSION &&
+              (hd.n_channels == 1 || hd.n_channels == 3) &&
+              hd.theta_max > 0.f && hd.data_offset >= sizeof(hd);
+    uint64_t total_tiles = 1;
+    for (int a = 0; ok && a < 4; a++) {
+        ok = hd.dims[a] >= 2 && hd.tile[a] >= 1 && hd.tile[a] <= hd.dims[a];
+        if (ok) {
+            this->n_tiles[a] = divUp(hd.dims[a], hd.tile[a]);
+            total_tiles *= this->n_tiles[a];
+        }
+    }
+    if (ok) {
+        this->tile_cells = hd.tile[0] * hd.tile[1] * hd.tile[2] * hd.tile[3];
+        this->tile_bytes = (size_t)this->tile_cells * hd.n_channels *
+                           sizeof(uint16_t);
+        ok = total_tiles < (1u << 31) &&
+             this->file.getSize() >=
+                 offset + hd.data_offset + total_tiles * this->tile_bytes;
+    }
+    if (!ok) {
+        this->error = "Not a 4D tabulated BRDF file: " + path;
+        this->file.close();
+        return false;
+    }
+    this->max_tiles = std::max(cache_bytes / this->tile_bytes, (size_t)1);
+    this->prefetch_thread = std::thread(&TiledBRDF::prefetchWorker, this);
+    return true;
+}
+
+std::shared_ptr<const TileData> TiledBRDF::getTile(int idx,
+                                                   bool prefetching) const {
+    {
+        std::lock_guard<std::mutex> lock(this->cache_mutex);
+        std::unordered_map<int, CacheEntry>::iterator it =
+            this->cache.find(idx);
+        if (it != this->cache.end()) {
+            this->lru.splice(this->lru.begin(), this->lru, it->second.lru);
+            if (!prefetching) this->stats.hits++;
+            return it->second.data;
+        }
+    }
+    // read without the lock (zeros on errors)
+    std::shared_ptr<TileData> data(
+        new TileData(this->tile_cells * this->header.n_channels, 0));
+    if (!this->file.read(this->offset + this->header.data_offset +
+                             (uint64_t)idx * this->tile_bytes,
+                         &(*data)[0], this->tile_bytes)) {
+        std::fill(data->begin(), data->end(), 0);
+    }
+    std::lock_guard<std::mutex> lock(this->cache_mutex);
+    std::unordered_map<int, CacheEntry>::iterator it = this->cache.find(idx);
+    if (it != this->cache.end()) return it->second.data;  // read twice
+    if (prefetching) {
+        this->stats.prefetched++;
+    } else {
+        this->stats.misses++;
+    }
+    this->lru.push_front(idx);
+    CacheEntry& entry = this->cache[idx];
+    entry.data = data;
+    entry.lru = this->lru.begin();
+    // evicted tiles live on while pinned
+    while (this->cache.size() > this->max_tiles) {
+        this->cache.erase(this->lru.back());
+        this->lru.pop_back();
+        this->stats.evictions++;
+    }
+    return data;
+}
+
+std::shared_ptr<const TileData> TiledBRDF::pinTile(int idx,
+                                                   TilePins& pins) const {
+    for (int i = 0; i < TilePins::N_PINS; i++) {
+        if (pins.idx[i] == idx) return pins.data[i];
+    }
+    const int slot = pins.next;
+    pins.next = (pins.next + 1) % TilePins::N_PINS;
+    pins.idx[slot] = idx;
+    pins.data[slot] = this->getTile(idx, false);
+    return pins.data[slot];
+}
+
+void TiledBRDF::lookup(float theta_i, float phi_i, float theta_o, float phi_o,
+                       TilePins& pins, float* out) const {
+    const TiledHeader& hd = this->header;
+    const int nc = hd.n_channels;
+    for (int c = 0; c < nc; c++) out[c] = 0.f;
+    int idx[4][2];
+    float w[4][2];
+    if (!thetaLerp(hd, 0, theta_i, idx[0], w[0]) ||
+        !thetaLerp(hd, 2, theta_o, idx[2], w[2])) {
+        return;
+    }
+    phiLerp(hd, 1, phi_i, idx[1], w[1]);
+    phiLerp(hd, 3, phi_o, idx[3], w[3]);
+    for (int corner = 0; corner < 16; corner++) {
+        int cell[4];
+        float weight = 1.f;
+        for (int a = 0; a < 4; a++) {
+            const int bit = (corner >> (3 - a)) & 1;
+            cell[a] = idx[a][bit];
+            weight *= w[a][bit];
+        }
+        if (weight == 0.f) continue;
+        int tile = 0, within = 0;
+        for (int a = 0; a < 4; a++) {
+            tile = tile * this->n_tiles[a] + cell[a] / (int)hd.tile[a];
+            within = within * hd.tile[a] + cell[a] % hd.tile[a];
+        }
+        const TileData& data = *this->pinTile(tile, pins);
+        for (int c = 0; c < nc; c++) {
+            out[c] += weight * halfToFloat(data[within * nc + c]) *
+                      hd.scale[c];
+        }
+    }
+}
+
+int TiledBRDF::incidentTile(float theta_i, float phi_i) const {
+    int j[2], k[2];
+    float w[2];
+    if (!thetaLerp(this->header, 0, theta_i, j, w)) return -1;
+    phiLerp(this->header, 1, phi_i, k, w);
+    return (j[0] / this->header.tile[0]) * this->n_tiles[1] +
+           k[0] / this->header.tile[1];
+}
+
+void TiledBRDF::prefetch(float theta_i, float phi_i) {
+    const int light_tile = this->incidentTile(theta_i, phi_i);
+    if (light_tile < 0) return;
+    const int ti = light_tile / this->n_tiles[1];
+    const int pi = light_tile % this->n_tiles[1];
+    const int n_out = this->n_tiles[2] * this->n_tiles[3];
+    // the incident tile first, then its neighbors (phi wraps around),
+    // within half of the cache
+    const int offsets[9][2] = {{0, 0}, {0, -1}, {0, 1}, {-1, 0}, {1, 0},
+                               {-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+    std::deque<int> tiles;
+    for (int o = 0; o < 9; o++) {
+        const int a = ti + offsets[o][0];
+        const int b = (pi + offsets[o][1] + this->n_tiles[1]) %
+                      this->n_tiles[1];
+        if (a < 0 || a >= this->n_tiles[0]) continue;
+        if (tiles.size() + n_out > this->max_tiles / 2) break;
+        const int first = (a * this->n_tiles[1] + b) * n_out;
+        for (int t = 0; t < n_out; t++) tiles.push_back(first + t);
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->queue_mutex);
+        this->queue.swap(tiles);
+    }
+    this->queue_cond.notify_one();
+}
+
+void TiledBRDF::prefetchWorker() {
+    while (true) {
+        int idx;
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            this->queue_cond.wait(lock, [this]() {
+                return this->stopping || !this->queue.empty();
+            });
+            if (this->stopping) return;
+            idx = this->queue.front();
+            this->queue.pop_front();
+        }
+        this->getTile(idx, true);
+    }
+}
+
+TileCacheStats TiledBRDF::getStats() const {
+    std::lock_guard<std::mutex> lock(this->cache_mutex);
+    TileCacheStats s = this->stats;
+    s.resident_tiles = (int)this->cache.size();
+    s.resident_bytes = this->cache.size() * this->tile_bytes;
+    return s;
+}
+
+// === Writer ===
+uint64_t tiledFileSize(const TiledHeader& header) {
+    uint64_t total_tiles = 1;
+    for (int a = 0; a < 4; a++) {
+        total_tiles *= divUp(header.dims[a], header.tile[a]);
+    }
+    const int tile_cells = header.tile[0] * header.tile[1] * header.tile[2] *
+                           header.tile[3];
+    return header.data_offset +
+           total_tiles * tile_cells * header.n_channels * sizeof(uint16_t);
+}
+
+bool writeTiledBRDF(const std::string& path, const TiledHeader& header,
+                    TiledEvalFunc eval, void* user, int n_threads,
+                    std::string& error) {
+    BlockFile file;
+    if (!file.open(path, true)) {
+        error = file.getError();
+        return false;
+    }
+    if (!writeTiledBRDF(file, 0, header, eval, user, n_threads, error)) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool writeTiledBRDF(BlockFile& file, uint64_t offset,
+                    const TiledHeader& header, TiledEvalFunc eval,
+                    void* user, int n_threads, std::string& error) {
+    const TiledHeader& hd = header;
+    int n_tiles[4];
+    int total_tiles = 1;
+    for (int a = 0; a < 4; a++) {
+        n_tiles[a] = divUp(hd.dims[a], hd.tile[a]);
+        total_tiles *= n_tiles[a];
+    }
+    const int tile_cells = hd.tile[0] * hd.tile[1] * hd.tile[2] * hd.tile[3];
+    const int nc = hd.n_channels;
+    const size_t tile_bytes = (size_t)tile_cells * nc * sizeof(uint16_t);
+
+    std::vector<char> head(hd.data_offset, 0);
+    memcpy(&head[0], &hd, sizeof(hd));
+    std::atomic<bool> ok(file.write(offset, &head[0], head.size()));
+    std::atomic<int> next(0);
+    auto worker = [&](int w) {
+        std::vector<float> values(tile_cells * nc);
+        std::vector<uint16_t> cells(tile_cells * nc);
+        for (int t = next++; t < total_tiles && ok; t = next++) {
+            // cell origin of the tile
+            int origin[4];
+            for (int a = 3, rest = t; a >= 0; a--) {
+                origin[a] = (rest % n_tiles[a]) * hd.tile[a];
+                rest /= n_tiles[a];
+            }
+            std::fill(values.begin(), values.end(), 0.f);
+            eval(user, w, hd, origin, &values[0]);
+            for (int i = 0; i < tile_cells * nc; i++) {
+                cells[i] = floatToHalf(values[i] / hd.scale[i % nc]);
+            }
+            if (!file.write(offset + hd.data_offset + (uint64_t)t * tile_bytes,
+                            &cells[0], tile_bytes)) {
+                ok = false;
+            }
+        }
+    };
+    n_threads = std::max(n_threads, 1);
+    std::vector<std::thread> threads;
+    for (int w = 1; w < n_threads; w++) threads.push_back(std::thread(worker, w));
+    worker(0);
+    for (int w = 0; w < threads.size(); w++) threads[w].join();
+    if (!ok) error = "Failed to write the table";
+    return ok;
+}
+
+// === Baking ===
+namespace {
+
+struct BakeContext {
+    std::vector<BaseShader*> shaders;  // per worker
+    ColorChannels channels;            // RGB
+};
+
+// One row of outgoing phi per batch
+void bakeTile(void* user, int worker, const TiledHeader& hd,
+              const int* origin, float* values) {
+    BakeContext& ctx = *(BakeContext*)user;
+    BaseShader& shader = *ctx.shaders[worker];
+    const glm::vec3 normal(0.f, 1.f, 0.f);
+    const int nc = hd.n_channels;
+    const int n_po = std::min(hd.tile[3], hd.dims[3] - origin[3]);
+    std::vector<glm::vec3> dirs(n_po);
+    std::vector<float> row(n_po * 3);
+    int cell[4];
+    for (int a = 0; a < hd.tile[0]; a++) {
+        cell[0] = origin[0] + a;
+        if (cell[0] >= hd.dims[0]) break;
+        for (int b = 0; b < hd.tile[1]; b++) {
+            cell[1] = origin[1] + b;
+            if (cell[1] >= hd.dims[1]) break;
+            const glm::vec3 light_dir = tiledDir(tiledTheta(hd, 0, cell[0]),
+                                                 tiledPhi(hd, 1, cell[1]));
+            for (int c = 0; c < hd.tile[2]; c++) {
+                cell[2] = origin[2] + c;
+                if (cell[2] >= hd.dims[2]) break;
+                const float theta_o = tiledTheta(hd, 2, cell[2]);
+                for (int d = 0; d < n_po; d++) {
+                    dirs[d] = tiledDir(theta_o,
+                                       tiledPhi(hd, 3, origin[3] + d));
+                }
+                if (nc == 1) {
+                    shader.sampleBatch(light_dir, &dirs[0], normal, &row[0],
+                                       n_po);
+                } else {
+                    shader.sampleColorBatch(light_dir, &dirs[0], normal,
+                                            ctx.channels, &row[0], n_po);
+                }
+                // NaN and negative values as zero
+                float* dst = values + (((a * hd.tile[1] + b) * hd.tile[2] +
+                                        c) * hd.tile[3]) * nc;
+                for (int i = 0; i < n_po * nc; i++) {
+                    dst[i] = (row[i] > 0.f) ? row[i] : 0.f;
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+glm::vec3 tiledDir(float theta, float phi) {
+    const glm::vec3 n(0.f, 1.f, 0.f), t(0.f, 0.f, 1.f);
+    const glm::vec3 b = glm::cross(n, t);
+    return std::sin(theta) * (std::cos(phi) * t + std::sin(phi) * b) +
+           std::cos(theta) * n;
+}
+
+bool bakeTiledBRDF(const std::string& path, const TiledHeader& header,
+                   const BaseShader& shader, int n_threads,
+                   std::string& error) {
+    BlockFile file;
+    if (!file.open(path, true)) {
+        error = file.getError();
+        return false;
+    }
+    if (!bakeTiledBRDF(file, 0, header, shader, n_threads, error)) {
+        error = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool bakeTiledBRDF(BlockFile& file, uint64_t offset,
+                   const TiledHeader& header, const BaseShader& shader,
+                   int n_threads, std::string& error) {
+    n_threads = std::max(n_threads, 1);
+    BakeContext ctx;
+    for (int w = 0; w < n_threads; w++) ctx.shaders.push_back(shader.clone());
+    const bool ok = writeTiledBRDF(file, offset, header, bakeTile, &ctx,
+                                   n_threads, error);
+    for (int w = 0; w < n_threads; w++) delete ctx.shaders[w];
+    return ok;
+}
+
+// === TiledShader ===
+const std::string& TiledShader::getPath() const {
+    static const std::string none;
+    return this->store ? this->store->getPath() : none;
+}
+
+bool TiledShader::load(const std::string& path, size_t cache_bytes,
+                       uint64_t offset) {
+    std::shared_ptr<TiledBRDF> store(new TiledBRDF());
+    if (!store->open(path, cache_bytes, offset)) {
+        this->error = store->getError();
+        return false;
+    }
+    this->store = store;
+    this->last_light_tile = -1;
+    return true;
+}
+
+bool TiledShader::sphere() const {
+    return this->store &&
+           this->store->getHeader().theta_max > 0.75f * glm::pi<float>();
+}
+
+TileCacheStats TiledShader::getStats() const {
+    return this->store ? this->store->getStats() : TileCacheStats();
+}
+
+void TiledShader::evalChannels(const glm::vec3& light_dir,
+                               const glm::vec3* out_dirs,
+                               const glm::vec3& normal, float* out, int n) {
+    const int nc = this->store ? this->store->getHeader().n_channels : 1;
+    std::fill(out, out + n * nc, 0.f);
+    if (!this->store) return;
+    // frame: tangent in the normal plane
+    const glm::vec3 nn = glm::normalize(normal);
+    glm::vec3 t = this->tangent - glm::dot(this->tangent, nn) * nn;
+    glm::vec3 b;
+    if (glm::dot(t, t) < 1e-12f) {
+        makeFrame(nn, t, b);
+    } else {
+        t = glm::normalize(t);
+        b = glm::cross(nn, t);
+    }
+    float theta_i, phi_i;
+    localAngles(glm::normalize(light_dir), t, b, nn, theta_i, phi_i);
+    // tiles of the next light positions in the background
+    const int light_tile = this->store->incidentTile(theta_i, phi_i);
+    if (this->prefetch && light_tile != this->last_light_tile) {
+        this->store->prefetch(theta_i, phi_i);
+        this->last_light_tile = light_tile;
+    }
+    // out angles by the batched kernels, in blocks
+    simd::CoordFrame frame;
+    frame.s = t;
+    frame.t = b;
+    frame.n = nn;
+    const simd::SphericalKernel spherical = simd::getCoordKernels().spherical[
+        this->fast_math ? simd::MATH_FAST : simd::MATH_ACCURATE];
+    const int BLOCK = 256;
+    float x[BLOCK], y[BLOCK], z[BLOCK], theta_o[BLOCK], phi_o[BLOCK];
+    TilePins pins;
+    for (int i0 = 0; i0 < n; i0 += BLOCK) {
+        const int m = std::min(BLOCK, n - i0);
+        simd::splitDirs(out_dirs + i0, m, x, y, z);
+        spherical(frame, simd::DirBlock(x, y, z), theta_o, phi_o, m);
+        for (int i = 0; i < m; i++) {
+            float* o = &out[(i0 + i) * nc];
+            this->store->lookup(theta_i, phi_i, theta_o[i], phi_o[i], pins,
+                                o);
+            for (int c = 0; c < nc; c++) o[c] *= this->scale;
+        }
+    }
+}
+
+float TiledShader::sample(const glm::vec3& light_dir,
+                          const glm::vec3& out_dir,
+                          const glm::vec3& normal) {
+    float values[3];
+    this->evalChannels(light_dir, &out_dir, normal, values, 1);
+    const int nc = this->store ? this->store->getHeader().n_channels : 1;
+    float sum = 0.f;
+    for (int c = 0; c < nc; c++) sum += values[c];
+    return sum / nc;
+}
+
+void TiledShader::sampleBatch(const glm::vec3& light_dir,
+                              const glm::vec3* out_dirs,
+                              const glm::vec3& normal, float* out, int n) {
+    const int nc = this->store ? this->store->getHeader().n_channels : 1;
+    if (nc == 1) {
+        this->evalChannels(light_dir, out_dirs, normal, out, n);
+        return;
+    }
+    // in blocks of RGB values
+    const int BLOCK = 256;
+    float values[3 * BLOCK];
+    for (int i0 = 0; i0 < n; i0 += BLOCK) {
+        const int m = std::min(BLOCK, n - i0);
+        this->evalChannels(light_dir, out_dirs + i0, normal, values, m);
+        for (int i = 0; i < m; i++) {
+            out[i0 + i] = (values[3 * i] + values[3 * i + 1] +
+                           values[3 * i + 2]) / 3.f;
+        }
+    }
+}
+
+void TiledShader::sampleColorBatch(const glm::vec3& light_dir,
+                                   const glm::vec3* out_dirs,
+                                   const glm::vec3& normal,
+                                   const ColorChannels& channels, float* out,
+                                   int n) {
+    const int nc = this->store ? this->store->getHeader().n_channels : 1;
+    if (nc == 1) {
+        BaseShader::sampleColorBatch(light_dir, out_dirs, normal, channels,
+                                     out, n);
+        return;
+    }
+    int bands[MAX_COLOR_CHANNELS];
+    for (int c = 0; c < channels.n; c++) bands[c] = channelBand(channels, c);
+    const int BLOCK = 256;
+    float values[3 * BLOCK];
+    for (int i0 = 0; i0 < n; i0 += BLOCK) {
+        const int m = std::min(BLOCK, n - i0);
+        this->evalChannels(light_dir, out_dirs + i0, normal, values, m);
+        for (int i = 0; i < m; i++) {
+            for (int c = 0; c < channels.n; c++) {
+                out[(i0 + i) * channels.n + c] = values[3 * i + bands[c]];
+            }
+        }
+    }
+}
+
+void TiledShader::getParams(std::vector<ShaderParam>& params) {
+    params.push_back(ShaderParam("scale", &this->scale));
+}
@@ -0,0 +1,202 @@
+#ifndef TILED_H_261018
+#define TILED_H_261018
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "io/block_file.h"
+#include "shader.h"
+
+// Out-of-core 4D tabulated BRDF (.b4d) over (theta_i, phi_i, theta_o,
+// phi_o) in the frame of the normal and the tangent (anisotropic surfaces,
+// or fibers when theta covers the sphere). The table is split in 4D tiles
+// read on demand into a bounded LRU cache, so it can be larger than RAM.
+//
+//   TiledHeader, padding up to data_offset
+//   tiles in row-major tile order, every tile tile[0..3] cells (edge tiles
+//   padded) of n_channels float16 values, cells in row-major order
+//
+// theta sample j is at j / (dims - 1) * theta_max, phi sample k at
+// 2 pi k / dims (wrapping around). Little endian.
+struct TiledHeader {
+    char magic[4];  // "B4DT"
+    uint32_t version;
+    uint32_t dims[4];  // theta_i, phi_i, theta_o, phi_o
+    uint32_t tile[4];
+    uint32_t n_channels;  // 1 or 3
+    float theta_max;      // pi / 2 (hemisphere) or pi (sphere)
+    float scale[3];       // value = half * scale
+    uint32_t data_offset;  // of the first tile (page aligned)
+};
+
+const uint32_t TILED_VERSION = 1;
+
+struct TileCacheStats {
+    TileCacheStats() : hits(0), misses(0), prefetched(0), evictions(0),
+                       resident_tiles(0), resident_bytes(0) {}
+    uint64_t hits;
+    uint64_t misses;      // read on demand
+    uint64_t prefetched;  // read by the prefetch thread
+    uint64_t evictions;
+    int resident_tiles;
+    size_t resident_bytes;
+};
+
+typedef std::vector<uint16_t> TileData;
+
+// Tiles held by one evaluation (lookups of neighboring directions mostly
+// hit the same few tiles without locking the cache)
+struct TilePins {
+    static const int N_PINS = 16;
+    TilePins() : next(0) {
+        for (int i = 0; i < N_PINS; i++) idx[i] = -1;
+    }
+    int idx[N_PINS];
+    std::shared_ptr<const TileData> data[N_PINS];
+    int next;  // round robin replacement
+};
+
+class TiledBRDF {
+public:
+    TiledBRDF();
+    ~TiledBRDF();
+    // Checks the header; tiles are read on demand up to `cache_bytes`.
+    // The table starts at `offset` of the file (inside a container).
+    bool open(const std::string& path, size_t cache_bytes,
+              uint64_t offset=0);
+    // Channel values at the angles (quadrilinear, n_channels floats)
+    void lookup(float theta_i, float phi_i, float theta_o, float phi_o,
+                TilePins& pins, float* out) const;
+    // Reads the tiles around the incident direction in the background
+    // (queued requests of an earlier direction are dropped)
+    void prefetch(float theta_i, float phi_i);
+    // Index of the incident tile (for change detection)
+    int incidentTile(float theta_i, float phi_i) const;
+    TileCacheStats getStats() const;
+    const TiledHeader& getHeader() const { return header; }
+    const std::string& getPath() const { return path; }
+    const std::string& getError() const { return error; }
+
+private:
+    TiledBRDF(const TiledBRDF&);
+    TiledBRDF& operator=(const TiledBRDF&);
+
+    std::shared_ptr<const TileData> getTile(int idx, bool prefetching) const;
+    std::shared_ptr<const TileData> pinTile(int idx, TilePins& pins) const;
+    void prefetchWorker();
+
+    BlockFile file;
+    uint64_t offset;
+    TiledHeader header;
+    std::string path;
+    std::string error;
+    int n_tiles[4];     // per axis
+    int tile_cells;
+    size_t tile_bytes;  // in the file and in memory
+
+    // LRU cache (front: most recent)
+    struct CacheEntry {
+        std::shared_ptr<const TileData> data;
+        std::list<int>::iterator lru;
+    };
+    mutable std::mutex cache_mutex;
+    mutable std::unordered_map<int, CacheEntry> cache;
+    mutable std::list<int> lru;
+    size_t max_tiles;
+    mutable TileCacheStats stats;
+
+    // prefetch queue
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::deque<int> queue;
+    bool stopping;
+    std::thread prefetch_thread;
+};
+
+// Writes a table tile by tile (memory of one tile per thread). `eval`
+// fills the channel values of the cells of one tile inside the table
+// (from the cell `tile_origin`, in the tile cell order); tiles are evaluated
+// on `n_threads` workers, `worker` in [0, n_threads).
+typedef void (*TiledEvalFunc)(void* user, int worker,
+                              const TiledHeader& header,
+                              const int* tile_origin, float* values);
+bool writeTiledBRDF(const std::string& path, const TiledHeader& header,
+                    TiledEvalFunc eval, void* user, int n_threads,
+                    std::string& error);
+// The same at `offset` of an open file (tiledFileSize() bytes)
+bool writeTiledBRDF(BlockFile& file, uint64_t offset,
+                    const TiledHeader& header, TiledEvalFunc eval,
+                    void* user, int n_threads, std::string& error);
+// Bakes a shader (one clone per worker) in the frame of a default
+// TiledShader: normal +y, tangent +z. NaN and negative values are stored
+// as zero.
+bool bakeTiledBRDF(const std::string& path, const TiledHeader& header,
+                   const BaseShader& shader, int n_threads,
+                   std::string& error);
+bool bakeTiledBRDF(BlockFile& file, uint64_t offset,
+                   const TiledHeader& header, const BaseShader& shader,
+                   int n_threads, std::string& error);
+// Header with the tile layout filled in
+TiledHeader tiledHeader(const int* dims, const int* tile, int n_channels,
+                        bool sphere);
+// Bytes of a table file
+uint64_t tiledFileSize(const TiledHeader& header);
+// Angles of a cell index along an axis
+float tiledTheta(const TiledHeader& header, int axis, int j);
+float tiledPhi(const TiledHeader& header, int axis, int k);
+// Direction of the angles in the frame of bakeTiledBRDF()
+glm::vec3 tiledDir(float theta, float phi);
+
+// BaseShader over a TiledBRDF. Clones share the table and its cache.
+class TiledShader : public BaseShader {
+public:
+    TiledShader() : tangent(0, 0, 1), scale(1.f), prefetch(true),
+                    last_light_tile(-1) {}
+    bool load(const std::string& path, size_t cache_bytes,
+              uint64_t offset=0);
+    bool loaded() const { return (bool)store; }
+    const std::string& getPath() const;  // empty when not loaded
+    const std::string& getError() const { return error; }
+    // Table over the sphere of directions (fibers)
+    bool sphere() const;
+    TileCacheStats getStats() const;
+
+    virtual BaseShader* clone() const { return new TiledShader(*this); }
+    // Mean of the channels
+    virtual float sample(const glm::vec3& light_dir, const glm::vec3& out_dir,
+                         const glm::vec3& normal);
+    virtual void sampleBatch(const glm::vec3& light_dir,
+                             const glm::vec3* out_dirs,
+                             const glm::vec3& normal, float* out, int n);
+    virtual void sampleColorBatch(const glm::vec3& light_dir,
+                                  const glm::vec3* out_dirs,
+                                  const glm::vec3& normal,
+                                  const ColorChannels& channels, float* out,
+                                  int n);
+    virtual void getParams(std::vector<ShaderParam>& params);
+    glm::vec3 tangent;
+    float scale;
+    // Reads the tiles around a new light direction in the background (for
+    // a moving light; off for random access)
+    bool prefetch;
+
+private:
+    // Channel values (n_channels per direction, 3 at most)
+    void evalChannels(const glm::vec3& light_dir, const glm::vec3* out_dirs,
+                      const glm::vec3& normal, float* out, int n);
+
+    std::shared_ptr<TiledBRDF> store;
+    std::string error;
+    int last_light_tile;
+};
+
+#endif
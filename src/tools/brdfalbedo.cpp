@@ -0,0 +1,135 @@
+// Directional albedo and white furnace test of one shader parameter set
+// (see albedo.h).
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../albedo.h"
+#include "../measured.h"
+#include "../tiled.h"
+
+namespace {
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl
+              << "  --shader <name>      specular, kajiyakay, marschner, "
+                 "measured or tiled" << std::endl
+              << "                       (marschner)" << std::endl
+              << "  --merl <file>        MERL .binary file (measured)"
+              << std::endl
+              << "  --tiled <file>       4D table (tiled)" << std::endl
+              << "  --set <name=value>   shader parameter (repeatable)"
+              << std::endl
+              << "  --angles <n>         incident angles over [0, 90] (19)"
+              << std::endl
+              << "  --directions <n>     directions per angle (1048576)"
+              << std::endl
+              << "  --replicas <n>       randomized replicas (8)" << std::endl
+              << "  --threads <n>        worker threads (hardware)"
+              << std::endl
+              << "  --fast-math          fast tier of the SIMD shader math"
+              << std::endl;
+}
+
+BaseShader* createShader(const std::string& name) {
+    if (name == "specular") return new SpecularShader();
+    if (name == "kajiyakay") return new KajiyaKayShader();
+    if (name == "marschner") return new AFMarschnerShader();
+    if (name == "measured") return new MeasuredShader();
+    if (name == "tiled") return new TiledShader();
+    return NULL;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    // arguments
+    std::string shader_name = "marschner";
+    std::string merl_path, tiled_path;
+    std::vector<std::string> sets;
+    AlbedoSettings settings;
+    bool fast_math = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--shader" && i + 1 < argc) {
+            shader_name = argv[++i];
+        } else if (arg == "--merl" && i + 1 < argc) {
+            merl_path = argv[++i];
+        } else if (arg == "--tiled" && i + 1 < argc) {
+            tiled_path = argv[++i];
+        } else if (arg == "--set" && i + 1 < argc) {
+            sets.push_back(argv[++i]);
+        } else if (arg == "--angles" && i + 1 < argc) {
+            settings.n_angles = atoi(argv[++i]);
+        } else if (arg == "--directions" && i + 1 < argc) {
+            settings.n_directions = atoi(argv[++i]);
+        } else if (arg == "--replicas" && i + 1 < argc) {
+            settings.n_replicas = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            settings.n_threads = atoi(argv[++i]);
+        } else if (arg == "--fast-math") {
+            fast_math = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // shader
+    BaseShader* shader = createShader(shader_name);
+    if (!shader) {
+        std::cerr << "Unknown shader: " << shader_name << std::endl;
+        return 1;
+    }
+    shader->fast_math = fast_math;
+    if (MeasuredShader* measured = dynamic_cast<MeasuredShader*>(shader)) {
+        if (!measured->load(merl_path)) {
+            std::cerr << measured->getError() << std::endl;
+            delete shader;
+            return 1;
+        }
+    }
+    if (TiledShader* tiled = dynamic_cast<TiledShader*>(shader)) {
+        if (!tiled->load(tiled_path, (size_t)256 << 20)) {
+            std::cerr << tiled->getError() << std::endl;
+            delete shader;
+            return 1;
+        }
+        tiled->prefetch = false;  // random directions
+    }
+    for (int i = 0; i < sets.size(); i++) {
+        const size_t eq = sets[i].find('=');
+        const std::string name = sets[i].substr(0, eq);
+        if (eq == std::string::npos ||
+            !shader->setParam(name, (float)atof(sets[i].c_str() + eq + 1))) {
+            std::cerr << "Unknown parameter: " << sets[i] << std::endl;
+            delete shader;
+            return 1;
+        }
+    }
+
+    // integrate
+    AlbedoResult res;
+    computeAlbedo(*shader, settings, res);
+    std::cout << "# " << shader_name << (res.fiber ? " (fiber)" : " (surface)")
+              << std::endl << "# angle_deg albedo error" << std::endl;
+    for (int a = 0; a < res.angle_deg.size(); a++) {
+        std::cout << std::setw(6) << res.angle_deg[a] << " " << res.albedo[a]
+                  << " " << res.error[a] << std::endl;
+    }
+    std::cout << "* White furnace: " << res.furnace << " +- "
+              << res.furnace_error << std::endl
+              << "* Max albedo: " << res.max_albedo << " at "
+              << res.max_angle_deg << " deg ("
+              << (res.conserving ? "conserving" : "NOT conserving") << ")"
+              << std::endl;
+    if (res.n_nan) std::cout << "* NaN samples: " << res.n_nan << std::endl;
+    std::cout << "* " << settings.n_directions << " directions x "
+              << res.angle_deg.size() << " angles in " << res.seconds
+              << " s" << std::endl;
+    delete shader;
+    return res.conserving ? 0 : 2;
+}
@@ -0,0 +1,362 @@
+// Bakes a parameter sweep (sweep.h) headless: lobes or 4D tables of every
+// variant, the variants in parallel on all cores. Each result is written to
+// its own file as soon as it completes and listed in sweep.tsv, or appended
+// to a result store (result_store.h) with --store, so an interrupted run
+// resumes with --resume.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../result_store.h"
+#include "../sweep.h"
+#include "../sweep_coordinator.h"
+#include "../tiled.h"
+
+namespace {
+
+const char* MANIFEST_NAME = "sweep.tsv";
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options] -o <dir>|--store <file>"
+              << std::endl
+              << "  --spec <file>          sweep options, one per line"
+              << std::endl
+              << sweepUsage()
+              << "  --threads <n>          worker threads (hardware)"
+              << std::endl
+              << "  --resume               skip the variants listed in "
+              << MANIFEST_NAME << " or stored" << std::endl
+              << "  --workers <n>          lobes on n worker processes "
+                 "(--store)" << std::endl
+              << "  --socket <path>        socket of the workers "
+                 "(/tmp/brdfbake.<pid>.sock)" << std::endl
+              << "  --unit <n>             variants per work unit (by the "
+                 "workers)" << std::endl
+              << "  --retries <n>          worker crashes per variant (2)"
+              << std::endl
+              << "  --connect <path>       run as a worker of a coordinator"
+              << std::endl;
+}
+
+std::string variantFile(const SweepSpec& spec, int variant) {
+    char name[32];
+    snprintf(name, sizeof(name), "v%07d.%s", variant,
+             spec.mode == SWEEP_TABLE ? "b4d" : "lobes");
+    return name;
+}
+
+// Header and variants of an earlier manifest
+void readManifest(const std::string& path, std::string& header,
+                  std::set<int>& done) {
+    std::ifstream ifs(path.c_str());
+    std::string line;
+    while (std::getline(ifs, line)) {
+        int variant;
+        if (!line.empty() && line[0] == '#') {
+            header += line + "\n";
+        } else if (sscanf(line.c_str(), "%d", &variant) == 1) {
+            done.insert(variant);
+        }
+    }
+}
+
+void writeManifestHeader(std::ostream& os, const SweepSpec& spec,
+                         int n_dirs) {
+    os << "# brdfbake " << spec.shader << ", " << spec.numVariants()
+       << " variants" << std::endl;
+    if (spec.mode == SWEEP_TABLE) {
+        os << "# table " << spec.dims[0] << "," << spec.dims[1] << ","
+           << spec.dims[2] << "," << spec.dims[3]
+           << (spec.tableSphere() ? " sphere" : " hemisphere") << std::endl;
+    } else {
+        // file: float32 [light][direction][value]
+        os << "# lobes n_phi " << spec.n_phi << ", " << n_dirs
+           << " directions x " << spec.valuesPerDir() << " values"
+           << std::endl << "# lights (theta phi degrees):";
+        for (int t = 0; t < spec.light_theta.n; t++) {
+            for (int p = 0; p < spec.light_phi.n; p++) {
+                os << " " << spec.light_theta.value(t) << " "
+                   << spec.light_phi.value(p);
+            }
+        }
+        os << std::endl;
+    }
+    os << "# variant\tfile";
+    for (int p = 0; p < spec.params.size(); p++) {
+        os << "\t" << spec.params[p].name;
+    }
+    os << std::endl;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    // arguments (spec files expanded in place)
+    std::vector<std::string> args;
+    std::string error;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--spec" && i + 1 < argc) {
+            if (!readSweepSpecFile(argv[++i], args, error)) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    SweepSpec spec;
+    std::string out_dir, store_path;
+    int n_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    bool resume = false;
+    SweepCoordinatorOptions farm;
+    farm.n_workers = 0;
+    std::vector<std::string> spec_args;  // sent to the workers
+    for (int i = 0; i < args.size(); i++) {
+        const int first = i;
+        if (args[i] == "--connect" && i + 1 < args.size()) {
+            return runSweepWorker(args[i + 1]);
+        } else if (args[i] == "--workers" && i + 1 < args.size()) {
+            farm.n_workers = std::max(atoi(args[++i].c_str()), 0);
+        } else if (args[i] == "--socket" && i + 1 < args.size()) {
+            farm.address = args[++i];
+        } else if (args[i] == "--unit" && i + 1 < args.size()) {
+            farm.unit_size = std::max(atoi(args[++i].c_str()), 0);
+        } else if (args[i] == "--retries" && i + 1 < args.size()) {
+            farm.retries = std::max(atoi(args[++i].c_str()), 0);
+        } else if (args[i] == "-o" && i + 1 < args.size()) {
+            out_dir = args[++i];
+        } else if (args[i] == "--store" && i + 1 < args.size()) {
+            store_path = args[++i];
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            n_threads = std::max(atoi(args[++i].c_str()), 1);
+        } else if (args[i] == "--resume") {
+            resume = true;
+        } else if (parseSweepOption(args, i, spec, error)) {
+            spec_args.insert(spec_args.end(), args.begin() + first,
+                             args.begin() + i + 1);
+        } else {
+            if (!error.empty()) std::cerr << error << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (out_dir.empty() == store_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (farm.n_workers > 0 &&
+        (store_path.empty() || spec.mode != SWEEP_LOBE)) {
+        std::cerr << "--workers needs --store and lobes" << std::endl;
+        return 1;
+    }
+    BaseShader* shader = createSweepShader(spec, error);
+    if (!shader) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    const int n_variants = spec.numVariants();
+    const int n_lights = spec.numLights();
+    const TiledHeader table = tiledHeader(spec.dims, spec.tile, 3,
+                                          spec.tableSphere());
+    std::vector<glm::vec3> dirs;
+    sweepLobeDirs(spec.n_phi, dirs);
+    std::set<int> done;
+    std::ofstream manifest;
+    ResultStoreWriter store;
+    int schema = -1;
+    if (!store_path.empty()) {
+        // result store, the variants with all lights stored are done
+        std::vector<std::string> names;
+        for (int p = 0; p < spec.params.size(); p++) {
+            names.push_back(spec.params[p].name);
+        }
+        if (!store.open(store_path) ||
+            (schema = store.addSchema(spec.shader, names)) < 0) {
+            std::cerr << store.getError() << std::endl;
+            delete shader;
+            return 1;
+        }
+        std::vector<float> params(spec.params.size());
+        for (int v = 0; resume && v < n_variants; v++) {
+            if (!params.empty()) spec.variantParams(v, &params[0]);
+            bool stored = true;
+            for (int l = 0; l < n_lights && stored; l++) {
+                stored = store.contains(
+                    schema, params.empty() ? NULL : &params[0],
+                    (int)params.size(),
+                    spec.mode == SWEEP_TABLE ? glm::vec3(0.f)
+                                             : spec.lightDir(l));
+            }
+            if (stored) done.insert(v);
+        }
+    } else {
+        // output directory and manifest
+        mkdir(out_dir.c_str(), 0755);
+        const std::string manifest_path = out_dir + "/" + MANIFEST_NAME;
+        std::ostringstream header;
+        writeManifestHeader(header, spec, (int)dirs.size());
+        std::string old_header;
+        if (resume) readManifest(manifest_path, old_header, done);
+        // variant indices depend on the whole spec
+        if (!old_header.empty() && old_header != header.str()) {
+            std::cerr << manifest_path << " is of another sweep" << std::endl;
+            delete shader;
+            return 1;
+        }
+        manifest.open(manifest_path.c_str(),
+                      resume ? std::ios::app : std::ios::trunc);
+        if (!manifest) {
+            std::cerr << "Failed to open " << manifest_path << std::endl;
+            delete shader;
+            return 1;
+        }
+        if (old_header.empty()) manifest << header.str();
+    }
+
+    // lobes on worker processes, merged into the store here
+    if (farm.n_workers > 0) {
+        if (farm.address.empty()) {
+            std::ostringstream address;
+            address << "/tmp/brdfbake." << getpid() << ".sock";
+            farm.address = address.str();
+        }
+        farm.worker_exe = argv[0];
+        SweepRunStats stats;
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        bool ok = runSweepCoordinator(spec, spec_args, done, store, schema,
+                                      farm, stats, error);
+        if (!ok) std::cerr << std::endl << error << std::endl;
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << std::endl << "* " << stats.n_done << " variants x "
+                  << n_lights << " lights in " << seconds << " s ("
+                  << farm.n_workers << " workers, " << stats.n_crashes
+                  << " crashes, " << done.size() << " skipped)" << std::endl;
+        if (!store.close()) {
+            std::cerr << store.getError() << std::endl;
+            ok = false;
+        }
+        if (stats.n_failed) {
+            std::cout << "* Failed: " << stats.n_failed << std::endl;
+        }
+        delete shader;
+        return (ok && stats.n_failed == 0) ? 0 : 1;
+    }
+
+    // variants on the workers, each result written when it completes
+    // (store appends take no lock; progress is printed by a free worker)
+    std::mutex manifest_mutex;
+    std::atomic<int> next(0), n_done(0), n_failed(0);
+    const int n_todo = n_variants - (int)done.size();
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    auto printProgress = [&](int n) {
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "\r" << n << "/" << n_todo << " variants, "
+                  << n / seconds << " /s, "
+                  << (int)((n_todo - n) * seconds / n) << " s left   "
+                  << std::flush;
+    };
+    auto worker = [&]() {
+        BaseShader* variant_shader = shader->clone();
+        StoreAppender appender(store);
+        const int n_values = (int)dirs.size() * spec.valuesPerDir();
+        std::vector<float> values(spec.mode == SWEEP_LOBE
+                                  ? n_lights * n_values : 0);
+        std::vector<float> params(spec.params.size());
+        const float* p = params.empty() ? NULL : &params[0];
+        const int n_params = (int)params.size();
+        for (int v = next++; v < n_variants; v = next++) {
+            if (done.count(v)) continue;
+            if (n_params) spec.variantParams(v, &params[0]);
+            const std::string file = variantFile(spec, v);
+            const std::string path = out_dir + "/" + file;
+            std::string variant_error;
+            bool ok = applySweepVariant(spec, v, *variant_shader);
+            if (ok && spec.mode == SWEEP_TABLE) {
+                ok = store.isOpen()
+                    ? appender.appendTable(schema, p, n_params, table,
+                                           *variant_shader, variant_error)
+                    : bakeTiledBRDF(path, table, *variant_shader, 1,
+                                    variant_error);
+            } else if (ok) {
+                for (int l = 0; l < n_lights; l++) {
+                    evalSweepLobe(spec, *variant_shader, spec.lightDir(l),
+                                  dirs, &values[l * n_values]);
+                }
+                if (store.isOpen()) {
+                    for (int l = 0; l < n_lights && ok; l++) {
+                        ok = appender.appendLobe(
+                            schema, p, n_params, spec.lightDir(l),
+                            spec.n_phi, (int)dirs.size(),
+                            spec.valuesPerDir(), spec.values,
+                            &values[l * n_values]);
+                    }
+                    if (!ok) variant_error = "Failed to write " + store_path;
+                } else {
+                    std::ofstream ofs(path.c_str(), std::ios::binary);
+                    ofs.write((const char*)&values[0],
+                              values.size() * sizeof(float));
+                    ok = (bool)ofs;
+                    if (!ok) variant_error = "Failed to write " + path;
+                }
+            }
+            if (!ok) {
+                std::lock_guard<std::mutex> lock(manifest_mutex);
+                std::cerr << variant_error << std::endl;
+                n_failed++;
+                continue;
+            }
+            const int n = ++n_done;
+            if (store.isOpen()) {
+                std::unique_lock<std::mutex> lock(manifest_mutex,
+                                                  std::try_to_lock);
+                if (lock.owns_lock()) printProgress(n);
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(manifest_mutex);
+            manifest << v << "\t" << file;
+            for (int i = 0; i < n_params; i++) manifest << "\t" << params[i];
+            manifest << std::endl;
+            printProgress(n);
+        }
+        if (!appender.flush()) n_failed++;
+        delete variant_shader;
+    };
+    std::vector<std::thread> threads;
+    for (int w = 1; w < n_threads; w++) threads.push_back(std::thread(worker));
+    worker();
+    for (int w = 0; w < threads.size(); w++) threads[w].join();
+
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << std::endl << "* " << n_done << " variants x " << n_lights
+              << (spec.mode == SWEEP_TABLE ? " tables" : " lights")
+              << " in " << seconds << " s (" << n_threads << " threads, "
+              << done.size() << " skipped)" << std::endl;
+    if (store.isOpen() && !store.close()) {
+        std::cerr << store.getError() << std::endl;
+        n_failed++;
+    }
+    if (n_failed) std::cout << "* Failed: " << n_failed << std::endl;
+    delete shader;
+    return n_failed == 0 ? 0 : 1;
+}
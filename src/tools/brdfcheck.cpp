@@ -0,0 +1,314 @@
+// Chi-square goodness-of-fit test of BaseShader::sampleDirection() against
+// BaseShader::pdf() over many shader parameter sets, in parallel.
+//
+// For each case the sampled directions are binned on an equal solid angle
+// (cos(theta), phi) grid and compared with the pdf integrated over the
+// bins. Every returned pdf is also checked against pdf() and the pdf must
+// integrate to one over the sphere.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../shader.h"
+
+namespace {
+
+const int N_COS_BINS = 32;
+const int N_PHI_BINS = 64;
+const int N_SUB = 16;           // pdf integration points per bin and axis
+const float MIN_EXPECTED = 5.f;  // pooled below
+const double SIGNIFICANCE = 0.01;
+
+struct CheckCase {
+    int shader;  // 0: Specular, 1: KajiyaKay, 2: AF Marschner
+    float light_deg;
+    std::vector<std::pair<std::string, float> > params;
+};
+
+struct CheckResult {
+    CheckResult() : chi2(0.0), dof(0), p_value(0.0), integral(0.0),
+                    n_failed(0), n_pdf_mismatch(0), passed(false) {}
+    double chi2;
+    int dof;
+    double p_value;
+    double integral;     // of the pdf over the sphere
+    int n_failed;        // sampleDirection() returned false
+    int n_pdf_mismatch;  // returned pdf != pdf()
+    bool passed;
+};
+
+const char* SHADER_NAMES[] = {"Specular", "KajiyaKay", "AFMarschner"};
+
+BaseShader* createShader(int idx) {
+    if (idx == 0) return new SpecularShader();
+    if (idx == 1) return new KajiyaKayShader();
+    return new AFMarschnerShader();
+}
+
+std::string caseName(const CheckCase& c) {
+    std::ostringstream ss;
+    ss << SHADER_NAMES[c.shader] << " light=" << c.light_deg;
+    for (int i = 0; i < c.params.size(); i++) {
+        ss << " " << c.params[i].first << "=" << c.params[i].second;
+    }
+    return ss.str();
+}
+
+void defaultCases(std::vector<CheckCase>& cases) {
+    const float lights[] = {0.f, 40.f, 80.f};
+    for (int l = 0; l < 3; l++) {
+        // Specular
+        const float spec[] = {0.f, 1.f, 5.f, 20.f, 100.f};
+        for (int i = 0; i < 5; i++) {
+            CheckCase c = {0, lights[l]};
+            c.params.push_back(std::make_pair("spec_factor", spec[i]));
+            cases.push_back(c);
+        }
+        // KajiyaKay
+        const float kk_spec[] = {5.f, 25.f, 80.f};
+        const float kk_kd[] = {0.3f, 0.f, 1.f};
+        const float kk_ks[] = {0.3f, 1.f, 0.f};
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                CheckCase c = {1, lights[l]};
+                c.params.push_back(std::make_pair("spec_factor", kk_spec[i]));
+                c.params.push_back(std::make_pair("kd", kk_kd[j]));
+                c.params.push_back(std::make_pair("ks", kk_ks[j]));
+                cases.push_back(c);
+            }
+        }
+        // AF Marschner
+        const char* names[] = {"", "longitudinalWidthR", "intensityR",
+                               "sigma_a", "eta", "intensityTT"};
+        const float values[] = {0.f, 0.3f, 0.f, 2.f, 1.3f, 3.f};
+        for (int i = 0; i < 6; i++) {
+            CheckCase c = {2, lights[l]};
+            if (i > 0) c.params.push_back(std::make_pair(names[i], values[i]));
+            cases.push_back(c);
+        }
+    }
+}
+
+// Regularized upper incomplete gamma function Q(a, x)
+double gammaQ(double a, double x) {
+    if (x <= 0.0) return 1.0;
+    const double log_pre = a * std::log(x) - x - std::lgamma(a);
+    if (x < a + 1.0) {
+        // series of P(a, x)
+        double term = 1.0 / a, sum = term;
+        for (int n = 1; n < 100000; n++) {
+            term *= x / (a + n);
+            sum += term;
+            if (term < sum * 1e-15) break;
+        }
+        return 1.0 - sum * std::exp(log_pre);
+    }
+    // continued fraction of Q(a, x) (modified Lentz)
+    const double tiny = 1e-300;
+    double b = x + 1.0 - a, c = 1.0 / tiny, d = 1.0 / b, h = d;
+    for (int n = 1; n < 100000; n++) {
+        const double an = -n * (n - a);
+        b += 2.0;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        const double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1.0) < 1e-15) break;
+    }
+    return std::exp(log_pre) * h;
+}
+
+// Direction of the (cos(theta), phi) grid around the y axis
+inline glm::vec3 gridDir(double z, double phi) {
+    const double r = std::sqrt(std::max(1.0 - z * z, 0.0));
+    return glm::vec3(r * std::cos(phi), z, r * std::sin(phi));
+}
+
+inline int gridBin(const glm::vec3& d) {
+    const double pi = glm::pi<double>();
+    const glm::vec3 n = glm::normalize(d);
+    double phi = std::atan2((double)n.z, (double)n.x);
+    if (phi < 0.0) phi += 2.0 * pi;
+    const int i = glm::clamp((int)((n.y + 1.0) * 0.5 * N_COS_BINS), 0,
+                             N_COS_BINS - 1);
+    const int j = glm::clamp((int)(phi / (2.0 * pi) * N_PHI_BINS), 0,
+                             N_PHI_BINS - 1);
+    return i * N_PHI_BINS + j;
+}
+
+CheckResult runCase(const CheckCase& c, int n_samples, unsigned seed,
+                    bool fast_math, double significance) {
+    CheckResult res;
+    BaseShader* shader = createShader(c.shader);
+    shader->fast_math = fast_math;
+    for (int i = 0; i < c.params.size(); i++) {
+        shader->setParam(c.params[i].first, c.params[i].second);
+    }
+    const glm::vec3 normal(0.f, 1.f, 0.f);
+    const float th = glm::radians(c.light_deg);
+    const glm::vec3 light_dir(std::sin(th), std::cos(th), 0.f);
+    const int n_bins = N_COS_BINS * N_PHI_BINS;
+    const double pi = glm::pi<double>();
+
+    // observed
+    std::vector<double> observed(n_bins, 0.0);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    for (int s = 0; s < n_samples; s++) {
+        const float u1 = std::min(uniform(rng), 1.f - 1e-7f);
+        const float u2 = std::min(uniform(rng), 1.f - 1e-7f);
+        glm::vec3 out_dir;
+        float pdf;
+        if (!shader->sampleDirection(light_dir, normal, u1, u2, out_dir,
+                                     pdf)) {
+            res.n_failed++;
+            continue;
+        }
+        const float ref = shader->pdf(light_dir, out_dir, normal);
+        if (std::fabs(ref - pdf) > 1e-3f * std::max(ref, 1e-3f)) {
+            res.n_pdf_mismatch++;
+        }
+        observed[gridBin(out_dir)] += 1.0;
+    }
+
+    // expected: midpoint rule on N_SUB x N_SUB points per bin
+    std::vector<double> expected(n_bins, 0.0);
+    const double dz = 2.0 / (N_COS_BINS * N_SUB);
+    const double dphi = 2.0 * pi / (N_PHI_BINS * N_SUB);
+    for (int i = 0; i < N_COS_BINS * N_SUB; i++) {
+        const double z = -1.0 + (i + 0.5) * dz;
+        for (int j = 0; j < N_PHI_BINS * N_SUB; j++) {
+            const double phi = (j + 0.5) * dphi;
+            const int bin = (i / N_SUB) * N_PHI_BINS + j / N_SUB;
+            expected[bin] += shader->pdf(light_dir, gridDir(z, phi), normal) *
+                             dz * dphi;
+        }
+    }
+    for (int b = 0; b < n_bins; b++) {
+        res.integral += expected[b];
+        expected[b] *= n_samples;
+    }
+
+    // chi-square with the small bins pooled
+    double pooled_obs = 0.0, pooled_exp = 0.0;
+    int n_used = 0;
+    for (int b = 0; b < n_bins; b++) {
+        if (expected[b] < MIN_EXPECTED) {
+            pooled_obs += observed[b];
+            pooled_exp += expected[b];
+            continue;
+        }
+        const double d = observed[b] - expected[b];
+        res.chi2 += d * d / expected[b];
+        n_used++;
+    }
+    if (pooled_exp > 0.0) {
+        const double d = pooled_obs - pooled_exp;
+        if (pooled_exp >= MIN_EXPECTED) {
+            res.chi2 += d * d / pooled_exp;
+            n_used++;
+        } else if (pooled_obs > 10.0 * MIN_EXPECTED) {
+            // samples where the pdf is (almost) zero
+            res.chi2 = HUGE_VAL;
+        }
+    }
+    res.dof = std::max(n_used - 1, 1);
+    res.p_value = gammaQ(res.dof * 0.5, res.chi2 * 0.5);
+    res.passed = (res.p_value >= significance) &&
+                 std::fabs(res.integral - 1.0) < 1e-2 &&
+                 res.n_pdf_mismatch <= n_samples / 1000 &&
+                 res.n_failed <= n_samples / 1000;
+    delete shader;
+    return res;
+}
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl
+              << "  --samples <n>   samples per case (1000000)" << std::endl
+              << "  --threads <n>   worker threads (hardware)" << std::endl
+              << "  --seed <n>      random seed (1)" << std::endl
+              << "  --fast-math     fast tier of the SIMD shader math"
+              << std::endl
+              << "  --verbose       print every case" << std::endl;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    // arguments
+    int n_samples = 1000000;
+    int n_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    unsigned seed = 1;
+    bool fast_math = false;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            n_samples = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            n_threads = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else if (arg == "--fast-math") {
+            fast_math = true;
+        } else if (arg == "--verbose") {
+            verbose = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<CheckCase> cases;
+    defaultCases(cases);
+    // Sidak correction over the cases
+    const double significance =
+        1.0 - std::pow(1.0 - SIGNIFICANCE, 1.0 / cases.size());
+
+    // cases in parallel (every worker owns its shaders)
+    std::vector<CheckResult> results(cases.size());
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < n_threads; t++) {
+        workers.push_back(std::thread([&]() {
+            for (int i = next++; i < cases.size(); i = next++) {
+                results[i] = runCase(cases[i], n_samples, seed + i,
+                                     fast_math, significance);
+            }
+        }));
+    }
+    for (int t = 0; t < workers.size(); t++) workers[t].join();
+
+    // report
+    int n_failed = 0;
+    for (int i = 0; i < cases.size(); i++) {
+        const CheckResult& r = results[i];
+        if (r.passed && !verbose) continue;
+        if (!r.passed) n_failed++;
+        std::cout << (r.passed ? "  ok   " : "  FAIL ") << caseName(cases[i])
+                  << ": chi2 " << r.chi2 << " dof " << r.dof << " p "
+                  << r.p_value << " integral " << r.integral;
+        if (r.n_failed) std::cout << " failed " << r.n_failed;
+        if (r.n_pdf_mismatch) {
+            std::cout << " pdf mismatches " << r.n_pdf_mismatch;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "* " << cases.size() - n_failed << "/" << cases.size()
+              << " cases passed (" << n_samples << " samples, significance "
+              << significance << ")" << std::endl;
+    return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Converts MERL .binary files to the compact tabulated format
+// (tabulated.h), the chunks of every file in parallel.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../tabulated.h"
+
+namespace {
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options] <file.binary|dir>..."
+              << std::endl
+              << "  -o <dir>            output directory (next to the input)"
+              << std::endl
+              << "  --encoding <name>   half or log (half)" << std::endl
+              << "  --compress          delta varint chunks" << std::endl
+              << "  --threads <n>       worker threads (hardware)"
+              << std::endl
+              << "  --verify            compare every cell with the input"
+              << std::endl;
+}
+
+std::string outputPath(const std::string& input, const std::string& out_dir) {
+    const size_t slash = input.find_last_of("/\\");
+    std::string name = (slash == std::string::npos)
+        ? input : input.substr(slash + 1);
+    const size_t dot = name.rfind('.');
+    if (dot != std::string::npos) name = name.substr(0, dot);
+    const std::string dir = !out_dir.empty() ? out_dir
+        : (slash == std::string::npos) ? "." : input.substr(0, slash);
+    return dir + "/" + name + ".btab";
+}
+
+// Largest error relative to the cell (or to 1e-3 of the channel maximum
+// for darker cells)
+double verifyCells(const MerlBRDF& merl, const TabulatedBRDF& tab) {
+    const TabulatedHeader& hd = tab.getHeader();
+    float max_value[3] = {0.f, 0.f, 0.f};
+    for (int c = 0; c < 3; c++) {
+        for (int h = 0; h < MERL_THETA_H; h++) {
+            for (int d = 0; d < MERL_THETA_D; d++) {
+                for (int p = 0; p < MERL_PHI_D; p++) {
+                    max_value[c] = std::max(max_value[c],
+                                            merl.value(c, h, d, p));
+                }
+            }
+        }
+    }
+    double max_error = 0.0;
+    for (int h = 0; h < MERL_THETA_H; h++) {
+        const uint16_t* cells = tab.chunk(h);
+        for (int c = 0; c < 3; c++) {
+            for (int d = 0; d < MERL_THETA_D; d++) {
+                for (int p = 0; p < MERL_PHI_D; p++) {
+                    const float v = std::max(merl.value(c, h, d, p), 0.f);
+                    const float t = tab.decode(
+                        c, cells[(c * hd.dims[1] + d) * hd.dims[2] + p]);
+                    const double e = std::fabs(t - v) /
+                        std::max(v, 1e-3f * max_value[c]);
+                    max_error = std::max(max_error, e);
+                }
+            }
+        }
+    }
+    return max_error;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    // arguments
+    std::vector<std::string> inputs;
+    std::string out_dir;
+    TabulatedOptions options;
+    bool verify = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--encoding" && i + 1 < argc) {
+            const std::string name = argv[++i];
+            if (name == "half") {
+                options.encoding = TAB_HALF;
+            } else if (name == "log") {
+                options.encoding = TAB_LOG16;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--compress") {
+            options.compression = TAB_DELTA_VARINT;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.n_threads = atoi(argv[++i]);
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            std::vector<std::string> files;
+            if (!listMeasuredFiles(arg, files)) {
+                std::cerr << "No such file or directory: " << arg
+                          << std::endl;
+                return 1;
+            }
+            for (int f = 0; f < files.size(); f++) {
+                if (!isTabulatedBRDF(files[f])) inputs.push_back(files[f]);
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (inputs.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // convert
+    int n_failed = 0;
+    size_t in_bytes = 0, out_bytes = 0;
+    for (int i = 0; i < inputs.size(); i++) {
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        MerlBRDF merl;
+        std::string error;
+        const std::string out_path = outputPath(inputs[i], out_dir);
+        if (!merl.open(inputs[i])) {
+            error = merl.getError();
+        } else {
+            writeTabulatedBRDF(out_path, merl, options, error);
+        }
+        TabulatedBRDF tab;
+        if (error.empty() && !tab.open(out_path)) error = tab.getError();
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+            n_failed++;
+            continue;
+        }
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        MappedFile in_file, out_file;
+        in_file.open(inputs[i]);
+        out_file.open(out_path);
+        in_bytes += in_file.getSize();
+        out_bytes += out_file.getSize();
+        std::cout << out_path << ": " << out_file.getSize() << " bytes ("
+                  << (double)in_file.getSize() / out_file.getSize()
+                  << "x smaller, " << seconds << " s)";
+        if (verify) {
+            std::cout << ", max relative error " << verifyCells(merl, tab);
+        }
+        std::cout << std::endl;
+    }
+    if (inputs.size() > 1) {
+        std::cout << "* " << inputs.size() - n_failed << "/" << inputs.size()
+                  << " files, " << in_bytes << " -> " << out_bytes
+                  << " bytes" << std::endl;
+    }
+    return n_failed == 0 ? 0 : 1;
+}
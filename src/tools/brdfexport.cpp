@@ -0,0 +1,305 @@
+// Exports the lobes of a sweep (a brdfbake result store or output
+// directory) as PLY or OBJ meshes for DCC tools, one file per variant and
+// light, the lobes in parallel on all cores. export.tsv lists the files
+// with their light and parameters.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "../mesh_export.h"
+#include "../result_store.h"
+#include "../sweep.h"
+
+namespace {
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " (--store <file> | --sweep <dir>) "
+                 "-o <dir> [options]" << std::endl
+              << "  --store <file>     result store of brdfbake (.bres)"
+              << std::endl
+              << "  --sweep <dir>      output directory of brdfbake (lobes)"
+              << std::endl
+              << "  -o <dir>           output directory" << std::endl
+              << "  --format <name>    ply or obj (ply)" << std::endl
+              << "  --quantize         16 bit positions and octahedral "
+                 "normals (ply)" << std::endl
+              << "  --scale <s>        lobe radius scale (1)" << std::endl
+              << "  --lobes            --sweep values are R, TT, TRT"
+              << std::endl
+              << "  --threads <n>      worker threads (all cores)"
+              << std::endl;
+}
+
+// One file to export
+struct ExportItem {
+    std::string name;  // file name without the extension
+    std::string source;  // variant file (--sweep)
+    const float* values;  // in the store mapping (--store)
+    int light;  // index into the variant file
+    glm::vec3 light_dir;
+    std::string params;  // "name=value ..." for export.tsv
+};
+
+// Lobe layout of a sweep directory (manifest header of brdfbake)
+struct SweepLobes {
+    SweepLobes() : n_phi(0), n_dirs(0), n_values(0) {}
+    int n_phi, n_dirs, n_values;
+    std::vector<glm::vec3> lights;
+};
+
+// Light direction as SweepSpec::lightDir()
+glm::vec3 lightFromDeg(float theta_deg, float phi_deg) {
+    const float theta = glm::radians(theta_deg), phi = glm::radians(phi_deg);
+    return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                     std::sin(theta) * std::sin(phi));
+}
+
+std::string paramText(const std::vector<std::string>& names,
+                      const float* values, int n) {
+    std::ostringstream ss;
+    for (int i = 0; i < n; i++) {
+        ss << (i ? " " : "")
+           << (i < names.size() ? names[i] : "p" + std::to_string(i)) << "="
+           << values[i];
+    }
+    return ss.str();
+}
+
+bool listStore(const ResultStore& store, std::vector<ExportItem>& items,
+               int& n_phi, int& n_values, bool& lobes) {
+    for (int r = 0; r < store.numRecords(); r++) {
+        const StoreRecord& record = store.record(r);
+        if (!store.lobeValues(record)) continue;
+        // one layout per export
+        if (!items.empty() && (record.n_phi != n_phi ||
+                               record.n_values != n_values)) {
+            std::cerr << "Skipping record " << r << " (other lobe layout)"
+                      << std::endl;
+            continue;
+        }
+        n_phi = record.n_phi;
+        n_values = record.n_values;
+        lobes = record.values == SWEEP_LOBES;
+        ExportItem item;
+        item.name = "lobe_" + std::to_string(r);
+        item.values = store.lobeValues(record);
+        item.light = 0;
+        item.light_dir = glm::vec3(record.light[0], record.light[1],
+                                   record.light[2]);
+        item.params = store.schemaShader(record.schema) + " " +
+                      paramText(store.schemaParams(record.schema),
+                                record.params, record.n_params);
+        items.push_back(item);
+    }
+    return !items.empty();
+}
+
+// Manifest lines of brdfbake (writeManifestHeader())
+const std::string TABLE_TAG = "# table ";
+const std::string LIGHTS_TAG = "# lights (theta phi degrees):";
+const std::string VARIANT_TAG = "# variant\t";
+
+bool listSweep(const std::string& dir, SweepLobes& lobes,
+               std::vector<ExportItem>& items, std::string& error) {
+    const std::string manifest = dir + "/sweep.tsv";
+    std::ifstream ifs(manifest.c_str());
+    if (!ifs) {
+        error = "Failed to open " + manifest;
+        return false;
+    }
+    std::vector<std::string> names;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, TABLE_TAG.size(), TABLE_TAG) == 0) {
+            error = "No lobes in " + dir;
+            return false;
+        } else if (sscanf(line.c_str(),
+                          "# lobes n_phi %d, %d directions x %d values",
+                          &lobes.n_phi, &lobes.n_dirs, &lobes.n_values) == 3) {
+            continue;
+        } else if (line.compare(0, LIGHTS_TAG.size(), LIGHTS_TAG) == 0) {
+            std::istringstream ss(line.substr(LIGHTS_TAG.size()));
+            float theta, phi;
+            while (ss >> theta >> phi) {
+                lobes.lights.push_back(lightFromDeg(theta, phi));
+            }
+        } else if (line.compare(0, VARIANT_TAG.size(), VARIANT_TAG) == 0) {
+            std::istringstream ss(line.substr(VARIANT_TAG.size()));
+            std::string name;
+            std::getline(ss, name, '\t');  // file
+            while (std::getline(ss, name, '\t')) names.push_back(name);
+        } else if (!line.empty() && line[0] != '#') {
+            std::istringstream ss(line);
+            std::string variant, file;
+            std::getline(ss, variant, '\t');
+            std::getline(ss, file, '\t');
+            std::vector<float> params;
+            for (float p; ss >> p;) params.push_back(p);
+            const std::string stem = file.substr(0, file.find_last_of('.'));
+            for (int l = 0; l < lobes.lights.size(); l++) {
+                ExportItem item;
+                item.name = stem + "_l" + std::to_string(l);
+                item.source = dir + "/" + file;
+                item.values = NULL;
+                item.light = l;
+                item.light_dir = lobes.lights[l];
+                item.params = paramText(names, params.empty() ? NULL
+                                                              : &params[0],
+                                        (int)params.size());
+                items.push_back(item);
+            }
+        }
+    }
+    if (lobes.n_phi <= 0 || lobes.n_values <= 0 || lobes.lights.empty()) {
+        error = "No lobe layout in " + manifest;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    std::string store_path, sweep_dir, out_dir;
+    MeshExportOptions options;
+    float scale = 1.f;
+    bool sweep_lobes = false;
+    int n_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--store" && i + 1 < argc) {
+            store_path = argv[++i];
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweep_dir = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            options.format = meshFormatOfPath(std::string(".") + argv[++i]);
+            if (options.format < 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--quantize") {
+            options.quantize = true;
+        } else if (arg == "--scale" && i + 1 < argc) {
+            scale = (float)atof(argv[++i]);
+        } else if (arg == "--lobes") {
+            sweep_lobes = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            n_threads = std::max(atoi(argv[++i]), 1);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (out_dir.empty() || store_path.empty() == sweep_dir.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (options.quantize && options.format != MESH_PLY) {
+        std::cerr << "--quantize needs --format ply" << std::endl;
+        return 1;
+    }
+
+    // lobes to export
+    ResultStore store;
+    SweepLobes sweep;
+    std::vector<ExportItem> items;
+    int n_phi = 0, n_values = 0;
+    bool lobes = sweep_lobes;
+    std::string error;
+    if (!store_path.empty()) {
+        if (!store.open(store_path)) {
+            std::cerr << store.getError() << std::endl;
+            return 1;
+        }
+        if (store.numInvalid() > 0) {
+            std::cerr << "Skipping " << store.numInvalid()
+                      << " lobe records of an invalid layout" << std::endl;
+        }
+        if (!listStore(store, items, n_phi, n_values, lobes)) {
+            std::cerr << "No lobes in " << store_path << std::endl;
+            return 1;
+        }
+    } else {
+        if (!listSweep(sweep_dir, sweep, items, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        n_phi = sweep.n_phi;
+        n_values = sweep.n_values;
+    }
+    mkdir(out_dir.c_str(), 0755);
+    const char* ext = options.format == MESH_OBJ ? ".obj" : ".ply";
+    const std::string index_path = out_dir + "/export.tsv";
+    std::ofstream index(index_path.c_str());
+    if (!index) {
+        std::cerr << "Failed to open " << index_path << std::endl;
+        return 1;
+    }
+    index << "# file\tlight x\tlight y\tlight z\tparameters" << std::endl;
+    for (int i = 0; i < items.size(); i++) {
+        const ExportItem& item = items[i];
+        index << item.name << ext << "\t" << item.light_dir.x << "\t"
+              << item.light_dir.y << "\t" << item.light_dir.z << "\t"
+              << item.params << std::endl;
+    }
+
+    // a mesh per thread; sweep files are read per item (one light)
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::atomic<int> next(0), n_failed(0);
+    std::mutex log_mutex;
+    const size_t lobe_floats = (size_t)sweep.n_dirs * n_values;
+    auto worker = [&]() {
+        Mesh mesh;
+        std::vector<float> values(lobe_floats);
+        for (int i = next++; i < items.size(); i = next++) {
+            const ExportItem& item = items[i];
+            const float* v = item.values;
+            std::string item_error;
+            if (!v) {
+                std::ifstream ifs(item.source.c_str(), std::ios::binary);
+                ifs.seekg(item.light * lobe_floats * sizeof(float));
+                ifs.read((char*)&values[0], lobe_floats * sizeof(float));
+                if (ifs) {
+                    v = &values[0];
+                } else {
+                    item_error = "Failed to read " + item.source;
+                }
+            }
+            if (v) {
+                createStoredBRDFMesh(mesh, v, n_values, lobes, scale, n_phi);
+                exportMesh(mesh, out_dir + "/" + item.name + ext, options,
+                           item_error);
+            }
+            if (!item_error.empty()) {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cerr << item_error << std::endl;
+                n_failed++;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) threads.push_back(std::thread(worker));
+    for (int t = 0; t < threads.size(); t++) threads[t].join();
+    const double sec = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "* " << items.size() - n_failed << " of " << items.size()
+              << " lobes exported to " << out_dir << " in " << sec << " s"
+              << std::endl;
+    return n_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+// Serves batched shader evaluation to other processes (eval_client.h): a
+// thread per client with its own shader clones, directions read from and
+// values written to the shared memory ring of the client.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../eval_client.h"
+#include "../measured.h"
+#include "../tiled.h"
+
+namespace {
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl
+              << "  --socket <path>      listening socket "
+                 "(/tmp/brdfserve.sock)" << std::endl
+              << "  --merl <file>        serve a measured BRDF (measured)"
+              << std::endl
+              << "  --tiled <file>       serve a 4D table (tiled)"
+              << std::endl
+              << "  --tile-cache-mb <n>  tile cache of --tiled (256)"
+              << std::endl
+              << "  --fast-math          fast tier of the SIMD shader math"
+              << std::endl;
+}
+
+// Shaders of the server, cloned per client
+struct ServedShaders {
+    std::vector<std::string> names;
+    std::vector<BaseShader*> shaders;
+};
+
+// Checks a request against the ring (error text, empty if valid)
+std::string checkRequest(const EvalRequest& request, size_t n_shaders,
+                         size_t ring_bytes) {
+    if (request.shader >= n_shaders) return "Unknown shader id";
+    if (request.values != 1 && request.values != 3) {
+        return "Values per direction must be 1 or 3";
+    }
+    const uint64_t dirs_bytes = (uint64_t)request.n_dirs * 3 * sizeof(float);
+    const uint64_t out_bytes =
+        (uint64_t)request.n_dirs * request.values * sizeof(float);
+    if (request.dirs_offset % sizeof(float) != 0 ||
+        request.out_offset % sizeof(float) != 0 ||
+        request.dirs_offset > ring_bytes ||
+        dirs_bytes > ring_bytes - request.dirs_offset ||
+        request.out_offset > ring_bytes ||
+        out_bytes > ring_bytes - request.out_offset) {
+        return "Batch outside the ring";
+    }
+    return "";
+}
+
+void serveClient(int fd, const ServedShaders& served, bool fast_math) {
+    MessageChannel channel;
+    channel.attach(fd);
+    uint32_t type;
+    std::vector<char> payload;
+    EvalHello hello;
+    if (!channel.receive(type, payload) || type != EVAL_MSG_HELLO ||
+        payload.size() != sizeof(hello)) {
+        return;
+    }
+    memcpy(&hello, &payload[0], sizeof(hello));
+    hello.ring_name[sizeof(hello.ring_name) - 1] = '\0';
+    SharedMemory ring;
+    std::string error;
+    if (hello.version != EVAL_PROTOCOL_VERSION) {
+        error = "Unsupported protocol version";
+    } else if (!ring.open(hello.ring_name)) {
+        error = ring.getError();
+    } else if (ring.getSize() < hello.ring_bytes) {
+        error = "Ring smaller than announced";
+    }
+    if (!error.empty()) {
+        channel.send(EVAL_MSG_ERROR, error.data(), error.size());
+        return;
+    }
+    std::string names;
+    for (int s = 0; s < served.names.size(); s++) {
+        names += served.names[s] + '\0';
+    }
+    if (!channel.send(EVAL_MSG_READY, names.data(), names.size())) return;
+
+    std::vector<BaseShader*> shaders;
+    for (int s = 0; s < served.shaders.size(); s++) {
+        shaders.push_back(served.shaders[s]->clone());
+        shaders.back()->fast_math = fast_math;
+    }
+    char* data = (char*)ring.getData();
+    while (channel.receive(type, payload)) {
+        EvalRequest request;
+        error.clear();
+        if (type != EVAL_MSG_EVAL || payload.size() < sizeof(request)) {
+            error = "Invalid request";
+        } else {
+            memcpy(&request, &payload[0], sizeof(request));
+            if (payload.size() != sizeof(request) +
+                                  request.n_params * sizeof(EvalParam)) {
+                error = "Invalid request";
+            } else {
+                error = checkRequest(request, shaders.size(), ring.getSize());
+            }
+        }
+        for (int p = 0; error.empty() && p < request.n_params; p++) {
+            EvalParam param;
+            memcpy(&param, &payload[sizeof(request) + p * sizeof(param)],
+                   sizeof(param));
+            param.name[sizeof(param.name) - 1] = '\0';
+            if (!shaders[request.shader]->setParam(param.name, param.value)) {
+                error = std::string("Unknown parameter: ") + param.name;
+            }
+        }
+        if (!error.empty()) {
+            if (!channel.send(EVAL_MSG_ERROR, error.data(), error.size())) {
+                break;
+            }
+            continue;
+        }
+
+        // in place in the ring
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        const glm::vec3 light(request.light[0], request.light[1],
+                              request.light[2]);
+        const glm::vec3 normal(request.normal[0], request.normal[1],
+                               request.normal[2]);
+        const glm::vec3* dirs = (const glm::vec3*)(data + request.dirs_offset);
+        float* out = (float*)(data + request.out_offset);
+        if (request.n_dirs > 0 && request.values == 1) {
+            shaders[request.shader]->sampleBatch(light, dirs, normal, out,
+                                                 request.n_dirs);
+        } else if (request.n_dirs > 0) {
+            shaders[request.shader]->sampleColorBatch(
+                light, dirs, normal, ColorChannels(), out, request.n_dirs);
+        }
+        EvalResult result;
+        memset(&result, 0, sizeof(result));
+        result.n_dirs = request.n_dirs;
+        result.eval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (!channel.send(EVAL_MSG_RESULT, &result, sizeof(result))) break;
+    }
+    for (int s = 0; s < shaders.size(); s++) delete shaders[s];
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    std::string address = "/tmp/brdfserve.sock";
+    std::string merl_path, tiled_path;
+    int tile_cache_mb = 256;
+    bool fast_math = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            address = argv[++i];
+        } else if (arg == "--merl" && i + 1 < argc) {
+            merl_path = argv[++i];
+        } else if (arg == "--tiled" && i + 1 < argc) {
+            tiled_path = argv[++i];
+        } else if (arg == "--tile-cache-mb" && i + 1 < argc) {
+            tile_cache_mb = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--fast-math") {
+            fast_math = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // shaders (ids in this order)
+    ServedShaders served;
+    served.names.push_back("specular");
+    served.shaders.push_back(new SpecularShader());
+    served.names.push_back("kajiyakay");
+    served.shaders.push_back(new KajiyaKayShader());
+    served.names.push_back("marschner");
+    served.shaders.push_back(new AFMarschnerShader());
+    if (!merl_path.empty()) {
+        MeasuredShader* measured = new MeasuredShader();
+        if (!measured->load(merl_path)) {
+            std::cerr << measured->getError() << std::endl;
+            return 1;
+        }
+        served.names.push_back("measured");
+        served.shaders.push_back(measured);
+    }
+    if (!tiled_path.empty()) {
+        TiledShader* tiled = new TiledShader();
+        if (!tiled->load(tiled_path, (size_t)tile_cache_mb << 20)) {
+            std::cerr << tiled->getError() << std::endl;
+            return 1;
+        }
+        // random access of many clients
+        tiled->prefetch = false;
+        served.names.push_back("tiled");
+        served.shaders.push_back(tiled);
+    }
+
+    std::string error;
+    const int listen_fd = listenMessageSocket(address, error);
+    if (listen_fd < 0) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << "* Serving";
+    for (int s = 0; s < served.names.size(); s++) {
+        std::cout << " " << served.names[s];
+    }
+    std::cout << " on " << address << std::endl;
+    // until killed; a client per thread
+    while (true) {
+        const int fd = acceptMessageSocket(listen_fd, -1);
+        if (fd < 0) continue;
+        std::thread(serveClient, fd, std::cref(served), fast_math).detach();
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Latency and throughput of a brdfserve process over batch sizes: round
+// trips of one batch at a time (p50/p99 latency, split into evaluation in
+// the server and transport), then the throughput with several batches in
+// flight.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../eval_client.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options]" << std::endl
+              << "  --socket <path>   server socket (/tmp/brdfserve.sock)"
+              << std::endl
+              << "  --shader <name>   served shader (specular)" << std::endl
+              << "  --values <1|3>    values per direction (1)" << std::endl
+              << "  --sizes <a,b,..>  batch sizes (1,64,1024,16384,262144)"
+              << std::endl
+              << "  --seconds <s>     time per batch size (1)" << std::endl
+              << "  --depth <n>       batches in flight for throughput (4)"
+              << std::endl
+              << "  --ring-mb <n>     shared memory ring (64)" << std::endl;
+}
+
+std::vector<int> parseSizes(const std::string& s) {
+    std::vector<int> sizes;
+    for (size_t i = 0; i < s.size();) {
+        size_t end = s.find(',', i);
+        if (end == std::string::npos) end = s.size();
+        const int n = atoi(s.substr(i, end - i).c_str());
+        if (n > 0) sizes.push_back(n);
+        i = end + 1;
+    }
+    return sizes;
+}
+
+// Uniform directions on the sphere
+void fillDirections(float* dirs, int n, std::mt19937& rng) {
+    std::uniform_real_distribution<float> u(0.f, 1.f);
+    for (int i = 0; i < n; i++) {
+        const float z = 1.f - 2.f * u(rng);
+        const float r = std::sqrt(std::max(0.f, 1.f - z * z));
+        const float phi = 6.2831853f * u(rng);
+        dirs[3 * i + 0] = r * std::cos(phi);
+        dirs[3 * i + 1] = z;
+        dirs[3 * i + 2] = r * std::sin(phi);
+    }
+}
+
+double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    const size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    return v[i];
+}
+
+double elapsedUs(const Clock::time_point& start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start)
+        .count();
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    std::string address = "/tmp/brdfserve.sock";
+    std::string shader_name = "specular";
+    std::vector<int> sizes = parseSizes("1,64,1024,16384,262144");
+    int values = 1;
+    double seconds = 1.0;
+    int depth = 4;
+    int ring_mb = 64;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            address = argv[++i];
+        } else if (arg == "--shader" && i + 1 < argc) {
+            shader_name = argv[++i];
+        } else if (arg == "--values" && i + 1 < argc) {
+            values = atoi(argv[++i]) == 3 ? 3 : 1;
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            sizes = parseSizes(argv[++i]);
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            seconds = std::max(atof(argv[++i]), 0.01);
+        } else if (arg == "--depth" && i + 1 < argc) {
+            depth = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--ring-mb" && i + 1 < argc) {
+            ring_mb = std::max(atoi(argv[++i]), 1);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    EvalClient client;
+    if (!client.connect(address, (size_t)ring_mb << 20)) {
+        std::cerr << client.getError() << std::endl;
+        return 1;
+    }
+    const int shader = client.findShader(shader_name);
+    if (shader < 0) {
+        std::cerr << "Unknown shader: " << shader_name << std::endl;
+        return 1;
+    }
+    const float light[3] = {0.5f, 0.70710678f, 0.5f};
+    const float normal[3] = {0.f, 1.f, 0.f};
+    std::mt19937 rng(1);
+    std::cout << "* " << shader_name << ", " << values
+              << " value(s) per direction, depth " << depth << std::endl
+              << std::setw(8) << "batch" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << std::setw(12) << "eval us"
+              << std::setw(12) << "xport us" << std::setw(14) << "Mdirs/s"
+              << std::endl;
+    for (int s = 0; s < sizes.size(); s++) {
+        const int n = sizes[s];
+        // one batch per round trip
+        std::vector<double> latency, transport;
+        double eval_total = 0.0;
+        const Clock::time_point phase = Clock::now();
+        while (elapsedUs(phase) < 0.5e6 * seconds || latency.size() < 3) {
+            EvalBatch batch;
+            if (!client.allocate(n, values, batch)) {
+                std::cerr << client.getError() << std::endl;
+                return 1;
+            }
+            fillDirections(batch.dirs, n, rng);
+            const Clock::time_point start = Clock::now();
+            uint64_t eval_ns = 0;
+            if (!client.submit(batch, shader, light, normal) ||
+                !client.wait(&eval_ns)) {
+                std::cerr << client.getError() << std::endl;
+                return 1;
+            }
+            const double us = elapsedUs(start);
+            latency.push_back(us);
+            transport.push_back(us - eval_ns * 1e-3);
+            eval_total += eval_ns * 1e-3;
+        }
+
+        // pipelined: refill while depth batches are in flight, with new
+        // directions every batch (the server shaders cache the terms of
+        // repeated directions)
+        long long n_dirs = 0;
+        const Clock::time_point start = Clock::now();
+        while (elapsedUs(start) < 0.5e6 * seconds) {
+            EvalBatch batch;
+            while (client.numPending() >= depth ||
+                   !client.allocate(n, values, batch)) {
+                if (client.numPending() == 0 || !client.wait()) {
+                    std::cerr << client.getError() << std::endl;
+                    return 1;
+                }
+                n_dirs += n;
+            }
+            fillDirections(batch.dirs, n, rng);
+            if (!client.submit(batch, shader, light, normal)) {
+                std::cerr << client.getError() << std::endl;
+                return 1;
+            }
+        }
+        while (client.numPending() > 0) {
+            if (!client.wait()) {
+                std::cerr << client.getError() << std::endl;
+                return 1;
+            }
+            n_dirs += n;
+        }
+        const double throughput = n_dirs / elapsedUs(start);
+        std::cout << std::setw(8) << n << std::fixed << std::setprecision(1)
+                  << std::setw(12) << percentile(latency, 0.5)
+                  << std::setw(12) << percentile(latency, 0.99)
+                  << std::setw(12) << eval_total / latency.size()
+                  << std::setw(12) << percentile(transport, 0.5)
+                  << std::setprecision(2) << std::setw(14) << throughput
+                  << std::endl;
+    }
+    return 0;
+}
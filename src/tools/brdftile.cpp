@@ -0,0 +1,262 @@
+// Bakes a shader into an out-of-core 4D tabulated BRDF (tiled.h), tile by
+// tile in parallel, and checks lookups through a bounded tile cache.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../measured.h"
+#include "../tiled.h"
+
+namespace {
+
+void printUsage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options] -o <file.b4d>" << std::endl
+              << "  --shader <name>      specular, kajiyakay, marschner or "
+                 "measured (marschner)" << std::endl
+              << "  --merl <file>        measured BRDF file (measured)"
+              << std::endl
+              << "  --set <name=value>   shader parameter (repeatable)"
+              << std::endl
+              << "  --dims <ti,pi,to,po> table size (32,64,32,64)" << std::endl
+              << "  --tile <ti,pi,to,po> tile size (4,4,16,32)" << std::endl
+              << "  --sphere             directions over the sphere "
+                 "(fibers; default for hair shaders)" << std::endl
+              << "  --hemisphere         directions over the hemisphere"
+              << std::endl
+              << "  --mono               one channel instead of RGB"
+              << std::endl
+              << "  --threads <n>        worker threads (hardware)"
+              << std::endl
+              << "  --verify <n>         random lookups compared with the "
+                 "shader (100000)" << std::endl
+              << "  --sweep <n>          light steps of the lobe sweep (90)"
+              << std::endl
+              << "  --cache-mb <n>       tile cache of the checks (64)"
+              << std::endl;
+}
+
+BaseShader* createShader(const std::string& name) {
+    if (name == "specular") return new SpecularShader();
+    if (name == "kajiyakay") return new KajiyaKayShader();
+    if (name == "marschner") return new AFMarschnerShader();
+    if (name == "measured") return new MeasuredShader();
+    return NULL;
+}
+
+bool parseInts(const std::string& s, int* values, int n) {
+    return n == 4 && sscanf(s.c_str(), "%d,%d,%d,%d", &values[0], &values[1],
+                            &values[2], &values[3]) == 4;
+}
+
+void printStats(const TileCacheStats& stats) {
+    std::cout << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.prefetched << " prefetched, " << stats.evictions
+              << " evictions, " << stats.resident_bytes / (1 << 20)
+              << " MB resident";
+}
+
+// Lobes of a light moving over the table, as the viewer builds them while
+// the light slider is dragged
+bool sweepLobes(const std::string& path, size_t cache_bytes, bool prefetch,
+                int n_steps) {
+    TiledShader tiled;
+    if (!tiled.load(path, cache_bytes)) {
+        std::cerr << tiled.getError() << std::endl;
+        return false;
+    }
+    tiled.prefetch = prefetch;
+    const glm::vec3 normal(0.f, 1.f, 0.f);
+    const int n_theta = 50, n_phi = 100;
+    const float theta_max = tiled.sphere() ? glm::pi<float>()
+                                           : 0.5f * glm::pi<float>();
+    std::vector<glm::vec3> dirs;
+    for (int i = 0; i < n_theta; i++) {
+        for (int j = 0; j < n_phi; j++) {
+            dirs.push_back(tiledDir((i + 0.5f) / n_theta * theta_max,
+                                    2.f * glm::pi<float>() * j / n_phi));
+        }
+    }
+    std::vector<float> values(dirs.size());
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int s = 0; s < n_steps; s++) {
+        const float t = (float)s / std::max(n_steps - 1, 1);
+        const glm::vec3 light_dir = tiledDir(0.9f * theta_max * t,
+                                             0.3f + glm::pi<float>() * t);
+        tiled.sampleBatch(light_dir, &dirs[0], normal, &values[0],
+                          (int)dirs.size());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "* Sweep (" << (prefetch ? "prefetch" : "no prefetch")
+              << "): " << n_steps << " lobes in " << seconds << " s, ";
+    printStats(tiled.getStats());
+    std::cout << std::endl;
+    return true;
+}
+
+} // namespace
+
+
+int main(int argc, char const* argv[]) {
+    // arguments
+    std::string shader_name = "marschner";
+    std::string merl_path, out_path;
+    std::vector<std::string> sets;
+    int dims[4] = {32, 64, 32, 64};
+    int tile[4] = {4, 4, 16, 32};
+    int sphere = -1;  // by the shader
+    bool mono = false;
+    int n_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    int n_verify = 100000;
+    int n_sweep = 90;
+    int cache_mb = 64;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--shader" && i + 1 < argc) {
+            shader_name = argv[++i];
+        } else if (arg == "--merl" && i + 1 < argc) {
+            merl_path = argv[++i];
+        } else if (arg == "--set" && i + 1 < argc) {
+            sets.push_back(argv[++i]);
+        } else if (arg == "--dims" && i + 1 < argc) {
+            if (!parseInts(argv[++i], dims, 4)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--tile" && i + 1 < argc) {
+            if (!parseInts(argv[++i], tile, 4)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--sphere") {
+            sphere = 1;
+        } else if (arg == "--hemisphere") {
+            sphere = 0;
+        } else if (arg == "--mono") {
+            mono = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            n_threads = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "--verify" && i + 1 < argc) {
+            n_verify = atoi(argv[++i]);
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            n_sweep = atoi(argv[++i]);
+        } else if (arg == "--cache-mb" && i + 1 < argc) {
+            cache_mb = std::max(atoi(argv[++i]), 1);
+        } else if (arg == "-o" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (out_path.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // shader
+    BaseShader* shader = createShader(shader_name);
+    if (!shader) {
+        std::cerr << "Unknown shader: " << shader_name << std::endl;
+        return 1;
+    }
+    if (MeasuredShader* measured = dynamic_cast<MeasuredShader*>(shader)) {
+        if (!measured->load(merl_path)) {
+            std::cerr << measured->getError() << std::endl;
+            delete shader;
+            return 1;
+        }
+    }
+    for (int i = 0; i < sets.size(); i++) {
+        const size_t eq = sets[i].find('=');
+        const std::string name = sets[i].substr(0, eq);
+        if (eq == std::string::npos ||
+            !shader->setParam(name, (float)atof(sets[i].c_str() + eq + 1))) {
+            std::cerr << "Unknown parameter: " << sets[i] << std::endl;
+            delete shader;
+            return 1;
+        }
+    }
+    if (sphere < 0) {
+        sphere = (shader_name == "kajiyakay" || shader_name == "marschner");
+    }
+
+    // bake
+    const TiledHeader hd = tiledHeader(dims, tile, mono ? 1 : 3, sphere);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::string error;
+    if (!bakeTiledBRDF(out_path, hd, *shader, n_threads, error)) {
+        std::cerr << error << std::endl;
+        delete shader;
+        return 1;
+    }
+    const double bake_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const double cells = (double)hd.dims[0] * hd.dims[1] * hd.dims[2] *
+                         hd.dims[3];
+    std::cout << "* " << out_path << ": " << hd.dims[0] << "x" << hd.dims[1]
+              << "x" << hd.dims[2] << "x" << hd.dims[3] << " cells, "
+              << cells * hd.n_channels * 2 / (1 << 20) << " MB, tiles "
+              << hd.tile[0] << "x" << hd.tile[1] << "x" << hd.tile[2] << "x"
+              << hd.tile[3] << " (" << bake_seconds << " s)" << std::endl;
+
+    // lookups through the cache against the shader at random directions
+    const size_t cache_bytes = (size_t)cache_mb << 20;
+    if (n_verify > 0) {
+        TiledShader tiled;
+        if (!tiled.load(out_path, cache_bytes)) {
+            std::cerr << tiled.getError() << std::endl;
+            delete shader;
+            return 1;
+        }
+        tiled.prefetch = false;
+        const glm::vec3 normal(0.f, 1.f, 0.f);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uniform(0.f, 1.f);
+        double sum_diff = 0.0, sum_ref = 0.0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n_verify; i++) {
+            const float z_max = sphere ? -1.f : 0.f;
+            const float zi = 1.f - uniform(rng) * (1.f - z_max);
+            const float zo = 1.f - uniform(rng) * (1.f - z_max);
+            const glm::vec3 light_dir =
+                tiledDir(std::acos(zi), 2.f * glm::pi<float>() * uniform(rng));
+            const glm::vec3 out_dir =
+                tiledDir(std::acos(zo), 2.f * glm::pi<float>() * uniform(rng));
+            float ref, value;
+            shader->sampleBatch(light_dir, &out_dir, normal, &ref, 1);
+            tiled.sampleBatch(light_dir, &out_dir, normal, &value, 1);
+            if (!(ref > 0.f)) ref = 0.f;
+            sum_diff += std::fabs(value - ref);
+            sum_ref += ref;
+        }
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        const TileCacheStats stats = tiled.getStats();
+        std::cout << "* Lookups: " << n_verify << " in " << seconds
+                  << " s, mean relative difference "
+                  << (sum_ref > 0.0 ? sum_diff / sum_ref : 0.0)
+                  << " (interpolation)" << std::endl
+                  << "* Cache (" << cache_mb << " MB): ";
+        printStats(stats);
+        std::cout << std::endl;
+    }
+    // moving light, without and with prefetching
+    bool swept = true;
+    if (n_sweep > 0) {
+        swept = sweepLobes(out_path, cache_bytes, false, n_sweep) &&
+                sweepLobes(out_path, cache_bytes, true, n_sweep);
+    }
+    delete shader;
+    return swept ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+#include "vertex_cache.h"
+
+namespace {
+
+// Next fanning vertex: the candidate that stays cached while its remaining
+// triangles are emitted and entered the cache earliest, else a vertex of
+// the dead-end stack or the next one with triangles left (-1: done)
+int nextVertex(const std::vector<int>& candidates,
+               const std::vector<int>& live,
+               const std::vector<int>& cache_time, int time, int cache_size,
+               std::vector<int>& dead_end, int& cursor) {
+    int best = -1, best_priority = -1;
+    for (int i = 0; i < candidates.size(); i++) {
+        const int v = candidates[i];
+        if (live[v] <= 0) continue;
+        int priority = 0;
+        if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+            priority = time - cache_time[v];
+        }
+        if (priority > best_priority) {
+            best = v;
+            best_priority = priority;
+        }
+    }
+    if (best >= 0) return best;
+    while (!dead_end.empty()) {
+        const int v = dead_end.back();
+        dead_end.pop_back();
+        if (live[v] > 0) return v;
+    }
+    for (; cursor < live.size(); cursor++) {
+        if (live[cursor] > 0) return cursor;
+    }
+    return -1;
+}
+
+} // namespace
+
+
+VertexCacheStats simulateVertexCache(const unsigned int* indices,
+                                     size_t n_indices, int n_vertices,
+                                     bool strips, int cache_size) {
+    VertexCacheStats stats;
+    // miss count when a vertex entered the cache (FIFO: hits keep it)
+    std::vector<long> entered(n_vertices, -1);
+    std::vector<bool> referenced(n_vertices, false);
+    size_t n_referenced = 0;
+    long misses = 0;
+    int strip_length = 0;
+    for (size_t i = 0; i < n_indices; i++) {
+        const unsigned int v = indices[i];
+        if (v == RESTART_INDEX || v >= n_vertices) {
+            strip_length = 0;
+            continue;
+        }
+        if (entered[v] < 0 || misses - entered[v] >= cache_size) {
+            entered[v] = misses++;
+        }
+        if (!referenced[v]) {
+            referenced[v] = true;
+            n_referenced++;
+        }
+        strip_length++;
+        if (!strips) continue;
+        if (strip_length >= 3) {
+            const unsigned int a = indices[i - 2], b = indices[i - 1];
+            if (a != b && b != v && a != v) stats.n_triangles++;
+        }
+    }
+    if (!strips) stats.n_triangles = n_indices / 3;
+    stats.n_transformed = misses;
+    if (stats.n_triangles > 0) {
+        stats.acmr = (float)misses / stats.n_triangles;
+    }
+    if (n_referenced > 0) stats.atvr = (float)misses / n_referenced;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<glm::uvec3>& triangles, int n_vertices,
+                         int cache_size) {
+    const int n_triangles = triangles.size();
+    if (n_triangles == 0 || n_vertices <= 0) return;
+
+    // triangles of each vertex
+    std::vector<int> live(n_vertices, 0);
+    for (int t = 0; t < n_triangles; t++) {
+        for (int k = 0; k < 3; k++) live[triangles[t][k]]++;
+    }
+    std::vector<int> offsets(n_vertices + 1, 0);
+    for (int v = 0; v < n_vertices; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<int> adjacency(offsets[n_vertices]);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (int t = 0; t < n_triangles; t++) {
+        for (int k = 0; k < 3; k++) adjacency[fill[triangles[t][k]]++] = t;
+    }
+
+    // fan around the current vertex until every triangle is emitted
+    std::vector<glm::uvec3> ordered;
+    ordered.reserve(n_triangles);
+    std::vector<bool> emitted(n_triangles, false);
+    std::vector<int> cache_time(n_vertices, 0);
+    std::vector<int> dead_end;
+    std::vector<int> candidates;
+    int time = cache_size + 1;
+    int cursor = 1;
+    int fan = 0;
+    while (fan >= 0) {
+        candidates.clear();
+        for (int i = offsets[fan]; i < offsets[fan + 1]; i++) {
+            const int t = adjacency[i];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            ordered.push_back(triangles[t]);
+            for (int k = 0; k < 3; k++) {
+                const int v = triangles[t][k];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+        }
+        fan = nextVertex(candidates, live, cache_time, time, cache_size,
+                         dead_end, cursor);
+    }
+    triangles.swap(ordered);
+}
@@ -0,0 +1,41 @@
+#ifndef VERTEX_CACHE_H_261018
+#define VERTEX_CACHE_H_261018
+
+#include <cstddef>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// Post-transform vertex cache of the GPU: an index already in the last
+// VERTEX_CACHE_SIZE transformed vertices (FIFO) is not shaded again.
+const int VERTEX_CACHE_SIZE = 16;
+// Separates the triangle strips of an index list (primitive restart)
+const unsigned int RESTART_INDEX = 0xffffffffu;
+
+// ACMR: transformed vertices per triangle (0.5 at best on a regular grid,
+// 3 without reuse). ATVR: transformed per referenced vertex (1 at best).
+struct VertexCacheStats {
+    VertexCacheStats() : n_triangles(0), n_transformed(0), acmr(0.f),
+                         atvr(0.f) {}
+    size_t n_triangles;
+    size_t n_transformed;
+    float acmr;
+    float atvr;
+};
+
+// Simulates the FIFO cache over triangle list indices, or triangle strips
+// (`strips`) separated by RESTART_INDEX, whose degenerate triangles do not
+// count as triangles
+VertexCacheStats simulateVertexCache(const unsigned int* indices,
+                                     size_t n_indices, int n_vertices,
+                                     bool strips=false,
+                                     int cache_size=VERTEX_CACHE_SIZE);
+
+// Reorders the triangles for the cache (Tipsify, Sander et al. 2007): fans
+// around one vertex at a time, next the cached vertex with the most
+// triangles left. Linear time; the vertices and windings are kept.
+void optimizeVertexCache(std::vector<glm::uvec3>& triangles, int n_vertices,
+                         int cache_size=VERTEX_CACHE_SIZE);
+
+#endif